@@ -0,0 +1,296 @@
+/**
+ * Audio.cpp - Microphone input implementation
+ *
+ * The audio task is the only writer of the published features. Readers
+ * copy them between two reads of an even sequence number and retry if the
+ * number changed (sequence lock), so neither side ever blocks; the copy
+ * is 24 bytes and a retry only happens if a block completes mid-copy.
+ *
+ * Author: icebear74
+ */
+
+#include "Audio.h"
+#include "Log.h"
+#include "Metrics.h"
+#include <atomic>
+
+#if AUDIO_ENABLED
+#include <driver/i2s_std.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Audio configuration
+const uint32_t AUDIO_BEAT_DECAY_MS = 150;  // Beat flash fades out over this time
+const uint32_t AUDIO_STALE_MS = 500;       // Features older than this count as no audio
+
+#define AUDIO_READ_RETRIES 4
+#define AUDIO_RECEIVE_STAMPS 8     // Receive times kept, more than the DMA queue holds
+
+static std::atomic<uint32_t> publishSequence(0);
+static AudioFeatures published;
+static AudioStats stats;
+
+#if AUDIO_ENABLED
+static i2s_chan_handle_t rxChannel = nullptr;
+static std::atomic<uint32_t> dmaOverflows(0);
+static std::atomic<uint32_t> receivedBlocks(0);
+static uint32_t receiveUs[AUDIO_RECEIVE_STAMPS];
+static int32_t rawSamples[AUDIO_HOP_SIZE];
+static int16_t samples[AUDIO_HOP_SIZE];
+
+/**
+ * I2S block received (ISR): its last sample was captured just now
+ */
+static bool IRAM_ATTR onReceive(i2s_chan_handle_t handle, i2s_event_data_t* event, void* context) {
+  uint32_t block = receivedBlocks.load(std::memory_order_relaxed);
+  receiveUs[block % AUDIO_RECEIVE_STAMPS] = micros();
+  receivedBlocks.store(block + 1, std::memory_order_release);
+  return false;
+}
+
+/**
+ * I2S receive queue overflow (ISR): a DMA block was dropped
+ */
+static bool IRAM_ATTR onReceiveOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* context) {
+  dmaOverflows.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+/**
+ * Publish features for the renderer (single writer)
+ */
+static void publish(const AudioFeatures& features) {
+  uint32_t sequence = publishSequence.load(std::memory_order_relaxed);
+  publishSequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&published, &features, sizeof(published));
+  publishSequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Capture time of a block read from the queue
+ * The driver queues blocks in order and drops the oldest on overflow, so
+ * the n-th block read is received block n plus the overflows so far.
+ * Without its stamp (overwritten) the block counts as captured now.
+ */
+static uint32_t blockCaptureUs(uint32_t blocksRead) {
+  uint32_t block = blocksRead + dmaOverflows.load(std::memory_order_relaxed);
+  uint32_t received = receivedBlocks.load(std::memory_order_acquire);
+  if (received - block - 1 < AUDIO_RECEIVE_STAMPS) {
+    return receiveUs[block % AUDIO_RECEIVE_STAMPS];
+  }
+  return micros();
+}
+
+/**
+ * Audio task: read a block, extract features, publish
+ * Beats and the render latency are timed from the block's receive
+ * interrupt, not from the read: a block may wait in the DMA queue.
+ */
+static void audioTaskLoop(void* parameter) {
+  AudioFeatures features = {};
+  uint32_t blocksRead = 0;
+  uint32_t windowStart = micros();
+  uint32_t windowBusyUs = 0;
+  uint32_t windowBlocks = 0;
+
+  for (;;) {
+    size_t bytes = 0;
+    esp_err_t err = i2s_channel_read(rxChannel, rawSamples, sizeof(rawSamples), &bytes, portMAX_DELAY);
+    uint32_t startUs = micros();
+    if (err != ESP_OK || bytes == 0) {
+      continue;
+    }
+    uint32_t captureUs = blockCaptureUs(blocksRead++);
+    if (bytes != sizeof(rawSamples)) {
+      continue;
+    }
+    for (int i = 0; i < AUDIO_HOP_SIZE; i++) {
+      int32_t sample = rawSamples[i] >> AUDIO_SAMPLE_SHIFT;
+      samples[i] = sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample;
+    }
+
+    audioDspProcess(samples, captureUs, features);
+    publish(features);
+    uint32_t dspUs = micros() - startUs;
+
+    stats.blocks = features.block;
+    stats.lastDspUs = dspUs;
+    if (dspUs > stats.maxDspUs) {
+      stats.maxDspUs = dspUs;
+    }
+    metricsObserve(METRIC_AUDIO_DSP_TIME, dspUs);
+    if (features.beat) {
+      metricsInc(METRIC_AUDIO_BEATS);
+    }
+
+    windowBusyUs += dspUs;
+    windowBlocks++;
+    uint32_t windowUs = micros() - windowStart;
+    if (windowUs >= 1000000) {
+      stats.avgDspUs = windowBusyUs / windowBlocks;
+      stats.cpuPercent = (uint64_t)windowBusyUs * 100 / windowUs;
+      uint32_t overflows = dmaOverflows.load(std::memory_order_relaxed);
+      metricsInc(METRIC_AUDIO_OVERRUNS, overflows - stats.overruns);
+      stats.overruns = overflows;
+      metricsSet(METRIC_AUDIO_CPU_PERCENT, stats.cpuPercent);
+      windowStart += windowUs;
+      windowBusyUs = 0;
+      windowBlocks = 0;
+    }
+  }
+}
+
+/**
+ * Configure the I2S receiver for a mono MEMS microphone
+ *
+ * @return true if the channel is running
+ */
+static bool startI2s() {
+  i2s_chan_config_t channelConfig = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+  channelConfig.dma_desc_num = AUDIO_DMA_BUFFERS;
+  channelConfig.dma_frame_num = AUDIO_HOP_SIZE;
+  if (i2s_new_channel(&channelConfig, nullptr, &rxChannel) != ESP_OK) {
+    return false;
+  }
+
+  i2s_std_config_t config = {};
+  config.clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(AUDIO_SAMPLE_RATE);
+  config.slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_MONO);
+  config.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+  config.gpio_cfg.mclk = I2S_GPIO_UNUSED;
+  config.gpio_cfg.bclk = (gpio_num_t)AUDIO_PIN_BCLK;
+  config.gpio_cfg.ws = (gpio_num_t)AUDIO_PIN_WS;
+  config.gpio_cfg.dout = I2S_GPIO_UNUSED;
+  config.gpio_cfg.din = (gpio_num_t)AUDIO_PIN_DIN;
+
+  i2s_event_callbacks_t callbacks = {};
+  callbacks.on_recv = onReceive;
+  callbacks.on_recv_q_ovf = onReceiveOverflow;
+  if (i2s_channel_init_std_mode(rxChannel, &config) != ESP_OK ||
+      i2s_channel_register_event_callback(rxChannel, &callbacks, nullptr) != ESP_OK ||
+      i2s_channel_enable(rxChannel) != ESP_OK) {
+    i2s_del_channel(rxChannel);
+    rxChannel = nullptr;
+    return false;
+  }
+  return true;
+}
+#endif
+
+/**
+ * Start capturing and the audio task
+ */
+void setupAudio() {
+#if AUDIO_ENABLED
+  setupAudioDsp();
+  if (!startI2s()) {
+    LOG_E(AUDIO, "I2S microphone setup failed, audio effects disabled");
+    return;
+  }
+  xTaskCreatePinnedToCore(audioTaskLoop, "audio", AUDIO_TASK_STACK, nullptr, AUDIO_TASK_PRIORITY, nullptr,
+                          AUDIO_TASK_CORE);
+  stats.running = true;
+  LOG_I(AUDIO, "Microphone started: %u Hz, %u-point FFT every %u samples", AUDIO_SAMPLE_RATE,
+        AUDIO_FFT_SIZE, AUDIO_HOP_SIZE);
+#endif
+}
+
+/**
+ * Get the latest published features (lock-free, any task)
+ *
+ * @return false if no microphone is running or no block was processed yet
+ */
+bool getAudioFeatures(AudioFeatures& features) {
+  if (!stats.running) {
+    return false;
+  }
+  for (int attempt = 0; attempt < AUDIO_READ_RETRIES; attempt++) {
+    uint32_t before = publishSequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(&features, &published, sizeof(features));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (publishSequence.load(std::memory_order_relaxed) == before) {
+      return features.block > 0;
+    }
+  }
+  return false;
+}
+
+/**
+ * Beat pulse: 255 at a beat, fading to 0 over AUDIO_BEAT_DECAY_MS
+ */
+uint8_t audioBeatPulse(const AudioFeatures& features) {
+  if (features.beats == 0) {
+    return 0;
+  }
+  uint32_t ageMs = (micros() - features.beatUs) / 1000;
+  return ageMs >= AUDIO_BEAT_DECAY_MS ? 0 : 255 - ageMs * 255 / AUDIO_BEAT_DECAY_MS;
+}
+
+/**
+ * Get the features as AUDIO_FEATURE_COUNT values 0-255 (effect programs)
+ *
+ * @param values Receives the values, all 0 without current audio
+ * @return true if the values are current
+ */
+bool audioFeatureVector(uint8_t* values) {
+  AudioFeatures features;
+  if (!getAudioFeatures(features) || micros() - features.captureUs > AUDIO_STALE_MS * 1000) {
+    memset(values, 0, AUDIO_FEATURE_COUNT);
+    return false;
+  }
+  memcpy(values, features.bands, AUDIO_BANDS);
+  values[AUDIO_FEATURE_LOUDNESS] = features.loudness;
+  values[AUDIO_FEATURE_ONSET] = features.onset;
+  values[AUDIO_FEATURE_BEAT] = audioBeatPulse(features);
+  return true;
+}
+
+/**
+ * Render effect "audio": the bands across the strip, low to high
+ * Band colors blend from low to high, brightness follows the band level,
+ * and every beat flashes the strip up.
+ *
+ * @return false without current audio (caller shows its fallback)
+ */
+bool renderAudioEffect(const CRGB& low, const CRGB& high, CRGB* leds, uint16_t numLeds) {
+  AudioFeatures features;
+  if (!getAudioFeatures(features)) {
+    return false;
+  }
+  uint32_t ageUs = micros() - features.captureUs;
+  if (ageUs > AUDIO_STALE_MS * 1000) {
+    return false;
+  }
+  stats.latencyUs = ageUs;
+  if (ageUs > stats.maxLatencyUs) {
+    stats.maxLatencyUs = ageUs;
+  }
+  metricsSet(METRIC_AUDIO_LATENCY_US, ageUs);
+
+  uint8_t flash = audioBeatPulse(features) / 2;
+  for (uint16_t i = 0; i < numLeds; i++) {
+    // Position along the bands in 1/256 steps, interpolated between neighbors
+    uint32_t position = numLeds > 1 ? (uint32_t)i * (AUDIO_BANDS - 1) * 256 / (numLeds - 1) : 0;
+    uint8_t band = position >> 8;
+    uint8_t fraction = position & 0xFF;
+    uint8_t next = band + 1 < AUDIO_BANDS ? band + 1 : band;
+    uint8_t level = lerp8by8(features.bands[band], features.bands[next], fraction);
+
+    CRGB color = blend(low, high, (fract8)(position * 255 / ((AUDIO_BANDS - 1) * 256)));
+    color.nscale8_video(qadd8(level, flash));
+    leds[i] = color;
+  }
+  return true;
+}
+
+/**
+ * Get capture and DSP statistics
+ */
+const AudioStats& getAudioStats() {
+  return stats;
+}
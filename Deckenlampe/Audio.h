@@ -0,0 +1,69 @@
+/**
+ * Audio.h - Microphone input for audio-reactive effects
+ *
+ * An I2S MEMS microphone (e.g. INMP441, L/R to GND) is read by DMA in
+ * blocks of AUDIO_HOP_SIZE samples. A task on core 0 turns every block
+ * into features (Audio_DSP: band energies, loudness, beats) and publishes
+ * them with a sequence lock, so the renderer on core 1 reads the latest
+ * features without waiting for the audio task.
+ *
+ * Latency from sound to light: one block of capture (16 ms), the DSP
+ * (well under 1 ms), up to one effect frame (10 ms) and the LED show.
+ * The part after capture is measured on every audio frame (/audio).
+ *
+ * The microphone is optional: with AUDIO_ENABLED 0 (default, Config.h)
+ * nothing is initialized, effect "audio" shows colorA and the lamp keeps
+ * sleeping while static. While capturing, the I2S driver keeps the APB clock up,
+ * which prevents light sleep.
+ *
+ * Author: icebear74
+ */
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include "Audio_DSP.h"
+#include "Config.h"
+
+#define AUDIO_PIN_BCLK        D8
+#define AUDIO_PIN_WS          D9
+#define AUDIO_PIN_DIN         D10
+#define AUDIO_SAMPLE_SHIFT    14      // 32-bit I2S slot to 16 bit, +12 dB gain
+#define AUDIO_DMA_BUFFERS     4       // Blocks the DMA can hold while the task is busy
+#define AUDIO_TASK_STACK      4096
+#define AUDIO_TASK_PRIORITY   4
+#define AUDIO_TASK_CORE       0       // The loop (rendering) runs on core 1
+
+// Feature vector for effect programs (Effect_VM "aud")
+#define AUDIO_FEATURE_LOUDNESS  AUDIO_BANDS       // 0-7 = bands
+#define AUDIO_FEATURE_ONSET     (AUDIO_BANDS + 1)
+#define AUDIO_FEATURE_BEAT      (AUDIO_BANDS + 2) // Beat pulse, decays after a beat
+#define AUDIO_FEATURE_COUNT     (AUDIO_BANDS + 3)
+
+// Audio configuration
+extern const uint32_t AUDIO_BEAT_DECAY_MS;
+extern const uint32_t AUDIO_STALE_MS;
+
+struct AudioStats {
+  bool running;                 // Microphone capturing
+  uint32_t blocks;              // Blocks processed since boot
+  uint32_t overruns;            // Blocks lost (DMA overflow)
+  uint32_t lastDspUs;           // Feature extraction time of the last block
+  uint32_t maxDspUs;
+  uint32_t avgDspUs;            // Average over the last second
+  uint8_t cpuPercent;           // Share of core 0 used by the DSP
+  uint32_t latencyUs;           // Capture of the newest sample to render, last audio frame
+  uint32_t maxLatencyUs;
+};
+
+// Function declarations
+void setupAudio();
+bool getAudioFeatures(AudioFeatures& features);
+uint8_t audioBeatPulse(const AudioFeatures& features);
+bool audioFeatureVector(uint8_t* values);
+bool renderAudioEffect(const CRGB& low, const CRGB& high, CRGB* leds, uint16_t numLeds);
+const AudioStats& getAudioStats();
+
+#endif // AUDIO_H
@@ -0,0 +1,241 @@
+/**
+ * Audio_DSP.cpp - Fixed-point audio feature extraction implementation
+ *
+ * All levels are handled as dB in Q8 (256 = 1 dB), computed from an
+ * integer log2, so the per-block path has no floating point. The window
+ * is normalized before the FFT (block floating point): quiet input is
+ * shifted up so the 1/2 scaling of every FFT stage does not drown it in
+ * rounding noise, and the shift is taken out again in the log domain.
+ *
+ * Author: icebear74
+ */
+
+#include "Audio_DSP.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM) && __has_include(<esp_dsp.h>)
+#define AUDIO_USE_ESP_DSP 1
+#include <esp_dsp.h>
+#else
+#define AUDIO_USE_ESP_DSP 0
+#endif
+
+#define DB_Q8(db)             ((int32_t)((db) * 256))
+#define BAND_FULL_SCALE_DB    80    // Band level of a full-scale sine (Hann window, 1/N FFT scaling)
+#define AGC_RANGE             DB_Q8(40)
+#define AGC_RELEASE           8     // Peak decay per block (Q8 dB, ~2 dB/s)
+#define AGC_MIN_PEAK          DB_Q8(-45)   // dBFS, keeps silence dark
+#define ONSET_BANDS           4     // Bands up to 1 kHz (kick, snare body, bass)
+#define ONSET_MIN_FLUX        DB_Q8(6)
+#define ONSET_FULL_SCALE      DB_Q8(12)
+#define BEAT_MIN_LOUDNESS     DB_Q8(-50)
+
+// First FFT bin of every band, plus the end of the last one
+static const uint16_t bandBins[AUDIO_BANDS + 1] = { 2, 4, 8, 16, 32, 64, 128, 192, 256 };
+
+static int16_t window[AUDIO_FFT_SIZE];          // Hann, Q15
+static int16_t history[AUDIO_FFT_SIZE];         // Last FFT_SIZE samples
+static int16_t fftData[AUDIO_FFT_SIZE * 2];     // Interleaved re, im
+#if !AUDIO_USE_ESP_DSP
+static int16_t twiddles[AUDIO_FFT_SIZE];        // cos, -sin for k < N/2, Q15
+#endif
+
+static int32_t bandPeak[AUDIO_BANDS];           // dBFS Q8
+static int32_t previousDb[AUDIO_BANDS];
+static int32_t olderDb[AUDIO_BANDS];
+static int32_t fluxHistory[AUDIO_FLUX_HISTORY];
+static int32_t fluxSum = 0;
+static uint16_t fluxIndex = 0;
+
+/**
+ * log2 in Q8, linear between powers of two (error < 0.09)
+ */
+static int32_t log2Q8(uint64_t x) {
+  if (x == 0) {
+    return 0;
+  }
+  int msb = 63 - __builtin_clzll(x);
+  uint32_t frac = msb >= 8 ? (uint32_t)(x >> (msb - 8)) & 0xFF : (uint32_t)(x << (8 - msb)) & 0xFF;
+  return msb * 256 + frac;
+}
+
+// 10 * log10(x) = 3.0103 * log2(x)
+static int32_t log2ToDbQ8(int32_t log2) {
+  return (log2 * 771) >> 8;
+}
+
+static uint8_t toByte(int32_t value, int32_t fullScale) {
+  if (value <= 0) {
+    return 0;
+  }
+  return value >= fullScale ? 255 : (uint8_t)(value * 255 / fullScale);
+}
+
+#if !AUDIO_USE_ESP_DSP
+/**
+ * In-place radix-2 FFT on interleaved 16-bit complex data
+ * Every stage scales by 1/2 (like dsps_fft2r_sc16), output = DFT / N.
+ */
+static void fft(int16_t* data) {
+  for (int i = 1, j = 0; i < AUDIO_FFT_SIZE; i++) {
+    int bit = AUDIO_FFT_SIZE >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j |= bit;
+    if (i < j) {
+      int16_t re = data[2 * i];
+      int16_t im = data[2 * i + 1];
+      data[2 * i] = data[2 * j];
+      data[2 * i + 1] = data[2 * j + 1];
+      data[2 * j] = re;
+      data[2 * j + 1] = im;
+    }
+  }
+
+  for (int len = 2; len <= AUDIO_FFT_SIZE; len <<= 1) {
+    int half = len >> 1;
+    int step = AUDIO_FFT_SIZE / len;
+    for (int i = 0; i < AUDIO_FFT_SIZE; i += len) {
+      for (int j = 0; j < half; j++) {
+        int32_t wr = twiddles[2 * j * step];
+        int32_t wi = twiddles[2 * j * step + 1];
+        int16_t* u = data + 2 * (i + j);
+        int16_t* v = data + 2 * (i + j + half);
+        int32_t tr = (v[0] * wr - v[1] * wi) >> 15;
+        int32_t ti = (v[0] * wi + v[1] * wr) >> 15;
+        int32_t ur = u[0];
+        int32_t ui = u[1];
+        u[0] = (ur + tr) >> 1;
+        u[1] = (ui + ti) >> 1;
+        v[0] = (ur - tr) >> 1;
+        v[1] = (ui - ti) >> 1;
+      }
+    }
+  }
+}
+#endif
+
+/**
+ * Build the window and FFT tables and reset the feature state
+ */
+void setupAudioDsp() {
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+    window[i] = (int16_t)lroundf(32767.0f * (0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / AUDIO_FFT_SIZE)));
+  }
+#if AUDIO_USE_ESP_DSP
+  dsps_fft2r_init_sc16(nullptr, AUDIO_FFT_SIZE);
+#else
+  for (int k = 0; k < AUDIO_FFT_SIZE / 2; k++) {
+    float angle = 2.0f * (float)M_PI * k / AUDIO_FFT_SIZE;
+    twiddles[2 * k] = (int16_t)lroundf(32767.0f * cosf(angle));
+    twiddles[2 * k + 1] = (int16_t)lroundf(-32767.0f * sinf(angle));
+  }
+#endif
+  memset(history, 0, sizeof(history));
+  for (int b = 0; b < AUDIO_BANDS; b++) {
+    bandPeak[b] = AGC_MIN_PEAK;
+    previousDb[b] = AGC_MIN_PEAK - AGC_RANGE;
+    olderDb[b] = AGC_MIN_PEAK - AGC_RANGE;
+  }
+  memset(fluxHistory, 0, sizeof(fluxHistory));
+  fluxSum = 0;
+  fluxIndex = 0;
+}
+
+/**
+ * Process one block of AUDIO_HOP_SIZE samples
+ *
+ * @param samples New samples (mono, full scale = 32767)
+ * @param captureUs Capture time of the last sample (beat timing)
+ * @param features Updated in place (block and beat counters carry on)
+ */
+void audioDspProcess(const int16_t* samples, uint32_t captureUs, AudioFeatures& features) {
+  memmove(history, history + AUDIO_HOP_SIZE, (AUDIO_FFT_SIZE - AUDIO_HOP_SIZE) * sizeof(int16_t));
+  memcpy(history + AUDIO_FFT_SIZE - AUDIO_HOP_SIZE, samples, AUDIO_HOP_SIZE * sizeof(int16_t));
+
+  // Loudness of the new samples, 0 dBFS = full-scale square wave
+  uint64_t sumSquares = 0;
+  for (int i = 0; i < AUDIO_HOP_SIZE; i++) {
+    sumSquares += (int32_t)samples[i] * samples[i];
+  }
+  int32_t loudnessDb = log2ToDbQ8(log2Q8(sumSquares / AUDIO_HOP_SIZE) - 30 * 256);
+  if (sumSquares == 0) {
+    loudnessDb = DB_Q8(-96);
+  }
+
+  // Window, normalized to 14 bits so no FFT stage can overflow: quiet
+  // input is shifted up, loud input (15 bits after the window) down
+  int32_t peak = 1;
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+    int32_t x = (history[i] * window[i]) >> 15;
+    fftData[2 * i] = x;
+    fftData[2 * i + 1] = 0;
+    peak |= x < 0 ? -x : x;
+  }
+  int shift = __builtin_clz((uint32_t)peak) - 18;
+  if (shift > 0) {
+    for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+      fftData[2 * i] = fftData[2 * i] * (1 << shift);
+    }
+  } else if (shift < 0) {
+    for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+      fftData[2 * i] = fftData[2 * i] >> -shift;
+    }
+  }
+
+#if AUDIO_USE_ESP_DSP
+  dsps_fft2r_sc16(fftData, AUDIO_FFT_SIZE);
+  dsps_bit_rev_sc16_ansi(fftData, AUDIO_FFT_SIZE);
+#else
+  fft(fftData);
+#endif
+
+  // Band levels and onset flux
+  int32_t flux = 0;
+  for (int b = 0; b < AUDIO_BANDS; b++) {
+    uint64_t energy = 0;
+    for (int k = bandBins[b]; k < bandBins[b + 1]; k++) {
+      int32_t re = fftData[2 * k];
+      int32_t im = fftData[2 * k + 1];
+      energy += (uint32_t)(re * re + im * im);
+    }
+    int32_t db = energy == 0 ? DB_Q8(-96)
+                             : log2ToDbQ8(log2Q8(energy) - 2 * shift * 256) - DB_Q8(BAND_FULL_SCALE_DB);
+
+    bandPeak[b] = db > bandPeak[b] ? db : bandPeak[b] - AGC_RELEASE;
+    if (bandPeak[b] < AGC_MIN_PEAK) {
+      bandPeak[b] = AGC_MIN_PEAK;
+    }
+    features.bands[b] = toByte(db - (bandPeak[b] - AGC_RANGE), AGC_RANGE);
+
+    // Rise over the louder of the two previous blocks: with 50% overlap a
+    // single noisy block would otherwise count twice
+    int32_t reference = previousDb[b] > olderDb[b] ? previousDb[b] : olderDb[b];
+    if (reference < bandPeak[b] - AGC_RANGE) {
+      reference = bandPeak[b] - AGC_RANGE;
+    }
+    if (b < ONSET_BANDS && db > reference) {
+      flux += db - reference;
+    }
+    olderDb[b] = previousDb[b];
+    previousDb[b] = db;
+  }
+  // Beat: flux well above its running mean (2.5x plus a fixed margin)
+  int32_t mean = fluxSum / AUDIO_FLUX_HISTORY;
+  fluxSum += flux - fluxHistory[fluxIndex];
+  fluxHistory[fluxIndex] = flux;
+  fluxIndex = (fluxIndex + 1) % AUDIO_FLUX_HISTORY;
+
+  features.onset = toByte(flux - mean, ONSET_FULL_SCALE);
+  features.beat = flux > 2 * mean + mean / 2 + ONSET_MIN_FLUX && loudnessDb > BEAT_MIN_LOUDNESS &&
+                  (features.beats == 0 || captureUs - features.beatUs >= AUDIO_BEAT_MIN_MS * 1000UL);
+  if (features.beat) {
+    features.beats++;
+    features.beatUs = captureUs;
+  }
+  features.loudness = toByte(loudnessDb + DB_Q8(60), DB_Q8(60));
+  features.captureUs = captureUs;
+  features.block++;
+}
@@ -0,0 +1,52 @@
+/**
+ * Audio_DSP.h - Fixed-point audio feature extraction for CeilingLamp
+ *
+ * Turns blocks of 16-bit microphone samples into features for effects:
+ * band energies, loudness and beat onsets. Every AUDIO_HOP_SIZE samples
+ * the last AUDIO_FFT_SIZE samples are windowed and transformed with a
+ * 16-bit fixed-point FFT (ESP-DSP where available, a portable radix-2
+ * FFT otherwise).
+ *
+ * - Bands: 8 octave-wide bands from 62 Hz to 8 kHz, log-compressed and
+ *   auto-gained per band to 0-255 (40 dB window below the recent peak)
+ * - Loudness: RMS of the block, -60 .. 0 dBFS mapped to 0-255
+ * - Beats: spectral flux of the low bands against 2.5x its running mean,
+ *   at most one beat per AUDIO_BEAT_MIN_MS
+ *
+ * The module has no Arduino dependencies, so the exact firmware code can
+ * be fed WAV files on a PC (audio-replay.cpp).
+ *
+ * Author: icebear74
+ */
+
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AUDIO_SAMPLE_RATE     16000
+#define AUDIO_FFT_SIZE        512   // 32 ms window, 31.25 Hz per bin
+#define AUDIO_FFT_BITS        9
+#define AUDIO_HOP_SIZE        256   // 16 ms per block (50% overlap)
+#define AUDIO_BANDS           8
+#define AUDIO_FLUX_HISTORY    64    // Blocks in the onset threshold (~1 s)
+#define AUDIO_BEAT_MIN_MS     200   // Shortest beat interval (300 BPM)
+
+// Features of one block
+struct AudioFeatures {
+  uint32_t block;               // Blocks processed, 0 = no audio yet
+  uint32_t captureUs;           // Time the last sample of the block was captured
+  uint32_t beatUs;              // Capture time of the last beat
+  uint32_t beats;               // Beats detected since start
+  uint8_t bands[AUDIO_BANDS];   // Band energy, 0-255 (auto-gained)
+  uint8_t loudness;             // 0-255 = -60 .. 0 dBFS
+  uint8_t onset;                // Onset strength of this block, 0-255
+  bool beat;                    // Beat detected in this block
+};
+
+// Function declarations
+void setupAudioDsp();
+void audioDspProcess(const int16_t* samples, uint32_t captureUs, AudioFeatures& features);
+
+#endif // AUDIO_DSP_H
@@ -0,0 +1,343 @@
+/**
+ * Bench.cpp - On-device benchmark suite implementation
+ *
+ * Benchmarks run in the web request that asks for them and block the
+ * loop for a few hundred milliseconds (shown as an HTTP stall on /stalls).
+ *
+ * Author: icebear74
+ */
+
+#include "Bench.h"
+
+#if BENCH_ENABLED
+
+#include "Audio.h"
+#include "Effect_VM.h"
+#include "Effects.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Power.h"
+#include "Sequence.h"
+#include "Settings.h"
+#include "Stall.h"
+#include "Static_Alloc.h"
+#include "Version.h"
+#include "WiFi_Manager.h"
+#include <mbedtls/sha256.h>
+
+// Benchmark configuration
+const uint32_t BENCH_TOLERANCE_PERCENT = 20;   // Slower than baseline by more = regression
+
+struct BenchInfo {
+  const char* name;
+  uint32_t iterations;          // Per repeat
+  void (*run)(uint32_t iterations);
+  bool (*available)();          // nullptr = always, else skipped when false
+};
+
+static uint32_t results[BENCH_COUNT];      // ns per iteration, fastest repeat, 0 = skipped
+static uint32_t baselines[BENCH_COUNT];    // ns per iteration, 0 = none
+static uint32_t regressions = 0;
+static bool recorded = false;
+static bool hasRun = false;
+
+static_assert(sizeof(baselines) <= SETTINGS_MAX_VALUE_SIZE, "baselines must fit one setting");
+
+// Keeps results alive so the compiler cannot drop the work
+static volatile uint32_t sink;
+static CRGB frameA[BENCH_LEDS];
+static CRGB frameB[BENCH_LEDS];
+static CRGB frameOut[BENCH_LEDS];
+static uint8_t otaChunk[1024];
+
+static void countBytes(const char* chunk) {
+  sink = sink + strlen(chunk);
+}
+
+static void benchTimeToLocal(uint32_t iterations) {
+  time_t t = 1704067200;  // 2024-01-01, steps cover both DST switches
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    acc += (uint32_t)timeConverter.toLocal(t);
+    t += 31537;
+  }
+  sink = acc;
+}
+
+static void benchTimeIsDst(uint32_t iterations) {
+  time_t t = 1704067200;
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    acc += timeConverter.isDST(t) ? 1 : 0;
+    t += 31537;
+  }
+  sink = acc;
+}
+
+static void benchRender(uint8_t type, uint32_t iterations) {
+  EffectParams params = DEFAULT_EFFECT;
+  params.type = type;
+  for (uint32_t i = 0; i < iterations; i++) {
+    renderEffect(params, i * 7, frameOut, BENCH_LEDS);
+  }
+  sink = frameOut[0].r;
+}
+
+static void benchRenderCrossfade(uint32_t iterations) {
+  benchRender(EFFECT_CROSSFADE, iterations);
+}
+
+static void benchRenderToggle(uint32_t iterations) {
+  benchRender(EFFECT_TOGGLE, iterations);
+}
+
+// Same per-pixel blend as Frame_Interpolator, one frame per iteration
+static void benchFrameBlend(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    uint8_t frac = i * 37;
+    for (int p = 0; p < BENCH_LEDS; p++) {
+      frameOut[p] = blend(frameA[p], frameB[p], frac);
+    }
+  }
+  sink = frameOut[0].g;
+}
+
+static void benchHttpMetrics(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    writeMetrics(countBytes);
+  }
+}
+
+static void benchHttpStalls(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    writeStallReport(countBytes);
+  }
+}
+
+// Hash of one 4 KB upload chunk, as OTA_Verify does while streaming
+static void benchOtaSha256(uint32_t iterations) {
+  uint8_t hash[32];
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (int k = 0; k < 4; k++) {
+      mbedtls_sha256_update(&ctx, otaChunk, sizeof(otaChunk));
+    }
+  }
+  mbedtls_sha256_finish(&ctx, hash);
+  mbedtls_sha256_free(&ctx);
+  sink = hash[0];
+}
+
+// Sequential frame decoding of the stored sequence (delta records from flash)
+static void benchSequenceDecode(uint32_t iterations) {
+  static uint32_t frame = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    decodeSequenceFrame(frame++, frameOut, BENCH_LEDS);
+  }
+  sink = frameOut[0].b;
+}
+
+// Reads 4 KB of the memory-mapped sequence file per iteration, striding
+// through it so flash cache misses are included
+static void benchSequenceRead(uint32_t iterations) {
+  static size_t offset = 0;
+  size_t size;
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(sequenceData(&size));
+  size_t count = size / 4;
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (size_t w = 0; w < 1024; w++) {
+      acc += words[offset];
+      offset = offset + 1 < count ? offset + 1 : 0;
+    }
+  }
+  sink = acc;
+}
+
+// Moving rainbow, a typical uploaded effect (make-effect.py syntax in comments)
+static const uint32_t vmRainbow[] = {
+  VM_I(VM_OP_LDI,  8, 0, 16384),   // li   r8, 0.25          ; turns per second
+  VM_R(VM_OP_MUL,  9, 4, 8),       // mul  r9, sec, r8
+  VM_R(VM_OP_ADD,  9, 9, 3),       // add  r9, r9, pos
+  VM_R(VM_OP_SIN, 10, 9, 0),       // sin  r10, r9
+  VM_R(VM_OP_COS, 11, 9, 0),       // cos  r11, r9
+  VM_I(VM_OP_ADDI, 9, 9, 21845),   // addi r9, r9, 0.3333
+  VM_R(VM_OP_SIN, 12, 9, 0),       // sin  r12, r9
+  VM_I(VM_OP_LUI, 13, 0, 1),       // lui  r13, 1
+  VM_R(VM_OP_ADD, 10, 10, 13),     // add  r10, r10, r13
+  VM_I(VM_OP_SHR,  5, 10, 1),      // shr  red, r10, 1
+  VM_R(VM_OP_ADD, 11, 11, 13),     // add  r11, r11, r13
+  VM_I(VM_OP_SHR,  6, 11, 1),      // shr  green, r11, 1
+  VM_R(VM_OP_ADD, 12, 12, 13),     // add  r12, r12, r13
+  VM_I(VM_OP_SHR,  7, 12, 1),      // shr  blue, r12, 1
+  VM_R(VM_OP_TRI, 14, 9, 0),       // tri  r14, r9
+  VM_R(VM_OP_MUL,  7, 7, 14),      // mul  blue, blue, r14
+  VM_R(VM_OP_HALT, 0, 0, 0),       // halt
+};
+static VmProgram vmProgram;
+
+// One frame of the rainbow program over the benchmark strip
+static void benchVmFrame(uint32_t iterations) {
+  uint32_t steps;
+  for (uint32_t i = 0; i < iterations; i++) {
+    vmRunFrame(vmProgram, i * 10, frameOut, BENCH_LEDS, &steps);
+  }
+  sink = frameOut[0].r + steps;
+}
+
+// Feature extraction of one block of a synthetic signal (bass + tone)
+static int16_t audioBlock[AUDIO_HOP_SIZE];
+static AudioFeatures audioFeatures;
+
+static void benchAudioDsp(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    audioDspProcess(audioBlock, i * 16000, audioFeatures);
+  }
+  sink = audioFeatures.bands[0];
+}
+
+// The DSP state is shared with the audio task
+static bool audioIdle() {
+  return !getAudioStats().running;
+}
+
+static const BenchInfo benchmarks[BENCH_COUNT] = {
+  { "time_to_local",     2000, benchTimeToLocal,     nullptr },
+  { "time_is_dst",       2000, benchTimeIsDst,       nullptr },
+  { "render_crossfade",  200,  benchRenderCrossfade, nullptr },
+  { "render_toggle",     200,  benchRenderToggle,    nullptr },
+  { "frame_blend",       200,  benchFrameBlend,      nullptr },
+  { "http_metrics",      5,    benchHttpMetrics,     nullptr },
+  { "http_stalls",       5,    benchHttpStalls,      nullptr },
+  { "ota_sha256_4k",     10,   benchOtaSha256,       nullptr },
+  { "sequence_decode",   200,  benchSequenceDecode,  sequenceLoaded },
+  { "sequence_read_4k",  20,   benchSequenceRead,    sequenceLoaded },
+  { "vm_frame",          200,  benchVmFrame,         nullptr },
+  { "audio_dsp",         50,   benchAudioDsp,        audioIdle },
+};
+
+/**
+ * Run one benchmark
+ *
+ * @return Nanoseconds per iteration of the fastest repeat
+ */
+static uint32_t measure(const BenchInfo& bench) {
+  if (bench.available != nullptr && !bench.available()) {
+    return 0;
+  }
+  uint32_t best = UINT32_MAX;
+  for (int r = 0; r < BENCH_REPEATS; r++) {
+    uint32_t t0 = micros();
+    bench.run(bench.iterations);
+    uint32_t elapsed = micros() - t0;
+    if (elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return (uint32_t)((uint64_t)best * 1000 / bench.iterations);
+}
+
+/**
+ * Run all benchmarks and compare them against the stored baselines
+ *
+ * @param record Store the results as the new baselines
+ * @return false if a benchmark regressed
+ */
+bool runBenchmarks(bool record) {
+  // Full clock: leave power-saving static mode first
+  powerActivity();
+
+  for (int p = 0; p < BENCH_LEDS; p++) {
+    frameA[p] = CRGB(p * 5, 255 - p * 5, 128);
+    frameB[p] = CRGB(255 - p * 3, p * 3, 64);
+  }
+  for (size_t i = 0; i < sizeof(otaChunk); i++) {
+    otaChunk[i] = i * 131;
+  }
+  const char* error;
+  vmVerify(vmProgram, vmRainbow, sizeof(vmRainbow) / sizeof(vmRainbow[0]), &error);
+  if (audioIdle()) {
+    setupAudioDsp();
+    for (int i = 0; i < AUDIO_HOP_SIZE; i++) {
+      audioBlock[i] = sin16(i * 256) / 4 + sin16(i * 4096) / 8;
+    }
+  }
+
+  for (int b = 0; b < BENCH_COUNT; b++) {
+    results[b] = measure(benchmarks[b]);
+  }
+
+  if (!loadSetting(SETTING_BENCH_BASELINES, baselines)) {
+    memset(baselines, 0, sizeof(baselines));
+  }
+  regressions = 0;
+  for (int b = 0; b < BENCH_COUNT; b++) {
+    if (!record && baselines[b] != 0 && results[b] != 0 &&
+        (uint64_t)results[b] * 100 > (uint64_t)baselines[b] * (100 + BENCH_TOLERANCE_PERCENT)) {
+      regressions++;
+      LOG_W(BENCH, "Benchmark %s regressed: %u ns (baseline %u ns)",
+            benchmarks[b].name, results[b], baselines[b]);
+    }
+  }
+  if (record) {
+    for (int b = 0; b < BENCH_COUNT; b++) {
+      if (results[b] != 0) {
+        baselines[b] = results[b];
+      }
+    }
+    storeSetting(SETTING_BENCH_BASELINES, baselines);
+    flushSettings();
+  }
+  recorded = record;
+  hasRun = true;
+  LOG_I(BENCH, "Benchmarks done: %u regressions%s", regressions, record ? ", baselines recorded" : "");
+  return regressions == 0;
+}
+
+/**
+ * Write the results of the last run as a text table
+ */
+void writeBenchReport(void (*write)(const char* chunk)) {
+  FixedString<96> line;
+  if (!hasRun) {
+    write("No benchmark run yet\n");
+    return;
+  }
+  line.appendf("Firmware %s, CPU %u MHz, best of %d, tolerance %u%%\n\n", DECKENLAMPE_VERSION,
+               (unsigned)getCpuFrequencyMhz(), BENCH_REPEATS, BENCH_TOLERANCE_PERCENT);
+  write(line.c_str());
+  line.clear();
+  line.appendf("%-18s %11s %9s %9s %8s\n", "benchmark", "iterations", "ns/op", "baseline", "change");
+  write(line.c_str());
+
+  for (int b = 0; b < BENCH_COUNT; b++) {
+    line.clear();
+    line.appendf("%-18s %11u", benchmarks[b].name, benchmarks[b].iterations);
+    if (results[b] == 0) {
+      line.appendf(" %9s %9s %8s\n", "skipped", "-", "-");
+    } else if (baselines[b] == 0) {
+      line.appendf(" %9u %9s %8s\n", results[b], "-", "-");
+    } else {
+      // Change in tenths of a percent
+      int32_t change = (int32_t)(((int64_t)results[b] - baselines[b]) * 1000 / baselines[b]);
+      uint32_t magnitude = abs(change);
+      line.appendf(" %9u %9u %c%4u.%u%%\n", results[b], baselines[b], change < 0 ? '-' : '+',
+                   (unsigned)(magnitude / 10), (unsigned)(magnitude % 10));
+    }
+    write(line.c_str());
+  }
+
+  line.clear();
+  if (recorded) {
+    line.append("\nResult: baselines recorded\n");
+  } else if (regressions > 0) {
+    line.appendf("\nResult: REGRESSION (%u)\n", regressions);
+  } else {
+    line.append("\nResult: OK\n");
+  }
+  write(line.c_str());
+}
+
+#endif // BENCH_ENABLED
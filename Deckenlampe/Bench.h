@@ -0,0 +1,61 @@
+/**
+ * Bench.h - On-device benchmark and regression suite for CeilingLamp
+ *
+ * Times the hot paths of the firmware on the lamp itself, at full clock:
+ * time conversion, effect rendering and frame blending (pixel pipeline),
+ * /metrics and /stalls body generation (HTTP handling) and the per-chunk
+ * SHA-256 of OTA uploads, plus frame decoding and flash reads of the
+ * stored light sequence (skipped when none is stored) and one frame of a
+ * built-in effect program in the bytecode interpreter and the audio
+ * feature extraction of one block (skipped while the microphone runs, its
+ * live cost is on /audio). Every benchmark runs BENCH_REPEATS times and
+ * the fastest run counts, so WiFi interrupts do not skew the result.
+ *
+ *   http://<lamp>/bench             run and compare against the baselines
+ *   http://<lamp>/bench?record=1    run and store the results as baselines
+ *
+ * Baselines live in the settings store and survive OTA updates. A result
+ * slower than its baseline by more than BENCH_TOLERANCE_PERCENT is a
+ * regression and the request fails with HTTP 500, so `curl -f` can gate
+ * a rollout after updating a test lamp.
+ *
+ * host/bench runs the same cases natively with Google Benchmark on every
+ * build, plus complete OTA uploads through decoding, verification and the
+ * writer task, against its own baselines.
+ *
+ * Author: icebear74
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+#define BENCH_REPEATS     5
+#define BENCH_LEDS        40    // Strip length the pixel benchmarks render
+
+// Benchmark configuration
+extern const uint32_t BENCH_TOLERANCE_PERCENT;
+
+enum BenchId {
+  BENCH_TIME_TO_LOCAL = 0,
+  BENCH_TIME_IS_DST,
+  BENCH_RENDER_CROSSFADE,
+  BENCH_RENDER_TOGGLE,
+  BENCH_FRAME_BLEND,
+  BENCH_HTTP_METRICS,
+  BENCH_HTTP_STALLS,
+  BENCH_OTA_SHA256_4K,
+  BENCH_SEQUENCE_DECODE,
+  BENCH_SEQUENCE_READ_4K,
+  BENCH_VM_FRAME,
+  BENCH_AUDIO_DSP,
+  BENCH_COUNT
+};
+
+// Function declarations
+bool runBenchmarks(bool record);
+void writeBenchReport(void (*write)(const char* chunk));
+
+#endif // BENCH_H
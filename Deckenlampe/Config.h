@@ -0,0 +1,158 @@
+/**
+ * Config.h - Build configuration for CeilingLamp
+ *
+ * One place for what gets built and how the lamp is set up: the feature
+ * switches, the LED hardware, device identity and the network endpoints.
+ * Tuning that only concerns one module stays in that module.
+ *
+ * Every subsystem has an X_ENABLED switch (1/0). Change the default here
+ * or override it per build, e.g.
+ *   arduino-cli compile --build-property "compiler.cpp.extra_flags=-DWPS_ENABLED=0" ...
+ * (feature-size.py builds the common profiles and compares their size).
+ * A disabled subsystem costs nothing: its library #includes and
+ * definitions are removed with #if (the Arduino builder links a library
+ * as soon as one of its headers is included), and its setup and loop
+ * calls are removed with if constexpr on the FEATURE_X constants, which
+ * keeps both sides type-checked in every profile.
+ *
+ * Author: icebear74
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <Arduino.h>
+
+// ---------------------------------------------------------------------------
+// Features
+// ---------------------------------------------------------------------------
+
+#ifndef ARDUINO_OTA_ENABLED
+#define ARDUINO_OTA_ENABLED 1         // Updates from the Arduino IDE (port OTA_PORT)
+#endif
+
+#ifndef WEB_SERVER_ENABLED
+#define WEB_SERVER_ENABLED 1          // HTTP server: /metrics, /trace, /log, uploads, ...
+#endif
+
+#ifndef WEB_OTA_ENABLED
+#define WEB_OTA_ENABLED WEB_SERVER_ENABLED  // Upload page on / and POST /update
+#endif
+
+#ifndef HTTP_UPDATE_ENABLED
+#define HTTP_UPDATE_ENABLED 1         // Manifest-polled updates from UPDATE_MANIFEST_URL
+#endif
+
+#ifndef NTP_ENABLED
+#define NTP_ENABLED 1                 // Wall clock from NTP (group sync needs it across lamps)
+#endif
+
+#ifndef WPS_ENABLED
+#define WPS_ENABLED 1                 // WPS pairing without stored credentials
+#endif
+
+#ifndef BENCH_ENABLED
+#define BENCH_ENABLED WEB_SERVER_ENABLED    // Benchmark suite on /bench
+#endif
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1               // Boot and runtime trace
+#endif
+
+#ifndef HEAP_CHECK_ENABLED
+#define HEAP_CHECK_ENABLED 1          // Count allocations after setup()
+#endif
+
+#ifndef HEAP_CHECK_WRAP_MALLOC
+#define HEAP_CHECK_WRAP_MALLOC 0      // Also count malloc/calloc/realloc (needs the --wrap linker flags, see README)
+#endif
+
+#ifndef POWER_LIGHT_SLEEP_ENABLED
+#define POWER_LIGHT_SLEEP_ENABLED 1   // Needs tickless idle in the ESP-IDF build
+#endif
+
+#ifndef AUDIO_ENABLED
+#define AUDIO_ENABLED 0               // Needs a microphone (pins in Audio.h)
+#endif
+
+#if WEB_OTA_ENABLED && !WEB_SERVER_ENABLED
+#error "WEB_OTA_ENABLED needs WEB_SERVER_ENABLED"
+#endif
+
+#if HEAP_CHECK_WRAP_MALLOC && !HEAP_CHECK_ENABLED
+#error "HEAP_CHECK_WRAP_MALLOC needs HEAP_CHECK_ENABLED"
+#endif
+
+#if BENCH_ENABLED && !WEB_SERVER_ENABLED
+#error "BENCH_ENABLED needs WEB_SERVER_ENABLED (results are served on /bench)"
+#endif
+
+// For if constexpr at the call sites
+constexpr bool FEATURE_ARDUINO_OTA = ARDUINO_OTA_ENABLED;
+constexpr bool FEATURE_WEB_SERVER = WEB_SERVER_ENABLED;
+constexpr bool FEATURE_WEB_OTA = WEB_OTA_ENABLED;
+constexpr bool FEATURE_HTTP_UPDATE = HTTP_UPDATE_ENABLED;
+constexpr bool FEATURE_NTP = NTP_ENABLED;
+constexpr bool FEATURE_WPS = WPS_ENABLED;
+
+// ---------------------------------------------------------------------------
+// Hardware
+// ---------------------------------------------------------------------------
+
+constexpr uint16_t NUM_LEDS = 40;
+constexpr uint8_t DATA_PIN = D3;
+constexpr unsigned long SERIAL_BAUD_RATE = 115200;
+
+// ---------------------------------------------------------------------------
+// Device identity (hostname, WPS, Home Assistant)
+// ---------------------------------------------------------------------------
+
+constexpr char ESP_MANUFACTURER[] = "XIAO";
+constexpr char ESP_MODEL_NUMBER[] = "ESP32S3";
+constexpr char ESP_MODEL_NAME[] = "SEED STUDIO";
+constexpr char ESP_DEVICE_NAME[] = "CeilingLamp";   // Hostname: CeilingLamp_<MAC suffix>
+
+// ---------------------------------------------------------------------------
+// WiFi
+// ---------------------------------------------------------------------------
+
+// Network to join; empty = credentials stored by WPS or an earlier build.
+// Needed once with WPS_ENABLED 0 (the driver keeps them in NVS).
+constexpr char WIFI_SSID[] = "";
+constexpr char WIFI_PASSWORD[] = "";
+
+constexpr unsigned long WIFI_CONNECTION_TIMEOUT_MS = 20000;  // 20 seconds for connection
+constexpr unsigned long WIFI_SCAN_TIMEOUT_MS = 10000;        // 10 seconds for scan
+constexpr unsigned int INITIAL_DELAY_MS = 10;
+constexpr unsigned int CONNECTION_CHECK_DELAY_MS = 500;
+
+#if WPS_ENABLED
+#include <esp_wps.h>
+constexpr wps_type_t WPS_MODE = WPS_TYPE_PBC;
+#endif
+
+// ---------------------------------------------------------------------------
+// Time
+// ---------------------------------------------------------------------------
+
+// Default timezone (Berlin, Germany)
+constexpr char DEFAULT_TIMEZONE[] = "CET-1CEST,M3.5.0,M10.5.0/3";
+
+// NTP Server configuration (fallback chain)
+constexpr char DEFAULT_NTP_SERVER_PRIMARY[] = "ptbtime1.ptb.de";
+constexpr char DEFAULT_NTP_SERVER_SECONDARY[] = "de.pool.ntp.org";
+constexpr char DEFAULT_NTP_SERVER_TERTIARY_IP[] = "216.239.35.0";  // Google Public NTP
+
+// ---------------------------------------------------------------------------
+// Updates
+// ---------------------------------------------------------------------------
+
+constexpr unsigned int OTA_PORT = 3232;
+constexpr unsigned long HTTP_UPDATE_CHECK_INTERVAL_MS = 3600000; // Check every hour
+constexpr unsigned long HTTP_UPDATE_FIRST_CHECK_MS = 300000;     // First check at a random time within 5 min after boot
+constexpr uint8_t HTTP_UPDATE_JITTER_PERCENT = 20;               // Check interval +/- 20%
+constexpr unsigned long HTTP_UPDATE_BACKOFF_MIN_MS = 60000;      // First retry after a failed check
+constexpr unsigned long HTTP_UPDATE_TIMEOUT_MS = 10000;          // Abort download after 10s without data
+// The update server URLs are set in OTA_Update.cpp
+
+#endif // CONFIG_H
@@ -9,87 +9,214 @@
  *   1. ArduinoOTA - Update via Arduino IDE over WiFi
  *   2. Web-based OTA - Upload firmware via web interface
  *   3. HTTP OTA - Automatic update from web server
+ * - Real-time pixel streaming via DDP and E1.31/sACN
+ *   with jitter buffer and frame interpolation
+ * - Multicast-synchronized effect playback across several lamps
+ * - MQTT control with Home Assistant discovery
+ * - Prometheus metrics on /metrics, boot/runtime trace on /trace
+ * - Loop stall profiler with backtrace samples on /stalls
+ * - Steady state without String/vector allocations (fixed-capacity strings/containers, scratch arena)
+ * - Lamp state kept across power cycles in a wear-leveled flash journal
+ * - Lower CPU clock and light sleep while the LED output is static
+ * - Audio-reactive effects from an optional I2S microphone
+ * - Subsystems and settings selected at compile time in Config.h
  * 
  * Hardware: XIAO ESP32S3
  * Author: icebear74
  */
 
+#include "Config.h"
 #include "WiFi_Manager.h"
+#include "Audio.h"
 #include "OTA_Update.h"
+#include "Fleet_OTA.h"
+#include "Pixel_Stream.h"
+#include "Frame_Interpolator.h"
+#include "Effects.h"
+#include "Group_Sync.h"
+#include "Lamp_Control.h"
+#include "MQTT_Client.h"
+#include "Power.h"
+#include "Sequence.h"
+#include "Settings.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Stall.h"
+#include "Static_Alloc.h"
+#include "Trace.h"
 #include "Version.h"
 #include <FastLED.h>
 
-#define NUM_LEDS 40
-#define DATA_PIN D3
-
 CRGB leds[NUM_LEDS];
 
+// Local effect state
+static CRGB shownLeds[NUM_LEDS];
+static uint32_t lastEffectFrame = 0;
+static uint32_t shownLampVersion = 0;
+static bool localEffectRunning = false;
+static bool firstLight = false;
 
-// Serial communication baud rate
-const unsigned long SERIAL_BAUD_RATE = 115200;
-void fillAndShow(CRGB color) {
-    for (int i = 0; i < NUM_LEDS; ++i) {
-        leds[i] = color;
-    }
-    FastLED.show();
+/**
+ * Push the LED buffer to the strip (timed and counted for /metrics)
+ * The first frame ends the boot trace (time to light).
+ */
+void showLeds() {
+  STALL_SCOPE(STALL_SUB_LED_SHOW);
+  powerActivity();
+  uint32_t t0 = micros();
+  FastLED.show();
+  metricsObserve(METRIC_SHOW_TIME, micros() - t0);
+  metricsInc(METRIC_FRAMES_SHOWN);
+  TRACE_SPAN(TRACE_LED_SHOW, t0);
+  if (!firstLight) {
+    firstLight = true;
+    TRACE_INSTANT(TRACE_FIRST_LIGHT);
+    traceBootComplete();
+  }
 }
+
+/**
+ * Render the local (non-streamed) effect without blocking the loop
+ * The frame index comes from the group timeline, so grouped lamps render
+ * the same frame at the same time. The strip is only pushed when the
+ * output or the lamp state (e.g. brightness) changes, and immediately
+ * when taking the LEDs back from a network stream.
+ */
+void renderLocalEffect() {
+  uint32_t frame = effectFrameIndex();
+  uint32_t lampVersion = lampStateVersion();
+  bool forceShow = !localEffectRunning || lampVersion != shownLampVersion;
+  if (!forceShow && frame == lastEffectFrame) {
+    return;
+  }
+  lastEffectFrame = frame;
+  renderEffect(getActiveEffect(), frame, leds, NUM_LEDS);
+
+  if (!forceShow && memcmp(leds, shownLeds, sizeof(leds)) == 0) {
+    return;
+  }
+  memcpy(shownLeds, leds, sizeof(leds));
+  shownLampVersion = lampVersion;
+  localEffectRunning = true;
+  showLeds();
+}
+
 /**
  * Setup function - Initializes system
  * 
- * Initializes serial communication, WiFi connection, and OTA services
+ * Initializes serial communication and logging, WiFi connection, and OTA services
  */
 void setup() {
+  TRACE_START(setupStart);
+  TRACE_START(t0);
   Serial.begin(SERIAL_BAUD_RATE);
   delay(10);
+  setupLog();
+  setupStallMonitor();
+  TRACE_SPAN(TRACE_SERIAL, t0);
 
-  Serial.println("\n\n========================================");
-  Serial.println("  Deckenlampe - Ceiling Lamp Controller");
-  Serial.println("========================================");
-  Serial.printf("Firmware: %s\n", DECKENLAMPE_VERSION);
-  Serial.printf("Build Date: %s %s\n", DECKENLAMPE_BUILD_DATE, DECKENLAMPE_BUILD_TIME);
-  Serial.println("========================================\n");
+  LOG_I(MAIN, "========================================");
+  LOG_I(MAIN, "  Deckenlampe - Ceiling Lamp Controller");
+  LOG_I(MAIN, "========================================");
+  LOG_I(MAIN, "Firmware: %s", DECKENLAMPE_VERSION);
+  LOG_I(MAIN, "Build Date: %s %s", DECKENLAMPE_BUILD_DATE, DECKENLAMPE_BUILD_TIME);
+  LOG_I(MAIN, "========================================");
+  setupSettings();
+  setupPower();
+  setupSequence();
+  setupAudio();
   
-  // Initialize WiFi connection
+  TRACE_START(t1);
    FastLED.addLeds<SK6812, DATA_PIN, GRB>(leds, NUM_LEDS).setRgbw(RgbwDefault());
      FastLED.setBrightness(255);
+  setupLampControl();
+  TRACE_SPAN(TRACE_LED_INIT, t1);
   
+  // Initialize WiFi connection
+  TRACE_START(t2);
   initWiFi();
+  TRACE_SPAN(TRACE_WIFI_INIT, t2);
   
   // Wait for WiFi to be connected before starting OTA
   // WPS might still be in progress, so we check periodically
+  TRACE_START(t3);
   unsigned long startTime = millis();
   while (WiFi.status() != WL_CONNECTED && millis() - startTime < 60000) {
     delay(500);
-    Serial.print(".");
   }
-  Serial.println();
+  TRACE_SPAN(TRACE_WIFI_WAIT, t3);
   
   if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\n--- Initializing OTA Services ---");
+    LOG_I(MAIN, "--- Initializing OTA Services ---");
     
-    // Initialize all OTA update methods
-    setupArduinoOTA();
-    setupWebOTA();
+    // Initialize the OTA update methods built in (Config.h)
+    if constexpr (FEATURE_ARDUINO_OTA) {
+      TRACE_SCOPE(TRACE_ARDUINO_OTA_SETUP);
+      setupArduinoOTA();
+    }
+    if constexpr (FEATURE_WEB_SERVER) {
+      TRACE_SCOPE(TRACE_WEB_SERVER_SETUP);
+      setupWebServer();
+    }
+    { TRACE_SCOPE(TRACE_FLEET_OTA_SETUP); setupFleetOta(); }
+    { TRACE_SCOPE(TRACE_PIXEL_STREAM_SETUP); setupPixelStream(NUM_LEDS); }
+    { TRACE_SCOPE(TRACE_GROUP_SYNC_SETUP); setupGroupSync(); }
+    { TRACE_SCOPE(TRACE_MQTT_SETUP); setupMqtt(); }
     
-    Serial.println("--- All Services Ready ---\n");
+    LOG_I(MAIN, "--- All Services Ready ---");
   } else {
-    Serial.println("WiFi not connected. OTA services not started.");
-    Serial.println("Waiting for WPS pairing...");
+    LOG_I(MAIN, "WiFi not connected. OTA services not started.");
+    if constexpr (FEATURE_WPS) {
+      LOG_I(MAIN, "Waiting for WPS pairing...");
+    }
   }
+  TRACE_SPAN(TRACE_SETUP, setupStart);
 }
 
 /**
  * Main loop function
  * 
- * Handles OTA operations and keeps services running
+ * Handles OTA operations and keeps services running.
+ * A network pixel stream takes over the LEDs while it is active,
+ * otherwise the local effect is rendered.
  */
 void loop() {
-  // Handle OTA updates (ArduinoOTA, Web Server, HTTP checks)
+  uint32_t loopStart = micros();
+  stallIterationBegin(STALL_WATCH_LOOP);
+
+  // Handle OTA updates (ArduinoOTA, Web Server, HTTP checks, fleet OTA)
   if (WiFi.status() == WL_CONNECTED) {
-    handleOTA();
+    if constexpr (FEATURE_ARDUINO_OTA) {
+      handleArduinoOTA();
+    }
+    if constexpr (FEATURE_WEB_SERVER) {
+      handleWebServer();
+    }
+    if constexpr (FEATURE_HTTP_UPDATE) {
+      handleUpdateCheck();
+    }
+  }
+  { STALL_SCOPE(STALL_SUB_FLEET_OTA); handleFleetOta(); }
+
+  { STALL_SCOPE(STALL_SUB_PIXEL_STREAM); handlePixelStream(); }
+  { STALL_SCOPE(STALL_SUB_GROUP_SYNC); handleGroupSync(); }
+  { STALL_SCOPE(STALL_SUB_MQTT); handleMqtt(); }
+  {
+    STALL_SCOPE(STALL_SUB_RENDER);
+    if (pixelStreamActive()) {
+      if (renderInterpolatedFrame(leds)) {
+        showLeds();
+      }
+      localEffectRunning = false;
+    } else {
+      renderLocalEffect();
+    }
   }
-  fillAndShow(CRGB(255,255,255));
-  delay(1000);
-  fillAndShow(CRGB(255,200,200));
-  delay(1000);
+  { STALL_SCOPE(STALL_SUB_SETTINGS); handleSettings(); }
+  { STALL_SCOPE(STALL_SUB_METRICS); handleMetrics(); }
+  handleHeapCheck();
+  handlePower();
+  metricsObserve(METRIC_LOOP_TIME, micros() - loopStart);
+  stallIterationEnd(STALL_WATCH_LOOP);
+  powerIdle();
 }
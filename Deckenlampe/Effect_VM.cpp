@@ -0,0 +1,295 @@
+/**
+ * Effect_VM.cpp - Bytecode interpreter implementation
+ *
+ * The uploaded program lives in RAM only; after a reboot effect "program"
+ * shows colorA until a program is uploaded again.
+ *
+ * Author: icebear74
+ */
+
+#include "Effect_VM.h"
+#include "Audio.h"
+#include "Log.h"
+#include "Metrics.h"
+#include <esp_rom_crc.h>
+
+// Effect VM configuration
+const uint32_t VM_FRAME_STEP_BUDGET = 40000;   // Instructions per frame for all pixels (host cost: BM_VmFrameBudget)
+const uint32_t VM_FRAME_BUDGET_US = 3000;      // Frame time, checked between pixels
+
+static VmProgram active;
+static bool loaded = false;
+static uint32_t consecutiveOverruns = 0;
+
+static uint8_t uploadBuffer[VM_HEADER_LEN + VM_MAX_INSTRUCTIONS * 4] __attribute__((aligned(4)));
+static size_t uploadSize = 0;
+static bool uploadTooLarge = false;
+static const char* lastError = "no program uploaded";
+
+static EffectVmStats stats;
+
+static bool isBranch(uint8_t op) {
+  return op == VM_OP_JMP || op == VM_OP_BLT || op == VM_OP_BGE || op == VM_OP_BEQ || op == VM_OP_BNE;
+}
+
+/**
+ * Verify and pre-decode a program
+ * The program is only changed if all instructions are valid.
+ *
+ * @param words Instruction words
+ * @param length Number of instructions
+ * @param error Receives the reason on failure
+ * @return true if the program can run
+ */
+bool vmVerify(VmProgram& program, const uint32_t* words, uint16_t length, const char** error) {
+  if (length == 0 || length > VM_MAX_INSTRUCTIONS) {
+    *error = "program length out of range";
+    return false;
+  }
+  for (uint16_t pc = 0; pc < length; pc++) {
+    uint8_t op = words[pc] & 0xFF;
+    int32_t imm = (int16_t)(words[pc] >> 16);
+    if (op >= VM_OP_COUNT) {
+      *error = "invalid opcode";
+      return false;
+    }
+    if (isBranch(op) && (imm < 0 || imm > length)) {
+      *error = "branch target out of range";
+      return false;
+    }
+    if ((op == VM_OP_SHL || op == VM_OP_SHR) && (imm < 0 || imm > 31)) {
+      *error = "shift amount out of range";
+      return false;
+    }
+    if (op == VM_OP_AUDIO && (imm < 0 || imm >= AUDIO_FEATURE_COUNT)) {
+      *error = "audio feature out of range";
+      return false;
+    }
+  }
+
+  for (uint16_t pc = 0; pc < length; pc++) {
+    VmInstruction& in = program.code[pc];
+    in.op = words[pc] & 0xFF;
+    in.d = (words[pc] >> 8) & 0x0F;
+    in.a = (words[pc] >> 12) & 0x0F;
+    in.b = (words[pc] >> 16) & 0x0F;
+    in.imm = (int16_t)(words[pc] >> 16);
+  }
+  program.length = length;
+  return true;
+}
+
+static uint8_t outputChannel(int32_t value) {
+  if (value <= 0) {
+    return 0;
+  }
+  return value >= 65535 ? 255 : value >> 8;
+}
+
+/**
+ * Render one frame with a verified program
+ * A frame over budget is cut short; the remaining pixels are black.
+ *
+ * @param elapsedMs Time since the start of the effect
+ * @param steps Receives the number of instructions executed
+ * @return false if the frame exceeded the budget
+ */
+bool vmRunFrame(const VmProgram& program, uint32_t elapsedMs, CRGB* leds, uint16_t numLeds, uint32_t* steps) {
+  int32_t reg[VM_REGISTERS] = {};
+  const VmInstruction* code = program.code;
+  uint32_t budget = VM_FRAME_STEP_BUDGET;
+  uint32_t t0 = micros();
+  uint16_t pixel = 0;
+  uint8_t audio[AUDIO_FEATURE_COUNT];
+  audioFeatureVector(audio);
+
+  reg[VM_REG_COUNT] = numLeds;
+  reg[VM_REG_TIME_MS] = elapsedMs;
+  reg[VM_REG_SECONDS] = (int32_t)((uint64_t)elapsedMs * 65536 / 1000);
+
+  for (; pixel < numLeds; pixel++) {
+    if (micros() - t0 > VM_FRAME_BUDGET_US) {
+      break;
+    }
+    reg[VM_REG_INDEX] = pixel;
+    reg[VM_REG_POSITION] = (int32_t)(((uint32_t)pixel << 16) / numLeds);
+
+    uint16_t pc = 0;
+    while (pc < program.length && budget > 0) {
+      const VmInstruction& in = code[pc++];
+      budget--;
+      int32_t a = reg[in.a];
+      int32_t b = reg[in.b];
+      switch (in.op) {
+        case VM_OP_HALT: pc = program.length; break;
+        case VM_OP_MOV:  reg[in.d] = a; break;
+        case VM_OP_LDI:  reg[in.d] = in.imm; break;
+        case VM_OP_LUI:  reg[in.d] = (int32_t)((uint32_t)in.imm << 16); break;
+        case VM_OP_ORI:  reg[in.d] = a | (uint16_t)in.imm; break;
+        case VM_OP_ADD:  reg[in.d] = (int32_t)((uint32_t)a + (uint32_t)b); break;
+        case VM_OP_SUB:  reg[in.d] = (int32_t)((uint32_t)a - (uint32_t)b); break;
+        case VM_OP_MUL:  reg[in.d] = (int32_t)(((int64_t)a * b) >> 16); break;
+        case VM_OP_DIV:  reg[in.d] = b != 0 ? (int32_t)((int64_t)a * 65536 / b) : 0; break;
+        case VM_OP_ADDI: reg[in.d] = (int32_t)((uint32_t)a + (uint32_t)in.imm); break;
+        case VM_OP_AND:  reg[in.d] = a & b; break;
+        case VM_OP_OR:   reg[in.d] = a | b; break;
+        case VM_OP_XOR:  reg[in.d] = a ^ b; break;
+        case VM_OP_SHL:  reg[in.d] = (int32_t)((uint32_t)a << in.imm); break;
+        case VM_OP_SHR:  reg[in.d] = a >> in.imm; break;
+        case VM_OP_MIN:  reg[in.d] = a < b ? a : b; break;
+        case VM_OP_MAX:  reg[in.d] = a > b ? a : b; break;
+        case VM_OP_ABS:  reg[in.d] = a < 0 ? (int32_t)(0u - (uint32_t)a) : a; break;
+        case VM_OP_FRAC: reg[in.d] = a & 0xFFFF; break;
+        case VM_OP_SIN:  reg[in.d] = sin16((uint16_t)a) * 2; break;
+        case VM_OP_COS:  reg[in.d] = sin16((uint16_t)(a + 16384)) * 2; break;
+        case VM_OP_TRI: {
+          uint32_t f = a & 0xFFFF;
+          reg[in.d] = f < 0x8000 ? f * 2 : (0x10000 - f) * 2;
+          break;
+        }
+        case VM_OP_JMP:  pc = in.imm; break;
+        case VM_OP_BLT:  if (reg[in.d] < a) pc = in.imm; break;
+        case VM_OP_BGE:  if (reg[in.d] >= a) pc = in.imm; break;
+        case VM_OP_BEQ:  if (reg[in.d] == a) pc = in.imm; break;
+        case VM_OP_BNE:  if (reg[in.d] != a) pc = in.imm; break;
+        case VM_OP_AUDIO: reg[in.d] = audio[in.imm] * 257; break;
+      }
+    }
+    if (budget == 0 && pc < program.length) {
+      break;
+    }
+    leds[pixel] = CRGB(outputChannel(reg[VM_REG_RED]), outputChannel(reg[VM_REG_GREEN]),
+                       outputChannel(reg[VM_REG_BLUE]));
+  }
+
+  *steps = VM_FRAME_STEP_BUDGET - budget;
+  if (pixel == numLeds) {
+    return true;
+  }
+  for (; pixel < numLeds; pixel++) {
+    leds[pixel] = CRGB::Black;
+  }
+  return false;
+}
+
+/**
+ * Check if an uploaded program is ready to run
+ */
+bool effectProgramLoaded() {
+  return loaded;
+}
+
+/**
+ * Render a frame of the uploaded program
+ *
+ * @param elapsedMs Time since the start of the effect
+ * @return false if no program is loaded
+ */
+bool renderEffectProgram(uint32_t elapsedMs, CRGB* leds, uint16_t numLeds) {
+  if (!loaded) {
+    return false;
+  }
+  uint32_t t0 = micros();
+  uint32_t steps;
+  bool complete = vmRunFrame(active, elapsedMs, leds, numLeds, &steps);
+
+  stats.frames++;
+  stats.lastSteps = steps;
+  stats.lastFrameUs = micros() - t0;
+  if (steps > stats.maxSteps) {
+    stats.maxSteps = steps;
+  }
+  if (stats.lastFrameUs > stats.maxFrameUs) {
+    stats.maxFrameUs = stats.lastFrameUs;
+  }
+
+  if (complete) {
+    consecutiveOverruns = 0;
+    return true;
+  }
+  stats.overruns++;
+  metricsInc(METRIC_VM_OVERRUNS);
+  if (++consecutiveOverruns >= VM_MAX_OVERRUNS) {
+    LOG_W(VM, "Effect program over budget (%u steps, %u us), unloaded", steps, stats.lastFrameUs);
+    loaded = false;
+    stats.loaded = false;
+    lastError = "unloaded: over frame budget";
+  }
+  return true;
+}
+
+/**
+ * Start receiving a program image
+ */
+void effectProgramUploadBegin() {
+  uploadSize = 0;
+  uploadTooLarge = false;
+}
+
+/**
+ * Receive the next chunk of a program image
+ */
+void effectProgramUploadWrite(const uint8_t* data, size_t len) {
+  if (len > sizeof(uploadBuffer) - uploadSize) {
+    uploadTooLarge = true;
+    return;
+  }
+  memcpy(uploadBuffer + uploadSize, data, len);
+  uploadSize += len;
+}
+
+/**
+ * Verify the received image and replace the running program
+ * The running program is kept if the image is invalid.
+ *
+ * @return true if the new program was loaded
+ */
+bool effectProgramUploadEnd() {
+  uint16_t length = uploadBuffer[6] | (uploadBuffer[7] << 8);
+  uint32_t crc;
+  memcpy(&crc, uploadBuffer + 8, sizeof(crc));
+  const char* error = nullptr;
+
+  if (uploadTooLarge) {
+    error = "program too large";
+  } else if (uploadSize < VM_HEADER_LEN || memcmp(uploadBuffer, VM_MAGIC, 4) != 0 ||
+             uploadBuffer[4] != VM_VERSION) {
+    error = "not an effect program";
+  } else if (uploadSize != VM_HEADER_LEN + (size_t)length * 4) {
+    error = "program size mismatch";
+  } else if (esp_rom_crc32_le(0, uploadBuffer + VM_HEADER_LEN, length * 4) != crc) {
+    error = "program CRC mismatch";
+  } else {
+    // Instruction words start 4-byte aligned in the buffer
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(uploadBuffer + VM_HEADER_LEN);
+    vmVerify(active, words, length, &error);
+  }
+
+  if (error != nullptr) {
+    lastError = error;
+    LOG_W(VM, "Effect program rejected: %s", error);
+    return false;
+  }
+  loaded = true;
+  consecutiveOverruns = 0;
+  memset(&stats, 0, sizeof(stats));
+  stats.loaded = true;
+  stats.instructions = length;
+  lastError = "";
+  LOG_I(VM, "Effect program loaded: %u instructions", length);
+  return true;
+}
+
+/**
+ * Get the reason the last upload was rejected or the program unloaded
+ */
+const char* effectProgramError() {
+  return lastError;
+}
+
+/**
+ * Get interpreter statistics
+ */
+const EffectVmStats& getEffectVmStats() {
+  return stats;
+}
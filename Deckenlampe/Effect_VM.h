@@ -0,0 +1,133 @@
+/**
+ * Effect_VM.h - Bytecode interpreter for user-defined effects
+ *
+ * Effects written in a small assembly language (make-effect.py) are
+ * uploaded over HTTP and run as effect "program" without a reflash. The
+ * program runs once per pixel per frame on 16 signed 32-bit registers;
+ * numbers are Q16.16 fixed point (1.0 = 65536) unless noted.
+ *
+ * Per pixel, before the program starts:
+ *   r0 = pixel index   r1 = pixel count   r2 = time (ms, integer)
+ *   r3 = position along the strip (Q16, 0 .. <1.0)   r4 = time (Q16 seconds)
+ * After the program ends (HALT or last instruction), r5/r6/r7 are the
+ * red/green/blue output (Q16, clamped to 0 .. 1.0). r5-r15 start every
+ * frame at 0 and keep their values from pixel to pixel. "aud" reads the
+ * microphone features of the frame: 0-7 bands (low to high), 8 loudness,
+ * 9 onset, 10 beat pulse.
+ *
+ * Instruction words (little endian uint32):
+ *   register form:  op | d << 8 | a << 12 | b << 16
+ *   immediate form: op | d << 8 | a << 12 | imm16 << 16
+ *
+ * Programs are verified once at upload (opcodes, branch targets, shift
+ * amounts) and pre-decoded, so the per-pixel loop has no checks. Every
+ * frame gets VM_FRAME_STEP_BUDGET instructions and VM_FRAME_BUDGET_US
+ * microseconds; a frame over budget is cut short, and a program that
+ * stays over budget is unloaded, so a runaway loop cannot starve WiFi.
+ *
+ * Upload: POST http://<lamp>/effect (multipart, like /update)
+ *
+ * Author: icebear74
+ */
+
+#ifndef EFFECT_VM_H
+#define EFFECT_VM_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#define VM_MAGIC              "DLVM"
+#define VM_VERSION            1
+#define VM_HEADER_LEN         12    // magic | version | reserved | length (2) | CRC32 of the code (4)
+#define VM_MAX_INSTRUCTIONS   128
+#define VM_REGISTERS          16
+#define VM_MAX_OVERRUNS       10    // Consecutive frames over budget before the program is unloaded
+
+// Register conventions
+#define VM_REG_INDEX          0
+#define VM_REG_COUNT          1
+#define VM_REG_TIME_MS        2
+#define VM_REG_POSITION       3
+#define VM_REG_SECONDS        4
+#define VM_REG_RED            5
+#define VM_REG_GREEN          6
+#define VM_REG_BLUE           7
+
+// Effect VM configuration
+extern const uint32_t VM_FRAME_STEP_BUDGET;
+extern const uint32_t VM_FRAME_BUDGET_US;
+
+enum VmOpcode : uint8_t {
+  VM_OP_HALT = 0x00,   // End of the pixel program
+  VM_OP_MOV,           // d = a
+  VM_OP_LDI,           // d = imm (sign extended)
+  VM_OP_LUI,           // d = imm << 16
+  VM_OP_ORI,           // d = a | (uint16_t)imm
+  VM_OP_ADD,           // d = a + b
+  VM_OP_SUB,           // d = a - b
+  VM_OP_MUL,           // d = a * b (Q16)
+  VM_OP_DIV,           // d = a / b (Q16, 0 if b is 0)
+  VM_OP_ADDI,          // d = a + imm
+  VM_OP_AND,           // d = a & b
+  VM_OP_OR,            // d = a | b
+  VM_OP_XOR,           // d = a ^ b
+  VM_OP_SHL,           // d = a << imm (0-31)
+  VM_OP_SHR,           // d = a >> imm (0-31, arithmetic)
+  VM_OP_MIN,           // d = min(a, b)
+  VM_OP_MAX,           // d = max(a, b)
+  VM_OP_ABS,           // d = |a|
+  VM_OP_FRAC,          // d = fractional part of a
+  VM_OP_SIN,           // d = sin(a turns), -1.0 .. 1.0
+  VM_OP_COS,           // d = cos(a turns)
+  VM_OP_TRI,           // d = triangle wave of a turns, 0 .. 1.0 .. 0
+  VM_OP_JMP,           // pc = imm
+  VM_OP_BLT,           // if d < a: pc = imm
+  VM_OP_BGE,           // if d >= a: pc = imm
+  VM_OP_BEQ,           // if d == a: pc = imm
+  VM_OP_BNE,           // if d != a: pc = imm
+  VM_OP_AUDIO,         // d = audio feature imm (see Audio.h), 0 .. 1.0, 0 without microphone
+  VM_OP_COUNT
+};
+
+// Instruction encoding helpers
+#define VM_R(op, d, a, b)     ((uint32_t)(op) | (d) << 8 | (a) << 12 | (uint32_t)(b) << 16)
+#define VM_I(op, d, a, imm)   ((uint32_t)(op) | (d) << 8 | (a) << 12 | (uint32_t)(uint16_t)(imm) << 16)
+
+// Pre-decoded instruction
+struct VmInstruction {
+  uint8_t op;
+  uint8_t d;
+  uint8_t a;
+  uint8_t b;
+  int32_t imm;
+};
+
+struct VmProgram {
+  VmInstruction code[VM_MAX_INSTRUCTIONS];
+  uint16_t length;
+};
+
+// Interpreter statistics
+struct EffectVmStats {
+  bool loaded;
+  uint16_t instructions;
+  uint32_t frames;              // Frames rendered by the uploaded program
+  uint32_t lastSteps;           // Instructions executed in the last frame
+  uint32_t maxSteps;
+  uint32_t lastFrameUs;
+  uint32_t maxFrameUs;
+  uint32_t overruns;            // Frames cut short by the budget
+};
+
+// Function declarations
+bool vmVerify(VmProgram& program, const uint32_t* words, uint16_t length, const char** error);
+bool vmRunFrame(const VmProgram& program, uint32_t elapsedMs, CRGB* leds, uint16_t numLeds, uint32_t* steps);
+bool effectProgramLoaded();
+bool renderEffectProgram(uint32_t elapsedMs, CRGB* leds, uint16_t numLeds);
+void effectProgramUploadBegin();
+void effectProgramUploadWrite(const uint8_t* data, size_t len);
+bool effectProgramUploadEnd();
+const char* effectProgramError();
+const EffectVmStats& getEffectVmStats();
+
+#endif // EFFECT_VM_H
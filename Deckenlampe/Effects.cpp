@@ -0,0 +1,77 @@
+/**
+ * Effects.cpp - Local light effects implementation
+ *
+ * Author: icebear74
+ */
+
+#include "Effects.h"
+#include "Audio.h"
+#include "Effect_VM.h"
+#include "Sequence.h"
+
+// Effect configuration
+const unsigned long EFFECT_FRAME_INTERVAL_MS = 10;  // Effect timeline resolution (100 FPS)
+
+// Default effect: toggle between white and pink every second
+const EffectParams DEFAULT_EFFECT = {
+  EFFECT_TOGGLE, 0, 1000,
+  { 255, 255, 255 },
+  { 255, 200, 200 }
+};
+
+/**
+ * Render one frame of an effect
+ *
+ * @param params Effect parameters
+ * @param frame Frame index on the effect timeline (EFFECT_FRAME_INTERVAL_MS per frame)
+ * @param leds Output pixel buffer
+ * @param numLeds Number of pixels
+ */
+void renderEffect(const EffectParams& params, uint32_t frame, CRGB* leds, uint16_t numLeds) {
+  CRGB a(params.colorA[0], params.colorA[1], params.colorA[2]);
+  CRGB b(params.colorB[0], params.colorB[1], params.colorB[2]);
+  uint32_t period = params.periodMs ? params.periodMs : 1;
+  uint32_t elapsedMs = frame * EFFECT_FRAME_INTERVAL_MS;
+  CRGB color;
+
+  if (params.type == EFFECT_SEQUENCE && renderSequence(elapsedMs, leds, numLeds)) {
+    return;
+  }
+  if (params.type == EFFECT_PROGRAM && renderEffectProgram(elapsedMs, leds, numLeds)) {
+    return;
+  }
+  if (params.type == EFFECT_AUDIO && renderAudioEffect(a, b, leds, numLeds)) {
+    return;
+  }
+
+  switch (params.type) {
+    case EFFECT_TOGGLE:
+      color = ((elapsedMs / period) & 1) ? b : a;
+      break;
+
+    case EFFECT_CROSSFADE: {
+      uint32_t phase = elapsedMs % (2 * period);
+      uint32_t ramp = phase < period ? phase : 2 * period - phase;
+      color = blend(a, b, (fract8)((ramp * 255) / period));
+      break;
+    }
+
+    case EFFECT_SOLID:
+    default:
+      color = a;
+      break;
+  }
+
+  for (uint16_t i = 0; i < numLeds; ++i) {
+    leds[i] = color;
+  }
+}
+
+/**
+ * Compare two effect parameter sets
+ *
+ * @return true if both describe the same effect
+ */
+bool effectParamsEqual(const EffectParams& a, const EffectParams& b) {
+  return memcmp(&a, &b, sizeof(EffectParams)) == 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * Effects.h - Local light effects for CeilingLamp
+ *
+ * Effects are pure functions of their parameters and a frame index, so
+ * several lamps rendering the same frame index show the same output.
+ * The frame index is derived from the effect timeline (see Group_Sync).
+ * Effect "audio" also depends on the room sound, which grouped lamps in
+ * the same room hear alike.
+ *
+ * Author: icebear74
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// Effect types
+enum EffectType : uint8_t {
+  EFFECT_TOGGLE = 0,     // Hard switch between colorA and colorB every period
+  EFFECT_CROSSFADE = 1,  // Smooth fade colorA -> colorB -> colorA, one period per direction
+  EFFECT_SOLID = 2,      // Static colorA
+  EFFECT_SEQUENCE = 3,   // Stored light sequence (see Sequence), colorA if none
+  EFFECT_PROGRAM = 4,    // Uploaded effect program (see Effect_VM), colorA if none
+  EFFECT_AUDIO = 5       // Band spectrum colorA -> colorB, beat flashes (see Audio), colorA if no microphone
+};
+
+// Effect parameters (packed, sent as-is in group sync beacons)
+struct __attribute__((packed)) EffectParams {
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t periodMs;
+  uint8_t colorA[3];
+  uint8_t colorB[3];
+};
+
+// Effect configuration
+extern const unsigned long EFFECT_FRAME_INTERVAL_MS;
+extern const EffectParams DEFAULT_EFFECT;
+
+// Function declarations
+void renderEffect(const EffectParams& params, uint32_t frame, CRGB* leds, uint16_t numLeds);
+bool effectParamsEqual(const EffectParams& a, const EffectParams& b);
+
+#endif // EFFECTS_H
@@ -0,0 +1,801 @@
+/**
+ * Fleet_OTA.cpp - Multicast firmware distribution implementation
+ *
+ * Packets are handled in the AsyncUDP task: receivers write DATA blocks
+ * straight into flash with esp_ota_write_with_offset(), the sender merges
+ * NACK bitmaps. esp_ota_write_with_offset() does not erase, so a receiver
+ * erase task clears the OTA partition sector by sector from the start;
+ * blocks beyond the erased range are dropped and requested again by NACK.
+ * Hashing and sending run in the main loop. The block bitmap and counters
+ * are shared and guarded by fleetMux.
+ *
+ * Author: icebear74
+ */
+
+#include "Fleet_OTA.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "OTA_Manifest.h"
+#include "OTA_Writer.h"
+#include "Power.h"
+#include "Static_Alloc.h"
+#include "Trace.h"
+#include "Version.h"
+#include <AsyncUDP.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_image_format.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mbedtls/sha256.h>
+
+// Fleet OTA configuration
+const unsigned long FLEET_OTA_BLOCK_INTERVAL_US = 10000;  // 100 KB/s, multicast goes out at low WiFi rates
+const unsigned long FLEET_OTA_ANNOUNCE_MS = 5000;         // Receivers erase ahead of the first block meanwhile
+const unsigned long FLEET_OTA_NACK_WINDOW_MS = 500;       // Sender waits this long for NACKs after END
+const unsigned long FLEET_OTA_NACK_JITTER_MS = 200;       // Receivers spread their NACKs over this time
+const unsigned long FLEET_OTA_RECEIVE_TIMEOUT_MS = 30000; // Receiver gives up after this silence
+const uint8_t FLEET_OTA_MAX_ROUNDS = 20;
+
+#define FLEET_OTA_ANNOUNCE_INTERVAL_MS 250
+#define FLEET_OTA_BURST                8     // Max blocks per handleFleetOta() call
+#define FLEET_OTA_IDLE_ROUNDS          2     // END rounds without NACK before the sender stops
+#define FLEET_OTA_RESTART_DELAY_MS     2000  // Time for the DONE packet before restarting
+#define FLEET_OTA_SECTOR_SIZE          4096  // Flash erase unit
+#define FLEET_OTA_ERASE_TASK_STACK     3072
+#define FLEET_OTA_ERASE_TASK_PRIORITY  1     // Below the AsyncUDP task, like the main loop
+
+enum SenderPhase : uint8_t {
+  PHASE_ANNOUNCE,
+  PHASE_DATA,
+  PHASE_COLLECT
+};
+
+static AsyncUDP fleetUdp;
+static portMUX_TYPE fleetMux = portMUX_INITIALIZER_UNLOCKED;
+static bool udpStarted = false;
+
+// Session (shared with the AsyncUDP task)
+static volatile FleetOtaState state = FLEET_OTA_IDLE;
+static FleetOtaAnnounce session = {};
+static uint32_t blockCount = 0;
+static uint8_t bitmap[FLEET_OTA_BITMAP_BYTES];  // Sender: blocks to send, receiver: blocks missing
+static uint32_t missingBlocks = 0;
+static unsigned long sessionStarted = 0;
+static unsigned long lastPacket = 0;
+
+// Sender
+static const esp_partition_t* sourcePartition = nullptr;
+static SenderPhase phase = PHASE_ANNOUNCE;
+static uint32_t nextBlock = 0;
+static unsigned long phaseStarted = 0;
+static unsigned long lastAnnounce = 0;
+static unsigned long lastBlockUs = 0;
+static uint8_t idleRounds = 0;
+static uint32_t nacksThisRound = 0;
+static uint32_t receiverIps[FLEET_OTA_MAX_RECEIVERS];
+static uint8_t receiverCount = 0;
+
+// Receiver
+static volatile bool startRequested = false;
+static FleetOtaAnnounce pendingAnnounce = {};
+static IPAddress senderIp;
+static uint16_t senderPort = 0;
+static const esp_partition_t* targetPartition = nullptr;
+static esp_ota_handle_t otaHandle = 0;
+static volatile bool receiverReady = false;
+static bool nackPending = false;
+static unsigned long nackDue = 0;
+static bool imageVerified = false;
+static unsigned long restartAt = 0;
+static uint32_t rejectedSession = 0;
+
+// Receiver erase task
+static TaskHandle_t eraseTask = nullptr;
+static volatile uint32_t eraseTarget = 0;      // Image and trailer, rounded up to sectors
+static volatile uint32_t erasedEnd = 0;        // Blocks below this offset can be written
+static volatile uint32_t eraseGeneration = 0;  // Bumped per session, stops a stale erase
+static volatile bool eraseFailed = false;
+static volatile bool eraseRunning = false;    // Erase task inside its sector loop
+static bool partitionHeld = false;            // Receiver owns the OTA partition
+
+// Main loop scratch buffer (outgoing packets, flash reads)
+static uint8_t packetBuffer[sizeof(FleetOtaData) + FLEET_OTA_BLOCK_SIZE];
+
+static FleetOtaStats stats = {};
+
+static inline bool testBit(uint32_t block) {
+  return bitmap[block >> 3] & (1 << (block & 7));
+}
+
+static inline void clearBit(uint32_t block) {
+  bitmap[block >> 3] &= ~(1 << (block & 7));
+}
+
+static size_t bitmapBytes() {
+  return (blockCount + 7) / 8;
+}
+
+/**
+ * Set the bits of all blocks of the session, clear the rest
+ */
+static void fillBitmap() {
+  memset(bitmap, 0, sizeof(bitmap));
+  memset(bitmap, 0xFF, blockCount / 8);
+  if (blockCount % 8) {
+    bitmap[blockCount / 8] = (1 << (blockCount % 8)) - 1;
+  }
+}
+
+static void fillHeader(FleetOtaHeader& header, uint8_t type) {
+  header.magic = FLEET_OTA_MAGIC;
+  header.version = FLEET_OTA_VERSION;
+  header.type = type;
+  header.reserved = 0;
+  header.session = session.header.session;
+}
+
+/**
+ * Hash the first len bytes of a partition
+ */
+static bool hashPartition(const esp_partition_t* partition, uint32_t len, uint8_t* hash) {
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  bool ok = true;
+  for (uint32_t offset = 0; offset < len && ok; offset += FLEET_OTA_BLOCK_SIZE) {
+    size_t chunk = min((uint32_t)FLEET_OTA_BLOCK_SIZE, len - offset);
+    ok = esp_partition_read(partition, offset, packetBuffer, chunk) == ESP_OK;
+    mbedtls_sha256_update(&sha, packetBuffer, chunk);
+  }
+  mbedtls_sha256_finish(&sha, hash);
+  mbedtls_sha256_free(&sha);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Sender
+// ---------------------------------------------------------------------------
+
+static void sendAnnounce(uint8_t type) {
+  FleetOtaAnnounce announce = session;
+  fillHeader(announce.header, type);
+  fleetUdp.writeTo(reinterpret_cast<const uint8_t*>(&announce), sizeof(announce),
+                   FLEET_OTA_MULTICAST_IP, FLEET_OTA_PORT);
+}
+
+static void startRound() {
+  stats.rounds++;
+  nextBlock = 0;
+  lastBlockUs = micros();
+  phase = PHASE_DATA;
+}
+
+/**
+ * Send the next block still marked in the bitmap
+ *
+ * @return false at the end of the round
+ */
+static bool sendNextBlock() {
+  portENTER_CRITICAL(&fleetMux);
+  while (nextBlock < blockCount && !testBit(nextBlock)) {
+    nextBlock++;
+  }
+  uint32_t block = nextBlock;
+  if (block < blockCount) {
+    clearBit(block);
+  }
+  portEXIT_CRITICAL(&fleetMux);
+
+  if (block >= blockCount) {
+    return false;
+  }
+  nextBlock++;
+
+  uint32_t offset = block * FLEET_OTA_BLOCK_SIZE;
+  size_t len = min((uint32_t)FLEET_OTA_BLOCK_SIZE, session.imageSize - offset);
+  FleetOtaData* data = reinterpret_cast<FleetOtaData*>(packetBuffer);
+  fillHeader(data->header, FLEET_OTA_DATA);
+  data->block = block;
+  if (esp_partition_read(sourcePartition, offset, packetBuffer + sizeof(FleetOtaData), len) != ESP_OK) {
+    return true;  // Skipped, requested again by NACK
+  }
+  fleetUdp.writeTo(packetBuffer, sizeof(FleetOtaData) + len, FLEET_OTA_MULTICAST_IP, FLEET_OTA_PORT);
+
+  stats.blocksSent++;
+  if (stats.rounds > 1) {
+    stats.blocksResent++;
+  }
+  return true;
+}
+
+static void finishSender() {
+  stats.durationMs = millis() - sessionStarted;
+  state = FLEET_OTA_IDLE;
+
+  uint32_t airtime = blockCount ? stats.blocksSent * 100 / blockCount : 0;
+  LOG_I(FLEET, "Fleet OTA: session %08X finished after %u rounds in %u ms",
+               session.header.session, stats.rounds, stats.durationMs);
+  LOG_I(FLEET, "Fleet OTA: %u blocks sent (%u resent, airtime %u.%02ux image), %u NACKs, %u receivers verified, %u failed",
+               stats.blocksSent, stats.blocksResent, airtime / 100, airtime % 100,
+               stats.nacksReceived, stats.receiversDone, stats.receiversFailed);
+}
+
+static void handleSender() {
+  unsigned long now = millis();
+
+  switch (phase) {
+    case PHASE_ANNOUNCE:
+      if (now - lastAnnounce >= FLEET_OTA_ANNOUNCE_INTERVAL_MS) {
+        sendAnnounce(FLEET_OTA_ANNOUNCE);
+        lastAnnounce = now;
+      }
+      if (now - phaseStarted >= FLEET_OTA_ANNOUNCE_MS) {
+        startRound();
+      }
+      break;
+
+    case PHASE_DATA:
+      // Paced sending; after a slow loop iteration at most one burst is caught up
+      if (micros() - lastBlockUs > FLEET_OTA_BURST * FLEET_OTA_BLOCK_INTERVAL_US) {
+        lastBlockUs = micros() - FLEET_OTA_BURST * FLEET_OTA_BLOCK_INTERVAL_US;
+      }
+      while (micros() - lastBlockUs >= FLEET_OTA_BLOCK_INTERVAL_US) {
+        lastBlockUs += FLEET_OTA_BLOCK_INTERVAL_US;
+        if (!sendNextBlock()) {
+          portENTER_CRITICAL(&fleetMux);
+          nacksThisRound = 0;
+          portEXIT_CRITICAL(&fleetMux);
+          sendAnnounce(FLEET_OTA_END);
+          phase = PHASE_COLLECT;
+          phaseStarted = now;
+          break;
+        }
+      }
+      break;
+
+    case PHASE_COLLECT: {
+      if (now - phaseStarted < FLEET_OTA_NACK_WINDOW_MS) {
+        break;
+      }
+      portENTER_CRITICAL(&fleetMux);
+      uint32_t nacks = nacksThisRound;
+      portEXIT_CRITICAL(&fleetMux);
+
+      if (nacks == 0) {
+        // Ask again: a receiver may have missed the END packet
+        if (++idleRounds >= FLEET_OTA_IDLE_ROUNDS) {
+          finishSender();
+        } else {
+          portENTER_CRITICAL(&fleetMux);
+          nacksThisRound = 0;
+          portEXIT_CRITICAL(&fleetMux);
+          sendAnnounce(FLEET_OTA_END);
+          phaseStarted = now;
+        }
+      } else if (stats.rounds >= FLEET_OTA_MAX_ROUNDS) {
+        LOG_I(FLEET, "Fleet OTA: round limit reached, receivers still missing blocks");
+        finishSender();
+      } else {
+        idleRounds = 0;
+        startRound();
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * Start multicasting the running firmware to the fleet
+ *
+ * The signature stored behind the image by OTA_Verify is sent along, so
+ * lamps with OTA_PUBLIC_KEY_PEM configured accept the image (lamps
+ * without a key only join if built with FLEET_OTA_ALLOW_UNSIGNED).
+ *
+ * @return false if a session is running or the running image is unusable
+ */
+bool startFleetOtaSender() {
+  if (!udpStarted || state != FLEET_OTA_IDLE || startRequested) {
+    return false;
+  }
+
+  sourcePartition = esp_ota_get_running_partition();
+  esp_partition_pos_t pos = { sourcePartition->address, sourcePartition->size };
+  esp_image_metadata_t metadata = {};
+  if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &metadata) != ESP_OK) {
+    LOG_W(FLEET, "Fleet OTA: running image cannot be read");
+    return false;
+  }
+  uint32_t imageSize = metadata.image_len;
+  if (imageSize > FLEET_OTA_MAX_BLOCKS * FLEET_OTA_BLOCK_SIZE) {
+    LOG_W(FLEET, "Fleet OTA: image too large");
+    return false;
+  }
+
+  FleetOtaAnnounce announce = {};
+  announce.header.session = esp_random();
+  announce.imageSize = imageSize;
+  announce.blockSize = FLEET_OTA_BLOCK_SIZE;
+  strlcpy(announce.firmwareVersion, DECKENLAMPE_VERSION, sizeof(announce.firmwareVersion));
+  if (!hashPartition(sourcePartition, imageSize, announce.sha256)) {
+    LOG_W(FLEET, "Fleet OTA: running image cannot be read");
+    return false;
+  }
+
+  uint8_t trailer[OTA_SIGNATURE_TRAILER_LEN];
+  if (esp_partition_read(sourcePartition, imageSize, trailer, sizeof(trailer)) == ESP_OK &&
+      memcmp(trailer, OTA_SIGNATURE_MAGIC, 4) == 0) {
+    announce.sigLen = trailer[4] | (trailer[5] << 8);
+    memcpy(announce.signature, trailer + 8, OTA_SIGNATURE_MAX_LEN);
+  } else {
+    LOG_I(FLEET, "Fleet OTA: running image is unsigned, only lamps built with FLEET_OTA_ALLOW_UNSIGNED accept it");
+  }
+
+  portENTER_CRITICAL(&fleetMux);
+  session = announce;
+  blockCount = (imageSize + FLEET_OTA_BLOCK_SIZE - 1) / FLEET_OTA_BLOCK_SIZE;
+  fillBitmap();
+  nacksThisRound = 0;
+  receiverCount = 0;
+  stats = {};
+  state = FLEET_OTA_SENDING;
+  portEXIT_CRITICAL(&fleetMux);
+
+  sessionStarted = millis();
+  phase = PHASE_ANNOUNCE;
+  phaseStarted = sessionStarted;
+  lastAnnounce = 0;
+  idleRounds = 0;
+
+  LOG_I(FLEET, "Fleet OTA: sending %s (%u bytes, %u blocks) as session %08X",
+               DECKENLAMPE_VERSION, imageSize, blockCount, announce.header.session);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Receiver
+// ---------------------------------------------------------------------------
+
+/**
+ * Erase task: clear the OTA partition sector by sector ahead of the blocks
+ */
+static void eraseTaskLoop(void* parameter) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    eraseRunning = true;
+    uint32_t generation = eraseGeneration;
+    while (receiverReady && generation == eraseGeneration && erasedEnd < eraseTarget) {
+      uint32_t offset = erasedEnd;
+      if (esp_partition_erase_range(targetPartition, offset, FLEET_OTA_SECTOR_SIZE) != ESP_OK) {
+        eraseFailed = true;
+        break;
+      }
+      portENTER_CRITICAL(&fleetMux);
+      if (generation == eraseGeneration) {
+        erasedEnd = offset + FLEET_OTA_SECTOR_SIZE;
+      }
+      portEXIT_CRITICAL(&fleetMux);
+    }
+    eraseRunning = false;
+  }
+}
+
+static void sendDone(bool ok) {
+  FleetOtaDone done;
+  fillHeader(done.header, FLEET_OTA_DONE);
+  done.ok = ok;
+  fleetUdp.writeTo(reinterpret_cast<const uint8_t*>(&done), sizeof(done), senderIp, senderPort);
+}
+
+static void sendNack() {
+  FleetOtaNack* nack = reinterpret_cast<FleetOtaNack*>(packetBuffer);
+  fillHeader(nack->header, FLEET_OTA_NACK);
+  size_t len = bitmapBytes();
+
+  portENTER_CRITICAL(&fleetMux);
+  nack->missing = missingBlocks;
+  memcpy(packetBuffer + sizeof(FleetOtaNack), bitmap, len);
+  portEXIT_CRITICAL(&fleetMux);
+
+  fleetUdp.writeTo(packetBuffer, sizeof(FleetOtaNack) + len, senderIp, senderPort);
+  stats.nacksSent++;
+}
+
+static void endReceive(const char* reason) {
+  receiverReady = false;
+  rejectedSession = session.header.session;
+  state = FLEET_OTA_IDLE;
+  LOG_I(FLEET, "Fleet OTA: session %08X abandoned: %s", session.header.session, reason);
+}
+
+/**
+ * Join an announced session: start the erase task and accept blocks as
+ * their sectors are erased
+ */
+static void beginReceive() {
+  FleetOtaAnnounce announce;
+  portENTER_CRITICAL(&fleetMux);
+  announce = pendingAnnounce;
+  portEXIT_CRITICAL(&fleetMux);
+
+  // Anyone on the LAN can send to the group: only signed images, unless the
+  // build opts out
+  if (OTA_PUBLIC_KEY_PEM[0] == '\0' && !FLEET_OTA_ALLOW_UNSIGNED) {
+    rejectedSession = announce.header.session;
+    startRequested = false;
+    LOG_W(FLEET, "Fleet OTA: ignoring session %08X, no OTA_PUBLIC_KEY_PEM configured "
+                 "(build with FLEET_OTA_ALLOW_UNSIGNED=1 to accept unsigned images)", announce.header.session);
+    return;
+  }
+  if (OTA_PUBLIC_KEY_PEM[0] != '\0' && announce.sigLen == 0) {
+    rejectedSession = announce.header.session;
+    startRequested = false;
+    LOG_W(FLEET, "Fleet OTA: ignoring session %08X, image is unsigned", announce.header.session);
+    return;
+  }
+
+  targetPartition = esp_ota_get_next_update_partition(nullptr);
+  if (targetPartition == nullptr ||
+      announce.imageSize + OTA_SIGNATURE_TRAILER_LEN > targetPartition->size) {
+    rejectedSession = announce.header.session;
+    startRequested = false;
+    LOG_W(FLEET, "Fleet OTA: image does not fit the OTA partition");
+    return;
+  }
+  // A web upload or HTTP update is writing the same partition: join a
+  // later announce of this session once it is done
+  if (!otaPartitionAcquire(OTA_OWNER_FLEET)) {
+    startRequested = false;
+    LOG_W(FLEET, "Fleet OTA: OTA partition busy, not joining session %08X", announce.header.session);
+    return;
+  }
+  partitionHeld = true;
+
+  LOG_I(FLEET, "Fleet OTA: joining session %08X, firmware %s (%u bytes) from %s",
+               announce.header.session, announce.firmwareVersion, announce.imageSize,
+               ipString(senderIp).c_str());
+  // No erase here (seconds for a full image); the erase task clears the
+  // partition while the blocks arrive
+  esp_err_t err = esp_ota_begin(targetPartition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle);
+  if (err != ESP_OK) {
+    rejectedSession = announce.header.session;
+    startRequested = false;
+    LOG_E(FLEET, "Fleet OTA: cannot start update: %s", esp_err_to_name(err));
+    otaPartitionRelease(OTA_OWNER_FLEET);
+    partitionHeld = false;
+    return;
+  }
+
+  portENTER_CRITICAL(&fleetMux);
+  session = announce;
+  blockCount = (announce.imageSize + FLEET_OTA_BLOCK_SIZE - 1) / FLEET_OTA_BLOCK_SIZE;
+  fillBitmap();
+  missingBlocks = blockCount;
+  stats = {};
+  lastPacket = millis();
+  nackPending = false;
+  imageVerified = false;
+  eraseGeneration++;
+  eraseTarget = (announce.imageSize + OTA_SIGNATURE_TRAILER_LEN + FLEET_OTA_SECTOR_SIZE - 1) &
+                ~(uint32_t)(FLEET_OTA_SECTOR_SIZE - 1);
+  erasedEnd = 0;
+  eraseFailed = false;
+  state = FLEET_OTA_RECEIVING;
+  receiverReady = true;
+  startRequested = false;
+  portEXIT_CRITICAL(&fleetMux);
+  sessionStarted = millis();
+  xTaskNotifyGive(eraseTask);
+}
+
+/**
+ * All blocks are in flash: check hash and signature, activate the image
+ */
+static void finishReceive() {
+  TRACE_SCOPE(TRACE_FLEET_VERIFY);
+  receiverReady = false;
+  stats.durationMs = millis() - sessionStarted;
+
+  uint8_t hash[32];
+  bool ok = hashPartition(targetPartition, session.imageSize, hash) &&
+            memcmp(hash, session.sha256, sizeof(hash)) == 0;
+  if (!ok) {
+    LOG_W(FLEET, "Fleet OTA: image hash mismatch");
+  }
+  if (ok && OTA_PUBLIC_KEY_PEM[0] != '\0') {
+    ok = otaVerifySignature(hash, session.signature, session.sigLen);
+  }
+
+  // Keep the signature behind the image, like OTA_Verify
+  if (ok && session.sigLen > 0) {
+    uint8_t trailer[OTA_SIGNATURE_TRAILER_LEN] = {};
+    memcpy(trailer, OTA_SIGNATURE_MAGIC, 4);
+    trailer[4] = session.sigLen & 0xFF;
+    trailer[5] = session.sigLen >> 8;
+    memcpy(trailer + 8, session.signature, OTA_SIGNATURE_MAX_LEN);
+    ok = esp_ota_write_with_offset(otaHandle, trailer, sizeof(trailer), session.imageSize) == ESP_OK;
+  }
+
+  esp_err_t err = ESP_OK;
+  if (ok) {
+    err = esp_ota_end(otaHandle);  // Validates the image
+    if (err == ESP_OK) {
+      err = esp_ota_set_boot_partition(targetPartition);
+    }
+  } else {
+    esp_ota_abort(otaHandle);
+  }
+
+  if (!ok || err != ESP_OK) {
+    if (err != ESP_OK) {
+      LOG_E(FLEET, "Fleet OTA: image rejected: %s", esp_err_to_name(err));
+    }
+    sendDone(false);
+    endReceive("verification failed");
+    return;
+  }
+
+  if (stats.durationMs > 0) {
+    metricsSet(METRIC_OTA_THROUGHPUT, (uint64_t)session.imageSize * 1000 / stats.durationMs);
+  }
+  LOG_I(FLEET, "Fleet OTA: image verified, %u blocks received (%u duplicates, %u ahead of the erase), "
+               "%u NACKs sent, %u ms", stats.blocksReceived, stats.duplicateBlocks, stats.blocksBeforeErase,
+               stats.nacksSent, stats.durationMs);
+  LOG_I(FLEET, "Fleet OTA: rebooting into new firmware...");
+  sendDone(true);
+  imageVerified = true;
+  restartAt = millis() + FLEET_OTA_RESTART_DELAY_MS;
+}
+
+static void handleReceiver() {
+  unsigned long now = millis();
+
+  portENTER_CRITICAL(&fleetMux);
+  bool nackNow = nackPending && (long)(now - nackDue) >= 0;
+  if (nackNow) {
+    nackPending = false;
+  }
+  uint32_t missing = missingBlocks;
+  unsigned long silence = now - lastPacket;
+  bool erased = erasedEnd >= eraseTarget;  // Includes the trailer
+  portEXIT_CRITICAL(&fleetMux);
+
+  if (imageVerified) {
+    if (nackNow) {
+      sendDone(true);
+    }
+    if ((long)(now - restartAt) >= 0) {
+      ESP.restart();
+    }
+  } else if (eraseFailed) {
+    esp_ota_abort(otaHandle);
+    endReceive("partition erase failed");
+  } else if (missing == 0 && erased) {
+    finishReceive();
+  } else if (silence > FLEET_OTA_RECEIVE_TIMEOUT_MS) {
+    esp_ota_abort(otaHandle);
+    endReceive("sender went silent");
+  } else if (nackNow) {
+    sendNack();
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Packet handling (AsyncUDP task)
+// ---------------------------------------------------------------------------
+
+static void handleAnnounce(AsyncUDPPacket& packet, bool isEnd) {
+  if (packet.length() < sizeof(FleetOtaAnnounce)) {
+    return;
+  }
+  const FleetOtaAnnounce* announce = reinterpret_cast<const FleetOtaAnnounce*>(packet.data());
+
+  if (state == FLEET_OTA_RECEIVING) {
+    portENTER_CRITICAL(&fleetMux);
+    if (announce->header.session == session.header.session) {
+      lastPacket = millis();
+      if (isEnd && !nackPending) {
+        nackPending = true;
+        nackDue = millis() + random(FLEET_OTA_NACK_JITTER_MS + 1);
+      }
+    }
+    portEXIT_CRITICAL(&fleetMux);
+    return;
+  }
+
+  if (state != FLEET_OTA_IDLE || startRequested || eraseTask == nullptr ||
+      otaPartitionOwner() != OTA_OWNER_NONE || announce->header.session == rejectedSession ||
+      announce->blockSize != FLEET_OTA_BLOCK_SIZE || announce->imageSize == 0 ||
+      announce->imageSize > FLEET_OTA_MAX_BLOCKS * FLEET_OTA_BLOCK_SIZE ||
+      announce->sigLen > OTA_SIGNATURE_MAX_LEN) {
+    return;
+  }
+
+  char version[sizeof(announce->firmwareVersion) + 1];
+  memcpy(version, announce->firmwareVersion, sizeof(announce->firmwareVersion));
+  version[sizeof(announce->firmwareVersion)] = '\0';
+  if (compareVersions(version, DECKENLAMPE_VERSION) <= 0) {
+    return;
+  }
+
+  IPAddress ip = packet.remoteIP();
+  portENTER_CRITICAL(&fleetMux);
+  pendingAnnounce = *announce;
+  senderIp = ip;
+  senderPort = packet.remotePort();
+  startRequested = true;
+  portEXIT_CRITICAL(&fleetMux);
+}
+
+static void handleData(const uint8_t* data, size_t len) {
+  if (state != FLEET_OTA_RECEIVING || !receiverReady || len < sizeof(FleetOtaData)) {
+    return;
+  }
+  const FleetOtaData* header = reinterpret_cast<const FleetOtaData*>(data);
+  uint32_t block = header->block;
+  if (header->header.session != session.header.session || block >= blockCount) {
+    return;
+  }
+  uint32_t offset = block * FLEET_OTA_BLOCK_SIZE;
+  size_t expected = min((uint32_t)FLEET_OTA_BLOCK_SIZE, session.imageSize - offset);
+  if (len - sizeof(FleetOtaData) != expected) {
+    return;
+  }
+
+  portENTER_CRITICAL(&fleetMux);
+  lastPacket = millis();
+  bool missing = testBit(block);
+  bool erased = offset + expected <= erasedEnd;
+  if (!missing) {
+    stats.duplicateBlocks++;
+  } else if (!erased) {
+    stats.blocksBeforeErase++;
+  }
+  portEXIT_CRITICAL(&fleetMux);
+  if (!missing || !erased) {
+    return;  // A block ahead of the erase stays missing, requested again by NACK
+  }
+
+  if (esp_ota_write_with_offset(otaHandle, data + sizeof(FleetOtaData), expected, offset) != ESP_OK) {
+    return;  // Stays missing, requested again by NACK
+  }
+
+  portENTER_CRITICAL(&fleetMux);
+  if (testBit(block)) {
+    clearBit(block);
+    missingBlocks--;
+    stats.blocksReceived++;
+  }
+  portEXIT_CRITICAL(&fleetMux);
+  metricsInc(METRIC_OTA_BYTES, expected);
+}
+
+static void handleNack(const uint8_t* data, size_t len) {
+  if (state != FLEET_OTA_SENDING || len < sizeof(FleetOtaNack)) {
+    return;
+  }
+  const FleetOtaNack* nack = reinterpret_cast<const FleetOtaNack*>(data);
+  if (nack->header.session != session.header.session) {
+    return;
+  }
+  size_t bytes = min(len - sizeof(FleetOtaNack), bitmapBytes());
+
+  portENTER_CRITICAL(&fleetMux);
+  for (size_t i = 0; i < bytes; i++) {
+    bitmap[i] |= data[sizeof(FleetOtaNack) + i];
+  }
+  nacksThisRound++;
+  stats.nacksReceived++;
+  portEXIT_CRITICAL(&fleetMux);
+}
+
+static void handleDone(const uint8_t* data, size_t len, uint32_t ip) {
+  if (state != FLEET_OTA_SENDING || len < sizeof(FleetOtaDone)) {
+    return;
+  }
+  const FleetOtaDone* done = reinterpret_cast<const FleetOtaDone*>(data);
+  if (done->header.session != session.header.session) {
+    return;
+  }
+
+  // Receivers repeat DONE on every END, count each one once
+  portENTER_CRITICAL(&fleetMux);
+  bool known = false;
+  for (uint8_t i = 0; i < receiverCount; i++) {
+    known |= receiverIps[i] == ip;
+  }
+  if (!known && receiverCount < FLEET_OTA_MAX_RECEIVERS) {
+    receiverIps[receiverCount++] = ip;
+    if (done->ok) {
+      stats.receiversDone++;
+    } else {
+      stats.receiversFailed++;
+    }
+  }
+  portEXIT_CRITICAL(&fleetMux);
+}
+
+static void handlePacket(AsyncUDPPacket& packet) {
+  const uint8_t* data = packet.data();
+  size_t len = packet.length();
+  if (len < sizeof(FleetOtaHeader)) {
+    return;
+  }
+  const FleetOtaHeader* header = reinterpret_cast<const FleetOtaHeader*>(data);
+  if (header->magic != FLEET_OTA_MAGIC || header->version != FLEET_OTA_VERSION) {
+    return;
+  }
+
+  switch (header->type) {
+    case FLEET_OTA_ANNOUNCE:
+    case FLEET_OTA_END:
+      if (state != FLEET_OTA_SENDING) {
+        handleAnnounce(packet, header->type == FLEET_OTA_END);
+      }
+      break;
+    case FLEET_OTA_DATA:
+      handleData(data, len);
+      break;
+    case FLEET_OTA_NACK:
+      handleNack(data, len);
+      break;
+    case FLEET_OTA_DONE:
+      handleDone(data, len, (uint32_t)packet.remoteIP());
+      break;
+  }
+}
+
+/**
+ * Join the fleet OTA multicast group
+ */
+void setupFleetOta() {
+  // Created at boot, the stack is not allocated while the lamp runs
+  if (xTaskCreate(eraseTaskLoop, "fleet_erase", FLEET_OTA_ERASE_TASK_STACK, nullptr,
+                  FLEET_OTA_ERASE_TASK_PRIORITY, &eraseTask) != pdPASS) {
+    LOG_W(FLEET, "Fleet OTA: cannot start erase task, receiving disabled");
+    eraseTask = nullptr;
+  }
+  if (!fleetUdp.listenMulticast(FLEET_OTA_MULTICAST_IP, FLEET_OTA_PORT)) {
+    LOG_W(FLEET, "Fleet OTA failed to join multicast group");
+    return;
+  }
+  fleetUdp.onPacket([](AsyncUDPPacket& packet) {
+    handlePacket(packet);
+    powerWake();
+  });
+  udpStarted = true;
+  LOG_I(FLEET, "Fleet OTA listening on %s:%d", ipString(FLEET_OTA_MULTICAST_IP).c_str(), FLEET_OTA_PORT);
+}
+
+/**
+ * Drive sender and receiver in the main loop
+ */
+void handleFleetOta() {
+  // An abandoned session gives the partition back once no erase is running
+  if (partitionHeld && state == FLEET_OTA_IDLE && !eraseRunning) {
+    otaPartitionRelease(OTA_OWNER_FLEET);
+    partitionHeld = false;
+  }
+  if (startRequested && state == FLEET_OTA_IDLE) {
+    beginReceive();
+  }
+  if (state == FLEET_OTA_SENDING) {
+    handleSender();
+  } else if (state == FLEET_OTA_RECEIVING) {
+    handleReceiver();
+  }
+}
+
+/**
+ * Get the current fleet OTA role
+ */
+FleetOtaState getFleetOtaState() {
+  return state;
+}
+
+/**
+ * Get statistics of the last session
+ */
+const FleetOtaStats& getFleetOtaStats() {
+  return stats;
+}
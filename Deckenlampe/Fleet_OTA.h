@@ -0,0 +1,127 @@
+/**
+ * Fleet_OTA.h - Multicast firmware distribution for CeilingLamp fleets
+ *
+ * One sender (a lamp passing on its running image, or fleet-ota.py)
+ * multicasts the firmware in numbered blocks; every lamp on the network
+ * receives the same packets, so the airtime for N lamps is about that of
+ * a single download:
+ * 1. ANNOUNCE (repeated for FLEET_OTA_ANNOUNCE_MS): image size, SHA-256,
+ *    signature, version. Lamps running an older version join the session
+ *    and erase their OTA partition in the background.
+ * 2. DATA: blocks are written straight into the OTA partition at their
+ *    offset once their sector is erased; a bitmap tracks the missing ones.
+ * 3. END: each receiver answers with a unicast NACK holding its bitmap of
+ *    missing blocks (or DONE); the sender resends the union of all NACKs
+ *    in the next round.
+ * 4. A complete image is hashed from flash, checked against the announced
+ *    SHA-256 and signature (OTA_PUBLIC_KEY_PEM) and activated.
+ * Lamps without OTA_PUBLIC_KEY_PEM ignore all sessions unless built with
+ * FLEET_OTA_ALLOW_UNSIGNED=1: any host on the network can send to the group.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FLEET_OTA_H
+#define FLEET_OTA_H
+
+#include <Arduino.h>
+#include "OTA_Verify.h"
+
+// Multicast group and port
+#define FLEET_OTA_MULTICAST_IP IPAddress(239, 255, 76, 77)
+#define FLEET_OTA_PORT         5578
+#define FLEET_OTA_MAGIC        0x4F464C44  // "DLFO"
+#define FLEET_OTA_VERSION      1
+
+#define FLEET_OTA_BLOCK_SIZE     1024
+#define FLEET_OTA_MAX_BLOCKS     4096  // 4 MB image
+#define FLEET_OTA_BITMAP_BYTES   (FLEET_OTA_MAX_BLOCKS / 8)
+#define FLEET_OTA_MAX_RECEIVERS  32    // Receivers counted by the sender
+
+#ifndef FLEET_OTA_ALLOW_UNSIGNED
+#define FLEET_OTA_ALLOW_UNSIGNED 0     // 1 = join sessions without OTA_PUBLIC_KEY_PEM
+#endif
+
+// Packet types
+#define FLEET_OTA_ANNOUNCE 1   // Sender -> group: image description
+#define FLEET_OTA_DATA     2   // Sender -> group: one block
+#define FLEET_OTA_END      3   // Sender -> group: round complete, report missing blocks
+#define FLEET_OTA_NACK     4   // Receiver -> sender: bitmap of missing blocks
+#define FLEET_OTA_DONE     5   // Receiver -> sender: image verified or rejected
+
+// Fleet OTA configuration
+extern const unsigned long FLEET_OTA_BLOCK_INTERVAL_US;
+extern const unsigned long FLEET_OTA_ANNOUNCE_MS;
+extern const unsigned long FLEET_OTA_NACK_WINDOW_MS;
+extern const unsigned long FLEET_OTA_NACK_JITTER_MS;
+extern const unsigned long FLEET_OTA_RECEIVE_TIMEOUT_MS;
+extern const uint8_t FLEET_OTA_MAX_ROUNDS;
+
+struct __attribute__((packed)) FleetOtaHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint16_t reserved;
+  uint32_t session;
+};
+
+// ANNOUNCE and END
+struct __attribute__((packed)) FleetOtaAnnounce {
+  FleetOtaHeader header;
+  uint32_t imageSize;
+  uint16_t blockSize;
+  uint16_t sigLen;                          // 0 = unsigned image
+  uint8_t sha256[32];
+  char firmwareVersion[32];
+  uint8_t signature[OTA_SIGNATURE_MAX_LEN];
+};
+
+// DATA (followed by the block, shorter for the last one)
+struct __attribute__((packed)) FleetOtaData {
+  FleetOtaHeader header;
+  uint32_t block;
+};
+
+// NACK (followed by (blockCount + 7) / 8 bitmap bytes, bit set = missing)
+struct __attribute__((packed)) FleetOtaNack {
+  FleetOtaHeader header;
+  uint32_t missing;
+};
+
+// DONE
+struct __attribute__((packed)) FleetOtaDone {
+  FleetOtaHeader header;
+  uint8_t ok;
+};
+
+enum FleetOtaState {
+  FLEET_OTA_IDLE = 0,
+  FLEET_OTA_SENDING = 1,
+  FLEET_OTA_RECEIVING = 2
+};
+
+// Statistics of the last session
+struct FleetOtaStats {
+  // Sender
+  uint32_t rounds;
+  uint32_t blocksSent;
+  uint32_t blocksResent;
+  uint32_t nacksReceived;
+  uint32_t receiversDone;
+  uint32_t receiversFailed;
+  // Receiver
+  uint32_t blocksReceived;
+  uint32_t duplicateBlocks;
+  uint32_t blocksBeforeErase;  // Arrived before their sector was erased
+  uint32_t nacksSent;
+  uint32_t durationMs;
+};
+
+// Function declarations
+void setupFleetOta();
+void handleFleetOta();
+bool startFleetOtaSender();
+FleetOtaState getFleetOtaState();
+const FleetOtaStats& getFleetOtaStats();
+
+#endif // FLEET_OTA_H
@@ -0,0 +1,236 @@
+/**
+ * Frame_Interpolator.cpp - Jitter buffer and frame interpolation implementation
+ *
+ * The receive side (AsyncUDP task) only ever writes the slot behind the
+ * newest keyframe, the render side (main loop) only reads the two oldest
+ * keyframes. Only the ring indices are shared, guarded by a spinlock.
+ * When the buffer is full the newest keyframe is rejected rather than
+ * overwriting a slot that may currently be read by the renderer.
+ *
+ * A new frame starts as a copy of the newest committed one, so pixels a
+ * sender does not update (DDP packets with partial offsets) keep their
+ * last value instead of whatever the recycled slot held. A stream reset
+ * comes from the receive side: it drops the buffered keyframes under the
+ * lock and leaves a flag for the render side to clear its own state.
+ *
+ * Author: icebear74
+ */
+
+#include "Frame_Interpolator.h"
+
+// Interpolator configuration
+const unsigned long PLAYOUT_DELAY_MS = 80;            // Fixed playout delay absorbing network jitter
+const unsigned long STREAM_RENDER_INTERVAL_MS = 10;   // Local render rate (100 FPS)
+
+// Keyframe ring buffer
+struct Keyframe {
+  unsigned long timestamp;  // Smoothed playout timestamp (millis)
+  CRGB pixels[STREAM_MAX_PIXELS];
+};
+
+static Keyframe keyframes[JITTER_BUFFER_DEPTH];
+static uint8_t head = 0;      // Oldest buffered keyframe
+static uint8_t count = 0;     // Number of buffered keyframes
+static uint16_t pixelCount = 0;
+static bool renderResetPending = false;   // Set by a reset, cleared by the renderer (under ringMux)
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Receive side only
+static unsigned long lastArrival = 0;
+static unsigned long lastTimestamp = 0;
+static unsigned long avgInterval = 0;
+static int8_t newestSlot = -1;            // Newest committed keyframe, -1 = none since the reset
+static bool slotSeeded = false;           // Write slot holds the base of the frame being received
+
+// Render side state
+static unsigned long lastRender = 0;
+static bool inUnderrun = false;
+static FrameInterpolatorStats stats = {};
+
+/**
+ * Initialize the interpolator for a strip
+ *
+ * @param numPixels Number of pixels per frame (capped at STREAM_MAX_PIXELS)
+ */
+void setupFrameInterpolator(uint16_t numPixels) {
+  pixelCount = numPixels > STREAM_MAX_PIXELS ? STREAM_MAX_PIXELS : numPixels;
+  resetFrameInterpolator();
+}
+
+/**
+ * Drop all buffered keyframes, e.g. when a new stream starts
+ * Called from the receive side (or before the receivers start). The ring
+ * restarts behind the old keyframes, so the slots the renderer may still
+ * be reading are not written first.
+ */
+void resetFrameInterpolator() {
+  portENTER_CRITICAL(&ringMux);
+  head = (head + count) % JITTER_BUFFER_DEPTH;
+  count = 0;
+  renderResetPending = true;
+  portEXIT_CRITICAL(&ringMux);
+
+  avgInterval = 0;
+  newestSlot = -1;
+  slotSeeded = false;
+  stats.maxDepth = 0;
+}
+
+/**
+ * Get the slot the receiver should decode the next frame into
+ * The slot is never read by the renderer until it has been committed.
+ * The first call for a frame fills the slot with the newest committed
+ * keyframe (black after a reset).
+ *
+ * @return Pixel buffer for the frame being received
+ */
+CRGB* jitterBufferWriteSlot() {
+  portENTER_CRITICAL(&ringMux);
+  uint8_t slot = (head + count) % JITTER_BUFFER_DEPTH;
+  portEXIT_CRITICAL(&ringMux);
+
+  if (!slotSeeded) {
+    slotSeeded = true;
+    if (newestSlot < 0) {
+      for (uint16_t i = 0; i < pixelCount; i++) {
+        keyframes[slot].pixels[i] = CRGB::Black;
+      }
+    } else {
+      memcpy(keyframes[slot].pixels, keyframes[newestSlot].pixels, pixelCount * sizeof(CRGB));
+    }
+  }
+  return keyframes[slot].pixels;
+}
+
+/**
+ * Abandon the frame in the write slot (a packet of it was lost)
+ * The next frame starts again from the newest committed keyframe.
+ */
+void jitterBufferDiscard() {
+  slotSeeded = false;
+}
+
+/**
+ * Timestamp the frame in the write slot and make it available for playout
+ *
+ * Arrival times are smoothed with a simple loop filter around the average
+ * frame interval, so network jitter does not turn into uneven fades. Large
+ * deviations (stream restart, long gap) resynchronize to the arrival time.
+ */
+void jitterBufferCommit() {
+  unsigned long arrival = millis();
+  unsigned long timestamp = arrival;
+
+  if (avgInterval != 0) {
+    unsigned long predicted = lastTimestamp + avgInterval;
+    long error = (long)(arrival - predicted);
+    if (error > (long)PLAYOUT_DELAY_MS || error < -(long)PLAYOUT_DELAY_MS) {
+      avgInterval = 0;  // Resynchronize
+    } else {
+      timestamp = predicted + error / 4;
+      avgInterval = (avgInterval * 7 + (arrival - lastArrival)) / 8;
+    }
+  } else if (lastArrival != 0 && arrival - lastArrival < PLAYOUT_DELAY_MS) {
+    avgInterval = arrival - lastArrival;
+  }
+  if (timestamp <= lastTimestamp) {
+    timestamp = lastTimestamp + 1;
+  }
+  lastArrival = arrival;
+  lastTimestamp = timestamp;
+
+  portENTER_CRITICAL(&ringMux);
+  uint8_t slot = (head + count) % JITTER_BUFFER_DEPTH;
+  bool accepted = count < JITTER_BUFFER_DEPTH - 1;
+  if (accepted) {
+    keyframes[slot].timestamp = timestamp;
+    count++;
+  }
+  uint8_t depth = count;
+  portEXIT_CRITICAL(&ringMux);
+
+  // A rejected frame stays in the write slot as the base of the next one
+  if (accepted) {
+    newestSlot = slot;
+    slotSeeded = false;
+    stats.framesQueued++;
+  } else {
+    stats.overruns++;
+  }
+  stats.depth = depth;
+  if (depth > stats.maxDepth) {
+    stats.maxDepth = depth;
+  }
+}
+
+/**
+ * Render the frame for the current playout time
+ *
+ * Runs at STREAM_RENDER_INTERVAL_MS. Keyframes older than the playout time
+ * are released; the output is blended between the two keyframes around it.
+ * If the stream falls behind, the newest keyframe is held (underrun).
+ *
+ * @param out Output pixel buffer (the LED frame buffer)
+ * @return true if out was updated and should be shown
+ */
+bool renderInterpolatedFrame(CRGB* out) {
+  unsigned long now = millis();
+  if (now - lastRender < STREAM_RENDER_INTERVAL_MS) {
+    return false;
+  }
+  lastRender = now;
+  unsigned long playout = now - PLAYOUT_DELAY_MS;
+
+  portENTER_CRITICAL(&ringMux);
+  bool reset = renderResetPending;
+  renderResetPending = false;
+  while (count >= 2 && (long)(playout - keyframes[(head + 1) % JITTER_BUFFER_DEPTH].timestamp) >= 0) {
+    head = (head + 1) % JITTER_BUFFER_DEPTH;
+    count--;
+  }
+  uint8_t available = count;
+  uint8_t a = head;
+  uint8_t b = (head + 1) % JITTER_BUFFER_DEPTH;
+  portEXIT_CRITICAL(&ringMux);
+  stats.depth = available;
+  if (reset) {
+    inUnderrun = false;
+  }
+
+  if (available == 0) {
+    return false;
+  }
+
+  const Keyframe& from = keyframes[a];
+  if ((long)(playout - from.timestamp) < 0) {
+    return false;  // First keyframe not due yet, still filling the buffer
+  }
+
+  if (available == 1) {
+    if (!inUnderrun) {
+      inUnderrun = true;
+      stats.underruns++;
+    }
+    memcpy(out, from.pixels, pixelCount * sizeof(CRGB));
+  } else {
+    inUnderrun = false;
+    const Keyframe& to = keyframes[b];
+    unsigned long span = to.timestamp - from.timestamp;
+    fract8 frac = (fract8)(((playout - from.timestamp) * 256) / span);
+    for (uint16_t i = 0; i < pixelCount; i++) {
+      out[i] = blend(from.pixels[i], to.pixels[i], frac);
+    }
+  }
+
+  stats.renderedFrames++;
+  return true;
+}
+
+/**
+ * Get jitter buffer statistics
+ *
+ * @return Reference to the live statistics
+ */
+const FrameInterpolatorStats& getFrameInterpolatorStats() {
+  return stats;
+}
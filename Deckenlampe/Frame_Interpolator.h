@@ -0,0 +1,46 @@
+/**
+ * Frame_Interpolator.h - Jitter buffer and frame interpolation for CeilingLamp
+ *
+ * Network streams often arrive at only 15-25 FPS with irregular spacing.
+ * Incoming frames are timestamped into a small jitter buffer and played out
+ * with a fixed delay. At the local render rate the output is linearly
+ * interpolated (8-bit fixed point) between the two keyframes that surround
+ * the playout time, so the lamp fades smoothly instead of stepping.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FRAME_INTERPOLATOR_H
+#define FRAME_INTERPOLATOR_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// Jitter buffer size (one slot is always reserved for the frame being received)
+#define JITTER_BUFFER_DEPTH 8
+#define STREAM_MAX_PIXELS   256
+
+// Interpolator configuration
+extern const unsigned long PLAYOUT_DELAY_MS;
+extern const unsigned long STREAM_RENDER_INTERVAL_MS;
+
+// Jitter buffer statistics
+struct FrameInterpolatorStats {
+  uint32_t framesQueued;      // Keyframes accepted into the buffer
+  uint32_t overruns;          // Keyframes rejected because the buffer was full
+  uint32_t underruns;         // Times playout ran past the newest keyframe
+  uint32_t renderedFrames;    // Interpolated frames sent to the LEDs
+  uint32_t depth;             // Keyframes currently buffered
+  uint32_t maxDepth;          // Highest depth seen since the stream started
+};
+
+// Function declarations
+void setupFrameInterpolator(uint16_t numPixels);
+void resetFrameInterpolator();
+CRGB* jitterBufferWriteSlot();
+void jitterBufferCommit();
+void jitterBufferDiscard();
+bool renderInterpolatedFrame(CRGB* out);
+const FrameInterpolatorStats& getFrameInterpolatorStats();
+
+#endif // FRAME_INTERPOLATOR_H
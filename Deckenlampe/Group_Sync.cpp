@@ -0,0 +1,363 @@
+/**
+ * Group_Sync.cpp - Multicast-synchronized multi-lamp playback implementation
+ *
+ * The group clock is the local wall clock (set by syncTimeWithNTP()) plus an
+ * offset. NTPClient only delivers whole seconds, so the beacons refine the
+ * offset to the leader's clock: every beacon yields one sample
+ * (leader time - local receive time), which is never larger than the true
+ * offset since network delay only makes it smaller. The estimate is the
+ * maximum over the last GROUP_SYNC_WINDOW samples; the applied offset slews
+ * towards it at GROUP_SYNC_SLEW_PERCENT of real time, larger errors are
+ * stepped.
+ *
+ * Beacons are handled in the AsyncUDP task, everything else in the main
+ * loop; shared state is guarded by syncMux.
+ *
+ * Author: icebear74
+ */
+
+#include "Group_Sync.h"
+#include "Log.h"
+#include "Power.h"
+#include "Static_Alloc.h"
+#include <AsyncUDP.h>
+#include <sys/time.h>
+
+// Group sync configuration
+const unsigned long GROUP_SYNC_BEACON_INTERVAL_MS = 1000;
+const unsigned long GROUP_SYNC_LEADER_TIMEOUT_MS = 3500;   // ~3 missed beacons
+const unsigned long GROUP_SYNC_START_DELAY_MS = 250;       // New effects start this far in the future
+const unsigned long GROUP_SYNC_REPORT_INTERVAL_MS = 30000;
+const long GROUP_SYNC_STEP_THRESHOLD_US = 50000;           // Step instead of slew above 50 ms
+
+#define GROUP_SYNC_WINDOW        8
+#define GROUP_SYNC_SLEW_PERCENT  10
+#define GROUP_SYNC_DRIFT_SPAN_MS 10000
+
+static AsyncUDP syncUdp;
+static portMUX_TYPE syncMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Group state (shared with the AsyncUDP task)
+static GroupSyncRole role = GROUP_ROLE_STANDALONE;
+static uint32_t deviceId = 0;
+static uint32_t leaderId = 0;
+static uint32_t paramsVersion = 0;
+static EffectParams activeEffect = DEFAULT_EFFECT;
+static int64_t startEpochMs = 0;
+static unsigned long lastBeaconReceived = 0;
+
+// Clock offset estimation (shared with the AsyncUDP task)
+static int64_t offsetSamples[GROUP_SYNC_WINDOW];
+static uint8_t sampleCount = 0;
+static uint8_t sampleIndex = 0;
+static int64_t targetOffsetUs = 0;
+
+// Applied offset (main loop only, read by groupClockMs())
+static volatile int64_t appliedOffsetUs = 0;
+static unsigned long lastSlew = 0;
+
+// Main loop bookkeeping
+static unsigned long lastBeaconSent = 0;
+static unsigned long lastReport = 0;
+static unsigned long lastDriftCheck = 0;
+static int64_t lastDriftTargetUs = 0;
+static bool beaconPending = false;
+
+static GroupSyncStats stats = {};
+
+/**
+ * Read the local wall clock in microseconds
+ */
+static int64_t localClockUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/**
+ * Read the group clock in microseconds
+ */
+static int64_t groupClockUs() {
+  return localClockUs() + appliedOffsetUs;
+}
+
+/**
+ * Drop all offset samples (new leader or clock jump)
+ * Must be called with syncMux held.
+ */
+static void resetOffsetWindow() {
+  sampleCount = 0;
+  sampleIndex = 0;
+}
+
+/**
+ * Add an offset sample and update the estimate
+ * Must be called with syncMux held.
+ *
+ * @param sampleUs Leader time minus local receive time
+ */
+static void addOffsetSample(int64_t sampleUs) {
+  if (sampleCount > 0) {
+    int64_t jump = sampleUs - targetOffsetUs;
+    if (jump > GROUP_SYNC_STEP_THRESHOLD_US || jump < -GROUP_SYNC_STEP_THRESHOLD_US) {
+      resetOffsetWindow();  // Local or leader clock was set, old samples are meaningless
+    }
+  }
+
+  offsetSamples[sampleIndex] = sampleUs;
+  sampleIndex = (sampleIndex + 1) % GROUP_SYNC_WINDOW;
+  if (sampleCount < GROUP_SYNC_WINDOW) {
+    sampleCount++;
+  }
+
+  int64_t best = offsetSamples[0];
+  for (uint8_t i = 1; i < sampleCount; i++) {
+    if (offsetSamples[i] > best) {
+      best = offsetSamples[i];
+    }
+  }
+  targetOffsetUs = best;
+}
+
+/**
+ * Handle a received beacon (AsyncUDP task)
+ *
+ * @param data Raw UDP payload
+ * @param len Payload length
+ */
+static void handleBeacon(const uint8_t* data, size_t len) {
+  if (len < sizeof(GroupSyncBeacon)) {
+    return;
+  }
+  GroupSyncBeacon beacon;
+  memcpy(&beacon, data, sizeof(beacon));
+  if (beacon.magic != GROUP_SYNC_MAGIC || beacon.version != GROUP_SYNC_VERSION ||
+      beacon.leaderId == deviceId) {
+    return;  // Foreign packet or our own multicast looped back
+  }
+
+  int64_t receivedUs = localClockUs();
+  unsigned long now = millis();
+
+  portENTER_CRITICAL(&syncMux);
+  bool leaderTimedOut = now - lastBeaconReceived > GROUP_SYNC_LEADER_TIMEOUT_MS;
+  bool accept = false;
+
+  if (role == GROUP_ROLE_LEADER) {
+    if (beacon.leaderId < deviceId) {
+      role = GROUP_ROLE_FOLLOWER;  // Yield to the lower ID
+      accept = true;
+    }
+  } else if (leaderId == 0 || beacon.leaderId == leaderId || beacon.leaderId < leaderId || leaderTimedOut) {
+    accept = true;  // A lamp joining a running group follows its leader at once
+  }
+
+  if (accept) {
+    if (beacon.leaderId != leaderId) {
+      leaderId = beacon.leaderId;
+      paramsVersion = beacon.paramsVersion - 1;  // Force adoption below
+      resetOffsetWindow();
+      stats.leaderChanges++;
+    }
+    lastBeaconReceived = now;
+    addOffsetSample(beacon.leaderTimeUs - receivedUs);
+
+    if (beacon.paramsVersion != paramsVersion) {
+      paramsVersion = beacon.paramsVersion;
+      activeEffect = beacon.params;
+      startEpochMs = beacon.startEpochMs;
+    }
+    stats.beaconsReceived++;
+  }
+  portEXIT_CRITICAL(&syncMux);
+}
+
+/**
+ * Multicast a beacon with the current effect and group clock (leader only)
+ */
+static void sendBeacon() {
+  GroupSyncBeacon beacon = {};
+  beacon.magic = GROUP_SYNC_MAGIC;
+  beacon.version = GROUP_SYNC_VERSION;
+  beacon.leaderId = deviceId;
+
+  portENTER_CRITICAL(&syncMux);
+  beacon.paramsVersion = paramsVersion;
+  beacon.startEpochMs = startEpochMs;
+  beacon.params = activeEffect;
+  portEXIT_CRITICAL(&syncMux);
+
+  beacon.leaderTimeUs = groupClockUs();
+  syncUdp.writeTo(reinterpret_cast<const uint8_t*>(&beacon), sizeof(beacon),
+                  GROUP_SYNC_MULTICAST_IP, GROUP_SYNC_PORT);
+  stats.beaconsSent++;
+}
+
+/**
+ * Join the sync multicast group
+ * The lamp starts as follower and takes over leadership if no leader is heard.
+ */
+void setupGroupSync() {
+  // Last four MAC bytes: the low word of getEfuseMac() is mostly the vendor prefix
+  deviceId = (uint32_t)(ESP.getEfuseMac() >> 16);
+  lastBeaconReceived = millis();
+
+  if (!syncUdp.listenMulticast(GROUP_SYNC_MULTICAST_IP, GROUP_SYNC_PORT)) {
+    LOG_W(SYNC, "Group sync failed to join multicast group");
+    return;
+  }
+  syncUdp.onPacket([](AsyncUDPPacket& packet) {
+    handleBeacon(packet.data(), packet.length());
+    powerWake();
+  });
+
+  role = GROUP_ROLE_FOLLOWER;
+  LOG_I(SYNC, "Group sync started (ID %08X), listening on %s:%d",
+              deviceId, ipString(GROUP_SYNC_MULTICAST_IP).c_str(), GROUP_SYNC_PORT);
+}
+
+/**
+ * Handle leader election, beacons and clock slewing in the main loop
+ */
+void handleGroupSync() {
+  if (role == GROUP_ROLE_STANDALONE) {
+    return;
+  }
+  unsigned long now = millis();
+
+  // Take over leadership if the leader went silent (staggered by device ID)
+  portENTER_CRITICAL(&syncMux);
+  bool takeOver = role == GROUP_ROLE_FOLLOWER &&
+                  now - lastBeaconReceived > GROUP_SYNC_LEADER_TIMEOUT_MS + (deviceId % 1024);
+  if (takeOver) {
+    role = GROUP_ROLE_LEADER;
+    leaderId = deviceId;
+    targetOffsetUs = appliedOffsetUs;  // Keep the current timeline
+    stats.leaderChanges++;
+  }
+  GroupSyncRole currentRole = role;
+  int64_t target = targetOffsetUs;
+  portEXIT_CRITICAL(&syncMux);
+
+  if (takeOver) {
+    LOG_I(SYNC, "Group sync: no leader heard, taking over as leader");
+    beaconPending = true;
+  }
+
+  if (currentRole == GROUP_ROLE_LEADER) {
+    if (beaconPending || now - lastBeaconSent >= GROUP_SYNC_BEACON_INTERVAL_MS) {
+      beaconPending = false;
+      lastBeaconSent = now;
+      sendBeacon();
+    }
+  } else {
+    // Slew the applied offset towards the estimate, step if too far off
+    int64_t error = target - appliedOffsetUs;
+    if (error > GROUP_SYNC_STEP_THRESHOLD_US || error < -GROUP_SYNC_STEP_THRESHOLD_US) {
+      appliedOffsetUs = target;
+      stats.clockSteps++;
+    } else {
+      int64_t maxStep = (int64_t)(now - lastSlew) * 1000 * GROUP_SYNC_SLEW_PERCENT / 100;
+      appliedOffsetUs += constrain(error, -maxStep, maxStep);
+    }
+    stats.offsetErrorUs = (int32_t)(target - appliedOffsetUs);
+
+    // Drift: change of the estimated offset over time
+    if (now - lastDriftCheck >= GROUP_SYNC_DRIFT_SPAN_MS) {
+      if (lastDriftCheck != 0) {
+        stats.driftPpb = (int32_t)((target - lastDriftTargetUs) * 1000000LL / (int64_t)(now - lastDriftCheck));
+      }
+      lastDriftCheck = now;
+      lastDriftTargetUs = target;
+    }
+  }
+  lastSlew = now;
+  stats.leaderId = leaderId;
+
+  if (now - lastReport >= GROUP_SYNC_REPORT_INTERVAL_MS) {
+    lastReport = now;
+    LOG_I(SYNC, "Group sync: %s, leader %08X, offset error %d us, drift %d ppb, %u steps",
+                currentRole == GROUP_ROLE_LEADER ? "leader" : "follower", leaderId,
+                stats.offsetErrorUs, stats.driftPpb, stats.clockSteps);
+  }
+}
+
+/**
+ * Get the role of this lamp in the group
+ */
+GroupSyncRole getGroupSyncRole() {
+  return role;
+}
+
+/**
+ * Read the group clock
+ *
+ * @return Milliseconds on the shared (leader) timeline
+ */
+int64_t groupClockMs() {
+  return groupClockUs() / 1000;
+}
+
+/**
+ * Get the effect frame to render now
+ * All lamps of a group return the same index at the same moment.
+ *
+ * @return Frame index since the effect start epoch
+ */
+uint32_t effectFrameIndex() {
+  int64_t now = groupClockMs();
+
+  portENTER_CRITICAL(&syncMux);
+  if (startEpochMs == 0) {
+    startEpochMs = now;  // Standalone: timeline starts at first use
+  }
+  int64_t start = startEpochMs;
+  portEXIT_CRITICAL(&syncMux);
+
+  int64_t elapsed = now - start;
+  if (elapsed < 0) {
+    return 0;  // Scheduled start not reached yet
+  }
+  return (uint32_t)(elapsed / EFFECT_FRAME_INTERVAL_MS);
+}
+
+/**
+ * Get the effect the group is currently playing
+ */
+EffectParams getActiveEffect() {
+  portENTER_CRITICAL(&syncMux);
+  EffectParams params = activeEffect;
+  portEXIT_CRITICAL(&syncMux);
+  return params;
+}
+
+/**
+ * Change the effect
+ * As leader (or standalone) the new effect is scheduled to start shortly in
+ * the future and announced immediately. As follower the change is applied
+ * locally until the next leader beacon.
+ *
+ * @param params New effect parameters
+ */
+void setGroupEffect(const EffectParams& params) {
+  int64_t start = groupClockMs() + GROUP_SYNC_START_DELAY_MS;
+
+  portENTER_CRITICAL(&syncMux);
+  if (!effectParamsEqual(params, activeEffect)) {
+    activeEffect = params;
+    startEpochMs = start;
+    paramsVersion++;
+  }
+  portEXIT_CRITICAL(&syncMux);
+
+  beaconPending = true;
+}
+
+/**
+ * Get group sync statistics
+ *
+ * @return Reference to the live statistics
+ */
+const GroupSyncStats& getGroupSyncStats() {
+  return stats;
+}
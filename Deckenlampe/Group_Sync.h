@@ -0,0 +1,76 @@
+/**
+ * Group_Sync.h - Multicast-synchronized multi-lamp playback for CeilingLamp
+ *
+ * Several lamps in one room elect a leader which multicasts the effect
+ * parameters, a shared start epoch and its group clock once per second.
+ * Followers estimate the offset between their NTP-disciplined wall clock
+ * and the leader's group clock from these beacons and slew towards it, so
+ * every lamp renders frame N of the effect timeline at the same moment
+ * without any per-frame network traffic.
+ *
+ * Leader election: a lamp that hears no beacon for GROUP_SYNC_LEADER_TIMEOUT_MS
+ * becomes leader; of two leaders the one with the lower device ID stays.
+ *
+ * Author: icebear74
+ */
+
+#ifndef GROUP_SYNC_H
+#define GROUP_SYNC_H
+
+#include <Arduino.h>
+#include "Effects.h"
+
+// Multicast group and port for sync beacons
+#define GROUP_SYNC_MULTICAST_IP IPAddress(239, 255, 76, 76)
+#define GROUP_SYNC_PORT         5577
+#define GROUP_SYNC_MAGIC        0x53474C44  // "DLGS"
+#define GROUP_SYNC_VERSION      1
+
+// Group sync configuration
+extern const unsigned long GROUP_SYNC_BEACON_INTERVAL_MS;
+extern const unsigned long GROUP_SYNC_LEADER_TIMEOUT_MS;
+extern const unsigned long GROUP_SYNC_START_DELAY_MS;
+extern const unsigned long GROUP_SYNC_REPORT_INTERVAL_MS;
+extern const long GROUP_SYNC_STEP_THRESHOLD_US;
+
+// Role of this lamp in the group
+enum GroupSyncRole {
+  GROUP_ROLE_STANDALONE = 0,  // Group sync not started (no WiFi)
+  GROUP_ROLE_FOLLOWER = 1,
+  GROUP_ROLE_LEADER = 2
+};
+
+// Sync beacon (multicast by the leader)
+struct __attribute__((packed)) GroupSyncBeacon {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved[3];
+  uint32_t leaderId;
+  uint32_t paramsVersion;
+  int64_t leaderTimeUs;   // Leader group clock at send time
+  int64_t startEpochMs;   // Group clock time of effect frame 0
+  EffectParams params;
+};
+
+// Group sync statistics
+struct GroupSyncStats {
+  uint32_t beaconsSent;
+  uint32_t beaconsReceived;
+  uint32_t leaderChanges;
+  uint32_t clockSteps;        // Offset corrections too large to slew
+  uint32_t leaderId;
+  int32_t offsetErrorUs;      // Remaining correction (estimated - applied offset)
+  int32_t driftPpb;           // Measured drift against the leader clock
+};
+
+// Function declarations
+void setupGroupSync();
+void handleGroupSync();
+GroupSyncRole getGroupSyncRole();
+int64_t groupClockMs();
+uint32_t effectFrameIndex();
+EffectParams getActiveEffect();
+void setGroupEffect(const EffectParams& params);
+const GroupSyncStats& getGroupSyncStats();
+
+#endif // GROUP_SYNC_H
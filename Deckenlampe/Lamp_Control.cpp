@@ -0,0 +1,141 @@
+/**
+ * Lamp_Control.cpp - Runtime control state implementation
+ *
+ * Author: icebear74
+ */
+
+#include "Lamp_Control.h"
+#include "Group_Sync.h"
+#include "Settings.h"
+#include <FastLED.h>
+
+// Effect names as exposed to control planes (index = EffectType)
+static const char* const EFFECT_NAMES[] = { "toggle", "crossfade", "solid", "sequence", "program", "audio" };
+#define EFFECT_COUNT (sizeof(EFFECT_NAMES) / sizeof(EFFECT_NAMES[0]))
+
+static LampState state = {
+  true, 255,
+  { DEFAULT_EFFECT.colorA[0], DEFAULT_EFFECT.colorA[1], DEFAULT_EFFECT.colorA[2] },
+  DEFAULT_EFFECT.type
+};
+static volatile uint32_t stateVersion = 0;
+
+/**
+ * Push the current state to FastLED and the effect timeline
+ */
+static void applyLampState() {
+  FastLED.setBrightness(state.on ? state.brightness : 0);
+
+  EffectParams params = getActiveEffect();
+  params.type = state.effect;
+  memcpy(params.colorA, state.color, sizeof(params.colorA));
+  setGroupEffect(params);
+
+  stateVersion++;
+}
+
+/**
+ * Restore the stored lamp state and apply it
+ * Settings that were never stored keep their defaults.
+ */
+void setupLampControl() {
+  uint8_t effect;
+  loadSetting(SETTING_POWER, state.on);
+  loadSetting(SETTING_BRIGHTNESS, state.brightness);
+  loadSetting(SETTING_COLOR, state.color);
+  if (loadSetting(SETTING_EFFECT, effect) && effect < EFFECT_COUNT) {
+    state.effect = effect;
+  }
+  applyLampState();
+}
+
+/**
+ * Get the current lamp state
+ */
+const LampState& getLampState() {
+  return state;
+}
+
+/**
+ * Get the state change counter
+ *
+ * @return Value that changes whenever the lamp state changes
+ */
+uint32_t lampStateVersion() {
+  return stateVersion;
+}
+
+/**
+ * Switch the lamp on or off
+ */
+void setLampPower(bool on) {
+  if (state.on == on) {
+    return;
+  }
+  state.on = on;
+  applyLampState();
+  storeSetting(SETTING_POWER, state.on);
+}
+
+/**
+ * Set the lamp brightness (0-255)
+ */
+void setLampBrightness(uint8_t brightness) {
+  if (state.brightness == brightness) {
+    return;
+  }
+  state.brightness = brightness;
+  applyLampState();
+  storeSetting(SETTING_BRIGHTNESS, state.brightness);
+}
+
+/**
+ * Set the primary effect color
+ */
+void setLampColor(uint8_t r, uint8_t g, uint8_t b) {
+  if (state.color[0] == r && state.color[1] == g && state.color[2] == b) {
+    return;
+  }
+  state.color[0] = r;
+  state.color[1] = g;
+  state.color[2] = b;
+  applyLampState();
+  storeSetting(SETTING_COLOR, state.color);
+}
+
+/**
+ * Select the effect (EffectType)
+ */
+void setLampEffect(uint8_t effect) {
+  if (effect >= EFFECT_COUNT || state.effect == effect) {
+    return;
+  }
+  state.effect = effect;
+  applyLampState();
+  storeSetting(SETTING_EFFECT, state.effect);
+}
+
+/**
+ * Get the name of an effect
+ *
+ * @param effect EffectType value
+ * @return Effect name, "unknown" for invalid values
+ */
+const char* effectName(uint8_t effect) {
+  return effect < EFFECT_COUNT ? EFFECT_NAMES[effect] : "unknown";
+}
+
+/**
+ * Look up an effect by name
+ *
+ * @param name Effect name (e.g. "crossfade")
+ * @return EffectType value, or -1 if unknown
+ */
+int effectFromName(const char* name) {
+  for (size_t i = 0; i < EFFECT_COUNT; i++) {
+    if (strcmp(name, EFFECT_NAMES[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
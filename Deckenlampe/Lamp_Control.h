@@ -0,0 +1,38 @@
+/**
+ * Lamp_Control.h - Runtime control state for CeilingLamp
+ *
+ * Holds the user-controllable lamp state (power, brightness, color, effect)
+ * and applies it to FastLED and the effect timeline. Control planes such as
+ * MQTT change the state through the setters; every change bumps a version
+ * counter so renderers and publishers can detect it cheaply. The state is
+ * kept in the settings store and restored at boot.
+ *
+ * Author: icebear74
+ */
+
+#ifndef LAMP_CONTROL_H
+#define LAMP_CONTROL_H
+
+#include <Arduino.h>
+#include "Effects.h"
+
+// Lamp state
+struct LampState {
+  bool on;
+  uint8_t brightness;
+  uint8_t color[3];
+  uint8_t effect;     // EffectType
+};
+
+// Function declarations
+void setupLampControl();
+const LampState& getLampState();
+uint32_t lampStateVersion();
+void setLampPower(bool on);
+void setLampBrightness(uint8_t brightness);
+void setLampColor(uint8_t r, uint8_t g, uint8_t b);
+void setLampEffect(uint8_t effect);
+const char* effectName(uint8_t effect);
+int effectFromName(const char* name);
+
+#endif // LAMP_CONTROL_H
@@ -0,0 +1,382 @@
+/**
+ * Log.cpp - Deferred-format logging implementation
+ *
+ * The queue is a bounded multi-producer ring (Vyukov style): a producer
+ * claims a slot by advancing enqueuePos with compare-and-swap and marks it
+ * full when done; the log task is the only consumer. Slot sequence numbers
+ * count laps (2 * lap = free, 2 * lap + 1 = full), so the zero-initialized
+ * queue is usable before setupLog() runs.
+ *
+ * The log task formats one conversion at a time from the binary arguments,
+ * using the argument's recorded type, so a wrong format specifier never
+ * reads past the argument data.
+ *
+ * Author: icebear74
+ */
+
+#include "Log.h"
+#include "Power.h"
+#include "WiFi.h"
+#include <AsyncUDP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Log configuration
+const char* LOG_SYSLOG_HOST = "";        // e.g. "192.168.1.10", empty = syslog disabled
+const uint16_t LOG_SYSLOG_PORT = 514;
+
+static const char* const moduleNames[LOG_MODULE_COUNT] = {
+  "MAIN", "WIFI", "OTA", "FLEET", "STREAM", "SYNC", "MQTT", "TRACE", "STALL", "PREFS",
+  "POWER", "BENCH", "SEQ", "VM", "AUDIO"
+};
+static const char levelChars[] = "-EWID";
+
+// Queue
+static LogSlot slots[LOG_QUEUE_SLOTS];
+static std::atomic<uint32_t> enqueuePos(0);
+static uint32_t dequeuePos = 0;              // Log task only
+static std::atomic<uint32_t> droppedCount(0);
+static uint32_t messageCount = 0;
+static uint32_t maxQueued = 0;
+static LogStats stats;
+
+// Formatted history for /log (written by the log task)
+static char history[LOG_HISTORY_SIZE];
+static uint32_t historyHead = 0;             // Total bytes ever written
+static portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Syslog
+static AsyncUDP syslogUdp;
+static IPAddress syslogIp;
+static bool syslogResolved = false;
+
+static TaskHandle_t logTask = nullptr;
+
+static inline uint32_t freeMark(uint32_t pos) {
+  return (pos / LOG_QUEUE_SLOTS) * 2;
+}
+
+/**
+ * Claim a free slot (any task)
+ *
+ * @return Slot to fill, nullptr if the queue is full (message dropped)
+ */
+LogSlot* logClaim() {
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    LogSlot* slot = &slots[pos % LOG_QUEUE_SLOTS];
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - freeMark(pos));
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * Hand a filled slot to the log task
+ */
+void logCommit(LogSlot* slot) {
+  slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * Format one conversion with the recorded argument
+ *
+ * @return Characters written (truncated to outLen - 1)
+ */
+static size_t formatArg(char* out, size_t outLen, const char* spec, char conversion,
+                        const uint8_t*& arg, const uint8_t* end) {
+  char fmt[20];
+  int written = 0;
+  uint8_t type = *arg++;
+
+  switch (type) {
+    case LOG_ARG_INT:
+    case LOG_ARG_UINT: {
+      uint32_t v;
+      if (arg + sizeof(v) > end) {
+        arg = end;
+        return 0;
+      }
+      memcpy(&v, arg, sizeof(v));
+      arg += sizeof(v);
+      if (conversion == 'p') {
+        written = snprintf(out, outLen, "0x%08x", (unsigned)v);
+        break;
+      }
+      if (strchr("diouxXc", conversion) == nullptr) {
+        conversion = type == LOG_ARG_INT ? 'd' : 'u';
+      }
+      snprintf(fmt, sizeof(fmt), "%s%c", spec, conversion);
+      written = type == LOG_ARG_INT ? snprintf(out, outLen, fmt, (int)v) : snprintf(out, outLen, fmt, (unsigned)v);
+      break;
+    }
+    case LOG_ARG_INT64:
+    case LOG_ARG_UINT64: {
+      uint64_t v;
+      if (arg + sizeof(v) > end) {
+        arg = end;
+        return 0;
+      }
+      memcpy(&v, arg, sizeof(v));
+      arg += sizeof(v);
+      if (strchr("diouxX", conversion) == nullptr) {
+        conversion = type == LOG_ARG_INT64 ? 'd' : 'u';
+      }
+      snprintf(fmt, sizeof(fmt), "%sll%c", spec, conversion);
+      written = snprintf(out, outLen, fmt, (unsigned long long)v);
+      break;
+    }
+    case LOG_ARG_DOUBLE: {
+      double v;
+      if (arg + sizeof(v) > end) {
+        arg = end;
+        return 0;
+      }
+      memcpy(&v, arg, sizeof(v));
+      arg += sizeof(v);
+      if (strchr("fFeEgGaA", conversion) == nullptr) {
+        conversion = 'f';
+      }
+      snprintf(fmt, sizeof(fmt), "%s%c", spec, conversion);
+      written = snprintf(out, outLen, fmt, v);
+      break;
+    }
+    case LOG_ARG_STRING: {
+      uint8_t len = arg < end ? *arg++ : 0;
+      if (arg + len > end) {
+        arg = end;
+        return 0;
+      }
+      char text[LOG_SLOT_ARGS_SIZE];
+      memcpy(text, arg, len);
+      text[len] = '\0';
+      arg += len;
+      snprintf(fmt, sizeof(fmt), "%ss", spec);
+      written = snprintf(out, outLen, fmt, text);
+      break;
+    }
+    default:
+      arg = end;
+      return 0;
+  }
+  if (written < 0) {
+    return 0;
+  }
+  return (size_t)written < outLen ? written : outLen - 1;
+}
+
+/**
+ * Expand a format string with the binary arguments of a slot
+ *
+ * @return Length of the message
+ */
+static size_t formatMessage(const LogSlot& slot, char* out, size_t outLen) {
+  const char* f = slot.format;
+  const uint8_t* arg = slot.args;
+  const uint8_t* end = slot.args + slot.argsLength;
+  size_t n = 0;
+
+  while (*f != '\0' && n + 1 < outLen) {
+    if (*f != '%') {
+      out[n++] = *f++;
+      continue;
+    }
+    f++;
+    if (*f == '%') {
+      out[n++] = *f++;
+      continue;
+    }
+
+    // Flags, width and precision are kept, length modifiers follow the argument type
+    char spec[12] = "%";
+    size_t s = 1;
+    while (*f != '\0' && strchr("-+ #0123456789.", *f) != nullptr) {
+      if (s + 1 < sizeof(spec)) {
+        spec[s++] = *f;
+      }
+      f++;
+    }
+    spec[s] = '\0';
+    while (*f != '\0' && strchr("hlLqjzt", *f) != nullptr) {
+      f++;
+    }
+    char conversion = *f != '\0' ? *f++ : 'd';
+
+    if (arg >= end) {
+      out[n++] = '?';   // Argument missing or truncated
+      continue;
+    }
+    n += formatArg(out + n, outLen - n, spec, conversion, arg, end);
+  }
+
+  while (n > 0 && (out[n - 1] == '\n' || out[n - 1] == '\r')) {
+    n--;
+  }
+  out[n] = '\0';
+  return n;
+}
+
+/**
+ * Append formatted text to the /log history
+ */
+static void appendHistory(const char* text, size_t len) {
+  portENTER_CRITICAL(&historyMux);
+  for (size_t i = 0; i < len; i++) {
+    history[(historyHead + i) % LOG_HISTORY_SIZE] = text[i];
+  }
+  historyHead += len;
+  portEXIT_CRITICAL(&historyMux);
+}
+
+/**
+ * Send one message to the syslog server (RFC 3164, facility local0)
+ */
+static void sendSyslog(uint8_t level, uint8_t module, const char* message) {
+  if (LOG_SYSLOG_HOST[0] == '\0' || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  if (!syslogResolved) {
+    syslogResolved = syslogIp.fromString(LOG_SYSLOG_HOST) || WiFi.hostByName(LOG_SYSLOG_HOST, syslogIp);
+    if (!syslogResolved) {
+      return;
+    }
+  }
+  static const uint8_t severity[] = { 7, 3, 4, 6, 7 };
+  char packet[320];
+  int len = snprintf(packet, sizeof(packet), "<%u>%s %s: %s", (16 << 3) | severity[level],
+                     WiFi.getHostname(), moduleNames[module], message);
+  if (len > 0) {
+    syslogUdp.writeTo(reinterpret_cast<const uint8_t*>(packet), min(len, (int)sizeof(packet) - 1),
+                      syslogIp, LOG_SYSLOG_PORT);
+  }
+}
+
+/**
+ * Write one formatted line to all outputs
+ */
+static void output(uint32_t timestampMs, uint8_t level, uint8_t module, const char* message) {
+  char line[288];
+  int len = snprintf(line, sizeof(line), "[%6u.%03u] %c %-6s %s\n",
+                     (unsigned)(timestampMs / 1000), (unsigned)(timestampMs % 1000),
+                     levelChars[level], moduleNames[module], message);
+  if (len <= 0) {
+    return;
+  }
+  len = min(len, (int)sizeof(line) - 1);
+  Serial.write(reinterpret_cast<const uint8_t*>(line), len);
+  appendHistory(line, len);
+  sendSyslog(level, module, message);
+}
+
+/**
+ * Format and output one queued message
+ *
+ * @return false if the queue was empty
+ */
+static bool drainOne() {
+  LogSlot& slot = slots[dequeuePos % LOG_QUEUE_SLOTS];
+  if (slot.sequence.load(std::memory_order_acquire) != freeMark(dequeuePos) + 1) {
+    return false;
+  }
+
+  uint32_t queued = enqueuePos.load(std::memory_order_relaxed) - dequeuePos;
+  maxQueued = max(maxQueued, queued);
+
+  char message[256];
+  formatMessage(slot, message, sizeof(message));
+  uint32_t timestampMs = slot.timestampMs;
+  uint8_t level = slot.level;
+  uint8_t module = slot.module < LOG_MODULE_COUNT ? slot.module : LOG_MODULE_MAIN;
+
+  // Slot is free again once the data is copied out
+  slot.sequence.store(freeMark(dequeuePos + LOG_QUEUE_SLOTS), std::memory_order_release);
+  dequeuePos++;
+  messageCount++;
+
+  output(timestampMs, level <= LOG_LEVEL_DEBUG ? level : LOG_LEVEL_INFO, module, message);
+  return true;
+}
+
+/**
+ * Log task: drain the queue, report dropped messages
+ */
+static void logTaskLoop(void* parameter) {
+  uint32_t reportedDrops = 0;
+  for (;;) {
+    bool busy = false;
+    while (drainOne()) {
+      busy = true;
+    }
+    uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+    if (dropped != reportedDrops) {
+      char message[48];
+      snprintf(message, sizeof(message), "%u log messages dropped", (unsigned)(dropped - reportedDrops));
+      output(millis(), LOG_LEVEL_WARN, LOG_MODULE_MAIN, message);
+      reportedDrops = dropped;
+    }
+    if (!busy) {
+      vTaskDelay(pdMS_TO_TICKS(powerPollInterval(10)));
+    }
+  }
+}
+
+/**
+ * Start the log task
+ * Messages logged before are kept in the queue.
+ */
+void setupLog() {
+  if (logTask != nullptr) {
+    return;
+  }
+  xTaskCreate(logTaskLoop, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, &logTask);
+}
+
+/**
+ * Stream the formatted history (oldest first)
+ *
+ * @param write Receives the text in chunks (null terminated)
+ */
+void writeLogHistory(void (*write)(const char* chunk)) {
+  char chunk[513];
+  uint32_t readPos = 0;
+  for (;;) {
+    portENTER_CRITICAL(&historyMux);
+    uint32_t head = historyHead;
+    if (head - readPos > LOG_HISTORY_SIZE) {
+      readPos = head - LOG_HISTORY_SIZE;   // Skip what was overwritten meanwhile
+    }
+    size_t len = min((uint32_t)(sizeof(chunk) - 1), head - readPos);
+    for (size_t i = 0; i < len; i++) {
+      chunk[i] = history[(readPos + i) % LOG_HISTORY_SIZE];
+    }
+    portEXIT_CRITICAL(&historyMux);
+
+    if (len == 0) {
+      return;
+    }
+    chunk[len] = '\0';
+    write(chunk);
+    readPos += len;
+  }
+}
+
+/**
+ * Get logging statistics
+ *
+ * @return Messages written, dropped and the deepest queue seen
+ */
+const LogStats& getLogStats() {
+  stats.messages = messageCount;
+  stats.dropped = droppedCount.load(std::memory_order_relaxed);
+  stats.maxQueued = maxQueued;
+  return stats;
+}
@@ -0,0 +1,196 @@
+/**
+ * Log.h - Deferred-format logging for CeilingLamp
+ *
+ * LOG_E/LOG_W/LOG_I/LOG_D(module, format, ...) never format or touch the
+ * UART on the caller's side: the format string pointer (its ID) and the
+ * arguments in binary form are copied into a slot of a lock-free queue
+ * (a copy of a few dozen bytes). A low-priority task formats the messages
+ * and writes them to Serial, the /log history and (optionally) UDP syslog.
+ * If the queue is full, messages are dropped and counted instead of
+ * blocking.
+ *
+ * Levels are per module and checked at compile time, so messages above
+ * a module's level compile out entirely:
+ *   #define LOG_LEVEL_OTA LOG_LEVEL_DEBUG
+ *
+ * String arguments (const char*, String) are copied into the slot and
+ * truncated if the slot is full; other arguments must be numbers.
+ *
+ * Author: icebear74
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Per-module log levels
+#define LOG_LEVEL_MAIN   LOG_LEVEL_INFO
+#define LOG_LEVEL_WIFI   LOG_LEVEL_INFO
+#define LOG_LEVEL_OTA    LOG_LEVEL_INFO
+#define LOG_LEVEL_FLEET  LOG_LEVEL_INFO
+#define LOG_LEVEL_STREAM LOG_LEVEL_INFO
+#define LOG_LEVEL_SYNC   LOG_LEVEL_INFO
+#define LOG_LEVEL_MQTT   LOG_LEVEL_INFO
+#define LOG_LEVEL_TRACE  LOG_LEVEL_INFO
+#define LOG_LEVEL_STALL  LOG_LEVEL_INFO
+#define LOG_LEVEL_PREFS  LOG_LEVEL_INFO
+#define LOG_LEVEL_POWER  LOG_LEVEL_INFO
+#define LOG_LEVEL_BENCH  LOG_LEVEL_INFO
+#define LOG_LEVEL_SEQ    LOG_LEVEL_INFO
+#define LOG_LEVEL_VM     LOG_LEVEL_INFO
+#define LOG_LEVEL_AUDIO  LOG_LEVEL_INFO
+
+#define LOG_QUEUE_SLOTS     128   // Power of two
+#define LOG_SLOT_ARGS_SIZE  64    // Binary argument bytes per message
+#define LOG_HISTORY_SIZE    4096  // Formatted text kept for /log
+#define LOG_TASK_STACK      4096
+#define LOG_TASK_PRIORITY   1
+
+// Log configuration
+extern const char* LOG_SYSLOG_HOST;
+extern const uint16_t LOG_SYSLOG_PORT;
+
+enum LogModule {
+  LOG_MODULE_MAIN = 0,
+  LOG_MODULE_WIFI,
+  LOG_MODULE_OTA,
+  LOG_MODULE_FLEET,
+  LOG_MODULE_STREAM,
+  LOG_MODULE_SYNC,
+  LOG_MODULE_MQTT,
+  LOG_MODULE_TRACE,
+  LOG_MODULE_STALL,
+  LOG_MODULE_PREFS,
+  LOG_MODULE_POWER,
+  LOG_MODULE_BENCH,
+  LOG_MODULE_SEQ,
+  LOG_MODULE_VM,
+  LOG_MODULE_AUDIO,
+  LOG_MODULE_COUNT
+};
+
+// Argument type tags
+enum LogArgType {
+  LOG_ARG_INT = 1,
+  LOG_ARG_UINT,
+  LOG_ARG_INT64,
+  LOG_ARG_UINT64,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_STRING      // Length byte + characters
+};
+
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  uint32_t timestampMs;
+  const char* format;
+  uint8_t module;
+  uint8_t level;
+  uint8_t argsLength;
+  uint8_t reserved;
+  uint8_t args[LOG_SLOT_ARGS_SIZE];
+};
+
+struct LogStats {
+  uint32_t messages;
+  uint32_t dropped;
+  uint32_t maxQueued;
+};
+
+// Function declarations
+void setupLog();
+LogSlot* logClaim();
+void logCommit(LogSlot* slot);
+void writeLogHistory(void (*write)(const char* chunk));
+const LogStats& getLogStats();
+
+// Argument encoding (used by the LOG_x macros)
+struct LogArgWriter {
+  uint8_t* pos;
+  uint8_t* end;
+};
+
+inline void logPutRaw(LogArgWriter& w, LogArgType type, const void* data, size_t len) {
+  if (w.pos + 1 + len > w.end) {
+    w.pos = w.end;      // Drop this and all following arguments
+    return;
+  }
+  *w.pos++ = type;
+  memcpy(w.pos, data, len);
+  w.pos += len;
+}
+
+inline void logPut(LogArgWriter& w, int v) { logPutRaw(w, LOG_ARG_INT, &v, sizeof(v)); }
+inline void logPut(LogArgWriter& w, long v) { int32_t x = v; logPutRaw(w, LOG_ARG_INT, &x, sizeof(x)); }
+inline void logPut(LogArgWriter& w, unsigned v) { logPutRaw(w, LOG_ARG_UINT, &v, sizeof(v)); }
+inline void logPut(LogArgWriter& w, unsigned long v) { uint32_t x = v; logPutRaw(w, LOG_ARG_UINT, &x, sizeof(x)); }
+inline void logPut(LogArgWriter& w, long long v) { logPutRaw(w, LOG_ARG_INT64, &v, sizeof(v)); }
+inline void logPut(LogArgWriter& w, unsigned long long v) { logPutRaw(w, LOG_ARG_UINT64, &v, sizeof(v)); }
+inline void logPut(LogArgWriter& w, double v) { logPutRaw(w, LOG_ARG_DOUBLE, &v, sizeof(v)); }
+inline void logPut(LogArgWriter& w, const void* v) { uint32_t x = (uint32_t)(uintptr_t)v; logPutRaw(w, LOG_ARG_UINT, &x, sizeof(x)); }
+
+inline void logPut(LogArgWriter& w, const char* s) {
+  if (s == nullptr) {
+    s = "(null)";
+  }
+  size_t len = strlen(s);
+  size_t room = w.end - w.pos;
+  if (room < 2) {
+    w.pos = w.end;
+    return;
+  }
+  if (len > room - 2) {
+    len = room - 2;     // Truncate to the slot
+  }
+  if (len > 255) {
+    len = 255;
+  }
+  *w.pos++ = LOG_ARG_STRING;
+  *w.pos++ = len;
+  memcpy(w.pos, s, len);
+  w.pos += len;
+}
+
+inline void logPut(LogArgWriter& w, char* s) { logPut(w, (const char*)s); }
+inline void logPut(LogArgWriter& w, const String& s) { logPut(w, s.c_str()); }
+
+/**
+ * Queue one message (called by the LOG_x macros)
+ */
+template <typename... Args>
+void logRecord(LogModule module, uint8_t level, const char* format, const Args&... args) {
+  LogSlot* slot = logClaim();
+  if (slot == nullptr) {
+    return;
+  }
+  slot->timestampMs = millis();
+  slot->format = format;
+  slot->module = module;
+  slot->level = level;
+  LogArgWriter w = { slot->args, slot->args + LOG_SLOT_ARGS_SIZE };
+  int expand[] = { 0, (logPut(w, args), 0)... };
+  (void)expand;
+  slot->argsLength = w.pos - slot->args;
+  logCommit(slot);
+}
+
+#define LOG_AT(level, module, format, ...)                                        \
+  do {                                                                            \
+    if ((level) <= LOG_LEVEL_##module) {                                          \
+      logRecord(LOG_MODULE_##module, (level), format, ##__VA_ARGS__);             \
+    }                                                                             \
+  } while (0)
+
+#define LOG_E(module, format, ...) LOG_AT(LOG_LEVEL_ERROR, module, format, ##__VA_ARGS__)
+#define LOG_W(module, format, ...) LOG_AT(LOG_LEVEL_WARN, module, format, ##__VA_ARGS__)
+#define LOG_I(module, format, ...) LOG_AT(LOG_LEVEL_INFO, module, format, ##__VA_ARGS__)
+#define LOG_D(module, format, ...) LOG_AT(LOG_LEVEL_DEBUG, module, format, ##__VA_ARGS__)
+
+#endif // LOG_H
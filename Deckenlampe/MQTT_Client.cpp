@@ -0,0 +1,896 @@
+/**
+ * MQTT_Client.cpp - MQTT control plane implementation
+ *
+ * Connection state machine (main loop only):
+ *   DISCONNECTED --(backoff elapsed, WiFi up)--> [RESOLVING] --> TCP_CONNECTING
+ *     --(socket writable)--> CONNECTING --(CONNACK)--> CONNECTED
+ * Any error closes the socket and schedules the next attempt with doubled
+ * backoff (plus jitter). Nothing blocks the render loop: the broker name
+ * goes through lwIP's asynchronous DNS once (IP literals skip it), and the
+ * TCP connect runs on a non-blocking socket that handleMqtt polls until
+ * MQTT_CONNECT_TIMEOUT_MS.
+ *
+ * Author: icebear74
+ */
+
+#include "MQTT_Client.h"
+#include "Log.h"
+#include "Lamp_Control.h"
+#include "Version.h"
+#include "WiFi_Manager.h"
+#include <lwip/dns.h>
+#include <lwip/sockets.h>
+
+// Broker configuration (configure these for your broker)
+const char* MQTT_BROKER_HOST = "";  // e.g. "192.168.1.10", empty = MQTT disabled
+const uint16_t MQTT_BROKER_PORT = 1883;
+const char* MQTT_USERNAME = "";
+const char* MQTT_PASSWORD = "";
+
+// Client configuration
+const uint16_t MQTT_KEEPALIVE_S = 30;
+const unsigned long MQTT_CONNECT_TIMEOUT_MS = 1000;
+const unsigned long MQTT_BACKOFF_MIN_MS = 1000;
+const unsigned long MQTT_BACKOFF_MAX_MS = 60000;
+const unsigned long MQTT_STATE_COALESCE_MS = 200;   // Quiet time before publishing state
+const unsigned long MQTT_REPORT_INTERVAL_MS = 60000;
+
+// MQTT control packet types
+#define MQTT_CONNECT    0x10
+#define MQTT_CONNACK    0x20
+#define MQTT_PUBLISH    0x30
+#define MQTT_SUBSCRIBE  0x82
+#define MQTT_SUBACK     0x90
+#define MQTT_PINGREQ    0xC0
+#define MQTT_PINGRESP   0xD0
+#define MQTT_RETAIN     0x01
+
+enum MqttState {
+  MQTT_STATE_DISCONNECTED,
+  MQTT_STATE_RESOLVING,       // Waiting for the DNS callback
+  MQTT_STATE_TCP_CONNECTING,  // Non-blocking connect in progress
+  MQTT_STATE_CONNECTING,      // CONNECT sent, waiting for CONNACK
+  MQTT_STATE_CONNECTED
+};
+
+static WiFiClient mqttSocket;
+static int pendingFd = -1;    // Socket of the TCP connect in progress
+static MqttState mqttState = MQTT_STATE_DISCONNECTED;
+static bool mqttEnabled = false;
+static MqttStats stats = {};
+
+// Topics (filled in setupMqtt)
+static char baseTopic[48];
+static char clientId[32];
+
+// Outbound ring buffer: packet bytes plus one descriptor per packet
+struct QueuedPacket {
+  uint16_t length;
+  unsigned long originMs;   // Time the data became publishable (for latency)
+};
+static uint8_t txRing[MQTT_QUEUE_BYTES];
+static size_t txHead = 0;
+static size_t txUsed = 0;
+static QueuedPacket txPackets[MQTT_QUEUE_PACKETS];
+static uint8_t txPacketHead = 0;
+static uint8_t txPacketCount = 0;
+static size_t txHeadPacketSent = 0;   // Bytes of the oldest packet already written
+static uint8_t txScratch[MQTT_MAX_PACKET];
+
+// Inbound buffer
+static uint8_t rxBuffer[MQTT_RX_BUFFER];
+static size_t rxLength = 0;
+static size_t rxSkip = 0;             // Bytes of an oversized packet still to discard
+
+// Connection timing
+static unsigned long backoffMs = MQTT_BACKOFF_MIN_MS;
+static unsigned long nextAttempt = 0;
+static unsigned long connectStarted = 0;
+static unsigned long lastOutbound = 0;
+static unsigned long lastInbound = 0;
+static unsigned long lastReport = 0;
+static bool pingOutstanding = false;
+
+// Set from the WiFi event task, consumed in the main loop
+static volatile bool wifiUp = false;
+static volatile bool wifiGotIp = false;
+
+// Broker address, resolved once; a failed TCP connect resolves it again
+static IPAddress brokerIp;
+static bool brokerResolved = false;
+
+// Set from the lwIP DNS callback (tcpip task), consumed in the main loop
+static volatile bool dnsDone = false;
+static volatile uint32_t dnsResult = 0;   // 0 = lookup failed
+
+// State publishing; a field counts as published once its PUBLISH is queued
+#define STATE_FIELD_ON          0x01
+#define STATE_FIELD_BRIGHTNESS  0x02
+#define STATE_FIELD_COLOR       0x04
+#define STATE_FIELD_EFFECT      0x08
+static LampState publishedState;
+static uint8_t publishedFields = 0;   // STATE_FIELD_* bits valid in publishedState
+static uint32_t seenStateVersion = 0;
+static bool stateDirty = false;
+static unsigned long dirtySince = 0;
+static unsigned long lastStateChange = 0;
+static bool discoveryPending = true;
+
+/**
+ * Append an MQTT UTF-8 string (2-byte length prefix)
+ */
+static size_t putString(uint8_t* buf, size_t pos, const char* str) {
+  size_t len = strlen(str);
+  buf[pos++] = len >> 8;
+  buf[pos++] = len & 0xFF;
+  memcpy(buf + pos, str, len);
+  return pos + len;
+}
+
+/**
+ * Prepend the fixed header to a packet body built at txScratch + 5
+ *
+ * @param type Packet type and flags
+ * @param bodyLen Length of the variable header + payload
+ * @param start Receives the offset of the first packet byte in txScratch
+ * @return Total packet length
+ */
+static size_t finishPacket(uint8_t type, size_t bodyLen, size_t& start) {
+  uint8_t lenBytes[4];
+  size_t n = 0;
+  size_t remaining = bodyLen;
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    if (remaining > 0) {
+      digit |= 0x80;
+    }
+    lenBytes[n++] = digit;
+  } while (remaining > 0 && n < 4);
+
+  start = 5 - 1 - n;
+  txScratch[start] = type;
+  memcpy(txScratch + start + 1, lenBytes, n);
+  return 1 + n + bodyLen;
+}
+
+/**
+ * Drop all queued packets
+ */
+static void clearQueue() {
+  txHead = 0;
+  txUsed = 0;
+  txPacketHead = 0;
+  txPacketCount = 0;
+  txHeadPacketSent = 0;
+  stats.queueDepth = 0;
+}
+
+/**
+ * Copy a finished packet into the outbound ring
+ *
+ * @return false if the queue is full
+ */
+static bool enqueuePacket(const uint8_t* data, size_t len, unsigned long originMs) {
+  if (txPacketCount >= MQTT_QUEUE_PACKETS || txUsed + len > MQTT_QUEUE_BYTES) {
+    stats.dropped++;
+    return false;
+  }
+
+  size_t tail = (txHead + txUsed) % MQTT_QUEUE_BYTES;
+  size_t first = min(len, (size_t)MQTT_QUEUE_BYTES - tail);
+  memcpy(txRing + tail, data, first);
+  memcpy(txRing, data + first, len - first);
+  txUsed += len;
+
+  QueuedPacket& packet = txPackets[(txPacketHead + txPacketCount) % MQTT_QUEUE_PACKETS];
+  packet.length = len;
+  packet.originMs = originMs;
+  txPacketCount++;
+
+  stats.queueDepth = txPacketCount;
+  if (txPacketCount > stats.queueMaxDepth) {
+    stats.queueMaxDepth = txPacketCount;
+  }
+  return true;
+}
+
+/**
+ * Build a PUBLISH packet and queue it
+ */
+static bool queuePublish(const char* topic, const char* payload, bool retain, unsigned long originMs) {
+  size_t topicLen = strlen(topic);
+  size_t payloadLen = strlen(payload);
+  if (5 + 2 + topicLen + payloadLen > MQTT_MAX_PACKET) {
+    stats.dropped++;
+    return false;
+  }
+
+  size_t pos = putString(txScratch, 5, topic);
+  memcpy(txScratch + pos, payload, payloadLen);
+  pos += payloadLen;
+
+  size_t start;
+  size_t len = finishPacket(MQTT_PUBLISH | (retain ? MQTT_RETAIN : 0), pos - 5, start);
+  return enqueuePacket(txScratch + start, len, originMs);
+}
+
+/**
+ * Write all queued packets to the socket in as few writes as possible
+ * (at most two when the ring wraps), so a batch of state updates leaves
+ * in a single TCP segment.
+ */
+static bool flushQueue() {
+  if (txUsed == 0) {
+    return true;
+  }
+
+  size_t written = 0;
+  while (txUsed > 0) {
+    size_t chunk = min(txUsed, (size_t)MQTT_QUEUE_BYTES - txHead);
+    size_t n = mqttSocket.write(txRing + txHead, chunk);
+    if (n == 0) {
+      break;  // Socket buffer full, retry next loop
+    }
+    txHead = (txHead + n) % MQTT_QUEUE_BYTES;
+    txUsed -= n;
+    written += n;
+    if (n < chunk) {
+      break;
+    }
+  }
+  if (written == 0) {
+    return mqttSocket.connected();
+  }
+  lastOutbound = millis();
+  stats.batches++;
+
+  // Retire fully written packets and record their latency
+  unsigned long now = millis();
+  txHeadPacketSent += written;
+  while (txPacketCount > 0 && txHeadPacketSent >= txPackets[txPacketHead].length) {
+    QueuedPacket& packet = txPackets[txPacketHead];
+    txHeadPacketSent -= packet.length;
+    txPacketHead = (txPacketHead + 1) % MQTT_QUEUE_PACKETS;
+    txPacketCount--;
+
+    uint32_t latency = now - packet.originMs;
+    stats.lastLatencyMs = latency;
+    stats.avgLatencyMs = (stats.avgLatencyMs * 7 + latency) / 8;
+    if (latency > stats.maxLatencyMs) {
+      stats.maxLatencyMs = latency;
+    }
+    stats.published++;
+  }
+  stats.queueDepth = txPacketCount;
+  return true;
+}
+
+/**
+ * Close the connection and schedule a reconnect with exponential backoff
+ */
+static void dropConnection(const char* reason) {
+  LOG_I(MQTT, "MQTT disconnected: %s (retry in %lu ms)", reason, backoffMs);
+  if (pendingFd >= 0) {
+    close(pendingFd);
+    pendingFd = -1;
+  }
+  mqttSocket.stop();
+  mqttState = MQTT_STATE_DISCONNECTED;
+  clearQueue();
+  rxLength = 0;
+  rxSkip = 0;
+
+  nextAttempt = millis() + backoffMs + random(backoffMs / 4 + 1);
+  backoffMs = min(backoffMs * 2, MQTT_BACKOFF_MAX_MS);
+}
+
+/**
+ * Write a control packet straight to the socket
+ * Only between packets: callers make sure no queued packet is partly
+ * written (txHeadPacketSent == 0), or the stream would be corrupted.
+ *
+ * @return Bytes written; anything short of len leaves a partial packet
+ *         on the stream unless it is 0
+ */
+static size_t writeDirect(const uint8_t* data, size_t len) {
+  size_t n = mqttSocket.write(data, len);
+  if (n > 0) {
+    lastOutbound = millis();
+  }
+  return n;
+}
+
+/**
+ * Count a failed connection attempt; the next one resolves the broker again
+ */
+static void failConnect(const char* reason) {
+  stats.connectFailures++;
+  brokerResolved = false;
+  dropConnection(reason);
+}
+
+/**
+ * lwIP DNS callback (tcpip task)
+ */
+static void onBrokerResolved(const char* name, const ip_addr_t* addr, void* arg) {
+  dnsResult = addr ? ip4_addr_get_u32(ip_2_ip4(addr)) : 0;
+  dnsDone = true;
+}
+
+/**
+ * Start the non-blocking TCP connect to brokerIp
+ */
+static void startTcpConnect() {
+  LOG_I(MQTT, "MQTT connecting to %s (%s):%d...", MQTT_BROKER_HOST, brokerIp.toString().c_str(),
+        MQTT_BROKER_PORT);
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    failConnect("no socket");
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(MQTT_BROKER_PORT);
+  address.sin_addr.s_addr = (uint32_t)brokerIp;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    failConnect("TCP connect failed");
+    return;
+  }
+  pendingFd = fd;
+  mqttState = MQTT_STATE_TCP_CONNECTING;
+  connectStarted = millis();
+}
+
+/**
+ * Begin a connection attempt: resolve the broker unless already known
+ */
+static void startConnect() {
+  if (brokerResolved || brokerIp.fromString(MQTT_BROKER_HOST)) {
+    brokerResolved = true;
+    startTcpConnect();
+    return;
+  }
+
+  ip_addr_t addr;
+  dnsDone = false;
+  err_t err = dns_gethostbyname(MQTT_BROKER_HOST, &addr, onBrokerResolved, nullptr);
+  if (err == ERR_OK) {
+    brokerIp = IPAddress(ip4_addr_get_u32(ip_2_ip4(&addr)));
+    brokerResolved = true;
+    startTcpConnect();
+  } else if (err == ERR_INPROGRESS) {
+    LOG_I(MQTT, "MQTT resolving %s...", MQTT_BROKER_HOST);
+    mqttState = MQTT_STATE_RESOLVING;
+    connectStarted = millis();
+  } else {
+    failConnect("DNS lookup failed");
+  }
+}
+
+/**
+ * Send CONNECT (with last will on availability) once the TCP connect
+ * completed; mqttSocket takes over the socket from here
+ */
+static void sendConnect() {
+  mqttSocket = WiFiClient(pendingFd);
+  pendingFd = -1;
+  mqttSocket.setNoDelay(true);  // Batching is done by flushQueue()
+
+  char willTopic[64];
+  snprintf(willTopic, sizeof(willTopic), "%s/availability", baseTopic);
+  // MQTT 3.1.1 (3.1.2.9): no password without a user name
+  bool hasUser = MQTT_USERNAME[0] != '\0';
+  bool hasPass = hasUser && MQTT_PASSWORD[0] != '\0';
+
+  size_t pos = putString(txScratch, 5, "MQTT");
+  txScratch[pos++] = 0x04;                       // Protocol level 3.1.1
+  txScratch[pos++] = 0x02 | 0x04 | 0x20 |        // Clean session, will, will retain
+                     (hasUser ? 0x80 : 0) | (hasPass ? 0x40 : 0);
+  txScratch[pos++] = MQTT_KEEPALIVE_S >> 8;
+  txScratch[pos++] = MQTT_KEEPALIVE_S & 0xFF;
+  pos = putString(txScratch, pos, clientId);
+  pos = putString(txScratch, pos, willTopic);
+  pos = putString(txScratch, pos, "offline");
+  if (hasUser) {
+    pos = putString(txScratch, pos, MQTT_USERNAME);
+  }
+  if (hasPass) {
+    pos = putString(txScratch, pos, MQTT_PASSWORD);
+  }
+
+  size_t start;
+  size_t len = finishPacket(MQTT_CONNECT, pos - 5, start);
+  if (writeDirect(txScratch + start, len) != len) {
+    stats.connectFailures++;
+    dropConnection("CONNECT write failed");
+    return;
+  }
+  mqttState = MQTT_STATE_CONNECTING;
+  connectStarted = millis();
+}
+
+/**
+ * Check the pending TCP connect without waiting: writable means done,
+ * SO_ERROR tells whether it succeeded
+ */
+static void pollTcpConnect(unsigned long now) {
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(pendingFd, &writable);
+  struct timeval noWait = { 0, 0 };
+  if (select(pendingFd + 1, nullptr, &writable, nullptr, &noWait) != 1) {
+    if (!wifiUp) {
+      failConnect("WiFi lost during connect");
+    } else if (now - connectStarted > MQTT_CONNECT_TIMEOUT_MS) {
+      failConnect("TCP connect timeout");
+    }
+    return;
+  }
+
+  int error = 0;
+  socklen_t errorLen = sizeof(error);
+  if (getsockopt(pendingFd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 || error != 0) {
+    failConnect("TCP connect failed");
+    return;
+  }
+  sendConnect();
+}
+
+/**
+ * Subscribe to the command topics and Home Assistant's birth message
+ * Sent right after CONNACK, before anything is queued.
+ *
+ * @return true if the whole packet was written
+ */
+static bool sendSubscribe() {
+  char cmdTopic[64];
+  char cmdWildcard[64];
+  snprintf(cmdTopic, sizeof(cmdTopic), "%s/set", baseTopic);
+  snprintf(cmdWildcard, sizeof(cmdWildcard), "%s/+/set", baseTopic);
+
+  size_t pos = 5;
+  txScratch[pos++] = 0x00;  // Packet identifier
+  txScratch[pos++] = 0x01;
+  pos = putString(txScratch, pos, cmdTopic);
+  txScratch[pos++] = 0x00;  // QoS 0
+  pos = putString(txScratch, pos, cmdWildcard);
+  txScratch[pos++] = 0x00;
+  pos = putString(txScratch, pos, MQTT_DISCOVERY_PREFIX "/status");
+  txScratch[pos++] = 0x00;
+
+  size_t start;
+  size_t len = finishPacket(MQTT_SUBSCRIBE, pos - 5, start);
+  return writeDirect(txScratch + start, len) == len;
+}
+
+/**
+ * Queue the Home Assistant discovery config (retained)
+ */
+static void queueDiscovery() {
+  char topic[96];
+  snprintf(topic, sizeof(topic), MQTT_DISCOVERY_PREFIX "/light/%s/config", clientId);
+
+  char config[640];
+  snprintf(config, sizeof(config),
+           "{\"~\":\"%s\",\"name\":null,\"uniq_id\":\"%s_light\","
+           "\"cmd_t\":\"~/set\",\"stat_t\":\"~/state\","
+           "\"bri_cmd_t\":\"~/brightness/set\",\"bri_stat_t\":\"~/brightness\","
+           "\"rgb_cmd_t\":\"~/rgb/set\",\"rgb_stat_t\":\"~/rgb\","
+           "\"fx_cmd_t\":\"~/effect/set\",\"fx_stat_t\":\"~/effect\","
+           "\"fx_list\":[\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"],"
+           "\"avty_t\":\"~/availability\","
+           "\"dev\":{\"ids\":[\"%s\"],\"name\":\"%s\",\"mf\":\"icebear74\","
+           "\"mdl\":\"%s %s\",\"sw\":\"%s\"}}",
+           baseTopic, clientId,
+           effectName(EFFECT_TOGGLE), effectName(EFFECT_CROSSFADE), effectName(EFFECT_SOLID),
+           effectName(EFFECT_SEQUENCE), effectName(EFFECT_PROGRAM), effectName(EFFECT_AUDIO), clientId, clientId,
+           ESP_MANUFACTURER, ESP_MODEL_NUMBER, DECKENLAMPE_VERSION);
+
+  if (queuePublish(topic, config, true, millis())) {
+    discoveryPending = false;
+    LOG_I(MQTT, "MQTT discovery config queued (%u bytes)", strlen(config));
+  }
+}
+
+/**
+ * Queue retained state publishes for every field that changed since the
+ * last publish (all fields after a reconnect)
+ *
+ * @return false if the queue rejected a publish; that field stays
+ *         unpublished and is retried on the next pass
+ */
+static bool queueStatePublish(unsigned long originMs) {
+  const LampState& state = getLampState();
+  char topic[64];
+  char payload[16];
+  bool complete = true;
+
+  if (!(publishedFields & STATE_FIELD_ON) || state.on != publishedState.on) {
+    snprintf(topic, sizeof(topic), "%s/state", baseTopic);
+    if (queuePublish(topic, state.on ? "ON" : "OFF", true, originMs)) {
+      publishedState.on = state.on;
+      publishedFields |= STATE_FIELD_ON;
+    } else {
+      complete = false;
+    }
+  }
+  if (!(publishedFields & STATE_FIELD_BRIGHTNESS) || state.brightness != publishedState.brightness) {
+    snprintf(topic, sizeof(topic), "%s/brightness", baseTopic);
+    snprintf(payload, sizeof(payload), "%u", state.brightness);
+    if (queuePublish(topic, payload, true, originMs)) {
+      publishedState.brightness = state.brightness;
+      publishedFields |= STATE_FIELD_BRIGHTNESS;
+    } else {
+      complete = false;
+    }
+  }
+  if (!(publishedFields & STATE_FIELD_COLOR) || memcmp(state.color, publishedState.color, sizeof(state.color)) != 0) {
+    snprintf(topic, sizeof(topic), "%s/rgb", baseTopic);
+    snprintf(payload, sizeof(payload), "%u,%u,%u", state.color[0], state.color[1], state.color[2]);
+    if (queuePublish(topic, payload, true, originMs)) {
+      memcpy(publishedState.color, state.color, sizeof(state.color));
+      publishedFields |= STATE_FIELD_COLOR;
+    } else {
+      complete = false;
+    }
+  }
+  if (!(publishedFields & STATE_FIELD_EFFECT) || state.effect != publishedState.effect) {
+    snprintf(topic, sizeof(topic), "%s/effect", baseTopic);
+    if (queuePublish(topic, effectName(state.effect), true, originMs)) {
+      publishedState.effect = state.effect;
+      publishedFields |= STATE_FIELD_EFFECT;
+    } else {
+      complete = false;
+    }
+  }
+
+  return complete;
+}
+
+/**
+ * Apply an inbound PUBLISH to the lamp
+ */
+static void handleCommand(const char* topic, const char* payload) {
+  stats.received++;
+
+  if (strcmp(topic, MQTT_DISCOVERY_PREFIX "/status") == 0) {
+    if (strcmp(payload, "online") == 0) {
+      discoveryPending = true;  // Home Assistant restarted
+      publishedFields = 0;
+      stateDirty = true;
+    }
+    return;
+  }
+
+  size_t baseLen = strlen(baseTopic);
+  if (strncmp(topic, baseTopic, baseLen) != 0 || topic[baseLen] != '/') {
+    return;
+  }
+  const char* command = topic + baseLen + 1;
+
+  if (strcmp(command, "set") == 0) {
+    setLampPower(strcmp(payload, "ON") == 0);
+  } else if (strcmp(command, "brightness/set") == 0) {
+    setLampBrightness(constrain(atoi(payload), 0, 255));
+  } else if (strcmp(command, "rgb/set") == 0) {
+    int r, g, b;
+    if (sscanf(payload, "%d,%d,%d", &r, &g, &b) == 3) {
+      setLampColor(constrain(r, 0, 255), constrain(g, 0, 255), constrain(b, 0, 255));
+    }
+  } else if (strcmp(command, "effect/set") == 0) {
+    int effect = effectFromName(payload);
+    if (effect >= 0) {
+      setLampEffect(effect);
+    }
+  }
+}
+
+/**
+ * Process one complete inbound packet
+ */
+static void handlePacket(uint8_t type, const uint8_t* body, size_t len) {
+  lastInbound = millis();
+
+  switch (type & 0xF0) {
+    case MQTT_CONNACK:
+      if (mqttState == MQTT_STATE_CONNECTING) {
+        if (len >= 2 && body[1] == 0) {
+          mqttState = MQTT_STATE_CONNECTED;
+          backoffMs = MQTT_BACKOFF_MIN_MS;
+          pingOutstanding = false;
+          stats.connects++;
+          LOG_I(MQTT, "MQTT connected");
+
+          if (!sendSubscribe()) {
+            dropConnection("SUBSCRIBE write failed");
+            break;
+          }
+          char topic[64];
+          snprintf(topic, sizeof(topic), "%s/availability", baseTopic);
+          queuePublish(topic, "online", true, millis());
+          publishedFields = 0;
+          stateDirty = true;
+          dirtySince = millis();
+        } else {
+          stats.connectFailures++;
+          LOG_W(MQTT, "MQTT connection refused (code %d)", len >= 2 ? body[1] : -1);
+          dropConnection("refused");
+        }
+      }
+      break;
+
+    case MQTT_PUBLISH: {
+      if (len < 2) {
+        break;
+      }
+      size_t topicLen = ((size_t)body[0] << 8) | body[1];
+      size_t offset = 2 + topicLen + (((type >> 1) & 0x03) ? 2 : 0);  // Skip packet id for QoS > 0
+      if (offset > len) {
+        break;
+      }
+      char topic[96];
+      char payload[64];
+      size_t payloadLen = len - offset;
+      if (topicLen >= sizeof(topic) || payloadLen >= sizeof(payload)) {
+        break;
+      }
+      memcpy(topic, body + 2, topicLen);
+      topic[topicLen] = '\0';
+      memcpy(payload, body + offset, payloadLen);
+      payload[payloadLen] = '\0';
+      handleCommand(topic, payload);
+      break;
+    }
+
+    case MQTT_PINGRESP:
+      pingOutstanding = false;
+      break;
+
+    default:
+      break;  // SUBACK and others need no action
+  }
+}
+
+/**
+ * Read available bytes and dispatch every complete packet
+ */
+static void pollInbound() {
+  while (mqttSocket.available() > 0) {
+    if (rxSkip > 0) {
+      uint8_t discard[32];
+      int n = mqttSocket.read(discard, min(rxSkip, sizeof(discard)));
+      if (n <= 0) {
+        return;
+      }
+      rxSkip -= n;
+      continue;
+    }
+    int n = mqttSocket.read(rxBuffer + rxLength, sizeof(rxBuffer) - rxLength);
+    if (n <= 0) {
+      return;
+    }
+    rxLength += n;
+
+    // Parse as many complete packets as the buffer holds
+    while (rxLength >= 2) {
+      size_t remaining = 0;
+      size_t multiplier = 1;
+      size_t pos = 1;
+      bool complete = false;
+      while (pos < rxLength && pos <= 4) {
+        uint8_t digit = rxBuffer[pos++];
+        remaining += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+        if ((digit & 0x80) == 0) {
+          complete = true;
+          break;
+        }
+      }
+      if (!complete) {
+        break;  // Length field not fully received yet
+      }
+
+      size_t total = pos + remaining;
+      if (total > sizeof(rxBuffer)) {
+        rxSkip = total - rxLength;  // Too large for us (e.g. foreign retained message)
+        rxLength = 0;
+        break;
+      }
+      if (rxLength < total) {
+        break;
+      }
+      handlePacket(rxBuffer[0], rxBuffer + pos, remaining);
+      if (mqttState == MQTT_STATE_DISCONNECTED) {
+        return;
+      }
+      memmove(rxBuffer, rxBuffer + total, rxLength - total);
+      rxLength -= total;
+    }
+  }
+}
+
+/**
+ * WiFi event hook: reconnect right after getting an IP, stop on link loss
+ */
+static void onMqttWiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    wifiUp = true;
+    wifiGotIp = true;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    wifiUp = false;
+  }
+}
+
+/**
+ * Initialize the MQTT client
+ * Topics are derived from the unique hostname.
+ */
+void setupMqtt() {
+  if (MQTT_BROKER_HOST[0] == '\0') {
+    LOG_I(MQTT, "MQTT disabled (no broker configured)");
+    return;
+  }
+  snprintf(clientId, sizeof(clientId), "%s", WiFi.getHostname());
+  snprintf(baseTopic, sizeof(baseTopic), MQTT_TOPIC_PREFIX "/%s", clientId);
+
+  WiFi.onEvent(onMqttWiFiEvent);
+  wifiUp = WiFi.status() == WL_CONNECTED;
+  nextAttempt = millis();
+  seenStateVersion = lampStateVersion();
+  mqttEnabled = true;
+
+  if (MQTT_USERNAME[0] == '\0' && MQTT_PASSWORD[0] != '\0') {
+    LOG_W(MQTT, "MQTT_PASSWORD ignored: MQTT 3.1.1 sends a password only with MQTT_USERNAME");
+  }
+  LOG_I(MQTT, "MQTT client ready, broker %s:%d, topic %s", MQTT_BROKER_HOST, MQTT_BROKER_PORT, baseTopic);
+}
+
+/**
+ * Run the MQTT state machine (call from the main loop)
+ */
+void handleMqtt() {
+  if (!mqttEnabled) {
+    return;
+  }
+  unsigned long now = millis();
+
+  if (wifiGotIp) {
+    wifiGotIp = false;
+    backoffMs = MQTT_BACKOFF_MIN_MS;  // Fresh link: retry immediately
+    nextAttempt = now;
+  }
+
+  // Track lamp state changes for coalesced publishing
+  uint32_t version = lampStateVersion();
+  if (version != seenStateVersion) {
+    seenStateVersion = version;
+    if (!stateDirty) {
+      dirtySince = now;
+    }
+    stateDirty = true;
+    lastStateChange = now;
+  }
+
+  switch (mqttState) {
+    case MQTT_STATE_DISCONNECTED:
+      if (wifiUp && (long)(now - nextAttempt) >= 0) {
+        startConnect();
+      }
+      break;
+
+    case MQTT_STATE_RESOLVING:
+      if (dnsDone) {
+        if (dnsResult == 0) {
+          failConnect("DNS lookup failed");
+          break;
+        }
+        brokerIp = IPAddress((uint32_t)dnsResult);
+        brokerResolved = true;
+        startTcpConnect();
+      } else if (now - connectStarted > MQTT_CONNECT_TIMEOUT_MS * 5) {
+        failConnect("DNS timeout");
+      }
+      break;
+
+    case MQTT_STATE_TCP_CONNECTING:
+      pollTcpConnect(now);
+      break;
+
+    case MQTT_STATE_CONNECTING:
+      if (!wifiUp || !mqttSocket.connected()) {
+        stats.connectFailures++;
+        dropConnection("connection lost during handshake");
+      } else if (now - connectStarted > MQTT_CONNECT_TIMEOUT_MS * 5) {
+        stats.connectFailures++;
+        dropConnection("CONNACK timeout");
+      } else {
+        pollInbound();
+      }
+      break;
+
+    case MQTT_STATE_CONNECTED:
+      if (!wifiUp || !mqttSocket.connected()) {
+        dropConnection("connection lost");
+        break;
+      }
+      pollInbound();
+      if (mqttState != MQTT_STATE_CONNECTED) {
+        break;
+      }
+
+      if (discoveryPending) {
+        queueDiscovery();
+      }
+      // Publish once the state has been quiet for the coalesce window,
+      // but never delay a busy stream of changes by more than 5 windows
+      if (stateDirty && (now - lastStateChange >= MQTT_STATE_COALESCE_MS ||
+                         now - dirtySince >= MQTT_STATE_COALESCE_MS * 5)) {
+        stateDirty = !queueStatePublish(dirtySince);
+      }
+
+      if (!flushQueue()) {
+        dropConnection("write failed");
+        break;
+      }
+
+      // Keep-alive; PINGREQ only between packets, never inside a partly
+      // written one (the socket may accept more bytes than flushQueue got).
+      // pollInbound and flushQueue stamp lastInbound/lastOutbound with a
+      // later millis() than now, which would wrap the differences below
+      now = millis();
+      if (pingOutstanding && now - lastInbound > MQTT_KEEPALIVE_S * 1000UL) {
+        dropConnection("keep-alive timeout");
+      } else if (!pingOutstanding && txHeadPacketSent == 0 && now - lastOutbound > MQTT_KEEPALIVE_S * 500UL) {
+        static const uint8_t ping[2] = { MQTT_PINGREQ, 0x00 };
+        size_t n = writeDirect(ping, sizeof(ping));
+        if (n == sizeof(ping)) {
+          pingOutstanding = true;
+        } else if (n > 0) {
+          dropConnection("partial PINGREQ write");
+        }
+      }
+      break;
+  }
+
+  if (mqttState == MQTT_STATE_CONNECTED && now - lastReport >= MQTT_REPORT_INTERVAL_MS) {
+    lastReport = now;
+    LOG_I(MQTT, "MQTT: %u published in %u batches, %u dropped, queue %u (max %u), latency %u ms (avg %u, max %u)",
+                stats.published, stats.batches, stats.dropped, stats.queueDepth, stats.queueMaxDepth,
+                stats.lastLatencyMs, stats.avgLatencyMs, stats.maxLatencyMs);
+  }
+}
+
+/**
+ * Check whether the broker connection is up
+ */
+bool mqttConnected() {
+  return mqttState == MQTT_STATE_CONNECTED;
+}
+
+/**
+ * Queue a publish for the next flush
+ *
+ * @param topic Full topic
+ * @param payload Payload string
+ * @param retain Retain flag
+ * @return false if the queue is full or the packet is too large
+ */
+bool mqttPublish(const char* topic, const char* payload, bool retain) {
+  if (mqttState != MQTT_STATE_CONNECTED) {
+    return false;
+  }
+  return queuePublish(topic, payload, retain, millis());
+}
+
+/**
+ * Get MQTT client statistics
+ *
+ * @return Reference to the live statistics
+ */
+const MqttStats& getMqttStats() {
+  return stats;
+}
@@ -0,0 +1,66 @@
+/**
+ * MQTT_Client.h - MQTT control plane for CeilingLamp
+ *
+ * Small non-blocking MQTT 3.1.1 client (QoS 0) driven from the main loop:
+ * - Home Assistant MQTT discovery (light with brightness, RGB and effects)
+ * - Command topics mapped onto Lamp_Control
+ * - State changes are coalesced for MQTT_STATE_COALESCE_MS and published
+ *   as one batch, so rapid slider moves do not flood the broker
+ * - Outbound packets go through a fixed-size ring buffer (no heap)
+ * - Reconnects use exponential backoff, reset by the WiFi GOT_IP event
+ *
+ * Author: icebear74
+ */
+
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <Arduino.h>
+
+// Topics
+#define MQTT_TOPIC_PREFIX     "deckenlampe"
+#define MQTT_DISCOVERY_PREFIX "homeassistant"
+
+// Buffer sizes
+#define MQTT_QUEUE_BYTES   2048  // Outbound ring buffer
+#define MQTT_QUEUE_PACKETS 16    // Max queued packets
+#define MQTT_MAX_PACKET    768   // Largest packet we build (discovery config)
+#define MQTT_RX_BUFFER     256   // Largest inbound packet we parse
+
+// Broker configuration (configure these for your broker)
+extern const char* MQTT_BROKER_HOST;
+extern const uint16_t MQTT_BROKER_PORT;
+extern const char* MQTT_USERNAME;
+extern const char* MQTT_PASSWORD;
+
+// Client configuration
+extern const uint16_t MQTT_KEEPALIVE_S;
+extern const unsigned long MQTT_CONNECT_TIMEOUT_MS;
+extern const unsigned long MQTT_BACKOFF_MIN_MS;
+extern const unsigned long MQTT_BACKOFF_MAX_MS;
+extern const unsigned long MQTT_STATE_COALESCE_MS;
+extern const unsigned long MQTT_REPORT_INTERVAL_MS;
+
+// MQTT client statistics
+struct MqttStats {
+  uint32_t connects;
+  uint32_t connectFailures;
+  uint32_t published;         // Packets written to the socket
+  uint32_t batches;           // Socket writes carrying queued packets
+  uint32_t dropped;           // Packets rejected because the queue was full
+  uint32_t received;          // Inbound PUBLISH packets
+  uint32_t queueDepth;        // Packets currently queued
+  uint32_t queueMaxDepth;
+  uint32_t lastLatencyMs;     // State change (or enqueue) to socket write
+  uint32_t avgLatencyMs;
+  uint32_t maxLatencyMs;
+};
+
+// Function declarations
+void setupMqtt();
+void handleMqtt();
+bool mqttConnected();
+bool mqttPublish(const char* topic, const char* payload, bool retain);
+const MqttStats& getMqttStats();
+
+#endif // MQTT_CLIENT_H
@@ -0,0 +1,282 @@
+/**
+ * Metrics.cpp - Runtime metrics registry implementation
+ *
+ * Histograms keep one (non-cumulative) count per bucket; the cumulative
+ * Prometheus buckets and _count are summed up at export time, which keeps
+ * metricsObserve() at one bucket search and two atomic adds.
+ *
+ * Author: icebear74
+ */
+
+#include "Metrics.h"
+#include "Static_Alloc.h"
+#include "Version.h"
+#include "WiFi.h"
+#include <atomic>
+#include <esp_heap_caps.h>
+
+// Metrics configuration
+const unsigned long METRICS_SAMPLE_INTERVAL_MS = 1000;  // Heap/RSSI/frame rate sampling, 64-bit extension
+
+struct MetricInfo {
+  const char* name;
+  const char* help;
+};
+
+struct HistogramInfo {
+  const char* name;
+  const char* help;
+  const uint32_t* bounds;       // Upper bucket bounds in us, ascending
+  uint8_t boundCount;
+};
+
+// Bucket bounds (microseconds)
+static const uint32_t loopBounds[] = { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+static const uint32_t showBounds[] = { 250, 500, 1000, 1500, 2000, 3000, 5000, 10000 };
+static const uint32_t httpBounds[] = { 1000, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 5000000 };
+static const uint32_t audioBounds[] = { 100, 200, 300, 500, 750, 1000, 1500, 2500, 5000 };
+static_assert(sizeof(loopBounds) / sizeof(loopBounds[0]) <= METRIC_MAX_BUCKETS, "too many buckets");
+static_assert(sizeof(showBounds) / sizeof(showBounds[0]) <= METRIC_MAX_BUCKETS, "too many buckets");
+static_assert(sizeof(httpBounds) / sizeof(httpBounds[0]) <= METRIC_MAX_BUCKETS, "too many buckets");
+static_assert(sizeof(audioBounds) / sizeof(audioBounds[0]) <= METRIC_MAX_BUCKETS, "too many buckets");
+
+static const MetricInfo counterInfo[METRIC_COUNTER_COUNT] = {
+  { "deckenlampe_frames_shown_total", "LED frames pushed to the strip" },
+  { "deckenlampe_wifi_reconnects_total", "WiFi station disconnects" },
+  { "deckenlampe_ntp_syncs_total", "Successful NTP synchronizations" },
+  { "deckenlampe_ota_bytes_total", "Firmware bytes written by web, HTTP and fleet OTA" },
+  { "deckenlampe_loop_heap_allocations_total", "Heap allocations seen by the main loop after setup (new, malloc if wrapped)" },
+  { "deckenlampe_settings_flash_writes_total", "Settings journal flash writes" },
+  { "deckenlampe_settings_sector_erases_total", "Settings journal sector erases" },
+  { "deckenlampe_effect_vm_overruns_total", "Effect program frames cut short by the frame budget" },
+  { "deckenlampe_audio_beats_total", "Beats detected in the microphone signal" },
+  { "deckenlampe_audio_overruns_total", "Audio blocks lost to I2S DMA overflow" },
+};
+
+static const MetricInfo gaugeInfo[METRIC_GAUGE_COUNT] = {
+  { "deckenlampe_heap_free_bytes", "Free heap" },
+  { "deckenlampe_heap_min_free_bytes", "Lowest free heap since boot" },
+  { "deckenlampe_heap_largest_free_block_bytes", "Largest allocatable heap block" },
+  { "deckenlampe_heap_largest_free_block_min_bytes", "Smallest largest-free-block seen since boot (fragmentation)" },
+  { "deckenlampe_heap_allocated_blocks", "Allocated heap blocks" },
+  { "deckenlampe_scratch_arena_high_water_bytes", "Peak use of the loop scratch arena" },
+  { "deckenlampe_wifi_connected", "1 if the station is connected" },
+  { "deckenlampe_wifi_rssi_dbm", "WiFi signal strength" },
+  { "deckenlampe_ntp_offset_seconds", "Clock error corrected by the last NTP sync" },
+  { "deckenlampe_frames_per_second", "LED frames shown in the last sample interval" },
+  { "deckenlampe_ota_throughput_bytes_per_second", "Receive throughput of the last OTA update" },
+  { "deckenlampe_settings_flash_writes_per_day", "Settings journal flash writes in the last 24 hours" },
+  { "deckenlampe_power_static", "1 while the output is static (low clock, sleeping loop)" },
+  { "deckenlampe_loop_idle_percent", "Share of the last second the main loop slept" },
+  { "deckenlampe_loop_wakeups_per_second", "Main loop wakeups in the last second" },
+  { "deckenlampe_cpu_frequency_mhz", "Current CPU clock" },
+  { "deckenlampe_uptime_seconds", "Time since boot" },
+  { "deckenlampe_audio_cpu_percent", "Share of one core used by audio feature extraction" },
+  { "deckenlampe_audio_latency_microseconds", "Audio capture to LED frame latency of the last audio frame" },
+};
+
+static const HistogramInfo histogramInfo[METRIC_HISTOGRAM_COUNT] = {
+  { "deckenlampe_loop_duration_seconds", "Main loop work time per iteration",
+    loopBounds, sizeof(loopBounds) / sizeof(loopBounds[0]) },
+  { "deckenlampe_led_show_duration_seconds", "FastLED.show() duration",
+    showBounds, sizeof(showBounds) / sizeof(showBounds[0]) },
+  { "deckenlampe_http_request_duration_seconds", "Web server request handling time",
+    httpBounds, sizeof(httpBounds) / sizeof(httpBounds[0]) },
+  { "deckenlampe_audio_dsp_duration_seconds", "Audio feature extraction time per block",
+    audioBounds, sizeof(audioBounds) / sizeof(audioBounds[0]) },
+};
+
+// Raw values, updated from any task
+static std::atomic<uint32_t> counters[METRIC_COUNTER_COUNT];
+static std::atomic<int32_t> gauges[METRIC_GAUGE_COUNT];
+static std::atomic<uint32_t> buckets[METRIC_HISTOGRAM_COUNT][METRIC_MAX_BUCKETS + 1];
+static std::atomic<uint32_t> sumsUs[METRIC_HISTOGRAM_COUNT];
+
+// 64-bit extension of a wrapping 32-bit value (main loop only)
+struct WideValue {
+  uint32_t last;
+  uint64_t total;
+};
+
+static WideValue wideCounters[METRIC_COUNTER_COUNT];
+static WideValue wideBuckets[METRIC_HISTOGRAM_COUNT][METRIC_MAX_BUCKETS + 1];
+static WideValue wideSums[METRIC_HISTOGRAM_COUNT];
+
+// Sampling state
+static unsigned long lastSample = 0;
+static uint64_t lastFrames = 0;
+static uint32_t largestBlockMin = UINT32_MAX;
+
+/**
+ * Increment a counter
+ *
+ * @param counter Counter to increment
+ * @param n Amount
+ */
+void metricsInc(MetricCounter counter, uint32_t n) {
+  counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * Set a gauge
+ *
+ * @param gauge Gauge to set
+ * @param value New value
+ */
+void metricsSet(MetricGauge gauge, int32_t value) {
+  gauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+/**
+ * Record a histogram sample
+ *
+ * @param histogram Histogram to update
+ * @param us Sample in microseconds
+ */
+void metricsObserve(MetricHistogram histogram, uint32_t us) {
+  const HistogramInfo& info = histogramInfo[histogram];
+  uint8_t bucket = 0;
+  while (bucket < info.boundCount && us > info.bounds[bucket]) {
+    bucket++;
+  }
+  buckets[histogram][bucket].fetch_add(1, std::memory_order_relaxed);
+  sumsUs[histogram].fetch_add(us, std::memory_order_relaxed);
+}
+
+/**
+ * Add the change of a raw 32-bit value since the last call
+ *
+ * @return 64-bit total
+ */
+static uint64_t widen(WideValue& wide, const std::atomic<uint32_t>& raw) {
+  uint32_t value = raw.load(std::memory_order_relaxed);
+  wide.total += (uint32_t)(value - wide.last);
+  wide.last = value;
+  return wide.total;
+}
+
+/**
+ * Fold all raw counters into their 64-bit totals
+ */
+static void accumulate() {
+  for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+    widen(wideCounters[c], counters[c]);
+  }
+  for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+    for (int b = 0; b <= histogramInfo[h].boundCount; b++) {
+      widen(wideBuckets[h][b], buckets[h][b]);
+    }
+    widen(wideSums[h], sumsUs[h]);
+  }
+}
+
+/**
+ * Sample heap, WiFi and frame rate gauges
+ * Call this function from the main loop; at most every
+ * METRICS_SAMPLE_INTERVAL_MS it costs a few microseconds.
+ */
+void handleMetrics() {
+  unsigned long now = millis();
+  if (now - lastSample < METRICS_SAMPLE_INTERVAL_MS) {
+    return;
+  }
+  unsigned long elapsed = now - lastSample;
+  lastSample = now;
+  accumulate();
+
+  uint64_t frames = wideCounters[METRIC_FRAMES_SHOWN].total;
+  metricsSet(METRIC_FRAME_RATE, (int32_t)((frames - lastFrames) * 1000 / elapsed));
+  lastFrames = frames;
+
+  metricsSet(METRIC_HEAP_FREE, ESP.getFreeHeap());
+  metricsSet(METRIC_HEAP_MIN_FREE, ESP.getMinFreeHeap());
+  multi_heap_info_t heap;
+  heap_caps_get_info(&heap, MALLOC_CAP_DEFAULT);
+  largestBlockMin = min(largestBlockMin, (uint32_t)heap.largest_free_block);
+  metricsSet(METRIC_HEAP_LARGEST_BLOCK, heap.largest_free_block);
+  metricsSet(METRIC_HEAP_LARGEST_MIN, largestBlockMin);
+  metricsSet(METRIC_HEAP_ALLOCATED_BLOCKS, heap.allocated_blocks);
+  bool connected = WiFi.status() == WL_CONNECTED;
+  metricsSet(METRIC_WIFI_CONNECTED, connected ? 1 : 0);
+  if (connected) {
+    metricsSet(METRIC_WIFI_RSSI, WiFi.RSSI());
+  }
+  metricsSet(METRIC_UPTIME, now / 1000);
+}
+
+// Chunked text output
+struct MetricsOutput {
+  void (*write)(const char* chunk);
+  FixedString<1024> buffer;
+};
+
+/**
+ * Append text, passing the buffer on whenever it would overflow
+ */
+static void emit(MetricsOutput& out, const char* text) {
+  size_t len = strlen(text);
+  if (out.buffer.length() + len > out.buffer.capacity()) {
+    out.write(out.buffer.c_str());
+    out.buffer.clear();
+  }
+  out.buffer.append(text, len);
+}
+
+/**
+ * Append HELP/TYPE lines of one metric family
+ */
+static void emitHeader(MetricsOutput& out, const char* name, const char* help, const char* type) {
+  char line[256];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  emit(out, line);
+}
+
+/**
+ * Export all metrics in Prometheus text format (version 0.0.4)
+ * Main loop only (shares the 64-bit totals with handleMetrics())
+ *
+ * @param write Receives the exposition text in chunks (null terminated)
+ */
+void writeMetrics(void (*write)(const char* chunk)) {
+  MetricsOutput out;
+  out.write = write;
+  char line[256];
+  accumulate();
+
+  emitHeader(out, "deckenlampe_build_info", "Firmware version", "gauge");
+  snprintf(line, sizeof(line), "deckenlampe_build_info{version=\"%s\"} 1\n", DECKENLAMPE_VERSION);
+  emit(out, line);
+
+  for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+    emitHeader(out, counterInfo[c].name, counterInfo[c].help, "counter");
+    snprintf(line, sizeof(line), "%s %llu\n", counterInfo[c].name,
+             (unsigned long long)wideCounters[c].total);
+    emit(out, line);
+  }
+
+  for (int g = 0; g < METRIC_GAUGE_COUNT; g++) {
+    emitHeader(out, gaugeInfo[g].name, gaugeInfo[g].help, "gauge");
+    snprintf(line, sizeof(line), "%s %d\n", gaugeInfo[g].name,
+             (int)gauges[g].load(std::memory_order_relaxed));
+    emit(out, line);
+  }
+
+  for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+    const HistogramInfo& info = histogramInfo[h];
+    emitHeader(out, info.name, info.help, "histogram");
+    uint64_t cumulative = 0;
+    for (int b = 0; b < info.boundCount; b++) {
+      cumulative += wideBuckets[h][b].total;
+      snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", info.name,
+               info.bounds[b] / 1e6, (unsigned long long)cumulative);
+      emit(out, line);
+    }
+    cumulative += wideBuckets[h][info.boundCount].total;
+    snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+             info.name, (unsigned long long)cumulative,
+             info.name, wideSums[h].total / 1e6,
+             info.name, (unsigned long long)cumulative);
+    emit(out, line);
+  }
+  write(out.buffer.c_str());
+}
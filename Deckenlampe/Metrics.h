@@ -0,0 +1,80 @@
+/**
+ * Metrics.h - Runtime metrics registry for CeilingLamp
+ *
+ * A fixed set of counters, gauges and histograms, exported in Prometheus
+ * text format on http://<lamp>/metrics. Every update is a single relaxed
+ * atomic operation, so the loop, the async_udp task, WiFi events and the
+ * OTA writer task can all record without locks:
+ * - metricsInc(METRIC_xxx)                    counter += n
+ * - metricsSet(METRIC_xxx, value)             gauge = value
+ * - metricsObserve(METRIC_xxx, microseconds)  histogram sample
+ *
+ * Raw values are 32 bit; handleMetrics() extends counters and histogram
+ * sums to 64 bit once per second, so exported totals do not wrap.
+ *
+ * Author: icebear74
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#define METRIC_MAX_BUCKETS 12   // Histogram buckets without +Inf
+
+// Metrics configuration
+extern const unsigned long METRICS_SAMPLE_INTERVAL_MS;
+
+enum MetricCounter {
+  METRIC_FRAMES_SHOWN = 0,      // FastLED.show() calls
+  METRIC_WIFI_RECONNECTS,       // Station disconnects
+  METRIC_NTP_SYNCS,             // Successful NTP synchronizations
+  METRIC_OTA_BYTES,             // Firmware bytes written (web, HTTP, fleet OTA)
+  METRIC_LOOP_HEAP_ALLOCATIONS, // operator new (wrapped malloc) calls by loop() after setup (Static_Alloc)
+  METRIC_SETTINGS_FLASH_WRITES, // Settings journal writes
+  METRIC_SETTINGS_ERASES,       // Settings journal sector erases
+  METRIC_VM_OVERRUNS,           // Effect program frames cut short by the budget
+  METRIC_AUDIO_BEATS,           // Beats detected in the microphone signal
+  METRIC_AUDIO_OVERRUNS,        // Audio blocks lost (I2S DMA overflow)
+  METRIC_COUNTER_COUNT
+};
+
+enum MetricGauge {
+  METRIC_HEAP_FREE = 0,         // Bytes
+  METRIC_HEAP_MIN_FREE,         // Bytes, low-water mark since boot
+  METRIC_HEAP_LARGEST_BLOCK,    // Bytes
+  METRIC_HEAP_LARGEST_MIN,      // Bytes, low-water mark of the largest block since boot
+  METRIC_HEAP_ALLOCATED_BLOCKS, // Blocks currently allocated
+  METRIC_SCRATCH_HIGH_WATER,    // Bytes, peak use of the loop scratch arena
+  METRIC_WIFI_CONNECTED,        // 0/1
+  METRIC_WIFI_RSSI,             // dBm
+  METRIC_NTP_OFFSET,            // Seconds the clock was off at the last sync
+  METRIC_FRAME_RATE,            // Frames shown per second
+  METRIC_OTA_THROUGHPUT,        // Bytes/s of the last update
+  METRIC_SETTINGS_DAY_WRITES,   // Settings journal writes in the last 24 h
+  METRIC_POWER_STATIC,          // 0/1, output static (low clock, sleeping loop)
+  METRIC_LOOP_IDLE_PERCENT,     // Share of time the loop slept
+  METRIC_LOOP_WAKEUPS,          // Loop iterations per second
+  METRIC_CPU_FREQ_MHZ,          // Current CPU clock
+  METRIC_UPTIME,                // Seconds
+  METRIC_AUDIO_CPU_PERCENT,     // Share of one core used by the audio DSP
+  METRIC_AUDIO_LATENCY_US,      // Audio capture to LED frame, last audio frame
+  METRIC_GAUGE_COUNT
+};
+
+enum MetricHistogram {
+  METRIC_LOOP_TIME = 0,         // loop() work time (without the delay)
+  METRIC_SHOW_TIME,             // FastLED.show() duration
+  METRIC_HTTP_REQUEST_TIME,     // Web server request handling
+  METRIC_AUDIO_DSP_TIME,        // Audio feature extraction per block
+  METRIC_HISTOGRAM_COUNT
+};
+
+// Function declarations
+void metricsInc(MetricCounter counter, uint32_t n = 1);
+void metricsSet(MetricGauge gauge, int32_t value);
+void metricsObserve(MetricHistogram histogram, uint32_t us);
+void handleMetrics();
+void writeMetrics(void (*write)(const char* chunk));
+
+#endif // METRICS_H
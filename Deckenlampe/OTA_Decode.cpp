@@ -0,0 +1,569 @@
+/**
+ * OTA_Decode.cpp - Compressed and delta OTA image implementation
+ *
+ * Two chained stages, each detecting its format from the first bytes:
+ *   network -> [gzip or plain] -> [delta or plain] -> OTA_Verify
+ *
+ * RAM is bounded: the inflater state and its 32 KB dictionary are only
+ * allocated for gzip uploads, delta COPY operations go through a 1 KB
+ * buffer read from the running partition.
+ *
+ * The gzip CRC is not checked: depending on the ROM version the inflater
+ * may keep trailer bytes in its bit buffer, and the SHA-256 in OTA_Verify
+ * covers the decoded image anyway. Trailing bytes are only bounded.
+ *
+ * Author: icebear74
+ */
+
+#include "OTA_Decode.h"
+#include "Log.h"
+#include "OTA_Verify.h"
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <rom/miniz.h>
+#include <mbedtls/sha256.h>
+
+#define GZIP_MAGIC_0     0x1F
+#define GZIP_MAGIC_1     0x8B
+#define GZIP_DEFLATE     8
+#define GZIP_HEADER_LEN  10
+#define GZIP_TRAILER_LEN 8
+
+// gzip header flags
+#define GZIP_FHCRC    0x02
+#define GZIP_FEXTRA   0x04
+#define GZIP_FNAME    0x08
+#define GZIP_FCOMMENT 0x10
+
+enum DecodeFormat : uint8_t {
+  FORMAT_UNKNOWN,
+  FORMAT_PLAIN,
+  FORMAT_GZIP,
+  FORMAT_DELTA
+};
+
+enum GzipState : uint8_t {
+  GZ_HEADER,
+  GZ_EXTRA_LEN,
+  GZ_EXTRA,
+  GZ_NAME,
+  GZ_COMMENT,
+  GZ_HCRC,
+  GZ_DATA,
+  GZ_TRAILER
+};
+
+enum DeltaState : uint8_t {
+  DELTA_HEADER,
+  DELTA_OP,
+  DELTA_ARGS,
+  DELTA_INSERT,
+  DELTA_DONE
+};
+
+// Stage 1: gzip
+static DecodeFormat inputFormat = FORMAT_UNKNOWN;
+static uint8_t inputSniff[2];
+static size_t inputSniffLength = 0;
+static GzipState gzState = GZ_HEADER;
+static uint8_t gzBuffer[GZIP_HEADER_LEN];
+static size_t gzCount = 0;
+static uint8_t gzFlags = 0;
+static uint32_t gzSkip = 0;
+static bool inflatePending = false;
+static tinfl_decompressor* inflator = nullptr;
+static uint8_t* dictionary = nullptr;
+static size_t dictOffset = 0;
+
+// Stage 2: delta
+static DecodeFormat imageFormat = FORMAT_UNKNOWN;
+static uint8_t imageSniff[4];
+static size_t imageSniffLength = 0;
+static DeltaState deltaState = DELTA_HEADER;
+static uint8_t deltaHeader[OTA_DELTA_HEADER_LEN];
+static size_t deltaHeaderLength = 0;
+static uint8_t deltaOp = 0;
+static uint8_t deltaArgs[8];
+static size_t deltaArgsLength = 0;
+static size_t deltaArgsNeeded = 0;
+static uint32_t insertRemaining = 0;
+static uint32_t sourceSize = 0;
+static uint32_t targetSize = 0;
+static uint32_t produced = 0;
+static const esp_partition_t* sourcePartition = nullptr;
+static uint8_t copyBuffer[OTA_DELTA_COPY_CHUNK];
+
+static unsigned long updateStarted = 0;
+static OtaDecodeStats stats = {};
+
+static uint32_t readLE32(const uint8_t* p) {
+  return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool reject(const char* message) {
+  otaVerifyReject(message);
+  return false;
+}
+
+static void freeInflater() {
+  free(inflator);
+  free(dictionary);
+  inflator = nullptr;
+  dictionary = nullptr;
+}
+
+/**
+ * Hand decoded image bytes to the verifier
+ */
+static bool emitOutput(const uint8_t* data, size_t len) {
+  stats.bytesOut += len;
+  return otaVerifyWrite(data, len);
+}
+
+/**
+ * Check the delta header and that the patch was made for the running firmware
+ */
+static bool startDelta() {
+  if (deltaHeader[4] != OTA_DELTA_VERSION) {
+    return reject("unsupported delta patch version");
+  }
+  sourceSize = readLE32(deltaHeader + 8);
+  targetSize = readLE32(deltaHeader + 12);
+
+  sourcePartition = esp_ota_get_running_partition();
+  if (sourcePartition == nullptr || sourceSize > sourcePartition->size) {
+    return reject("delta source larger than running partition");
+  }
+
+  // Hash the running image once; a patch for another version would
+  // otherwise produce a valid-looking but broken image
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  for (uint32_t offset = 0; offset < sourceSize; offset += OTA_DELTA_COPY_CHUNK) {
+    size_t chunk = min((uint32_t)OTA_DELTA_COPY_CHUNK, sourceSize - offset);
+    if (esp_partition_read(sourcePartition, offset, copyBuffer, chunk) != ESP_OK) {
+      mbedtls_sha256_free(&sha);
+      return reject("cannot read running partition");
+    }
+    mbedtls_sha256_update(&sha, copyBuffer, chunk);
+  }
+  uint8_t hash[32];
+  mbedtls_sha256_finish(&sha, hash);
+  mbedtls_sha256_free(&sha);
+
+  if (memcmp(hash, deltaHeader + 16, sizeof(hash)) != 0) {
+    return reject("delta patch does not match running firmware");
+  }
+  LOG_I(OTA, "OTA delta: %u -> %u bytes against running partition '%s'",
+             sourceSize, targetSize, sourcePartition->label);
+  return true;
+}
+
+/**
+ * COPY operation: stream a range of the running partition into the image
+ */
+static bool copyFromSource(uint32_t offset, uint32_t length) {
+  if (length > sourceSize || offset > sourceSize - length) {
+    return reject("delta copy outside source image");
+  }
+  if (length > targetSize - produced) {
+    return reject("delta patch exceeds target size");
+  }
+  produced += length;
+  stats.copiedBytes += length;
+
+  while (length > 0) {
+    size_t chunk = min((uint32_t)OTA_DELTA_COPY_CHUNK, length);
+    if (esp_partition_read(sourcePartition, offset, copyBuffer, chunk) != ESP_OK) {
+      return reject("cannot read running partition");
+    }
+    if (!emitOutput(copyBuffer, chunk)) {
+      return false;
+    }
+    offset += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+/**
+ * Apply the next bytes of a delta patch
+ */
+static bool applyDelta(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    switch (deltaState) {
+      case DELTA_HEADER: {
+        size_t take = min(len, OTA_DELTA_HEADER_LEN - deltaHeaderLength);
+        memcpy(deltaHeader + deltaHeaderLength, data, take);
+        deltaHeaderLength += take;
+        data += take;
+        len -= take;
+        if (deltaHeaderLength == OTA_DELTA_HEADER_LEN) {
+          if (!startDelta()) {
+            return false;
+          }
+          deltaState = DELTA_OP;
+        }
+        break;
+      }
+
+      case DELTA_OP:
+        deltaOp = *data++;
+        len--;
+        deltaArgsLength = 0;
+        if (deltaOp == OTA_DELTA_OP_END) {
+          if (produced != targetSize) {
+            return reject("delta patch ended early");
+          }
+          deltaState = DELTA_DONE;
+        } else if (deltaOp == OTA_DELTA_OP_COPY) {
+          deltaArgsNeeded = 8;
+          deltaState = DELTA_ARGS;
+        } else if (deltaOp == OTA_DELTA_OP_INSERT) {
+          deltaArgsNeeded = 4;
+          deltaState = DELTA_ARGS;
+        } else {
+          return reject("unknown delta operation");
+        }
+        break;
+
+      case DELTA_ARGS: {
+        size_t take = min(len, deltaArgsNeeded - deltaArgsLength);
+        memcpy(deltaArgs + deltaArgsLength, data, take);
+        deltaArgsLength += take;
+        data += take;
+        len -= take;
+        if (deltaArgsLength < deltaArgsNeeded) {
+          break;
+        }
+        if (deltaOp == OTA_DELTA_OP_COPY) {
+          if (!copyFromSource(readLE32(deltaArgs), readLE32(deltaArgs + 4))) {
+            return false;
+          }
+          deltaState = DELTA_OP;
+        } else {
+          insertRemaining = readLE32(deltaArgs);
+          if (insertRemaining > targetSize - produced) {
+            return reject("delta patch exceeds target size");
+          }
+          produced += insertRemaining;
+          deltaState = insertRemaining > 0 ? DELTA_INSERT : DELTA_OP;
+        }
+        break;
+      }
+
+      case DELTA_INSERT: {
+        size_t take = min(len, (size_t)insertRemaining);
+        if (!emitOutput(data, take)) {
+          return false;
+        }
+        insertRemaining -= take;
+        data += take;
+        len -= take;
+        if (insertRemaining == 0) {
+          deltaState = DELTA_OP;
+        }
+        break;
+      }
+
+      case DELTA_DONE:
+        return reject("data after end of delta patch");
+    }
+  }
+  return true;
+}
+
+/**
+ * Stage 2 input: detect a delta patch, otherwise pass through
+ */
+static bool imageWrite(const uint8_t* data, size_t len) {
+  if (imageFormat == FORMAT_UNKNOWN) {
+    size_t take = min(len, sizeof(imageSniff) - imageSniffLength);
+    memcpy(imageSniff + imageSniffLength, data, take);
+    imageSniffLength += take;
+    data += take;
+    len -= take;
+    if (imageSniffLength < sizeof(imageSniff)) {
+      return true;
+    }
+
+    if (memcmp(imageSniff, OTA_DELTA_MAGIC, 4) == 0) {
+      imageFormat = FORMAT_DELTA;
+      stats.delta = true;
+      if (!applyDelta(imageSniff, sizeof(imageSniff))) {
+        return false;
+      }
+    } else {
+      imageFormat = FORMAT_PLAIN;
+      if (!emitOutput(imageSniff, sizeof(imageSniff))) {
+        return false;
+      }
+    }
+  }
+
+  if (len == 0) {
+    return true;
+  }
+  if (imageFormat == FORMAT_DELTA) {
+    return applyDelta(data, len);
+  }
+  return emitOutput(data, len);
+}
+
+/**
+ * Next gzip header field present according to the flags
+ */
+static GzipState nextGzipState(GzipState state) {
+  switch (state) {
+    case GZ_HEADER:
+      if (gzFlags & GZIP_FEXTRA) return GZ_EXTRA_LEN;
+      // fall through
+    case GZ_EXTRA:
+      if (gzFlags & GZIP_FNAME) return GZ_NAME;
+      // fall through
+    case GZ_NAME:
+      if (gzFlags & GZIP_FCOMMENT) return GZ_COMMENT;
+      // fall through
+    case GZ_COMMENT:
+      if (gzFlags & GZIP_FHCRC) return GZ_HCRC;
+      // fall through
+    default:
+      return GZ_DATA;
+  }
+}
+
+/**
+ * Stage 1 for gzip input: parse header and trailer, inflate the data
+ */
+static bool inflateWrite(const uint8_t* data, size_t len) {
+  while (len > 0 || inflatePending) {
+    switch (gzState) {
+      case GZ_HEADER:
+      case GZ_EXTRA_LEN:
+      case GZ_HCRC: {
+        size_t need = gzState == GZ_HEADER ? GZIP_HEADER_LEN : 2;
+        size_t take = min(len, need - gzCount);
+        memcpy(gzBuffer + gzCount, data, take);
+        gzCount += take;
+        data += take;
+        len -= take;
+        if (gzCount < need) {
+          break;
+        }
+        gzCount = 0;
+
+        if (gzState == GZ_HEADER) {
+          if (gzBuffer[2] != GZIP_DEFLATE) {
+            return reject("unsupported gzip compression method");
+          }
+          gzFlags = gzBuffer[3];
+          gzState = nextGzipState(GZ_HEADER);
+        } else if (gzState == GZ_EXTRA_LEN) {
+          gzSkip = gzBuffer[0] | (gzBuffer[1] << 8);
+          gzState = GZ_EXTRA;
+        } else {
+          gzState = GZ_DATA;
+        }
+        break;
+      }
+
+      case GZ_EXTRA: {
+        size_t take = min(len, (size_t)gzSkip);
+        gzSkip -= take;
+        data += take;
+        len -= take;
+        if (gzSkip == 0) {
+          gzState = nextGzipState(GZ_EXTRA);
+        }
+        break;
+      }
+
+      case GZ_NAME:
+      case GZ_COMMENT: {
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(data, 0, len));
+        size_t take = end ? (size_t)(end - data) + 1 : len;
+        data += take;
+        len -= take;
+        if (end) {
+          gzState = nextGzipState(gzState);
+        }
+        break;
+      }
+
+      case GZ_DATA: {
+        size_t inBytes = len;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - dictOffset;
+        unsigned long t0 = micros();
+        tinfl_status status = tinfl_decompress(inflator, data, &inBytes, dictionary,
+                                               dictionary + dictOffset, &outBytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        stats.inflateUs += micros() - t0;
+        data += inBytes;
+        len -= inBytes;
+
+        if (outBytes > 0) {
+          if (!imageWrite(dictionary + dictOffset, outBytes)) {
+            return false;
+          }
+          dictOffset = (dictOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        inflatePending = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+        if (status < TINFL_STATUS_DONE) {
+          return reject("corrupt gzip data");
+        }
+        if (status == TINFL_STATUS_DONE) {
+          gzState = GZ_TRAILER;
+        }
+        break;
+      }
+
+      case GZ_TRAILER:
+        // CRC32 and size, see above
+        if (len > GZIP_TRAILER_LEN - gzCount) {
+          return reject("data after end of gzip stream");
+        }
+        gzCount += len;
+        len = 0;
+        break;
+    }
+  }
+  return true;
+}
+
+/**
+ * Start decoding a new update (also starts OTA_Verify)
+ *
+ * @return false if the updater could not be started
+ */
+bool otaDecodeBegin() {
+  freeInflater();
+  inputFormat = FORMAT_UNKNOWN;
+  inputSniffLength = 0;
+  gzState = GZ_HEADER;
+  gzCount = 0;
+  inflatePending = false;
+  dictOffset = 0;
+
+  imageFormat = FORMAT_UNKNOWN;
+  imageSniffLength = 0;
+  deltaState = DELTA_HEADER;
+  deltaHeaderLength = 0;
+  produced = 0;
+
+  updateStarted = millis();
+  stats = {};
+  return otaVerifyBegin();
+}
+
+/**
+ * Feed the next chunk as received from the network
+ *
+ * @param data Chunk data
+ * @param len Chunk length
+ * @return false once the update has been rejected
+ */
+bool otaDecodeWrite(const uint8_t* data, size_t len) {
+  if (otaVerifyFailed()) {
+    return false;
+  }
+  stats.bytesIn += len;
+
+  if (inputFormat == FORMAT_UNKNOWN) {
+    size_t take = min(len, sizeof(inputSniff) - inputSniffLength);
+    memcpy(inputSniff + inputSniffLength, data, take);
+    inputSniffLength += take;
+    data += take;
+    len -= take;
+    if (inputSniffLength < sizeof(inputSniff)) {
+      return true;
+    }
+
+    if (inputSniff[0] == GZIP_MAGIC_0 && inputSniff[1] == GZIP_MAGIC_1) {
+      inflator = static_cast<tinfl_decompressor*>(malloc(sizeof(tinfl_decompressor)));
+      dictionary = static_cast<uint8_t*>(malloc(TINFL_LZ_DICT_SIZE));
+      if (inflator == nullptr || dictionary == nullptr) {
+        freeInflater();
+        return reject("not enough memory to inflate");
+      }
+      tinfl_init(inflator);
+      inputFormat = FORMAT_GZIP;
+      stats.compressed = true;
+      if (!inflateWrite(inputSniff, sizeof(inputSniff))) {
+        return false;
+      }
+    } else {
+      inputFormat = FORMAT_PLAIN;
+      if (!imageWrite(inputSniff, sizeof(inputSniff))) {
+        return false;
+      }
+    }
+  }
+
+  if (len == 0) {
+    return true;
+  }
+  if (inputFormat == FORMAT_GZIP) {
+    return inflateWrite(data, len);
+  }
+  return imageWrite(data, len);
+}
+
+/**
+ * Finish the update: check that all stages are complete, then verify
+ * and activate the image
+ *
+ * @return true if the image was accepted and the boot partition switched
+ */
+bool otaDecodeEnd() {
+  // Streams shorter than a magic number are passed on as they are
+  if (!otaVerifyFailed() && inputFormat == FORMAT_UNKNOWN) {
+    inputFormat = FORMAT_PLAIN;
+    imageWrite(inputSniff, inputSniffLength);
+  }
+  if (!otaVerifyFailed() && imageFormat == FORMAT_UNKNOWN) {
+    imageFormat = FORMAT_PLAIN;
+    emitOutput(imageSniff, imageSniffLength);
+  }
+  if (!otaVerifyFailed() && inputFormat == FORMAT_GZIP && gzState != GZ_TRAILER) {
+    reject("truncated gzip stream");
+  }
+  if (!otaVerifyFailed() && imageFormat == FORMAT_DELTA && deltaState != DELTA_DONE) {
+    reject("truncated delta patch");
+  }
+  freeInflater();
+
+  if (!otaVerifyEnd()) {
+    return false;
+  }
+
+  stats.totalMs = millis() - updateStarted;
+  uint32_t saved = stats.bytesOut > stats.bytesIn ? stats.bytesOut - stats.bytesIn : 0;
+  LOG_I(OTA, "OTA transfer: %u bytes for %u byte image (%s%s), saved %u bytes (%u%%), %u ms end-to-end",
+             stats.bytesIn, stats.bytesOut,
+             stats.compressed ? "gzip" : "plain", stats.delta ? " delta" : "",
+             saved, stats.bytesOut ? saved * 100 / stats.bytesOut : 0, stats.totalMs);
+  if (stats.compressed) {
+    LOG_I(OTA, "OTA inflate: %u ms", stats.inflateUs / 1000);
+  }
+  if (stats.delta) {
+    LOG_I(OTA, "OTA delta: %u bytes copied from running partition", stats.copiedBytes);
+  }
+  return true;
+}
+
+/**
+ * Abort an update (connection lost)
+ */
+void otaDecodeAbort() {
+  freeInflater();
+  otaVerifyAbort();
+}
+
+/**
+ * Get statistics of the last update
+ */
+const OtaDecodeStats& getOtaDecodeStats() {
+  return stats;
+}
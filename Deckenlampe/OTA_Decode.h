@@ -0,0 +1,58 @@
+/**
+ * OTA_Decode.h - Compressed and delta OTA images for CeilingLamp
+ *
+ * Streaming decode stage in front of OTA_Verify, used by web OTA and
+ * HTTP OTA. The format is detected from the first bytes, so plain,
+ * compressed and delta images are uploaded the same way:
+ * - gzip (magic 1f 8b) is inflated with the ROM inflater while streaming
+ * - A delta patch (magic "DLDP", see make-delta.py) rebuilds the new image
+ *   from the running partition using COPY and INSERT operations
+ * - Both can be combined (gzip compressed patch), anything else is passed
+ *   through unchanged
+ *
+ * The decoded output is the signed image, so header check, hash and
+ * signature are applied to the rebuilt firmware.
+ *
+ * Delta patch layout (all integers little endian):
+ *   header: "DLDP" | version (1) | reserved (3) | sourceSize (4) | targetSize (4) | SHA-256 of source (32)
+ *   ops:    0x01 COPY offset (4) length (4)  - bytes from the running partition
+ *           0x02 INSERT length (4) data      - literal bytes
+ *           0x00 END
+ *
+ * Author: icebear74
+ */
+
+#ifndef OTA_DECODE_H
+#define OTA_DECODE_H
+
+#include <Arduino.h>
+
+#define OTA_DELTA_MAGIC       "DLDP"
+#define OTA_DELTA_VERSION     1
+#define OTA_DELTA_HEADER_LEN  48
+#define OTA_DELTA_COPY_CHUNK  1024  // Source partition read buffer
+
+// Delta operations
+#define OTA_DELTA_OP_END      0x00
+#define OTA_DELTA_OP_COPY     0x01
+#define OTA_DELTA_OP_INSERT   0x02
+
+// Statistics of the last update
+struct OtaDecodeStats {
+  uint32_t bytesIn;       // Bytes received over the network
+  uint32_t bytesOut;      // Bytes handed to OTA_Verify
+  bool compressed;
+  bool delta;
+  uint32_t copiedBytes;   // Delta: bytes taken from the running partition
+  uint32_t inflateUs;
+  uint32_t totalMs;       // First byte to verified image
+};
+
+// Function declarations
+bool otaDecodeBegin();
+bool otaDecodeWrite(const uint8_t* data, size_t len);
+bool otaDecodeEnd();
+void otaDecodeAbort();
+const OtaDecodeStats& getOtaDecodeStats();
+
+#endif // OTA_DECODE_H
@@ -0,0 +1,108 @@
+/**
+ * OTA_Manifest.cpp - Update manifest parsing implementation
+ *
+ * Only flat string members are needed, so there is no full JSON parser:
+ * a key is looked up as "key" followed by ':' and a string value.
+ *
+ * Author: icebear74
+ */
+
+#include "OTA_Manifest.h"
+
+/**
+ * Copy the string value of a top-level key
+ *
+ * @param json Manifest text
+ * @param key Member name
+ * @param out Output buffer
+ * @param outLen Output buffer size
+ * @return false if the key is missing, not a string or too long
+ */
+static bool jsonString(const char* json, const char* key, char* out, size_t outLen) {
+  char pattern[24];
+  snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+
+  const char* p = strstr(json, pattern);
+  if (p == nullptr) {
+    return false;
+  }
+  p += strlen(pattern);
+  while (isspace((unsigned char)*p)) p++;
+  if (*p++ != ':') {
+    return false;
+  }
+  while (isspace((unsigned char)*p)) p++;
+  if (*p++ != '"') {
+    return false;
+  }
+
+  size_t n = 0;
+  while (*p != '"') {
+    if (*p == '\0') {
+      return false;
+    }
+    if (*p == '\\') {
+      p++;
+      if (*p != '"' && *p != '\\' && *p != '/') {
+        return false;   // Other escapes never appear in versions or URLs
+      }
+    }
+    if (n + 1 >= outLen) {
+      return false;
+    }
+    out[n++] = *p++;
+  }
+  out[n] = '\0';
+  return true;
+}
+
+/**
+ * Parse an update manifest
+ *
+ * @param json Manifest text (null terminated)
+ * @param manifest Parsed result
+ * @return true if a version was found and the url, if present, is valid
+ */
+bool parseUpdateManifest(const char* json, UpdateManifest& manifest) {
+  manifest = {};
+  if (!jsonString(json, "version", manifest.version, sizeof(manifest.version))) {
+    return false;
+  }
+  // A url that is there but unusable must not fall back to UPDATE_SERVER_URL
+  if (strstr(json, "\"url\"") != nullptr && !jsonString(json, "url", manifest.url, sizeof(manifest.url))) {
+    manifest = {};
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Read the next numeric version component and skip its '.' separator
+ * (missing components count as 0)
+ */
+static unsigned long versionPart(const char*& p) {
+  unsigned long value = 0;
+  while (isdigit((unsigned char)*p)) {
+    value = value * 10 + (*p++ - '0');
+  }
+  if (*p == '.') {
+    p++;
+  }
+  return value;
+}
+
+/**
+ * Compare two firmware versions (MAJOR.MINOR.PATCH[-suffix])
+ *
+ * @return <0 if a is older than b, 0 if equal, >0 if a is newer
+ */
+int compareVersions(const char* a, const char* b) {
+  for (int part = 0; part < 3; part++) {
+    unsigned long va = versionPart(a);
+    unsigned long vb = versionPart(b);
+    if (va != vb) {
+      return va < vb ? -1 : 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * OTA_Manifest.h - Update manifest parsing for CeilingLamp
+ *
+ * The HTTP update check fetches a small JSON manifest instead of the
+ * firmware itself (see make-manifest.sh):
+ *   { "version": "1.0.1-a1b2c3d", "url": "http://server/firmware.bin.gz" }
+ *
+ * "url" is optional (UPDATE_SERVER_URL is used without it). Versions are
+ * compared numerically by MAJOR.MINOR.PATCH, the "-<git hash>" suffix is
+ * ignored.
+ *
+ * Author: icebear74
+ */
+
+#ifndef OTA_MANIFEST_H
+#define OTA_MANIFEST_H
+
+#include <Arduino.h>
+
+#define UPDATE_MANIFEST_MAX_LEN 512
+#define UPDATE_VERSION_MAX_LEN  32
+#define UPDATE_URL_MAX_LEN      160
+
+struct UpdateManifest {
+  char version[UPDATE_VERSION_MAX_LEN];
+  char url[UPDATE_URL_MAX_LEN];          // Empty = not given
+};
+
+// Function declarations
+bool parseUpdateManifest(const char* json, UpdateManifest& manifest);
+int compareVersions(const char* a, const char* b);
+
+#endif // OTA_MANIFEST_H
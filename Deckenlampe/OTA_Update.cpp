@@ -5,25 +5,83 @@
  * 1. ArduinoOTA - Update via Arduino IDE over WiFi
  * 2. Web-based OTA - Upload firmware via web interface
  * 3. HTTP OTA - Automatic update from web server
+ * Parts disabled in Config.h are left out (see OTA_Update.h).
  * 
  * Author: icebear74
  */
 
 #include "OTA_Update.h"
+#include "Audio.h"
+#include "Bench.h"
+#include "Effect_VM.h"
+#include "Log.h"
+#include "OTA_Decode.h"
+#include "Fleet_OTA.h"
+#include "Metrics.h"
+#include "Sequence.h"
+#include "Stall.h"
+#include "Trace.h"
+#include "OTA_Manifest.h"
+#include "OTA_Verify.h"
+#include "Static_Alloc.h"
 #include "WiFi.h"
 
-// OTA Configuration
-const unsigned int OTA_PORT = 3232;
-const unsigned long HTTP_UPDATE_CHECK_INTERVAL_MS = 3600000; // Check every hour
-unsigned long lastUpdateCheck = 0;
-
+#if HTTP_UPDATE_ENABLED
 // HTTP Update Server URLs (configure these to your update server)
 const char* UPDATE_SERVER_URL = "http://your-update-server.com/firmware.bin";
-const char* UPDATE_VERSION_URL = "http://your-update-server.com/version.txt";
+const char* UPDATE_MANIFEST_URL = "";  // e.g. "http://your-update-server.com/manifest.json", empty = disabled
+
+// Update check state
+static unsigned long lastUpdateCheck = 0;
+static unsigned long updateCheckDelay = 0;
+static unsigned long updateBackoffMs = 0;
+static bool updateCheckScheduled = false;
+static char manifestETag[80] = "";
+static char manifestLastModified[40] = "";
+
+/**
+ * Collects an HTTP response body in a caller-provided buffer
+ * (HTTPClient::writeToStream() without a heap String)
+ */
+class BufferStream : public Stream {
+ public:
+  BufferStream(char* buffer, size_t size) : buffer(buffer), size(size), len(0) { buffer[0] = '\0'; }
 
+  size_t write(const uint8_t* data, size_t dataLen) override {
+    if (dataLen > size - 1 - len) {
+      return 0;     // Too large: makes writeToStream() fail
+    }
+    memcpy(buffer + len, data, dataLen);
+    len += dataLen;
+    buffer[len] = '\0';
+    return dataLen;
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+
+ private:
+  char* buffer;
+  size_t size;
+  size_t len;
+};
+#endif // HTTP_UPDATE_ENABLED
+
+#if WEB_SERVER_ENABLED
 // Web Server for OTA updates
 WebServer server(80);
+static bool requestServed = false;  // Set by the handlers, times handleClient() for /metrics
 
+/**
+ * Send text as a chunk of the current response (without a String copy)
+ */
+static void sendChunk(const char* chunk) {
+  server.sendContent(chunk, strlen(chunk));
+}
+
+#if WEB_OTA_ENABLED
 /**
  * HTML page for OTA web interface
  * Provides a user-friendly interface for uploading firmware updates
@@ -152,9 +210,9 @@ const char* otaWebPage2 = R"=====(</div>
     </div>
     <div class='upload-section'>
       <h3>Upload Firmware</h3>
-      <p style='color: #666; font-size: 14px;'>Select a .bin firmware file to update the device</p>
+      <p style='color: #666; font-size: 14px;'>Select a firmware file (.bin, gzip compressed .bin.gz or delta .patch) to update the device</p>
       <form method='POST' action='/update' enctype='multipart/form-data' id='upload-form'>
-        <input type='file' name='update' accept='.bin' required>
+        <input type='file' name='update' accept='.bin,.gz,.patch' required>
         <input type='submit' value='Upload & Update'>
       </form>
     </div>
@@ -221,43 +279,50 @@ const char* otaWebPage5 = R"=====(';
  * Handle root page request - display OTA update interface
  */
 void handleRoot() {
-  String hostname = WiFi.getHostname();
-  String ip = WiFi.localIP().toString();
   uint8_t mac[6];
   WiFi.macAddress(mac);
-  char macStr[18];
-  sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-  
-  String page = String(otaWebPage) + DECKENLAMPE_VERSION + 
-                String(otaWebPage2) + hostname + 
-                String(otaWebPage3) + ip + 
-                String(otaWebPage4) + String(macStr) + 
-                String(otaWebPage5);
+  IpString ip = ipString(WiFi.localIP());
+  MacString macStr = macString(mac);
   
-  server.send(200, "text/html", page);
+  // Static parts are sent as they are, the page is never assembled
+  const char* parts[] = {
+    otaWebPage, DECKENLAMPE_VERSION,
+    otaWebPage2, WiFi.getHostname(),
+    otaWebPage3, ip.c_str(),
+    otaWebPage4, macStr.c_str(),
+    otaWebPage5
+  };
+  size_t length = 0;
+  for (const char* part : parts) {
+    length += strlen(part);
+  }
+  server.setContentLength(length);
+  server.send(200, "text/html", "");
+  for (const char* part : parts) {
+    server.sendContent(part, strlen(part));
+  }
+  requestServed = true;
 }
 
 /**
  * Handle firmware upload and update
+ * Compressed and delta images are decoded while streaming (see OTA_Decode),
+ * the result is verified (header, SHA-256, signature, see OTA_Verify).
  */
 void handleUpdate() {
   HTTPUpload& upload = server.upload();
   
   if (upload.status == UPLOAD_FILE_START) {
-    Serial.printf("Update: %s\n", upload.filename.c_str());
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-      Update.printError(Serial);
-    }
+    LOG_I(OTA, "Update: %s", upload.filename.c_str());
+    otaDecodeBegin();
   } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-      Update.printError(Serial);
-    }
+    otaDecodeWrite(upload.buf, upload.currentSize);
   } else if (upload.status == UPLOAD_FILE_END) {
-    if (Update.end(true)) {
-      Serial.printf("Update Success: %u bytes\nRebooting...\n", upload.totalSize);
-    } else {
-      Update.printError(Serial);
+    if (otaDecodeEnd()) {
+      LOG_I(OTA, "Update Success: %u bytes, rebooting...", upload.totalSize);
     }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    otaDecodeAbort();
   }
 }
 
@@ -265,15 +330,216 @@ void handleUpdate() {
  * Handle update completion
  */
 void handleUpdateEnd() {
-  if (Update.hasError()) {
-    server.send(500, "text/plain", "Update Failed");
+  requestServed = true;
+  if (otaVerifyFailed()) {
+    FixedString<96> message("Update Failed: ");
+    message += otaVerifyError();
+    server.send(400, "text/plain", message.c_str());
   } else {
     server.send(200, "text/plain", "Update OK");
     delay(1000);
     ESP.restart();
   }
 }
+#endif // WEB_OTA_ENABLED
 
+/**
+ * Start passing the running firmware on to the fleet (POST /fleet-ota)
+ */
+void handleFleetOtaStart() {
+  if (startFleetOtaSender()) {
+    server.send(200, "text/plain", "Fleet OTA started");
+  } else {
+    server.send(409, "text/plain", "Fleet OTA not possible (session running or image unreadable)");
+  }
+  requestServed = true;
+}
+
+/**
+ * Export runtime metrics in Prometheus text format (GET /metrics)
+ */
+void handleMetricsRequest() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+  writeMetrics(sendChunk);
+  sendChunk("");
+  requestServed = true;
+}
+
+/**
+ * Export the boot and runtime trace as Chrome trace JSON (GET /trace)
+ */
+void handleTraceRequest() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  writeTraceJson(sendChunk);
+  sendChunk("");
+  requestServed = true;
+}
+
+/**
+ * Show the recent log messages (GET /log)
+ */
+void handleLogRequest() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  writeLogHistory(sendChunk);
+  sendChunk("");
+  requestServed = true;
+}
+
+/**
+ * Show the loop stall histogram and backtrace samples (GET /stalls)
+ */
+void handleStallsRequest() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  writeStallReport(sendChunk);
+  sendChunk("");
+  requestServed = true;
+}
+
+/**
+ * Handle light sequence upload (POST /sequence, see make-sequence.py)
+ */
+void handleSequenceUpload() {
+  HTTPUpload& upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    LOG_I(OTA, "Sequence upload: %s", upload.filename.c_str());
+    sequenceUploadBegin();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    sequenceUploadWrite(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    sequenceUploadEnd();
+  }
+}
+
+/**
+ * Handle sequence upload completion
+ */
+void handleSequenceEnd() {
+  requestServed = true;
+  if (!sequenceLoaded()) {
+    FixedString<96> message("Sequence Failed: ");
+    message += sequenceError();
+    server.send(400, "text/plain", message.c_str());
+  } else {
+    server.send(200, "text/plain", "Sequence OK");
+  }
+}
+
+/**
+ * Show the stored light sequence (GET /sequence)
+ */
+void handleSequenceInfo() {
+  const SequenceStats& stats = getSequenceStats();
+  FixedString<192> info;
+  if (stats.loaded) {
+    info.appendf("frames %u\npixels %u\ninterval_ms %u\nbytes %u\n"
+                 "frames_decoded %u\nseeks %u\nmax_decode_us %u\n",
+                 stats.frameCount, stats.pixelCount, stats.frameIntervalMs, stats.fileSize,
+                 stats.framesDecoded, stats.seeks, stats.maxDecodeUs);
+  } else {
+    info.appendf("No sequence: %s\n", sequenceError());
+  }
+  server.send(200, "text/plain", info.c_str());
+  requestServed = true;
+}
+
+/**
+ * Handle effect program upload (POST /effect, see make-effect.py)
+ */
+void handleEffectUpload() {
+  HTTPUpload& upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    LOG_I(OTA, "Effect program upload: %s", upload.filename.c_str());
+    effectProgramUploadBegin();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    effectProgramUploadWrite(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    effectProgramUploadEnd();
+  }
+}
+
+/**
+ * Handle effect program upload completion
+ */
+void handleEffectEnd() {
+  requestServed = true;
+  if (!effectProgramLoaded()) {
+    FixedString<96> message("Effect Failed: ");
+    message += effectProgramError();
+    server.send(400, "text/plain", message.c_str());
+  } else {
+    server.send(200, "text/plain", "Effect OK");
+  }
+}
+
+/**
+ * Show the uploaded effect program and its frame cost (GET /effect)
+ */
+void handleEffectInfo() {
+  const EffectVmStats& stats = getEffectVmStats();
+  FixedString<192> info;
+  if (stats.loaded) {
+    info.appendf("instructions %u\nframes %u\nsteps %u\nmax_steps %u\nstep_budget %u\n"
+                 "frame_us %u\nmax_frame_us %u\noverruns %u\n",
+                 stats.instructions, stats.frames, stats.lastSteps, stats.maxSteps, VM_FRAME_STEP_BUDGET,
+                 stats.lastFrameUs, stats.maxFrameUs, stats.overruns);
+  } else {
+    info.appendf("No program: %s\n", effectProgramError());
+  }
+  server.send(200, "text/plain", info.c_str());
+  requestServed = true;
+}
+
+/**
+ * Show microphone features, DSP cost and latency (GET /audio)
+ * latency_us is capture to render; add block_us for the age of the
+ * oldest sample in a block.
+ */
+void handleAudioInfo() {
+  const AudioStats& stats = getAudioStats();
+  AudioFeatures features;
+  FixedString<320> info;
+  if (!stats.running) {
+    info.append(AUDIO_ENABLED ? "No microphone: I2S setup failed\n" : "No microphone: built with AUDIO_ENABLED 0\n");
+  } else {
+    info.appendf("blocks %u\noverruns %u\nblock_us %u\ndsp_us %u\navg_dsp_us %u\nmax_dsp_us %u\n"
+                 "cpu_percent %u\nlatency_us %u\nmax_latency_us %u\n",
+                 stats.blocks, stats.overruns, AUDIO_HOP_SIZE * 1000000 / AUDIO_SAMPLE_RATE, stats.lastDspUs,
+                 stats.avgDspUs, stats.maxDspUs, stats.cpuPercent, stats.latencyUs, stats.maxLatencyUs);
+    if (getAudioFeatures(features)) {
+      info.appendf("beats %u\nloudness %u\nonset %u\nbands", features.beats, features.loudness, features.onset);
+      for (int b = 0; b < AUDIO_BANDS; b++) {
+        info.appendf(" %u", features.bands[b]);
+      }
+      info.append("\n");
+    }
+  }
+  server.send(200, "text/plain", info.c_str());
+  requestServed = true;
+}
+
+#if BENCH_ENABLED
+/**
+ * Run the benchmark suite (GET /bench, ?record=1 stores new baselines)
+ * Responds 500 if a benchmark regressed against its baseline.
+ */
+void handleBenchRequest() {
+  bool ok = runBenchmarks(server.hasArg("record"));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(ok ? 200 : 500, "text/plain", "");
+  writeBenchReport(sendChunk);
+  sendChunk("");
+  requestServed = true;
+}
+#endif
+#endif // WEB_SERVER_ENABLED
+
+#if ARDUINO_OTA_ENABLED
 /**
  * Initialize ArduinoOTA for Arduino IDE updates
  */
@@ -282,118 +548,292 @@ void setupArduinoOTA() {
   ArduinoOTA.setHostname(WiFi.getHostname());
   
   ArduinoOTA.onStart([]() {
-    String type;
-    if (ArduinoOTA.getCommand() == U_FLASH) {
-      type = "sketch";
-    } else {
-      type = "filesystem";
-    }
-    Serial.println("Start updating " + type);
+    const char* type = ArduinoOTA.getCommand() == U_FLASH ? "sketch" : "filesystem";
+    LOG_I(OTA, "Start updating %s", type);
   });
   
   ArduinoOTA.onEnd([]() {
-    Serial.println("\nEnd");
+    LOG_I(OTA, "End");
   });
   
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+    // Called for every chunk, only log every 10%
+    static unsigned int lastPercent = 100;
+    unsigned int percent = progress / (total / 100);
+    if (percent / 10 != lastPercent / 10) {
+      LOG_I(OTA, "Progress: %u%%", percent);
+      lastPercent = percent;
+    }
   });
   
   ArduinoOTA.onError([](ota_error_t error) {
-    Serial.printf("Error[%u]: ", error);
+    const char* reason = "Unknown";
     if (error == OTA_AUTH_ERROR) {
-      Serial.println("Auth Failed");
+      reason = "Auth Failed";
     } else if (error == OTA_BEGIN_ERROR) {
-      Serial.println("Begin Failed");
+      reason = "Begin Failed";
     } else if (error == OTA_CONNECT_ERROR) {
-      Serial.println("Connect Failed");
+      reason = "Connect Failed";
     } else if (error == OTA_RECEIVE_ERROR) {
-      Serial.println("Receive Failed");
+      reason = "Receive Failed";
     } else if (error == OTA_END_ERROR) {
-      Serial.println("End Failed");
+      reason = "End Failed";
     }
+    LOG_E(OTA, "Error[%u]: %s", error, reason);
   });
   
   ArduinoOTA.begin();
-  Serial.println("ArduinoOTA initialized");
-  Serial.printf("Ready for OTA updates on port %d\n", OTA_PORT);
+  LOG_I(OTA, "ArduinoOTA initialized");
+  LOG_I(OTA, "Ready for OTA updates on port %d", OTA_PORT);
+}
+
+/**
+ * Handle Arduino IDE updates in the main loop
+ */
+void handleArduinoOTA() {
+  STALL_SCOPE(STALL_SUB_ARDUINO_OTA);
+  ArduinoOTA.handle();
 }
+#endif // ARDUINO_OTA_ENABLED
 
+#if WEB_SERVER_ENABLED
 /**
- * Initialize Web Server for manual OTA updates
+ * Initialize Web Server for manual OTA updates and the status endpoints
  */
-void setupWebOTA() {
+void setupWebServer() {
+#if WEB_OTA_ENABLED
   server.on("/", HTTP_GET, handleRoot);
   server.on("/update", HTTP_POST, handleUpdateEnd, handleUpdate);
+#endif
+  server.on("/fleet-ota", HTTP_POST, handleFleetOtaStart);
+  server.on("/metrics", HTTP_GET, handleMetricsRequest);
+  server.on("/trace", HTTP_GET, handleTraceRequest);
+  server.on("/log", HTTP_GET, handleLogRequest);
+  server.on("/stalls", HTTP_GET, handleStallsRequest);
+  server.on("/sequence", HTTP_POST, handleSequenceEnd, handleSequenceUpload);
+  server.on("/sequence", HTTP_GET, handleSequenceInfo);
+  server.on("/effect", HTTP_POST, handleEffectEnd, handleEffectUpload);
+  server.on("/effect", HTTP_GET, handleEffectInfo);
+  server.on("/audio", HTTP_GET, handleAudioInfo);
+#if BENCH_ENABLED
+  server.on("/bench", HTTP_GET, handleBenchRequest);
+#endif
   server.begin();
   
-  Serial.println("Web OTA server started");
-  Serial.printf("Access web interface at http://%s/\n", WiFi.localIP().toString().c_str());
+  LOG_I(OTA, "Web server started");
+  LOG_I(OTA, "Access web interface at http://%s/", ipString(WiFi.localIP()).c_str());
 }
 
 /**
- * Check for firmware updates from HTTP server
- * Compares version and downloads new firmware if available
+ * Serve web requests in the main loop (timed for /metrics and /trace)
  */
-void checkHTTPUpdate() {
-  Serial.println("Checking for firmware updates...");
-  
+void handleWebServer() {
+  uint32_t t0 = micros();
+  { STALL_SCOPE(STALL_SUB_HTTP); server.handleClient(); }
+  if (requestServed) {
+    metricsObserve(METRIC_HTTP_REQUEST_TIME, micros() - t0);
+    TRACE_SPAN(TRACE_HTTP_REQUEST, t0);
+    requestServed = false;
+  }
+}
+#endif // WEB_SERVER_ENABLED
+
+#if HTTP_UPDATE_ENABLED
+/**
+ * Download a firmware image and stream it through OTA_Decode/OTA_Verify
+ * Plain, gzip compressed and delta images are accepted, like web OTA.
+ *
+ * @param url Firmware URL
+ * @return true if the image was accepted and the boot partition switched
+ */
+bool downloadFirmware(const char* url) {
   WiFiClient client;
-  HTTPUpdate httpUpdate;
+  HTTPClient http;
   
-  httpUpdate.setLedPin(LED_BUILTIN, LOW);
+  if (!http.begin(client, url)) {
+    LOG_W(OTA, "HTTP Update: invalid URL");
+    return false;
+  }
   
-  httpUpdate.onStart([]() {
-    Serial.println("HTTP Update started");
-  });
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    LOG_W(OTA, "HTTP Update: server returned %d", code);
+    http.end();
+    return false;
+  }
   
-  httpUpdate.onEnd([]() {
-    Serial.println("HTTP Update finished");
-  });
+  int total = http.getSize();
+  WiFiClient* stream = http.getStreamPtr();
+  uint8_t buffer[1460];
+  int received = 0;
+  int lastPercent = -1;
+  unsigned long lastData = millis();
   
-  httpUpdate.onProgress([](int cur, int total) {
-    Serial.printf("HTTP Update Progress: %d%%\n", (cur * 100) / total);
-  });
+  LOG_I(OTA, "HTTP Update started (%d bytes)", total);
+  otaDecodeBegin();
   
-  httpUpdate.onError([&httpUpdate](int err) {
-    Serial.printf("HTTP Update Error (%d): %s\n", err, httpUpdate.getLastErrorString().c_str());
-  });
+  while (total < 0 || received < total) {
+    size_t available = stream->available();
+    if (available == 0) {
+      if (!http.connected() || millis() - lastData > HTTP_UPDATE_TIMEOUT_MS) {
+        break;
+      }
+      delay(1);
+      continue;
+    }
+    
+    size_t n = stream->readBytes(buffer, min(available, sizeof(buffer)));
+    lastData = millis();
+    received += n;
+    if (!otaDecodeWrite(buffer, n)) {
+      break;
+    }
+    
+    if (total > 0 && received * 10 / total != lastPercent) {   // Every 10%
+      lastPercent = received * 10 / total;
+      LOG_I(OTA, "HTTP Update Progress: %d%%", lastPercent * 10);
+    }
+  }
+  http.end();
+  
+  if (total > 0 && received < total && !otaVerifyFailed()) {
+    otaDecodeAbort();
+  }
+  if (!otaDecodeEnd()) {
+    LOG_E(OTA, "HTTP Update failed: %s", otaVerifyError() ? otaVerifyError() : "unknown error");
+    return false;
+  }
+  LOG_I(OTA, "HTTP Update finished");
+  return true;
+}
+
+/**
+ * Remember the manifest validators for the next conditional request
+ */
+static void storeManifestValidators(HTTPClient& http) {
+  strlcpy(manifestETag, http.header("ETag").c_str(), sizeof(manifestETag));
+  strlcpy(manifestLastModified, http.header("Last-Modified").c_str(), sizeof(manifestLastModified));
+}
+
+/**
+ * Check for firmware updates from HTTP server
+ * Fetches the manifest conditionally (If-None-Match / If-Modified-Since)
+ * and downloads the firmware only if the manifest version is newer.
+ *
+ * @return Result of the check, used to schedule the next one
+ */
+UpdateCheckResult checkHTTPUpdate() {
+  TRACE_SCOPE(TRACE_UPDATE_CHECK);
+  LOG_I(OTA, "Checking for firmware updates...");
   
-  // In a real implementation, you would:
-  // 1. Check UPDATE_VERSION_URL for new version
-  // 2. Compare with FIRMWARE_VERSION
-  // 3. If newer, download from UPDATE_SERVER_URL
-  // For now, we'll just show the structure
+  WiFiClient client;
+  HTTPClient http;
+  const char* headerKeys[] = { "ETag", "Last-Modified" };
   
-  t_httpUpdate_return ret = httpUpdate.update(client, UPDATE_SERVER_URL);
+  if (!http.begin(client, UPDATE_MANIFEST_URL)) {
+    LOG_W(OTA, "Update check: invalid manifest URL");
+    return UPDATE_CHECK_FAILED;
+  }
+  http.collectHeaders(headerKeys, 2);
+  if (manifestETag[0] != '\0') {
+    http.addHeader("If-None-Match", manifestETag);
+  }
+  if (manifestLastModified[0] != '\0') {
+    http.addHeader("If-Modified-Since", manifestLastModified);
+  }
   
-  switch (ret) {
-    case HTTP_UPDATE_FAILED:
-      Serial.printf("HTTP Update failed: Error (%d): %s\n", 
-                    httpUpdate.getLastError(), 
-                    httpUpdate.getLastErrorString().c_str());
-      break;
-    case HTTP_UPDATE_NO_UPDATES:
-      Serial.println("No updates available");
-      break;
-    case HTTP_UPDATE_OK:
-      Serial.println("Update successful");
-      break;
+  int code = http.GET();
+  if (code == HTTP_CODE_NOT_MODIFIED) {
+    http.end();
+    LOG_I(OTA, "Update check: manifest not modified");
+    return UPDATE_CHECK_NOT_MODIFIED;
   }
+  if (code != HTTP_CODE_OK) {
+    LOG_W(OTA, "Update check: server returned %d", code);
+    http.end();
+    return UPDATE_CHECK_FAILED;
+  }
+  if (http.getSize() > UPDATE_MANIFEST_MAX_LEN) {
+    LOG_W(OTA, "Update check: manifest too large");
+    http.end();
+    return UPDATE_CHECK_FAILED;
+  }
+  
+  ArenaScope scope(scratchArena);
+  char* body = scratchArena.allocateArray<char>(UPDATE_MANIFEST_MAX_LEN + 1);
+  if (body == nullptr) {
+    LOG_E(OTA, "Update check: scratch arena exhausted");
+    http.end();
+    return UPDATE_CHECK_FAILED;
+  }
+  UpdateManifest manifest;
+  BufferStream bodyStream(body, UPDATE_MANIFEST_MAX_LEN + 1);
+  if (http.writeToStream(&bodyStream) < 0 || !parseUpdateManifest(body, manifest)) {
+    LOG_W(OTA, "Update check: invalid manifest");
+    http.end();
+    return UPDATE_CHECK_FAILED;
+  }
+  
+  if (compareVersions(manifest.version, DECKENLAMPE_VERSION) <= 0) {
+    LOG_I(OTA, "Update check: firmware %s is current (server: %s)", DECKENLAMPE_VERSION, manifest.version);
+    storeManifestValidators(http);
+    http.end();
+    return UPDATE_CHECK_CURRENT;
+  }
+  http.end();
+  
+  // Validators are only stored once the update went through, otherwise
+  // the next check would get 304 and never retry the download
+  LOG_I(OTA, "Update check: new firmware %s (running %s)", manifest.version, DECKENLAMPE_VERSION);
+  if (!downloadFirmware(manifest.url[0] != '\0' ? manifest.url : UPDATE_SERVER_URL)) {
+    return UPDATE_CHECK_FAILED;
+  }
+  
+  LOG_I(OTA, "Update successful, rebooting...");
+  delay(1000);
+  ESP.restart();
+  return UPDATE_CHECK_INSTALLED;
 }
 
 /**
- * Handle OTA operations in the main loop
- * Call this function from the main loop to keep OTA services active
+ * Schedule the next update check
+ * Regular checks are spread by +/- HTTP_UPDATE_JITTER_PERCENT so a fleet
+ * powered up together does not hit the server at once; failed checks
+ * back off exponentially (with jitter) up to the regular interval.
+ *
+ * @param failed Whether the last check failed
  */
-void handleOTA() {
-  ArduinoOTA.handle();
-  server.handleClient();
-  
-  // Periodically check for HTTP updates
-  if (millis() - lastUpdateCheck > HTTP_UPDATE_CHECK_INTERVAL_MS) {
+static void scheduleUpdateCheck(bool failed) {
+  lastUpdateCheck = millis();
+  if (failed) {
+    updateBackoffMs = updateBackoffMs == 0 ? HTTP_UPDATE_BACKOFF_MIN_MS
+                                           : min(updateBackoffMs * 2, HTTP_UPDATE_CHECK_INTERVAL_MS);
+    updateCheckDelay = updateBackoffMs + random(updateBackoffMs / 4 + 1);
+    LOG_I(OTA, "Update check: retry in %lu s", updateCheckDelay / 1000);
+  } else {
+    unsigned long jitter = HTTP_UPDATE_CHECK_INTERVAL_MS / 100 * HTTP_UPDATE_JITTER_PERCENT;
+    updateBackoffMs = 0;
+    updateCheckDelay = HTTP_UPDATE_CHECK_INTERVAL_MS - jitter + random(2 * jitter + 1);
+  }
+}
+
+/**
+ * Periodically check for HTTP updates in the main loop
+ * (only with a manifest URL)
+ */
+void handleUpdateCheck() {
+  if (UPDATE_MANIFEST_URL[0] == '\0') {
+    return;
+  }
+  if (!updateCheckScheduled) {
     lastUpdateCheck = millis();
-    // Uncomment the line below when you have a valid update server
-    // checkHTTPUpdate();
+    updateCheckDelay = random(HTTP_UPDATE_FIRST_CHECK_MS + 1);
+    updateCheckScheduled = true;
+  }
+  if (millis() - lastUpdateCheck > updateCheckDelay) {
+    STALL_SCOPE(STALL_SUB_UPDATE_CHECK);
+    UpdateCheckResult result = checkHTTPUpdate();
+    scheduleUpdateCheck(result == UPDATE_CHECK_FAILED);
   }
 }
+#endif // HTTP_UPDATE_ENABLED
@@ -6,39 +6,76 @@
  * 2. Web-based OTA - Upload firmware via web interface
  * 3. HTTP OTA - Automatic update from web server
  * 
+ * The web server also serves the status and upload endpoints.
+ * Each part is switched in Config.h (ARDUINO_OTA_ENABLED, WEB_SERVER_ENABLED,
+ * WEB_OTA_ENABLED, HTTP_UPDATE_ENABLED); the setup and handle functions of
+ * a disabled part are declared but not defined, so call them under
+ * if constexpr (FEATURE_X).
+ * 
  * Author: icebear74
  */
 
 #ifndef OTA_UPDATE_H
 #define OTA_UPDATE_H
 
-#include <ArduinoOTA.h>
-#include <WebServer.h>
-#include <HTTPUpdate.h>
-#include <Update.h>
+#include "Config.h"
 #include "Version.h"
 
-// OTA Configuration
-extern const unsigned int OTA_PORT;
-extern const unsigned long HTTP_UPDATE_CHECK_INTERVAL_MS;
-extern unsigned long lastUpdateCheck;
+#if ARDUINO_OTA_ENABLED
+#include <ArduinoOTA.h>
+#include <Update.h>
+#endif
+#if WEB_SERVER_ENABLED
+#include <WebServer.h>
+#endif
+#if HTTP_UPDATE_ENABLED
+#include <HTTPClient.h>
+#endif
 
-// HTTP Update Server URLs
-extern const char* UPDATE_SERVER_URL;
-extern const char* UPDATE_VERSION_URL;
+// Result of an HTTP update check
+enum UpdateCheckResult {
+  UPDATE_CHECK_FAILED,        // Network/server error, retried with backoff
+  UPDATE_CHECK_NOT_MODIFIED,  // Manifest unchanged (304)
+  UPDATE_CHECK_CURRENT,       // Running firmware is up to date
+  UPDATE_CHECK_INSTALLED      // New firmware installed (device restarts)
+};
 
+#if WEB_SERVER_ENABLED
 // Web Server instance
 extern WebServer server;
+#endif
+
+#if HTTP_UPDATE_ENABLED
+// HTTP Update Server URLs
+extern const char* UPDATE_SERVER_URL;
+extern const char* UPDATE_MANIFEST_URL;
+#endif
 
 // Function declarations
 void setupArduinoOTA();
-void setupWebOTA();
-void checkHTTPUpdate();
-void handleOTA();
+void setupWebServer();
+bool downloadFirmware(const char* url);
+UpdateCheckResult checkHTTPUpdate();
+void handleArduinoOTA();
+void handleWebServer();
+void handleUpdateCheck();
 
 // Web handler functions
 void handleRoot();
 void handleUpdate();
 void handleUpdateEnd();
+void handleFleetOtaStart();
+void handleMetricsRequest();
+void handleTraceRequest();
+void handleLogRequest();
+void handleStallsRequest();
+void handleBenchRequest();
+void handleSequenceUpload();
+void handleSequenceEnd();
+void handleSequenceInfo();
+void handleEffectUpload();
+void handleEffectEnd();
+void handleEffectInfo();
+void handleAudioInfo();
 
 #endif // OTA_UPDATE_H
@@ -0,0 +1,304 @@
+/**
+ * OTA_Verify.cpp - Streaming firmware verification implementation
+ *
+ * The signature trailer is only recognizable once the upload has ended, so
+ * the last OTA_SIGNATURE_TRAILER_LEN bytes of the stream are always held
+ * back: everything before them is hashed and written to flash immediately,
+ * the held-back bytes are parsed as trailer at the end.
+ *
+ * If OTA_PUBLIC_KEY_PEM is empty, images are header-checked and hashed but
+ * the signature is not required (development builds).
+ *
+ * Author: icebear74
+ */
+
+#include "OTA_Verify.h"
+#include "Log.h"
+#include "OTA_Writer.h"
+#include <esp_image_format.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+
+// Public key for firmware signatures (PEM, ECDSA P-256). Empty = signature optional.
+// Generate with: openssl ec -in ota_private.pem -pubout
+const char* OTA_PUBLIC_KEY_PEM = "";
+
+static mbedtls_sha256_context shaContext;
+static uint8_t trailer[OTA_SIGNATURE_TRAILER_LEN];
+static size_t trailerLength = 0;
+static uint8_t headerBuffer[sizeof(esp_image_header_t)];
+static size_t headerLength = 0;
+static const char* errorMessage = nullptr;
+static unsigned long uploadStarted = 0;
+static OtaVerifyStats stats = {};
+
+/**
+ * Record the first error of this upload and abort the flash update
+ */
+static bool fail(const char* message) {
+  if (errorMessage == nullptr) {
+    errorMessage = message;
+    LOG_W(OTA, "OTA verification failed: %s", message);
+  }
+  if (otaWriterRunning()) {
+    otaWriterAbort();
+  }
+  return false;
+}
+
+/**
+ * Check the ESP application image header (once the first bytes are in)
+ */
+static bool checkImageHeader(const uint8_t* data) {
+  esp_image_header_t header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != ESP_IMAGE_HEADER_MAGIC) {
+    return fail("not an ESP32 firmware image");
+  }
+  if (header.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+    return fail("firmware built for a different chip");
+  }
+  if (header.segment_count == 0 || header.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+    return fail("invalid segment count in image header");
+  }
+  return true;
+}
+
+/**
+ * Hash and queue firmware bytes for flashing (everything except the trailer)
+ */
+static bool emitImage(const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return true;
+  }
+
+  unsigned long t0 = micros();
+  mbedtls_sha256_update(&shaContext, data, len);
+  unsigned long t1 = micros();
+  bool queued = otaWriterWrite(data, len);
+  unsigned long t2 = micros();
+
+  stats.hashUs += t1 - t0;
+  stats.writeUs += t2 - t1;
+  stats.bytes += len;
+
+  if (!queued) {
+    return fail("flash write failed");
+  }
+  return true;
+}
+
+/**
+ * Start verifying a new upload and open the OTA partition
+ *
+ * @return false if the updater could not be started
+ */
+bool otaVerifyBegin() {
+  mbedtls_sha256_init(&shaContext);
+  mbedtls_sha256_starts(&shaContext, 0);
+  trailerLength = 0;
+  headerLength = 0;
+  errorMessage = nullptr;
+  uploadStarted = millis();
+  stats = {};
+
+  if (!otaWriterBegin()) {
+    return fail("could not start update");
+  }
+  return true;
+}
+
+/**
+ * Feed the next chunk of the upload
+ *
+ * Chunks may have any size; the image header is checked as soon as its
+ * bytes are complete, which is always before the first flash write since
+ * the trailer hold-back is larger than the header.
+ *
+ * @param data Chunk data
+ * @param len Chunk length
+ * @return false once the upload has been rejected
+ */
+bool otaVerifyWrite(const uint8_t* data, size_t len) {
+  if (errorMessage != nullptr) {
+    return false;
+  }
+  if (headerLength < sizeof(headerBuffer)) {
+    size_t take = min(len, sizeof(headerBuffer) - headerLength);
+    memcpy(headerBuffer + headerLength, data, take);
+    headerLength += take;
+    if (headerLength == sizeof(headerBuffer) && !checkImageHeader(headerBuffer)) {
+      return false;
+    }
+  }
+
+  // Keep the last OTA_SIGNATURE_TRAILER_LEN bytes of the stream back
+  if (trailerLength + len <= OTA_SIGNATURE_TRAILER_LEN) {
+    memcpy(trailer + trailerLength, data, len);
+    trailerLength += len;
+    return true;
+  }
+
+  size_t emit = trailerLength + len - OTA_SIGNATURE_TRAILER_LEN;
+  size_t fromTrailer = min(emit, trailerLength);
+  if (!emitImage(trailer, fromTrailer)) {
+    return false;
+  }
+  memmove(trailer, trailer + fromTrailer, trailerLength - fromTrailer);
+  trailerLength -= fromTrailer;
+
+  size_t fromData = emit - fromTrailer;
+  if (!emitImage(data, fromData)) {
+    return false;
+  }
+  memcpy(trailer + trailerLength, data + fromData, len - fromData);
+  trailerLength += len - fromData;
+  return true;
+}
+
+/**
+ * Finish the upload: check the signature and activate the new image
+ *
+ * @return true if the image was accepted and the boot partition switched
+ */
+bool otaVerifyEnd() {
+  if (errorMessage != nullptr) {
+    mbedtls_sha256_free(&shaContext);
+    return false;
+  }
+  if (headerLength < sizeof(headerBuffer)) {
+    mbedtls_sha256_free(&shaContext);
+    return fail("upload too short for image header");
+  }
+
+  bool hasTrailer = trailerLength == OTA_SIGNATURE_TRAILER_LEN &&
+                    memcmp(trailer, OTA_SIGNATURE_MAGIC, 4) == 0;
+  bool keyConfigured = OTA_PUBLIC_KEY_PEM[0] != '\0';
+
+  if (!hasTrailer) {
+    if (keyConfigured) {
+      mbedtls_sha256_free(&shaContext);
+      return fail("image is not signed");
+    }
+    // Unsigned image: the held-back bytes are firmware
+    if (!emitImage(trailer, trailerLength)) {
+      mbedtls_sha256_free(&shaContext);
+      return false;
+    }
+    trailerLength = 0;
+  }
+
+  uint8_t hash[32];
+  mbedtls_sha256_finish(&shaContext, hash);
+  mbedtls_sha256_free(&shaContext);
+
+  char hashHex[65];
+  for (int i = 0; i < 32; i++) {
+    snprintf(hashHex + 2 * i, 3, "%02x", hash[i]);
+  }
+  LOG_I(OTA, "OTA image SHA-256: %s", hashHex);
+
+  if (keyConfigured) {
+    unsigned long t0 = micros();
+    size_t sigLen = trailer[4] | ((size_t)trailer[5] << 8);
+    bool valid = otaVerifySignature(hash, trailer + 8, sigLen);
+    stats.verifyUs = micros() - t0;
+    if (!valid) {
+      return fail("signature check failed");
+    }
+  } else if (hasTrailer) {
+    LOG_I(OTA, "OTA signature present but no public key configured, not checked");
+  } else {
+    LOG_I(OTA, "OTA image is unsigned (no public key configured)");
+  }
+
+  // Keep the trailer behind the image (ignored by the bootloader), so this
+  // lamp can pass the signed image on to others (Fleet_OTA)
+  if (hasTrailer && !otaWriterWrite(trailer, OTA_SIGNATURE_TRAILER_LEN)) {
+    return fail("flash write failed");
+  }
+
+  if (!otaWriterEnd()) {
+    return fail("image rejected by updater");
+  }
+
+  stats.totalMs = millis() - uploadStarted;
+  uint32_t totalUs = stats.totalMs * 1000;
+  LOG_I(OTA, "OTA: %u bytes in %u ms (%u KB/s), hash %u ms (%u.%u%%), queue %u ms, verify %u ms",
+             stats.bytes, stats.totalMs, stats.totalMs ? stats.bytes / stats.totalMs : 0,
+             stats.hashUs / 1000,
+             totalUs ? stats.hashUs * 100 / totalUs : 0,
+             totalUs ? (stats.hashUs * 1000 / totalUs) % 10 : 0,
+             stats.writeUs / 1000, stats.verifyUs / 1000);
+  return true;
+}
+
+/**
+ * Check an ECDSA P-256 signature over an image hash with OTA_PUBLIC_KEY_PEM
+ *
+ * @param hash SHA-256 of the firmware image
+ * @param signature DER encoded signature
+ * @param sigLen Signature length
+ * @return true if the signature is valid (false if no key is configured)
+ */
+bool otaVerifySignature(const uint8_t* hash, const uint8_t* signature, size_t sigLen) {
+  if (OTA_PUBLIC_KEY_PEM[0] == '\0' || sigLen == 0 || sigLen > OTA_SIGNATURE_MAX_LEN) {
+    return false;
+  }
+
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  int ret = mbedtls_pk_parse_public_key(&pk, reinterpret_cast<const unsigned char*>(OTA_PUBLIC_KEY_PEM),
+                                        strlen(OTA_PUBLIC_KEY_PEM) + 1);
+  if (ret == 0) {
+    ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, hash, 32, signature, sigLen);
+  }
+  mbedtls_pk_free(&pk);
+
+  if (ret != 0) {
+    LOG_W(OTA, "OTA signature invalid (mbedtls error -0x%04x)", -ret);
+    return false;
+  }
+  LOG_I(OTA, "OTA signature valid");
+  return true;
+}
+
+/**
+ * Abort an upload (client disconnected)
+ */
+void otaVerifyAbort() {
+  mbedtls_sha256_free(&shaContext);
+  fail("upload aborted");
+}
+
+/**
+ * Reject the current upload (used by the decode stage in front of us)
+ *
+ * @param message Reason shown to the uploader
+ */
+void otaVerifyReject(const char* message) {
+  fail(message);
+}
+
+/**
+ * Check whether the current upload has been rejected
+ */
+bool otaVerifyFailed() {
+  return errorMessage != nullptr;
+}
+
+/**
+ * Get the reason the upload was rejected
+ *
+ * @return Error message, or nullptr if no error occurred
+ */
+const char* otaVerifyError() {
+  return errorMessage;
+}
+
+/**
+ * Get statistics of the last upload
+ */
+const OtaVerifyStats& getOtaVerifyStats() {
+  return stats;
+}
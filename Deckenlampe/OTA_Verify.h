@@ -0,0 +1,51 @@
+/**
+ * OTA_Verify.h - Streaming firmware verification for CeilingLamp
+ *
+ * Verifies web OTA uploads while they stream into flash:
+ * - The image header is checked on the first bytes, so a wrong file is
+ *   rejected before a single flash sector is erased
+ * - Every chunk is fed into a SHA-256 hash as it is written
+ * - An ECDSA P-256 signature over that hash is checked against the
+ *   embedded public key before the boot partition is switched
+ * - The trailer is stored behind the image in flash, so the signed image
+ *   can be passed on by Fleet_OTA
+ *
+ * Signed image layout (see sign-firmware.sh):
+ *   [firmware .bin][trailer: "DLS1" | sigLen (2, LE) | 0x0000 | DER signature, zero padded to 72]
+ *
+ * Author: icebear74
+ */
+
+#ifndef OTA_VERIFY_H
+#define OTA_VERIFY_H
+
+#include <Arduino.h>
+
+#define OTA_SIGNATURE_MAGIC       "DLS1"
+#define OTA_SIGNATURE_MAX_LEN     72   // DER encoded ECDSA P-256 signature
+#define OTA_SIGNATURE_TRAILER_LEN (8 + OTA_SIGNATURE_MAX_LEN)
+
+// Verification configuration
+extern const char* OTA_PUBLIC_KEY_PEM;
+
+// Upload statistics (one upload)
+struct OtaVerifyStats {
+  uint32_t bytes;         // Firmware bytes written (without trailer)
+  uint32_t hashUs;        // Time spent hashing
+  uint32_t writeUs;       // Time spent handing bytes to OTA_Writer (incl. stalls)
+  uint32_t verifyUs;      // Signature check
+  uint32_t totalMs;       // First chunk to end of verification
+};
+
+// Function declarations
+bool otaVerifyBegin();
+bool otaVerifyWrite(const uint8_t* data, size_t len);
+bool otaVerifyEnd();
+void otaVerifyAbort();
+void otaVerifyReject(const char* message);
+bool otaVerifySignature(const uint8_t* hash, const uint8_t* signature, size_t sigLen);
+bool otaVerifyFailed();
+const char* otaVerifyError();
+const OtaVerifyStats& getOtaVerifyStats();
+
+#endif // OTA_VERIFY_H
@@ -0,0 +1,368 @@
+/**
+ * OTA_Writer.cpp - Pipelined OTA flash writer implementation
+ *
+ * Two queues connect the receiver (loop task, web/HTTP OTA) and the
+ * writer task: free buffer indices flow to the receiver, filled buffers
+ * flow to the writer. A job with length 0 is a drain marker, answered
+ * through a semaphore once everything before it is in flash.
+ *
+ * Author: icebear74
+ */
+
+#include "OTA_Writer.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
+
+struct WriterJob {
+  uint8_t index;
+  uint16_t length;   // 0 = drain marker
+};
+
+static TaskHandle_t writerTask = nullptr;
+static QueueHandle_t freeQueue = nullptr;
+static QueueHandle_t fullQueue = nullptr;
+static SemaphoreHandle_t drainedSemaphore = nullptr;
+
+static const esp_partition_t* partition = nullptr;
+static uint8_t* buffers = nullptr;
+static uint8_t skipBuffer[OTA_WRITER_SKIP_LEN];
+static bool running = false;
+static unsigned long started = 0;
+
+// Receiver side
+static int fillIndex = -1;
+static size_t fillLength = 0;
+
+// Writer task side
+static uint32_t writeOffset = 0;
+static uint32_t erasedEnd = 0;
+static volatile bool eraseAhead = false;
+static volatile esp_err_t writeError = ESP_OK;
+
+static OtaWriterStats stats = {};
+
+static std::atomic<uint8_t> partitionOwner(OTA_OWNER_NONE);
+
+/**
+ * Erase the next sector of the partition
+ */
+static bool eraseSector() {
+  unsigned long t0 = micros();
+  esp_err_t err = esp_partition_erase_range(partition, erasedEnd, OTA_WRITER_BUFFER_SIZE);
+  stats.eraseUs += micros() - t0;
+  if (err != ESP_OK) {
+    writeError = err;
+    return false;
+  }
+  erasedEnd += OTA_WRITER_BUFFER_SIZE;
+  stats.sectorsErased++;
+  return true;
+}
+
+/**
+ * Erase ahead only once data is flowing (the image header has been
+ * checked by then) and only a few sectors beyond it
+ */
+static bool eraseAheadWanted() {
+  return eraseAhead && writeError == ESP_OK && writeOffset > 0 &&
+         erasedEnd < writeOffset + OTA_WRITER_ERASE_AHEAD * OTA_WRITER_BUFFER_SIZE &&
+         erasedEnd < partition->size;
+}
+
+/**
+ * Program one buffer at the current write offset
+ */
+static void writeBuffer(uint8_t* data, size_t len) {
+  uint32_t end = writeOffset + len;
+  if (end > partition->size) {
+    writeError = ESP_ERR_INVALID_SIZE;
+    return;
+  }
+  while (erasedEnd < end) {
+    if (!eraseSector()) {
+      return;
+    }
+  }
+
+  if (writeOffset == 0) {
+    // Keep the image magic out of flash until the update is complete
+    memcpy(skipBuffer, data, OTA_WRITER_SKIP_LEN);
+    memset(data, 0xFF, OTA_WRITER_SKIP_LEN);
+  }
+
+  unsigned long t0 = micros();
+  esp_err_t err = esp_partition_write(partition, writeOffset, data, len);
+  stats.writeUs += micros() - t0;
+  if (err != ESP_OK) {
+    writeError = err;
+    return;
+  }
+  writeOffset = end;
+}
+
+/**
+ * Writer task: drain full buffers, erase ahead while idle
+ */
+static void writerTaskLoop(void* parameter) {
+  WriterJob job;
+  for (;;) {
+    TickType_t wait = eraseAheadWanted() ? 0 : portMAX_DELAY;
+    if (xQueueReceive(fullQueue, &job, wait) != pdTRUE) {
+      if (eraseSector()) {
+        stats.sectorsAhead++;
+      }
+      continue;
+    }
+
+    if (job.length == 0) {
+      xSemaphoreGive(drainedSemaphore);
+      continue;
+    }
+    if (writeError == ESP_OK) {
+      writeBuffer(buffers + job.index * OTA_WRITER_BUFFER_SIZE, job.length);
+    }
+    xQueueSend(freeQueue, &job.index, portMAX_DELAY);
+  }
+}
+
+/**
+ * Hand the buffer being filled to the writer task
+ */
+static void queueFillBuffer() {
+  WriterJob job = { (uint8_t)fillIndex, (uint16_t)fillLength };
+  xQueueSend(fullQueue, &job, portMAX_DELAY);
+  stats.bytes += fillLength;
+  metricsInc(METRIC_OTA_BYTES, fillLength);
+  stats.maxQueued = max(stats.maxQueued, (uint32_t)uxQueueMessagesWaiting(fullQueue));
+  fillIndex = -1;
+  fillLength = 0;
+}
+
+/**
+ * Queue the partial buffer and wait until the writer task is idle
+ */
+static void drain() {
+  if (fillIndex >= 0 && fillLength > 0) {
+    queueFillBuffer();
+  } else if (fillIndex >= 0) {
+    uint8_t index = fillIndex;
+    xQueueSend(freeQueue, &index, portMAX_DELAY);
+    fillIndex = -1;
+  }
+  eraseAhead = false;
+  WriterJob marker = { 0, 0 };
+  xQueueSend(fullQueue, &marker, portMAX_DELAY);
+  xSemaphoreTake(drainedSemaphore, portMAX_DELAY);
+}
+
+static void releaseBuffers() {
+  free(buffers);
+  buffers = nullptr;
+  running = false;
+}
+
+/**
+ * Take the next OTA partition for one update path (any task)
+ *
+ * @param owner Update path
+ * @return true if the partition was free or already owned by this path
+ */
+bool otaPartitionAcquire(OtaPartitionOwner owner) {
+  uint8_t expected = OTA_OWNER_NONE;
+  return partitionOwner.compare_exchange_strong(expected, owner) || expected == owner;
+}
+
+/**
+ * Give the partition back (only if this path owns it)
+ */
+void otaPartitionRelease(OtaPartitionOwner owner) {
+  uint8_t expected = owner;
+  partitionOwner.compare_exchange_strong(expected, OTA_OWNER_NONE);
+}
+
+/**
+ * Get the current owner of the next OTA partition
+ */
+OtaPartitionOwner otaPartitionOwner() {
+  return (OtaPartitionOwner)partitionOwner.load();
+}
+
+/**
+ * Start writing a new image into the next OTA partition
+ *
+ * @return false if no partition, memory or writer task is available, or
+ *         a fleet OTA session owns the partition
+ */
+bool otaWriterBegin() {
+  if (running) {
+    otaWriterAbort();
+  }
+  if (!otaPartitionAcquire(OTA_OWNER_WRITER)) {
+    LOG_W(OTA, "OTA writer: partition busy with a fleet OTA session");
+    return false;
+  }
+
+  if (writerTask == nullptr) {
+    freeQueue = xQueueCreate(OTA_WRITER_BUFFERS, sizeof(uint8_t));
+    fullQueue = xQueueCreate(OTA_WRITER_BUFFERS + 1, sizeof(WriterJob));
+    drainedSemaphore = xSemaphoreCreateBinary();
+    if (freeQueue == nullptr || fullQueue == nullptr || drainedSemaphore == nullptr ||
+        xTaskCreate(writerTaskLoop, "ota_writer", OTA_WRITER_TASK_STACK, nullptr,
+                    OTA_WRITER_TASK_PRIORITY, &writerTask) != pdPASS) {
+      LOG_E(OTA, "OTA writer: cannot create writer task");
+      otaPartitionRelease(OTA_OWNER_WRITER);
+      return false;
+    }
+  }
+
+  partition = esp_ota_get_next_update_partition(nullptr);
+  if (partition == nullptr) {
+    LOG_E(OTA, "OTA writer: no OTA partition");
+    otaPartitionRelease(OTA_OWNER_WRITER);
+    return false;
+  }
+  buffers = static_cast<uint8_t*>(malloc(OTA_WRITER_BUFFERS * OTA_WRITER_BUFFER_SIZE));
+  if (buffers == nullptr) {
+    LOG_E(OTA, "OTA writer: not enough memory for buffers");
+    otaPartitionRelease(OTA_OWNER_WRITER);
+    return false;
+  }
+
+  xQueueReset(freeQueue);
+  xQueueReset(fullQueue);
+  for (uint8_t i = 0; i < OTA_WRITER_BUFFERS; i++) {
+    xQueueSend(freeQueue, &i, 0);
+  }
+  fillIndex = -1;
+  fillLength = 0;
+  writeOffset = 0;
+  erasedEnd = 0;
+  writeError = ESP_OK;
+  stats = {};
+  started = millis();
+  running = true;
+  eraseAhead = true;
+
+  LOG_I(OTA, "OTA writer: partition '%s' at 0x%x (%u bytes)",
+             partition->label, partition->address, partition->size);
+  return true;
+}
+
+/**
+ * Queue image bytes for writing
+ *
+ * Only blocks when all buffers are waiting for the flash.
+ *
+ * @param data Image data
+ * @param len Data length
+ * @return false if the writer is not running or a flash operation failed
+ */
+bool otaWriterWrite(const uint8_t* data, size_t len) {
+  if (!running || writeError != ESP_OK) {
+    return false;
+  }
+
+  while (len > 0) {
+    if (fillIndex < 0) {
+      uint8_t index;
+      unsigned long t0 = micros();
+      xQueueReceive(freeQueue, &index, portMAX_DELAY);
+      stats.stallUs += micros() - t0;
+      fillIndex = index;
+    }
+
+    size_t take = min(len, OTA_WRITER_BUFFER_SIZE - fillLength);
+    memcpy(buffers + fillIndex * OTA_WRITER_BUFFER_SIZE + fillLength, data, take);
+    fillLength += take;
+    data += take;
+    len -= take;
+
+    if (fillLength == OTA_WRITER_BUFFER_SIZE) {
+      queueFillBuffer();
+    }
+  }
+  return writeError == ESP_OK;
+}
+
+/**
+ * Flush all buffers, complete the image and switch the boot partition
+ *
+ * @return true if the image was written and validated
+ */
+bool otaWriterEnd() {
+  if (!running) {
+    return false;
+  }
+  TRACE_SCOPE(TRACE_OTA_FINISH);
+
+  unsigned long t0 = millis();
+  stats.receiveMs = t0 - started;
+  drain();
+  stats.drainMs = millis() - t0;
+  releaseBuffers();
+
+  esp_err_t err = writeError;
+  if (err == ESP_OK && stats.bytes < OTA_WRITER_SKIP_LEN) {
+    err = ESP_ERR_INVALID_SIZE;
+  }
+  if (err == ESP_OK) {
+    err = esp_partition_write(partition, 0, skipBuffer, OTA_WRITER_SKIP_LEN);
+  }
+  if (err == ESP_OK) {
+    // Validates the complete image before it is marked bootable
+    err = esp_ota_set_boot_partition(partition);
+  }
+  if (err != ESP_OK) {
+    LOG_E(OTA, "OTA writer failed: %s", esp_err_to_name(err));
+    otaPartitionRelease(OTA_OWNER_WRITER);
+    return false;
+  }
+
+  if (stats.receiveMs > 0) {
+    metricsSet(METRIC_OTA_THROUGHPUT, (uint64_t)stats.bytes * 1000 / stats.receiveMs);
+  }
+
+  uint32_t flashMs = (stats.writeUs + stats.eraseUs) / 1000;
+  LOG_I(OTA, "OTA writer: %u bytes, receive %u KB/s, flash %u KB/s, erase %u ms (%u of %u sectors ahead), "
+             "stalled %u ms, drain %u ms, max %u/%u buffers queued",
+             stats.bytes, stats.receiveMs ? stats.bytes / stats.receiveMs : 0,
+             flashMs ? stats.bytes / flashMs : 0, stats.eraseUs / 1000,
+             stats.sectorsAhead, stats.sectorsErased, stats.stallUs / 1000,
+             stats.drainMs, stats.maxQueued, OTA_WRITER_BUFFERS);
+  return true;
+}
+
+/**
+ * Abort the current image; the partition is left unbootable
+ */
+void otaWriterAbort() {
+  if (!running) {
+    return;
+  }
+  drain();
+  releaseBuffers();
+  otaPartitionRelease(OTA_OWNER_WRITER);
+  LOG_W(OTA, "OTA writer: aborted");
+}
+
+/**
+ * Check whether an image is being written
+ */
+bool otaWriterRunning() {
+  return running;
+}
+
+/**
+ * Get statistics of the last update
+ */
+const OtaWriterStats& getOtaWriterStats() {
+  return stats;
+}
@@ -0,0 +1,66 @@
+/**
+ * OTA_Writer.h - Pipelined OTA flash writer for CeilingLamp
+ *
+ * Decouples network receive from flash erase/write:
+ * - Incoming image bytes are copied into a ring of preallocated
+ *   sector-sized buffers and handed to a writer task
+ * - The writer task programs full buffers into the OTA partition and,
+ *   whenever it is idle, erases the next sectors ahead of the data
+ * - The receiving side only waits ("stalls") when all buffers are full
+ *
+ * The first bytes of the image are written last, so an interrupted update
+ * never leaves a bootable half image behind (same as the Update library).
+ *
+ * The writer and the fleet OTA receiver both write the next OTA partition.
+ * Whoever erases or writes it owns it first (otaPartitionAcquire); the
+ * other path is refused until the owner releases it. After a successful
+ * update the owner keeps it until the reboot, so nothing overwrites the
+ * image that is about to boot.
+ *
+ * Author: icebear74
+ */
+
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <Arduino.h>
+
+#define OTA_WRITER_BUFFERS       4     // Ring size
+#define OTA_WRITER_BUFFER_SIZE   4096  // One flash sector per buffer
+#define OTA_WRITER_ERASE_AHEAD   2     // Sectors erased ahead of the data
+#define OTA_WRITER_SKIP_LEN      16    // Image bytes written last
+#define OTA_WRITER_TASK_STACK    4096
+#define OTA_WRITER_TASK_PRIORITY 2
+
+// Statistics of the last update
+struct OtaWriterStats {
+  uint32_t bytes;
+  uint32_t receiveMs;      // otaWriterBegin() to otaWriterEnd()
+  uint32_t drainMs;        // otaWriterEnd() until the last buffer is in flash
+  uint32_t writeUs;        // Writer task: flash program time
+  uint32_t eraseUs;        // Writer task: sector erase time
+  uint32_t sectorsErased;
+  uint32_t sectorsAhead;   // Erased while no data was waiting
+  uint32_t stallUs;        // Receiver waiting for a free buffer
+  uint32_t maxQueued;      // Highest number of full buffers waiting
+};
+
+// Owner of the next OTA partition
+enum OtaPartitionOwner : uint8_t {
+  OTA_OWNER_NONE = 0,
+  OTA_OWNER_WRITER,        // Web upload / HTTP update (otaWriterBegin)
+  OTA_OWNER_FLEET          // Fleet OTA receiver
+};
+
+// Function declarations
+bool otaPartitionAcquire(OtaPartitionOwner owner);
+void otaPartitionRelease(OtaPartitionOwner owner);
+OtaPartitionOwner otaPartitionOwner();
+bool otaWriterBegin();
+bool otaWriterWrite(const uint8_t* data, size_t len);
+bool otaWriterEnd();
+void otaWriterAbort();
+bool otaWriterRunning();
+const OtaWriterStats& getOtaWriterStats();
+
+#endif // OTA_WRITER_H
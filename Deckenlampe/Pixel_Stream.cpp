@@ -0,0 +1,365 @@
+/**
+ * Pixel_Stream.cpp - Real-time UDP pixel streaming implementation
+ *
+ * DDP and E1.31 datagrams are delivered by AsyncUDP, which hands out a
+ * pointer into the lwIP packet buffer. Headers are validated in place and
+ * the pixel payload is copied directly into the jitter buffer slot of the
+ * frame being received, so no per-packet allocation happens on the
+ * receive path. Completed frames are committed to the Frame_Interpolator,
+ * which plays them out from the main loop.
+ *
+ * Author: icebear74
+ */
+
+#include "Pixel_Stream.h"
+#include "Log.h"
+#include "Power.h"
+#include "Frame_Interpolator.h"
+#include <AsyncUDP.h>
+
+// Stream configuration
+const unsigned long PIXEL_STREAM_TIMEOUT_MS = 2500;           // E1.31 network data loss timeout
+const unsigned long PIXEL_STREAM_REPORT_INTERVAL_MS = 10000;  // Serial statistics while streaming
+const uint16_t E131_START_UNIVERSE = 1;
+
+// UDP listeners
+static AsyncUDP ddpUdp;
+static AsyncUDP e131Udp;
+
+// Bytes per frame (pixels * 3)
+static size_t frameBytes = 0;
+
+// Stream state
+static volatile bool streamActive = false;
+static volatile unsigned long lastPacketMs = 0;
+static PixelStreamStats stats = {};
+
+// DDP reassembly state
+static uint8_t ddpLastSeq = 0;          // 0 = sequence numbers not in use
+static bool ddpFrameCorrupt = false;
+
+// E1.31 reassembly state
+static uint8_t e131LastSeq[E131_MAX_UNIVERSES];
+static uint8_t e131SeqValid = 0;        // Bit per universe: e131LastSeq is valid
+static uint8_t e131ReceivedMask = 0;    // Bit per universe: received for current frame
+static uint8_t e131CompleteMask = 0;    // All universes that carry pixels
+
+// Rate bookkeeping (main loop only)
+static unsigned long lastRateUpdate = 0;
+static unsigned long lastReport = 0;
+static uint32_t packetsAtLastRate = 0;
+static uint32_t framesAtLastRate = 0;
+
+/**
+ * Copy a payload slice into the frame currently being received
+ * Writes beyond the end of the strip are clipped.
+ *
+ * @param offset Byte offset into the frame
+ * @param data Pixel payload (RGB, 3 bytes per pixel)
+ * @param len Payload length in bytes
+ */
+static void copyToFrame(size_t offset, const uint8_t* data, size_t len) {
+  if (offset >= frameBytes) {
+    return;
+  }
+  if (len > frameBytes - offset) {
+    len = frameBytes - offset;
+  }
+  memcpy(reinterpret_cast<uint8_t*>(jitterBufferWriteSlot()) + offset, data, len);
+}
+
+/**
+ * Mark the current frame as complete (or dropped) and commit it for playout
+ *
+ * @param corrupt true if a packet of this frame was lost
+ */
+static void completeFrame(bool corrupt) {
+  if (corrupt) {
+    stats.droppedFrames++;
+    jitterBufferDiscard();
+    return;
+  }
+  stats.framesCompleted++;
+  jitterBufferCommit();
+}
+
+/**
+ * (Re)activate streaming mode with the first valid packet of a stream
+ * Runs before the packet is decoded, so the stream starts with an empty
+ * jitter buffer and no reassembly state left over from the last one.
+ */
+static void startStream() {
+  if (streamActive) {
+    return;
+  }
+  resetFrameInterpolator();
+  ddpLastSeq = 0;
+  ddpFrameCorrupt = false;
+  e131SeqValid = 0;
+  e131ReceivedMask = 0;
+  streamActive = true;
+  LOG_I(STREAM, "Pixel stream started, local effect paused");
+}
+
+/**
+ * Record a valid packet
+ */
+static void notePacket() {
+  stats.packets++;
+  lastPacketMs = millis();
+}
+
+/**
+ * Decode a DDP datagram into the frame buffer
+ *
+ * Sequence numbers (1..15) detect lost and reordered packets: late or
+ * duplicate packets are ignored, a gap marks the frame as corrupt so it is
+ * dropped when its push flag arrives.
+ *
+ * @param data Raw UDP payload
+ * @param len Payload length in bytes
+ * @return true if the packet carried pixel data for this device
+ */
+bool decodeDDPPacket(const uint8_t* data, size_t len) {
+  if (len < DDP_HEADER_LEN || (data[0] & DDP_FLAGS_VER_MASK) != DDP_FLAGS_VER1) {
+    stats.droppedPackets++;
+    return false;
+  }
+
+  uint8_t flags = data[0];
+  if (flags & (DDP_FLAGS_QUERY | DDP_FLAGS_REPLY | DDP_FLAGS_STORAGE)) {
+    return false;  // Status/config traffic, not pixel data
+  }
+  if (data[3] != DDP_ID_DISPLAY && data[3] != DDP_ID_ALL) {
+    return false;
+  }
+
+  size_t headerLen = (flags & DDP_FLAGS_TIMECODE) ? DDP_HEADER_LEN_TIMECODE : DDP_HEADER_LEN;
+  uint32_t offset = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
+                    ((uint32_t)data[6] << 8) | data[7];
+  size_t dataLen = ((size_t)data[8] << 8) | data[9];
+  if (len < headerLen + dataLen) {
+    stats.droppedPackets++;
+    return false;
+  }
+
+  startStream();
+  uint8_t seq = data[1] & 0x0F;
+  if (seq != 0 && ddpLastSeq != 0) {
+    uint8_t ahead = (seq + 15 - ddpLastSeq) % 15;  // Distance in the 1..15 sequence space
+    if (ahead == 0 || ahead > 7) {
+      stats.droppedPackets++;  // Duplicate or reordered packet
+      return false;
+    }
+    if (ahead > 1) {
+      ddpFrameCorrupt = true;  // Packets in between were lost
+    }
+  }
+  ddpLastSeq = seq;
+
+  copyToFrame(offset, data + headerLen, dataLen);
+  notePacket();
+
+  if (flags & DDP_FLAGS_PUSH) {
+    completeFrame(ddpFrameCorrupt);
+    ddpFrameCorrupt = false;
+  }
+  return true;
+}
+
+/**
+ * Decode an E1.31 (sACN) data packet into the frame buffer
+ *
+ * Universes starting at E131_START_UNIVERSE are mapped back to back onto
+ * the strip. A frame is complete once every universe covering the strip
+ * has been received; if a universe repeats before that, the previous frame
+ * lost a packet and is dropped.
+ *
+ * @param data Raw UDP payload
+ * @param len Payload length in bytes
+ * @return true if the packet carried pixel data for this device
+ */
+bool decodeE131Packet(const uint8_t* data, size_t len) {
+  static const uint8_t acnId[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+  if (len < E131_HEADER_LEN ||
+      memcmp(data + E131_OFFSET_ACN_ID, acnId, sizeof(acnId)) != 0 ||
+      data[E131_OFFSET_ROOT_VECTOR + 3] != 0x04 ||
+      data[E131_OFFSET_FRAME_VECTOR + 3] != 0x02 ||
+      data[E131_OFFSET_DMP_VECTOR] != 0x02 ||
+      data[E131_OFFSET_START_CODE] != 0x00) {
+    stats.droppedPackets++;
+    return false;
+  }
+
+  uint8_t options = data[E131_OFFSET_OPTIONS];
+  if (options & E131_OPTION_PREVIEW) {
+    return false;
+  }
+  if (options & E131_OPTION_TERMINATED) {
+    streamActive = false;
+    LOG_I(STREAM, "E1.31 stream terminated by source");
+    return false;
+  }
+
+  uint16_t universe = ((uint16_t)data[E131_OFFSET_UNIVERSE] << 8) | data[E131_OFFSET_UNIVERSE + 1];
+  if (universe < E131_START_UNIVERSE || universe - E131_START_UNIVERSE >= E131_MAX_UNIVERSES) {
+    return false;
+  }
+  uint8_t index = universe - E131_START_UNIVERSE;
+  uint8_t bit = 1 << index;
+  size_t offset = (size_t)index * E131_CHANNELS_PER_UNIVERSE;
+  if (offset >= frameBytes) {
+    return false;
+  }
+
+  uint16_t propCount = ((uint16_t)data[E131_OFFSET_PROP_COUNT] << 8) | data[E131_OFFSET_PROP_COUNT + 1];
+  if (propCount < 1 || len < (size_t)E131_HEADER_LEN + propCount - 1) {
+    stats.droppedPackets++;
+    return false;
+  }
+  size_t channels = propCount - 1;  // Property values include the start code
+  if (channels > E131_CHANNELS_PER_UNIVERSE) {
+    channels = E131_CHANNELS_PER_UNIVERSE;
+  }
+
+  startStream();
+
+  // E1.31 6.7.2: discard packets whose sequence is within 20 behind the last one
+  uint8_t seq = data[E131_OFFSET_SEQUENCE];
+  if (e131SeqValid & bit) {
+    int8_t diff = (int8_t)(seq - e131LastSeq[index]);
+    if (diff <= 0 && diff > -20) {
+      stats.droppedPackets++;
+      return false;
+    }
+  }
+  e131LastSeq[index] = seq;
+  e131SeqValid |= bit;
+
+  if (e131ReceivedMask & bit) {
+    completeFrame(true);  // Previous frame never got all of its universes
+    e131ReceivedMask = 0;
+  }
+
+  copyToFrame(offset, data + E131_HEADER_LEN, channels);
+  notePacket();
+
+  e131ReceivedMask |= bit;
+  if (e131ReceivedMask == e131CompleteMask) {
+    completeFrame(false);
+    e131ReceivedMask = 0;
+  }
+  return true;
+}
+
+/**
+ * Update the decode time statistics
+ *
+ * @param startUs micros() value taken before decoding
+ */
+static void recordDecodeTime(unsigned long startUs) {
+  uint32_t us = micros() - startUs;
+  stats.lastDecodeUs = us;
+  if (us > stats.maxDecodeUs) {
+    stats.maxDecodeUs = us;
+  }
+  stats.avgDecodeUs = (stats.avgDecodeUs * 7 + us) / 8;
+}
+
+/**
+ * Start the DDP and E1.31 listeners
+ *
+ * @param numPixels Number of pixels on the strip
+ */
+void setupPixelStream(uint16_t numPixels) {
+  if (numPixels > STREAM_MAX_PIXELS) {
+    numPixels = STREAM_MAX_PIXELS;
+  }
+  frameBytes = (size_t)numPixels * sizeof(CRGB);
+  setupFrameInterpolator(numPixels);
+
+  unsigned universes = (frameBytes + E131_CHANNELS_PER_UNIVERSE - 1) / E131_CHANNELS_PER_UNIVERSE;
+  if (universes > E131_MAX_UNIVERSES) {
+    universes = E131_MAX_UNIVERSES;
+  }
+  e131CompleteMask = (1 << universes) - 1;
+
+  if (ddpUdp.listen(DDP_PORT)) {
+    ddpUdp.onPacket([](AsyncUDPPacket& packet) {
+      unsigned long startUs = micros();
+      powerWake();
+      if (decodeDDPPacket(packet.data(), packet.length())) {
+        recordDecodeTime(startUs);
+      }
+    });
+    LOG_I(STREAM, "DDP receiver listening on UDP port %d", DDP_PORT);
+  } else {
+    LOG_W(STREAM, "DDP receiver failed to start");
+  }
+
+  if (e131Udp.listen(E131_PORT)) {
+    e131Udp.onPacket([](AsyncUDPPacket& packet) {
+      unsigned long startUs = micros();
+      powerWake();
+      if (decodeE131Packet(packet.data(), packet.length())) {
+        recordDecodeTime(startUs);
+      }
+    });
+    LOG_I(STREAM, "E1.31 receiver listening on UDP port %d (universe %u-%u)",
+                  E131_PORT, E131_START_UNIVERSE, E131_START_UNIVERSE + universes - 1);
+  } else {
+    LOG_W(STREAM, "E1.31 receiver failed to start");
+  }
+}
+
+/**
+ * Handle stream timeout and statistics in the main loop
+ */
+void handlePixelStream() {
+  // The receiver task stamps packets; read the stamp before the clock, or a
+  // packet in between would make the difference wrap into a timeout
+  unsigned long lastPacket = lastPacketMs;
+  unsigned long now = millis();
+
+  if (streamActive && now - lastPacket > PIXEL_STREAM_TIMEOUT_MS) {
+    streamActive = false;
+    LOG_I(STREAM, "Pixel stream timed out, resuming local effect");
+  }
+
+  if (now - lastRateUpdate >= 1000) {
+    lastRateUpdate = now;
+    stats.packetsPerSec = stats.packets - packetsAtLastRate;
+    stats.framesPerSec = stats.framesCompleted - framesAtLastRate;
+    packetsAtLastRate = stats.packets;
+    framesAtLastRate = stats.framesCompleted;
+  }
+
+  if (streamActive && now - lastReport >= PIXEL_STREAM_REPORT_INTERVAL_MS) {
+    lastReport = now;
+    const FrameInterpolatorStats& jitter = getFrameInterpolatorStats();
+    LOG_I(STREAM, "Stream: %u pkt/s, %u fps, %u dropped frames, %u dropped pkts, decode %u us (avg %u, max %u)",
+                  stats.packetsPerSec, stats.framesPerSec, stats.droppedFrames, stats.droppedPackets,
+                  stats.lastDecodeUs, stats.avgDecodeUs, stats.maxDecodeUs);
+    LOG_I(STREAM, "Jitter buffer: depth %u (max %u), %u underruns, %u overruns, %u frames rendered",
+                  jitter.depth, jitter.maxDepth, jitter.underruns, jitter.overruns, jitter.renderedFrames);
+  }
+}
+
+/**
+ * Check whether a network stream currently owns the LEDs
+ *
+ * @return true while stream packets keep arriving
+ */
+bool pixelStreamActive() {
+  return streamActive;
+}
+
+/**
+ * Get streaming statistics
+ *
+ * @return Reference to the live statistics
+ */
+const PixelStreamStats& getPixelStreamStats() {
+  return stats;
+}
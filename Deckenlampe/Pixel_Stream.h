@@ -0,0 +1,84 @@
+/**
+ * Pixel_Stream.h - Real-time UDP pixel streaming for CeilingLamp
+ *
+ * Receives pixel data from lighting software on the LAN and copies it
+ * straight into the jitter buffer frame slot (see Frame_Interpolator):
+ * 1. DDP (Distributed Display Protocol) on UDP port 4048
+ * 2. E1.31 / sACN (Streaming ACN) on UDP port 5568
+ *
+ * Packets are parsed in place inside the lwIP receive buffer, so the only
+ * copy is the one from the packet payload into the frame slot.
+ * When no stream data arrives for PIXEL_STREAM_TIMEOUT_MS the lamp falls
+ * back to its local effect.
+ *
+ * Author: icebear74
+ */
+
+#ifndef PIXEL_STREAM_H
+#define PIXEL_STREAM_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// UDP ports (protocol defaults)
+#define DDP_PORT  4048
+#define E131_PORT 5568
+
+// DDP header layout
+#define DDP_HEADER_LEN           10
+#define DDP_HEADER_LEN_TIMECODE  14
+#define DDP_FLAGS_VER_MASK       0xC0
+#define DDP_FLAGS_VER1           0x40
+#define DDP_FLAGS_TIMECODE       0x10
+#define DDP_FLAGS_STORAGE        0x08
+#define DDP_FLAGS_REPLY          0x04
+#define DDP_FLAGS_QUERY          0x02
+#define DDP_FLAGS_PUSH           0x01
+#define DDP_ID_DISPLAY           1
+#define DDP_ID_ALL               255
+
+// E1.31 packet layout (ANSI E1.31-2018)
+#define E131_HEADER_LEN          126  // Up to and including the DMX start code
+#define E131_OFFSET_ACN_ID       4
+#define E131_OFFSET_ROOT_VECTOR  18
+#define E131_OFFSET_FRAME_VECTOR 40
+#define E131_OFFSET_SEQUENCE     111
+#define E131_OFFSET_OPTIONS      112
+#define E131_OFFSET_UNIVERSE     113
+#define E131_OFFSET_DMP_VECTOR   117
+#define E131_OFFSET_PROP_COUNT   123
+#define E131_OFFSET_START_CODE   125
+#define E131_OPTION_PREVIEW      0x80
+#define E131_OPTION_TERMINATED   0x40
+#define E131_CHANNELS_PER_UNIVERSE 510  // 170 RGB pixels, no pixel split across universes
+#define E131_MAX_UNIVERSES       4
+
+// Stream configuration
+extern const unsigned long PIXEL_STREAM_TIMEOUT_MS;
+extern const unsigned long PIXEL_STREAM_REPORT_INTERVAL_MS;
+extern const uint16_t E131_START_UNIVERSE;
+
+// Streaming statistics
+struct PixelStreamStats {
+  uint32_t packets;           // Valid pixel packets received
+  uint32_t packetsPerSec;     // Packet rate over the last second
+  uint32_t framesCompleted;   // Frames committed to the jitter buffer
+  uint32_t framesPerSec;      // Frame rate over the last second
+  uint32_t droppedFrames;     // Frames discarded because a packet was lost
+  uint32_t droppedPackets;    // Late, duplicate or malformed packets
+  uint32_t lastDecodeUs;      // Decode time of the most recent packet
+  uint32_t maxDecodeUs;       // Worst decode time since boot
+  uint32_t avgDecodeUs;       // Moving average decode time
+};
+
+// Function declarations
+void setupPixelStream(uint16_t numPixels);
+void handlePixelStream();
+bool pixelStreamActive();
+const PixelStreamStats& getPixelStreamStats();
+
+// Packet decoders (no network dependency, operate on the raw datagram)
+bool decodeDDPPacket(const uint8_t* data, size_t len);
+bool decodeE131Packet(const uint8_t* data, size_t len);
+
+#endif // PIXEL_STREAM_H
@@ -0,0 +1,211 @@
+/**
+ * Power.cpp - Power management implementation
+ *
+ * With esp_pm available, the loop holds a CPU_FREQ_MAX and a
+ * NO_LIGHT_SLEEP lock while active and releases both when static; the
+ * power manager then scales the clock and sleeps on its own. The minimum
+ * clock is 80 MHz so the APB clock (RMT timing for the LEDs, WiFi) stays
+ * fixed. Without esp_pm the clock is switched with setCpuFrequencyMhz().
+ *
+ * Author: icebear74
+ */
+
+#include "Power.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Pixel_Stream.h"
+#include "OTA_Writer.h"
+#include "Fleet_OTA.h"
+#include <WiFi.h>
+#include <atomic>
+#include <esp_pm.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Power configuration
+const unsigned long POWER_STATIC_AFTER_MS = 5000;  // No LED frame for this long = static output
+const uint32_t POWER_STATIC_TICK_MS = 50;          // Loop wake interval while static
+const int POWER_MAX_FREQ_MHZ = 240;
+const int POWER_MIN_FREQ_MHZ = 80;                 // Lowest clock with a fixed 80 MHz APB
+
+#define POWER_SAMPLE_INTERVAL_MS 1000
+
+static TaskHandle_t loopTask = nullptr;
+static std::atomic<uint8_t> mode(POWER_ACTIVE);
+static esp_pm_lock_handle_t cpuLock = nullptr;
+static esp_pm_lock_handle_t sleepLock = nullptr;
+static unsigned long lastActivity = 0;
+
+// Current proxies
+static uint32_t idleUs = 0;
+static uint32_t wakeups = 0;
+static unsigned long lastSample = 0;
+static PowerStats stats;
+
+/**
+ * Configure DFS and automatic light sleep
+ *
+ * @return true if esp_pm accepted a configuration
+ */
+static bool configurePm() {
+  esp_pm_config_esp32s3_t config = {};
+  config.max_freq_mhz = POWER_MAX_FREQ_MHZ;
+  config.min_freq_mhz = POWER_MIN_FREQ_MHZ;
+  config.light_sleep_enable = POWER_LIGHT_SLEEP_ENABLED;
+  esp_err_t err = esp_pm_configure(&config);
+  if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable) {
+    // Light sleep needs CONFIG_FREERTOS_USE_TICKLESS_IDLE; keep DFS
+    config.light_sleep_enable = false;
+    err = esp_pm_configure(&config);
+  }
+  if (err != ESP_OK) {
+    LOG_W(POWER, "esp_pm unavailable (%d), switching the clock directly", err);
+    return false;
+  }
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "lamp_active", &cpuLock) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "lamp_active", &sleepLock) != ESP_OK) {
+    LOG_W(POWER, "esp_pm locks unavailable, switching the clock directly");
+    return false;
+  }
+  stats.lightSleep = config.light_sleep_enable;
+  return true;
+}
+
+static void enterStatic() {
+  if (stats.frequencyScaling) {
+    esp_pm_lock_release(sleepLock);
+    esp_pm_lock_release(cpuLock);
+  } else {
+    setCpuFrequencyMhz(POWER_MIN_FREQ_MHZ);
+  }
+  mode.store(POWER_STATIC, std::memory_order_relaxed);
+  stats.staticEntries++;
+  LOG_D(POWER, "Output static, %d MHz", (int)getCpuFrequencyMhz());
+}
+
+static void leaveStatic() {
+  if (stats.frequencyScaling) {
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(sleepLock);
+  } else {
+    setCpuFrequencyMhz(POWER_MAX_FREQ_MHZ);
+  }
+  mode.store(POWER_ACTIVE, std::memory_order_relaxed);
+  LOG_D(POWER, "Output active, %d MHz", (int)getCpuFrequencyMhz());
+}
+
+/**
+ * Set up power management
+ * Must be called from setup() (the loop task), starts in active mode.
+ */
+void setupPower() {
+  loopTask = xTaskGetCurrentTaskHandle();
+  stats.frequencyScaling = configurePm();
+  if (stats.frequencyScaling) {
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(sleepLock);
+  }
+
+  // Modem sleep: the radio wakes for DTIM beacons only (needed for light sleep)
+  WiFi.setSleep(WIFI_PS_MIN_MODEM);
+
+  lastActivity = millis();
+  lastSample = lastActivity;
+  LOG_I(POWER, "Power management: %s, light sleep %s",
+        stats.frequencyScaling ? "DFS" : "fixed clock", stats.lightSleep ? "on" : "off");
+}
+
+/**
+ * Switch between active and static mode, sample the current proxies
+ */
+void handlePower() {
+  unsigned long now = millis();
+  bool busy = pixelStreamActive() || otaWriterRunning() || getFleetOtaState() != FLEET_OTA_IDLE;
+  if (busy) {
+    lastActivity = now;
+  }
+  PowerMode current = getPowerMode();
+  if (current == POWER_ACTIVE && now - lastActivity >= POWER_STATIC_AFTER_MS) {
+    enterStatic();
+  } else if (current == POWER_STATIC && busy) {
+    leaveStatic();
+  }
+
+  unsigned long elapsed = now - lastSample;
+  if (elapsed >= POWER_SAMPLE_INTERVAL_MS) {
+    uint32_t idle = idleUs / 10 / elapsed;
+    stats.idlePercent = idle > 100 ? 100 : idle;
+    stats.wakeupsPerSecond = wakeups * 1000 / elapsed;
+    idleUs = 0;
+    wakeups = 0;
+    lastSample = now;
+    metricsSet(METRIC_POWER_STATIC, getPowerMode() == POWER_STATIC ? 1 : 0);
+    metricsSet(METRIC_LOOP_IDLE_PERCENT, stats.idlePercent);
+    metricsSet(METRIC_LOOP_WAKEUPS, stats.wakeupsPerSecond);
+    metricsSet(METRIC_CPU_FREQ_MHZ, getCpuFrequencyMhz());
+  }
+}
+
+/**
+ * Report LED output activity (loop task)
+ * Leaves static mode at once, so the frame is rendered at full clock.
+ */
+void powerActivity() {
+  lastActivity = millis();
+  if (getPowerMode() == POWER_STATIC) {
+    leaveStatic();
+  }
+}
+
+/**
+ * End the loop's idle wait (any task, e.g. UDP receivers)
+ */
+void powerWake() {
+  if (loopTask != nullptr && getPowerMode() == POWER_STATIC) {
+    xTaskNotifyGive(loopTask);
+  }
+}
+
+/**
+ * Wait at the end of loop()
+ * 1 ms while active; while static up to POWER_STATIC_TICK_MS or until
+ * powerWake(). TCP sockets cannot call powerWake(), their data waits
+ * for the end of the tick.
+ */
+void powerIdle() {
+  uint32_t t0 = micros();
+  if (getPowerMode() == POWER_STATIC) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_STATIC_TICK_MS));
+  } else {
+    delay(1);
+  }
+  idleUs += micros() - t0;
+  wakeups++;
+}
+
+/**
+ * Poll interval for background tasks (log, stall monitor)
+ *
+ * @param activeMs Interval while active
+ * @return activeMs, stretched to POWER_STATIC_TICK_MS while static
+ */
+uint32_t powerPollInterval(uint32_t activeMs) {
+  if (getPowerMode() == POWER_STATIC && activeMs < POWER_STATIC_TICK_MS) {
+    return POWER_STATIC_TICK_MS;
+  }
+  return activeMs;
+}
+
+/**
+ * Get the current power mode
+ */
+PowerMode getPowerMode() {
+  return (PowerMode)mode.load(std::memory_order_relaxed);
+}
+
+/**
+ * Get power management statistics
+ */
+const PowerStats& getPowerStats() {
+  return stats;
+}
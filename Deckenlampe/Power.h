@@ -0,0 +1,59 @@
+/**
+ * Power.h - Power management for CeilingLamp
+ *
+ * While the LED output changes (effects, pixel streams, OTA) the lamp runs
+ * at full clock and the loop polls every millisecond. Once nothing was
+ * pushed to the strip for POWER_STATIC_AFTER_MS, the lamp goes static:
+ * - the CPU clock drops to POWER_MIN_FREQ_MHZ (dynamic frequency scaling)
+ * - the loop sleeps up to POWER_STATIC_TICK_MS between iterations, so
+ *   HTTP, MQTT and ArduinoOTA are still polled
+ * - with automatic light sleep available, the chip sleeps between WiFi
+ *   beacons (modem sleep at DTIM) whenever all tasks are idle
+ * UDP input (receivers call powerWake()) ends the loop's wait
+ * immediately; the next LED frame (powerActivity()) restores full clock.
+ * TCP input (HTTP, MQTT, ArduinoOTA) has no receive callback in the
+ * Arduino core and is only seen at the next tick: up to
+ * POWER_STATIC_TICK_MS of added latency while static.
+ *
+ * Loop idle time, wakeups per second and the CPU clock are exported on
+ * /metrics as proxies for the average current.
+ *
+ * Author: icebear74
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// Power configuration
+extern const unsigned long POWER_STATIC_AFTER_MS;
+extern const uint32_t POWER_STATIC_TICK_MS;
+extern const int POWER_MAX_FREQ_MHZ;
+extern const int POWER_MIN_FREQ_MHZ;
+
+enum PowerMode {
+  POWER_ACTIVE = 0,             // Output changing: full clock, 1 ms loop
+  POWER_STATIC                  // Output static: low clock, sleeping loop
+};
+
+struct PowerStats {
+  uint32_t staticEntries;       // Switches to static mode since boot
+  uint8_t idlePercent;          // Share of the last second the loop slept
+  uint16_t wakeupsPerSecond;    // Loop iterations in the last second
+  bool frequencyScaling;        // esp_pm DFS configured
+  bool lightSleep;              // Automatic light sleep configured
+};
+
+// Function declarations
+void setupPower();
+void handlePower();
+void powerActivity();
+void powerWake();
+void powerIdle();
+uint32_t powerPollInterval(uint32_t activeMs);
+PowerMode getPowerMode();
+const PowerStats& getPowerStats();
+
+#endif // POWER_H
@@ -0,0 +1,399 @@
+/**
+ * Sequence.cpp - Flash-resident light sequence player implementation
+ *
+ * The player remembers the last decoded frame and a hash of the pixels it
+ * wrote. If the next request continues forward from there and the buffer
+ * is untouched, only the following delta records are applied; otherwise
+ * decoding restarts at the keyframe before the requested frame.
+ *
+ * Lamps that keep the default partition table use the spiffs partition
+ * behind the settings journal (see partitions.csv).
+ *
+ * Author: icebear74
+ */
+
+#include "Sequence.h"
+#include "Log.h"
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+
+#define SPIFFS_SEQUENCE_OFFSET 0x10000   // Behind the settings journal
+
+static const esp_partition_t* partition = nullptr;
+static uint32_t areaOffset = 0;          // Sequence area within the partition
+static uint32_t areaSize = 0;
+
+// Mapped file
+static esp_partition_mmap_handle_t mapHandle;
+static const uint8_t* file = nullptr;
+static const SequenceHeader* header = nullptr;
+static const uint8_t* keyframeIndex = nullptr;
+
+// Player position
+static const CRGB* decodedTarget = nullptr;
+static uint32_t decodedFrame = UINT32_MAX;
+static uint32_t decodedHash = 0;
+static uint32_t nextRecord = 0;          // File offset of the record after decodedFrame
+
+// Upload
+static uint32_t uploadOffset = 0;
+static uint32_t erasedEnd = 0;
+static bool uploadFailed = false;
+static const char* lastError = "";
+
+static SequenceStats stats;
+
+static uint16_t read16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t read32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * FNV-1a over the pixels, detects writes by others between frames
+ */
+static uint32_t pixelHash(const CRGB* leds, uint16_t numLeds) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(leds);
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < (size_t)numLeds * sizeof(CRGB); i++) {
+    hash = (hash ^ p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void unmapSequence() {
+  if (file != nullptr) {
+    esp_partition_munmap(mapHandle);
+  }
+  file = nullptr;
+  header = nullptr;
+  keyframeIndex = nullptr;
+  decodedFrame = UINT32_MAX;
+  stats.loaded = false;
+}
+
+/**
+ * Map the sequence area and validate the file
+ *
+ * @return true if a valid sequence is ready to play
+ */
+static bool loadSequence() {
+  unmapSequence();
+  if (partition == nullptr) {
+    lastError = "no sequence partition";
+    return false;
+  }
+
+  SequenceHeader head;
+  if (esp_partition_read(partition, areaOffset, &head, sizeof(head)) != ESP_OK ||
+      memcmp(head.magic, SEQUENCE_MAGIC, 4) != 0) {
+    lastError = "no sequence stored";
+    return false;
+  }
+  // Every size comes from the file: compare in 64 bits, subtract only after
+  // the lower bound holds
+  uint64_t keyframes = head.frameCount && head.keyframeInterval ?
+                       (head.frameCount - 1) / head.keyframeInterval + 1 : 0;
+  if (head.version != SEQUENCE_VERSION || head.pixelCount == 0 || head.frameCount == 0 ||
+      head.frameIntervalMs == 0 || head.keyframeInterval == 0 ||
+      head.fileSize < SEQUENCE_HEADER_LEN || head.fileSize > areaSize ||
+      head.dataSize > head.fileSize - SEQUENCE_HEADER_LEN ||
+      head.indexOffset != SEQUENCE_HEADER_LEN + head.dataSize ||
+      head.indexOffset + keyframes * 4 != head.fileSize) {
+    lastError = "invalid sequence header";
+    return false;
+  }
+
+  const void* mapped = nullptr;
+  esp_err_t err = esp_partition_mmap(partition, areaOffset, head.fileSize, ESP_PARTITION_MMAP_DATA,
+                                     &mapped, &mapHandle);
+  if (err != ESP_OK) {
+    LOG_E(SEQ, "Sequence mmap failed (%d)", err);
+    lastError = "mmap failed";
+    return false;
+  }
+  file = static_cast<const uint8_t*>(mapped);
+
+  uint32_t crc = esp_rom_crc32_le(0, file + SEQUENCE_HEADER_LEN, head.fileSize - SEQUENCE_HEADER_LEN);
+  if (crc != head.crc) {
+    unmapSequence();
+    lastError = "sequence CRC mismatch";
+    return false;
+  }
+  for (uint32_t k = 0; k < keyframes; k++) {
+    uint32_t offset = read32(file + head.indexOffset + k * 4);
+    if (offset < SEQUENCE_HEADER_LEN || offset > head.indexOffset - 2) {
+      unmapSequence();
+      lastError = "invalid keyframe index";
+      return false;
+    }
+  }
+
+  header = reinterpret_cast<const SequenceHeader*>(file);
+  keyframeIndex = file + header->indexOffset;
+  stats.loaded = true;
+  stats.pixelCount = header->pixelCount;
+  stats.frameCount = header->frameCount;
+  stats.frameIntervalMs = header->frameIntervalMs;
+  stats.fileSize = header->fileSize;
+  lastError = "";
+  LOG_I(SEQ, "Sequence: %u frames of %u pixels, %u ms/frame, %u bytes",
+        header->frameCount, header->pixelCount, header->frameIntervalMs, header->fileSize);
+  return true;
+}
+
+/**
+ * Apply one frame record
+ *
+ * @param offset File offset of the record, advanced past it
+ * @param key Keyframe (SKIP not allowed)
+ * @return false if the record is malformed
+ */
+static bool applyRecord(uint32_t& offset, bool key, CRGB* leds, uint16_t numLeds) {
+  if (offset > header->indexOffset - 2) {
+    return false;
+  }
+  const uint8_t* p = file + offset + 2;
+  const uint8_t* end = p + read16(file + offset);
+  if (end > file + header->indexOffset) {
+    return false;
+  }
+
+  uint32_t pixel = 0;
+  while (p < end) {
+    uint8_t op = *p++;
+    uint32_t run = (op & ~SEQUENCE_OP_MASK) + 1;
+    if (pixel + run > header->pixelCount) {
+      return false;
+    }
+    switch (op & SEQUENCE_OP_MASK) {
+      case SEQUENCE_OP_SKIP:
+        if (key) {
+          return false;
+        }
+        break;
+
+      case SEQUENCE_OP_REPEAT: {
+        if (p + 3 > end) {
+          return false;
+        }
+        CRGB color(p[0], p[1], p[2]);
+        p += 3;
+        for (uint32_t i = pixel; i < pixel + run && i < numLeds; i++) {
+          leds[i] = color;
+        }
+        break;
+      }
+
+      case SEQUENCE_OP_LITERAL:
+        if (p + 3 * run > end) {
+          return false;
+        }
+        for (uint32_t i = pixel; i < pixel + run; i++, p += 3) {
+          if (i < numLeds) {
+            leds[i] = CRGB(p[0], p[1], p[2]);
+          }
+        }
+        break;
+
+      default:
+        return false;
+    }
+    pixel += run;
+  }
+
+  offset = end - file;
+  stats.framesDecoded++;
+  return pixel == header->pixelCount;
+}
+
+/**
+ * Decode a sequence frame into an LED buffer
+ * Pixels beyond the sequence's pixel count are cleared on keyframes.
+ *
+ * @param frame Frame number (wrapped to the sequence length)
+ * @return false if no sequence is loaded or the frame is damaged
+ */
+bool decodeSequenceFrame(uint32_t frame, CRGB* leds, uint16_t numLeds) {
+  if (header == nullptr) {
+    return false;
+  }
+  frame %= header->frameCount;
+  uint16_t interval = header->keyframeInterval;
+  uint32_t keyframe = frame - frame % interval;
+
+  bool intact = leds == decodedTarget && decodedFrame != UINT32_MAX &&
+                pixelHash(leds, numLeds) == decodedHash;
+  if (intact && frame == decodedFrame) {
+    return true;
+  }
+
+  uint32_t current;
+  uint32_t offset;
+  if (intact && frame > decodedFrame && decodedFrame + 1 >= keyframe) {
+    // Continue with the next delta records
+    current = decodedFrame + 1;
+    offset = nextRecord;
+  } else {
+    current = keyframe;
+    offset = read32(keyframeIndex + (keyframe / interval) * 4);
+    stats.seeks++;
+  }
+
+  for (; current <= frame; current++) {
+    bool key = current % interval == 0;
+    if (key) {
+      for (uint16_t i = header->pixelCount; i < numLeds; i++) {
+        leds[i] = CRGB::Black;
+      }
+    }
+    if (!applyRecord(offset, key, leds, numLeds)) {
+      LOG_E(SEQ, "Sequence frame %u is damaged", current);
+      decodedFrame = UINT32_MAX;
+      return false;
+    }
+  }
+
+  decodedTarget = leds;
+  decodedFrame = frame;
+  decodedHash = pixelHash(leds, numLeds);
+  nextRecord = offset;
+  return true;
+}
+
+/**
+ * Locate the sequence partition and load a stored sequence
+ */
+void setupSequence() {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                       SEQUENCE_PARTITION_LABEL);
+  if (partition != nullptr) {
+    areaOffset = 0;
+    areaSize = partition->size;
+  } else {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+    if (partition == nullptr || partition->size <= SPIFFS_SEQUENCE_OFFSET) {
+      partition = nullptr;
+      LOG_W(SEQ, "No sequence partition, sequence playback disabled");
+      return;
+    }
+    areaOffset = SPIFFS_SEQUENCE_OFFSET;
+    areaSize = partition->size - SPIFFS_SEQUENCE_OFFSET;
+  }
+  if (!loadSequence()) {
+    LOG_I(SEQ, "Sequence: %s", lastError);
+  }
+}
+
+/**
+ * Check if a sequence is ready to play
+ */
+bool sequenceLoaded() {
+  return header != nullptr;
+}
+
+/**
+ * Render the sequence at a position on the effect timeline (loops)
+ *
+ * @param elapsedMs Time since the start of the effect
+ * @return false if no sequence is loaded
+ */
+bool renderSequence(uint32_t elapsedMs, CRGB* leds, uint16_t numLeds) {
+  if (header == nullptr) {
+    return false;
+  }
+  uint32_t t0 = micros();
+  uint32_t before = stats.framesDecoded;
+  bool ok = decodeSequenceFrame(elapsedMs / header->frameIntervalMs, leds, numLeds);
+  if (stats.framesDecoded != before) {
+    stats.lastDecodeUs = micros() - t0;
+    if (stats.lastDecodeUs > stats.maxDecodeUs) {
+      stats.maxDecodeUs = stats.lastDecodeUs;
+    }
+  }
+  return ok;
+}
+
+/**
+ * Get the mapped sequence file (benchmarks)
+ *
+ * @param size Receives the file size
+ * @return File start, nullptr if no sequence is loaded
+ */
+const uint8_t* sequenceData(size_t* size) {
+  *size = header != nullptr ? header->fileSize : 0;
+  return file;
+}
+
+/**
+ * Start writing a new sequence file
+ * Playback stops until the upload is complete.
+ */
+bool sequenceUploadBegin() {
+  unmapSequence();
+  uploadOffset = 0;
+  erasedEnd = 0;
+  uploadFailed = partition == nullptr;
+  lastError = uploadFailed ? "no sequence partition" : "";
+  return !uploadFailed;
+}
+
+/**
+ * Write the next chunk of the sequence file
+ * Sectors are erased just ahead of the data.
+ */
+bool sequenceUploadWrite(const uint8_t* data, size_t len) {
+  if (uploadFailed) {
+    return false;
+  }
+  if (len > areaSize - uploadOffset) {
+    uploadFailed = true;
+    lastError = "sequence too large for the partition";
+    return false;
+  }
+  while (erasedEnd < uploadOffset + len) {
+    if (esp_partition_erase_range(partition, areaOffset + erasedEnd, SEQUENCE_SECTOR_SIZE) != ESP_OK) {
+      uploadFailed = true;
+      lastError = "flash erase failed";
+      return false;
+    }
+    erasedEnd += SEQUENCE_SECTOR_SIZE;
+  }
+  if (esp_partition_write(partition, areaOffset + uploadOffset, data, len) != ESP_OK) {
+    uploadFailed = true;
+    lastError = "flash write failed";
+    return false;
+  }
+  uploadOffset += len;
+  return true;
+}
+
+/**
+ * Finish the upload and start playing the new sequence
+ *
+ * @return true if the stored file is a valid sequence
+ */
+bool sequenceUploadEnd() {
+  if (uploadFailed) {
+    LOG_W(SEQ, "Sequence upload failed: %s", lastError);
+    return false;
+  }
+  LOG_I(SEQ, "Sequence upload: %u bytes written", uploadOffset);
+  return loadSequence();
+}
+
+/**
+ * Get the reason of the last load or upload failure
+ */
+const char* sequenceError() {
+  return lastError;
+}
+
+/**
+ * Get sequence player statistics
+ */
+const SequenceStats& getSequenceStats() {
+  return stats;
+}
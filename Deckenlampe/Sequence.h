@@ -0,0 +1,86 @@
+/**
+ * Sequence.h - Flash-resident light sequence player for CeilingLamp
+ *
+ * Plays light shows authored on a PC (make-sequence.py) from the
+ * "sequence" flash partition. The file is memory-mapped, so frames are
+ * decoded straight from flash into the LED buffer; nothing but the
+ * player state lives in RAM. The sequence plays as effect "sequence" on
+ * the effect timeline, so grouped lamps play it in sync.
+ *
+ * File layout (all integers little endian):
+ *   header (32): "DLSQ" | version (1) | reserved (1) | pixelCount (2) |
+ *                frameCount (4) | frameIntervalMs (2) | keyframeInterval (2) |
+ *                indexOffset (4) | dataSize (4) | fileSize (4) |
+ *                CRC32 of everything after the header (4)
+ *   frames:      length (2) | ops, one record per frame, from offset 32
+ *   index:       offset (4) of every keyframe record (frame % keyframeInterval == 0)
+ *
+ * Frame ops work on whole pixels; keyframes must not contain SKIP:
+ *   0x00-0x3F  SKIP n       (op & 0x3F) + 1 pixels unchanged
+ *   0x40-0x7F  REPEAT n     one RGB value for n pixels
+ *   0x80-0xBF  LITERAL n    n RGB values
+ *
+ * Upload: POST http://<lamp>/sequence (multipart, like /update)
+ *
+ * Author: icebear74
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#define SEQUENCE_PARTITION_LABEL  "sequence"
+#define SEQUENCE_MAGIC            "DLSQ"
+#define SEQUENCE_VERSION          1
+#define SEQUENCE_HEADER_LEN       32
+#define SEQUENCE_SECTOR_SIZE      4096  // Flash erase unit
+
+// Frame ops
+#define SEQUENCE_OP_SKIP          0x00
+#define SEQUENCE_OP_REPEAT        0x40
+#define SEQUENCE_OP_LITERAL       0x80
+#define SEQUENCE_OP_MASK          0xC0
+#define SEQUENCE_OP_MAX_RUN       64
+
+struct __attribute__((packed)) SequenceHeader {
+  char magic[4];
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t pixelCount;
+  uint32_t frameCount;
+  uint16_t frameIntervalMs;
+  uint16_t keyframeInterval;
+  uint32_t indexOffset;
+  uint32_t dataSize;
+  uint32_t fileSize;
+  uint32_t crc;
+};
+
+// Player statistics
+struct SequenceStats {
+  bool loaded;
+  uint16_t pixelCount;
+  uint32_t frameCount;
+  uint16_t frameIntervalMs;
+  uint32_t fileSize;
+  uint32_t framesDecoded;       // Frame records applied since boot
+  uint32_t seeks;               // Restarts from a keyframe
+  uint32_t lastDecodeUs;        // Last renderSequence() call that decoded
+  uint32_t maxDecodeUs;
+};
+
+// Function declarations
+void setupSequence();
+bool sequenceLoaded();
+bool renderSequence(uint32_t elapsedMs, CRGB* leds, uint16_t numLeds);
+bool decodeSequenceFrame(uint32_t frame, CRGB* leds, uint16_t numLeds);
+const uint8_t* sequenceData(size_t* size);
+bool sequenceUploadBegin();
+bool sequenceUploadWrite(const uint8_t* data, size_t len);
+bool sequenceUploadEnd();
+const char* sequenceError();
+const SequenceStats& getSequenceStats();
+
+#endif // SEQUENCE_H
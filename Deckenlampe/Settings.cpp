@@ -0,0 +1,454 @@
+/**
+ * Settings.cpp - Persistent settings store implementation
+ *
+ * Journal sector layout (erased flash reads 0xFF):
+ *   [SectorHeader][record][record]...[0xFF...]
+ *   record = RecordHeader + value, padded to 4 bytes
+ *
+ * A sector becomes valid only when its header is written, which happens
+ * after its snapshot records: a power loss during compaction leaves the
+ * previous sector in charge. A torn change record fails its CRC; loading
+ * stops there and the next flush compacts into a fresh sector.
+ *
+ * The brownout detector resets the chip from an interrupt without running
+ * shutdown handlers, so changes made within the last quiet period before a
+ * power loss cannot be saved; a brownout reset is logged at the next boot.
+ *
+ * Author: icebear74
+ */
+
+#include "Settings.h"
+#include "Bench.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include <atomic>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+
+// Settings configuration
+const unsigned long SETTINGS_QUIET_MS = 3000;        // Flush once no setting changed for this long
+const unsigned long SETTINGS_MAX_DELAY_MS = 30000;   // Flush at the latest this long after the first change
+
+#define SETTINGS_MAGIC      0x31534C44   // "DLS1"
+#define RECORD_KEY_ERASED   0xFF
+#define HOUR_MS             3600000UL
+
+struct SectorHeader {
+  uint32_t magic;
+  uint32_t sequence;            // Increases with every compaction
+  uint32_t crc;                 // CRC32 of magic and sequence
+  uint32_t reserved;            // Left erased
+};
+
+struct RecordHeader {
+  uint8_t key;                  // Schema key, RECORD_KEY_ERASED = end of journal
+  uint8_t length;               // Value bytes
+  uint16_t crc;                 // CRC16 of key, length and value
+};
+
+// Schema: keys are stored in flash and must never be reused
+struct SettingInfo {
+  uint8_t key;
+  uint8_t size;
+  const char* name;
+};
+
+static const SettingInfo schema[SETTING_COUNT] = {
+  { 1, sizeof(bool),        "power" },
+  { 2, sizeof(uint8_t),     "brightness" },
+  { 3, 3 * sizeof(uint8_t), "color" },
+  { 4, sizeof(uint8_t),     "effect" },
+  { 5, BENCH_COUNT * sizeof(uint32_t), "bench_baselines" },
+};
+
+static_assert(SETTING_COUNT <= 32, "dirty masks are 32 bit");
+static_assert(sizeof(SectorHeader) == 16 && sizeof(RecordHeader) == 4, "packed flash layout");
+
+// RAM shadow (loop task and shutdown handler)
+static portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t shadow[SETTING_COUNT][SETTINGS_MAX_VALUE_SIZE];
+static uint32_t presentMask = 0;   // Settings with a value (loaded or stored)
+static uint32_t dirtyMask = 0;     // Settings not yet in flash
+static unsigned long firstChange = 0;
+static unsigned long lastChange = 0;
+
+// Journal
+static const esp_partition_t* partition = nullptr;
+static uint8_t sectorCount = 0;
+static int activeSector = -1;
+static uint32_t writeOffset = 0;   // Within the active sector
+static bool needsCompaction = false;
+static std::atomic<bool> flushing(false);
+
+// Write statistics
+static uint32_t hourWrites[24];
+static uint8_t hourIndex = 0;
+static uint8_t hoursCounted = 0;
+static unsigned long hourStart = 0;
+static SettingsStats stats;
+
+/**
+ * Size of a journal record in flash
+ */
+static uint32_t recordSize(uint8_t length) {
+  return (sizeof(RecordHeader) + length + 3) & ~3u;
+}
+
+static uint16_t recordCrc(uint8_t key, uint8_t length, const uint8_t* value) {
+  uint8_t head[2] = { key, length };
+  uint16_t crc = esp_rom_crc16_le(0, head, sizeof(head));
+  return esp_rom_crc16_le(crc, value, length);
+}
+
+static uint32_t headerCrc(const SectorHeader& header) {
+  return esp_rom_crc32_le(0, (const uint8_t*)&header, offsetof(SectorHeader, crc));
+}
+
+static int findKey(uint8_t key) {
+  for (int i = 0; i < SETTING_COUNT; i++) {
+    if (schema[i].key == key) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void updateDayStats() {
+  uint32_t total = 0;
+  for (int h = 0; h < 24; h++) {
+    total += hourWrites[h];
+  }
+  stats.writesLastDay = total;
+  metricsSet(METRIC_SETTINGS_DAY_WRITES, total);
+}
+
+/**
+ * Write to the journal and count it
+ */
+static bool journalWrite(uint32_t offset, const void* data, size_t len) {
+  esp_err_t err = esp_partition_write(partition, offset, data, len);
+  if (err != ESP_OK) {
+    LOG_E(PREFS, "Flash write at 0x%x failed (%d)", (unsigned)offset, err);
+    return false;
+  }
+  stats.flashWrites++;
+  hourWrites[hourIndex]++;
+  metricsInc(METRIC_SETTINGS_FLASH_WRITES);
+  return true;
+}
+
+/**
+ * Write one record (header and value in one flash write)
+ */
+static bool writeRecord(uint32_t offset, int id, const uint8_t* value) {
+  uint8_t buffer[sizeof(RecordHeader) + SETTINGS_MAX_VALUE_SIZE + 3];
+  uint8_t length = schema[id].size;
+  uint32_t size = recordSize(length);
+  RecordHeader header = { schema[id].key, length, recordCrc(schema[id].key, length, value) };
+  memset(buffer, 0xFF, size);
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), value, length);
+  return journalWrite(offset, buffer, size);
+}
+
+/**
+ * Start the next sector with a snapshot of all stored settings
+ */
+static bool compact(const uint8_t values[][SETTINGS_MAX_VALUE_SIZE], uint32_t stored) {
+  uint8_t next = activeSector < 0 ? 0 : (activeSector + 1) % sectorCount;
+  uint32_t base = next * SETTINGS_SECTOR_SIZE;
+
+  esp_err_t err = esp_partition_erase_range(partition, base, SETTINGS_SECTOR_SIZE);
+  if (err != ESP_OK) {
+    LOG_E(PREFS, "Erasing sector %u failed (%d)", next, err);
+    return false;
+  }
+  stats.sectorErases++;
+  metricsInc(METRIC_SETTINGS_ERASES);
+
+  uint32_t offset = sizeof(SectorHeader);
+  for (int i = 0; i < SETTING_COUNT; i++) {
+    if (stored & (1u << i)) {
+      if (!writeRecord(base + offset, i, values[i])) {
+        return false;
+      }
+      offset += recordSize(schema[i].size);
+    }
+  }
+
+  // The header goes last: it makes the sector valid
+  SectorHeader header = { SETTINGS_MAGIC, stats.sequence + 1, 0, 0xFFFFFFFF };
+  header.crc = headerCrc(header);
+  if (!journalWrite(base, &header, sizeof(header))) {
+    return false;
+  }
+
+  activeSector = next;
+  stats.sequence = header.sequence;
+  writeOffset = offset;
+  needsCompaction = false;
+  LOG_D(PREFS, "Compacted into sector %u (generation %u)", next, stats.sequence);
+  return true;
+}
+
+/**
+ * Find the newest valid sector and replay its records into the shadow
+ */
+static void loadJournal() {
+  int best = -1;
+  uint32_t bestSequence = 0;
+  for (int s = 0; s < sectorCount; s++) {
+    SectorHeader header;
+    if (esp_partition_read(partition, s * SETTINGS_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+      continue;
+    }
+    if (header.magic != SETTINGS_MAGIC || header.crc != headerCrc(header)) {
+      continue;
+    }
+    if (best < 0 || header.sequence > bestSequence) {
+      best = s;
+      bestSequence = header.sequence;
+    }
+  }
+  if (best < 0) {
+    LOG_I(PREFS, "No stored settings, using defaults");
+    return;
+  }
+
+  uint32_t base = best * SETTINGS_SECTOR_SIZE;
+  uint32_t offset = sizeof(SectorHeader);
+  int records = 0;
+  while (offset + sizeof(RecordHeader) <= SETTINGS_SECTOR_SIZE) {
+    RecordHeader header;
+    uint8_t value[SETTINGS_MAX_VALUE_SIZE];
+    if (esp_partition_read(partition, base + offset, &header, sizeof(header)) != ESP_OK) {
+      needsCompaction = true;
+      break;
+    }
+    if (header.key == RECORD_KEY_ERASED) {
+      // End of the journal, unless a write was torn after the key byte
+      needsCompaction = header.length != 0xFF || header.crc != 0xFFFF;
+      break;
+    }
+    if (header.length > SETTINGS_MAX_VALUE_SIZE ||
+        offset + recordSize(header.length) > SETTINGS_SECTOR_SIZE ||
+        esp_partition_read(partition, base + offset + sizeof(header), value, header.length) != ESP_OK ||
+        header.crc != recordCrc(header.key, header.length, value)) {
+      LOG_W(PREFS, "Damaged record at 0x%x, dropping the rest of the journal", (unsigned)(base + offset));
+      needsCompaction = true;
+      break;
+    }
+
+    // Unknown keys (removed settings) and changed sizes are skipped
+    int id = findKey(header.key);
+    if (id >= 0 && header.length == schema[id].size) {
+      memcpy(shadow[id], value, header.length);
+      presentMask |= 1u << id;
+    }
+    offset += recordSize(header.length);
+    records++;
+  }
+
+  activeSector = best;
+  stats.sequence = bestSequence;
+  writeOffset = offset;
+  LOG_I(PREFS, "Loaded %d records from sector %d (generation %u)", records, best, bestSequence);
+}
+
+/**
+ * Write pending changes before esp_restart()
+ */
+static void flushOnShutdown() {
+  flushSettings();
+}
+
+/**
+ * Locate the journal and load the stored settings
+ * Must run before the settings are read (setupLampControl()).
+ */
+void setupSettings() {
+  TRACE_START(t0);
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                       SETTINGS_PARTITION_LABEL);
+  if (partition == nullptr) {
+    // Lamps flashed with the default table and updated over the air: the
+    // settings partition overlays the start of the unused spiffs partition
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+  }
+  if (partition == nullptr || partition->size < 2 * SETTINGS_SECTOR_SIZE) {
+    partition = nullptr;
+    LOG_W(PREFS, "No settings partition, changes will not survive a reboot");
+    return;
+  }
+
+  sectorCount = partition->size / SETTINGS_SECTOR_SIZE;
+  if (sectorCount > SETTINGS_MAX_SECTORS) {
+    sectorCount = SETTINGS_MAX_SECTORS;
+  }
+  stats.available = true;
+  LOG_I(PREFS, "Journal: %u sectors in partition '%s' at 0x%x", sectorCount, partition->label,
+        (unsigned)partition->address);
+
+  if (esp_reset_reason() == ESP_RST_BROWNOUT) {
+    LOG_W(PREFS, "Brownout reset: changes from the last %lu ms before it may be lost", SETTINGS_QUIET_MS);
+  }
+
+  loadJournal();
+  stats.journalUsed = writeOffset;
+  hourStart = millis();
+  esp_register_shutdown_handler(flushOnShutdown);
+  TRACE_SPAN(TRACE_SETTINGS_LOAD, t0);
+}
+
+/**
+ * Flush coalesced changes and keep the daily write statistics
+ */
+void handleSettings() {
+  unsigned long now = millis();
+  if (now - hourStart >= HOUR_MS) {
+    hourStart += HOUR_MS;
+    hourIndex = (hourIndex + 1) % 24;
+    hourWrites[hourIndex] = 0;
+    updateDayStats();
+    if (++hoursCounted == 24) {
+      hoursCounted = 0;
+      LOG_I(PREFS, "%u flash writes in the last 24 h, %u sector erases since boot",
+            stats.writesLastDay, stats.sectorErases);
+    }
+  }
+
+  portENTER_CRITICAL(&settingsMux);
+  uint32_t pending = dirtyMask;
+  unsigned long first = firstChange;
+  unsigned long last = lastChange;
+  portEXIT_CRITICAL(&settingsMux);
+
+  if (pending != 0 && (now - last >= SETTINGS_QUIET_MS || now - first >= SETTINGS_MAX_DELAY_MS)) {
+    flushSettings();
+  }
+}
+
+/**
+ * Write all pending changes to flash now
+ * Appends one record per changed setting; compacts into the next sector
+ * when the active one is full.
+ */
+void flushSettings() {
+  if (partition == nullptr) {
+    return;
+  }
+  bool idle = false;
+  if (!flushing.compare_exchange_strong(idle, true)) {
+    return;
+  }
+
+  uint8_t values[SETTING_COUNT][SETTINGS_MAX_VALUE_SIZE];
+  portENTER_CRITICAL(&settingsMux);
+  uint32_t pending = dirtyMask;
+  uint32_t stored = presentMask;
+  memcpy(values, shadow, sizeof(values));
+  dirtyMask = 0;
+  portEXIT_CRITICAL(&settingsMux);
+
+  if (pending == 0) {
+    flushing.store(false);
+    return;
+  }
+
+  TRACE_START(t0);
+  uint32_t needed = 0;
+  for (int i = 0; i < SETTING_COUNT; i++) {
+    if (pending & (1u << i)) {
+      needed += recordSize(schema[i].size);
+    }
+  }
+
+  bool ok = true;
+  if (activeSector < 0 || needsCompaction || writeOffset + needed > SETTINGS_SECTOR_SIZE) {
+    ok = compact(values, stored);
+  } else {
+    uint32_t base = activeSector * SETTINGS_SECTOR_SIZE;
+    for (int i = 0; i < SETTING_COUNT && ok; i++) {
+      if (pending & (1u << i)) {
+        ok = writeRecord(base + writeOffset, i, values[i]);
+        writeOffset += recordSize(schema[i].size);
+      }
+    }
+  }
+
+  if (!ok) {
+    // Retry after the next quiet period, into a fresh sector
+    needsCompaction = true;
+    portENTER_CRITICAL(&settingsMux);
+    dirtyMask |= pending;
+    firstChange = lastChange = millis();
+    portEXIT_CRITICAL(&settingsMux);
+  }
+  stats.flushes++;
+  stats.journalUsed = writeOffset;
+  updateDayStats();
+  TRACE_SPAN(TRACE_SETTINGS_FLUSH, t0);
+  flushing.store(false);
+}
+
+/**
+ * Read a setting from the RAM shadow
+ *
+ * @param id Setting
+ * @param value Receives the value
+ * @param size Size of value, must match the schema
+ * @return false if the setting was never stored or the size is wrong
+ */
+bool readSetting(SettingId id, void* value, size_t size) {
+  if (id >= SETTING_COUNT || size != schema[id].size) {
+    return false;
+  }
+  portENTER_CRITICAL(&settingsMux);
+  bool present = presentMask & (1u << id);
+  if (present) {
+    memcpy(value, shadow[id], size);
+  }
+  portEXIT_CRITICAL(&settingsMux);
+  return present;
+}
+
+/**
+ * Change a setting in the RAM shadow and schedule the flash write
+ * Writing the stored value again does nothing.
+ *
+ * @param id Setting
+ * @param value New value
+ * @param size Size of value, must match the schema
+ */
+void writeSetting(SettingId id, const void* value, size_t size) {
+  if (id >= SETTING_COUNT) {
+    return;
+  }
+  if (size != schema[id].size) {
+    LOG_E(PREFS, "Setting '%s': wrong value size %u", schema[id].name, (unsigned)size);
+    return;
+  }
+  unsigned long now = millis();
+  uint32_t bit = 1u << id;
+  portENTER_CRITICAL(&settingsMux);
+  if (!(presentMask & bit) || memcmp(shadow[id], value, size) != 0) {
+    memcpy(shadow[id], value, size);
+    presentMask |= bit;
+    if (dirtyMask == 0) {
+      firstChange = now;
+    }
+    dirtyMask |= bit;
+    lastChange = now;
+  }
+  portEXIT_CRITICAL(&settingsMux);
+}
+
+/**
+ * Get settings store statistics
+ */
+const SettingsStats& getSettingsStats() {
+  return stats;
+}
@@ -0,0 +1,82 @@
+/**
+ * Settings.h - Persistent settings store for CeilingLamp
+ *
+ * Settings live in a RAM shadow described by a typed schema. Writers only
+ * update the shadow and mark the entry dirty:
+ *   storeSetting(SETTING_BRIGHTNESS, brightness);
+ * handleSettings() writes dirty entries to flash once nothing changed for
+ * SETTINGS_QUIET_MS (at the latest SETTINGS_MAX_DELAY_MS after the first
+ * change), so a slider drag costs one flash write, not hundreds. Pending
+ * changes are also written when the lamp reboots (ESP.restart(), OTA).
+ *
+ * Flash layout: an append-only journal over the sectors of the "settings"
+ * partition. Each sector starts with a full snapshot of all settings,
+ * followed by change records. When a sector is full the next one is
+ * erased and compacted into (snapshot of the current values), so erases
+ * rotate through all sectors (wear leveling) and only the newest sector
+ * has to be read at boot, in a single pass.
+ *
+ * Author: icebear74
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <Arduino.h>
+
+#define SETTINGS_PARTITION_LABEL  "settings"
+#define SETTINGS_SECTOR_SIZE      4096
+#define SETTINGS_MAX_SECTORS      16    // 64 KB journal
+#define SETTINGS_MAX_VALUE_SIZE   64    // Bytes per setting
+
+// Settings configuration
+extern const unsigned long SETTINGS_QUIET_MS;
+extern const unsigned long SETTINGS_MAX_DELAY_MS;
+
+// Schema entries (see Settings.cpp for keys and types)
+enum SettingId {
+  SETTING_POWER = 0,            // bool
+  SETTING_BRIGHTNESS,           // uint8_t
+  SETTING_COLOR,                // uint8_t[3] (RGB)
+  SETTING_EFFECT,               // uint8_t (EffectType)
+  SETTING_BENCH_BASELINES,      // uint32_t[BENCH_COUNT] (Bench, ns/op)
+  SETTING_COUNT
+};
+
+struct SettingsStats {
+  uint32_t flushes;             // Coalesced flushes since boot
+  uint32_t flashWrites;         // Journal records and headers written since boot
+  uint32_t sectorErases;        // Since boot
+  uint32_t writesLastDay;       // Flash writes in the last 24 hours
+  uint32_t sequence;            // Generation of the active sector
+  uint16_t journalUsed;         // Bytes used in the active sector
+  bool available;               // Settings partition found
+};
+
+// Function declarations
+void setupSettings();
+void handleSettings();
+void flushSettings();
+bool readSetting(SettingId id, void* value, size_t size);
+void writeSetting(SettingId id, const void* value, size_t size);
+const SettingsStats& getSettingsStats();
+
+/**
+ * Load a setting into a typed variable
+ *
+ * @return false if the setting was never stored (value is unchanged)
+ */
+template <typename T>
+bool loadSetting(SettingId id, T& value) {
+  return readSetting(id, &value, sizeof(T));
+}
+
+/**
+ * Store a setting (RAM shadow; flushed to flash later)
+ */
+template <typename T>
+void storeSetting(SettingId id, const T& value) {
+  writeSetting(id, &value, sizeof(T));
+}
+
+#endif // SETTINGS_H
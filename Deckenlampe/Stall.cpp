@@ -0,0 +1,402 @@
+/**
+ * Stall.cpp - Loop latency watchdog and stall profiler implementation
+ *
+ * Blame is decided by the watched task itself: whenever a scope is entered
+ * or left (and at the end of the iteration) the elapsed time is compared
+ * to the budget, and the first check that finds it exceeded blames the
+ * subsystem that was running up to that point. This costs one micros()
+ * per scope and needs no sampling.
+ *
+ * Backtraces are taken by the monitor task from the stalled task's saved
+ * context: the first TCB member is the stack pointer saved on the last
+ * context switch, pointing at a solicited frame (task blocked in delay(),
+ * a semaphore or a socket) or an interrupt frame (preempted). Spinning
+ * tasks have no saved context, their samples carry no backtrace. The
+ * task may resume while it is walked; every stack pointer is checked
+ * before it is read, so a torn sample is at worst wrong, never a crash.
+ *
+ * Author: icebear74
+ */
+
+#include "Stall.h"
+#include "Log.h"
+#include "Power.h"
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+#include <esp_debug_helpers.h>
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+#endif
+
+// Stall configuration
+const uint32_t STALL_BUDGET_MS = 20;      // Iterations above this are counted as stalls
+const uint32_t STALL_SEVERE_MS = 500;     // Stalls above this get a backtrace sample
+
+#define STALL_BUCKET_COUNT 8
+
+static const uint32_t bucketLimitsMs[STALL_BUCKET_COUNT - 1] = { 50, 100, 250, 500, 1000, 2000, 5000 };
+static const char* const bucketNames[STALL_BUCKET_COUNT] = {
+  "<50ms", "<100ms", "<250ms", "<500ms", "<1s", "<2s", "<5s", ">=5s"
+};
+static const char* const watchNames[STALL_WATCH_COUNT] = { "loop", "wifi_event" };
+static const char* const subsystemNames[STALL_SUB_COUNT] = {
+  "other", "arduino_ota", "http", "update_check", "fleet_ota", "pixel_stream",
+  "group_sync", "mqtt", "render", "led_show", "metrics", "wifi", "wps", "ntp",
+  "settings"
+};
+
+struct WatchState {
+  std::atomic<TaskHandle_t> task;
+  std::atomic<bool> running;
+  std::atomic<uint32_t> iteration;
+  std::atomic<uint32_t> startUs;
+  std::atomic<uint8_t> subsystem;
+  int8_t blamed;                    // Own task only, -1 = within budget
+  uint32_t maxUs;
+};
+
+struct StallSample {
+  uint32_t startMs;                 // millis() when the iteration started
+  uint32_t durationMs;              // Final duration, 0 while still stalled
+  uint32_t iteration;
+  uint8_t watch;
+  uint8_t subsystem;
+  uint8_t depth;
+  bool spinning;                    // Running on the other core, no backtrace
+  uint32_t backtrace[STALL_BACKTRACE_DEPTH];
+};
+
+static WatchState watches[STALL_WATCH_COUNT];
+
+// Written under stallMux
+static uint32_t stallCounts[STALL_SUB_COUNT][STALL_BUCKET_COUNT];
+static uint32_t stallMaxMs[STALL_SUB_COUNT];
+static uint64_t stallTotalMs[STALL_SUB_COUNT];
+static StallSample samples[STALL_RING_SIZE];
+static uint32_t sampleCount = 0;    // Total samples taken
+static portMUX_TYPE stallMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t monitorTask = nullptr;
+
+/**
+ * Find the running iteration of the calling task
+ */
+static WatchState* currentWatch() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < STALL_WATCH_COUNT; i++) {
+    if (watches[i].task.load(std::memory_order_relaxed) == self &&
+        watches[i].running.load(std::memory_order_relaxed)) {
+      return &watches[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Blame the subsystem that ran until now if this is where the budget ran out
+ */
+static inline void checkBudget(WatchState& w) {
+  if (w.blamed < 0 &&
+      micros() - w.startUs.load(std::memory_order_relaxed) >= STALL_BUDGET_MS * 1000) {
+    w.blamed = w.subsystem.load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Start timing an iteration of a watched task
+ *
+ * @param watch Watched task (the calling task)
+ */
+void stallIterationBegin(StallWatch watch) {
+  WatchState& w = watches[watch];
+  w.task.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+  w.subsystem.store(STALL_SUB_OTHER, std::memory_order_relaxed);
+  w.blamed = -1;
+  w.startUs.store(micros(), std::memory_order_relaxed);
+  w.iteration.fetch_add(1, std::memory_order_relaxed);
+  w.running.store(true, std::memory_order_release);
+}
+
+/**
+ * End an iteration; count it if it exceeded the budget
+ *
+ * @param watch Watched task (the calling task)
+ */
+void stallIterationEnd(StallWatch watch) {
+  WatchState& w = watches[watch];
+  if (!w.running.load(std::memory_order_relaxed)) {
+    return;
+  }
+  checkBudget(w);
+  w.running.store(false, std::memory_order_release);
+  uint32_t us = micros() - w.startUs.load(std::memory_order_relaxed);
+  if (us > w.maxUs) {
+    w.maxUs = us;
+  }
+  if (w.blamed < 0) {
+    return;
+  }
+
+  uint32_t ms = us / 1000;
+  int bucket = 0;
+  while (bucket < STALL_BUCKET_COUNT - 1 && ms >= bucketLimitsMs[bucket]) {
+    bucket++;
+  }
+  uint32_t iteration = w.iteration.load(std::memory_order_relaxed);
+  bool severe = false;
+  portENTER_CRITICAL(&stallMux);
+  stallCounts[w.blamed][bucket]++;
+  stallTotalMs[w.blamed] += ms;
+  if (ms > stallMaxMs[w.blamed]) {
+    stallMaxMs[w.blamed] = ms;
+  }
+  uint32_t first = sampleCount > STALL_RING_SIZE ? sampleCount - STALL_RING_SIZE : 0;
+  for (uint32_t n = sampleCount; n > first && !severe; n--) {
+    StallSample& sample = samples[(n - 1) % STALL_RING_SIZE];
+    if (sample.watch == watch && sample.iteration == iteration) {
+      sample.durationMs = ms;
+      severe = true;
+    }
+  }
+  portEXIT_CRITICAL(&stallMux);
+
+  if (severe) {
+    LOG_W(STALL, "%s stalled %u ms, budget exceeded in %s", watchNames[watch], ms,
+                 subsystemNames[w.blamed]);
+  }
+}
+
+/**
+ * Enter a subsystem (used by STALL_SCOPE)
+ *
+ * @param subsystem Subsystem the following code belongs to
+ * @return Previous subsystem, to be passed to stallLeave()
+ */
+StallSubsystem stallEnter(StallSubsystem subsystem) {
+  WatchState* w = currentWatch();
+  if (w == nullptr) {
+    return STALL_SUB_OTHER;
+  }
+  checkBudget(*w);
+  StallSubsystem previous = (StallSubsystem)w->subsystem.load(std::memory_order_relaxed);
+  w->subsystem.store(subsystem, std::memory_order_relaxed);
+  return previous;
+}
+
+/**
+ * Leave a subsystem (used by STALL_SCOPE)
+ *
+ * @param previous Subsystem returned by stallEnter()
+ */
+void stallLeave(StallSubsystem previous) {
+  WatchState* w = currentWatch();
+  if (w == nullptr) {
+    return;
+  }
+  checkBudget(*w);
+  w->subsystem.store(previous, std::memory_order_relaxed);
+}
+
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+
+/**
+ * Walk the saved stack of a task that is switched out
+ *
+ * @return Number of return addresses stored
+ */
+static uint8_t captureBacktrace(TaskHandle_t task, uint32_t* backtrace) {
+  // pxTopOfStack is the first member of the TCB
+  const uint32_t* frame = *(const uint32_t* const*)task;
+  if (!esp_stack_ptr_is_sane((uint32_t)(uintptr_t)frame)) {
+    return 0;
+  }
+  esp_backtrace_frame_t bt;
+  if (frame[0] == 0) {
+    // XtSolFrame: exit (0), pc, ps, next, a0, a1
+    bt.pc = frame[1];
+    bt.next_pc = frame[4];
+    bt.sp = frame[5];
+  } else {
+    // XtExcFrame: exit, pc, ps, a0, a1
+    bt.pc = frame[1];
+    bt.next_pc = frame[3];
+    bt.sp = frame[4];
+  }
+  bt.exc_frame = nullptr;
+
+  uint8_t depth = 0;
+  backtrace[depth++] = esp_cpu_process_stack_pc(bt.pc);
+  while (depth < STALL_BACKTRACE_DEPTH && bt.next_pc != 0 && esp_stack_ptr_is_sane(bt.sp)) {
+    if (!esp_backtrace_get_next_frame(&bt)) {
+      break;
+    }
+    uint32_t pc = esp_cpu_process_stack_pc(bt.pc);
+    if (!esp_ptr_executable((void*)(uintptr_t)pc)) {
+      break;
+    }
+    backtrace[depth++] = pc;
+  }
+  return depth;
+}
+
+#else
+
+static uint8_t captureBacktrace(TaskHandle_t task, uint32_t* backtrace) {
+  return 0;
+}
+
+#endif // CONFIG_IDF_TARGET_ARCH_XTENSA
+
+/**
+ * Check whether a task is executing right now on another core
+ */
+static bool isRunningElsewhere(TaskHandle_t task) {
+  for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (core != xPortGetCoreID() && xTaskGetCurrentTaskHandleForCPU(core) == task) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Take a backtrace sample of a watched task stuck beyond STALL_SEVERE_MS
+ */
+static void sampleStall(StallWatch watch, uint32_t iteration, uint32_t elapsedMs) {
+  WatchState& w = watches[watch];
+  StallSample sample = {};
+  sample.startMs = millis() - elapsedMs;
+  sample.iteration = iteration;
+  sample.watch = watch;
+  sample.subsystem = w.subsystem.load(std::memory_order_relaxed);
+
+  TaskHandle_t task = w.task.load(std::memory_order_relaxed);
+  sample.spinning = isRunningElsewhere(task);
+  if (!sample.spinning) {
+    sample.depth = captureBacktrace(task, sample.backtrace);
+  }
+  if (w.iteration.load(std::memory_order_relaxed) != iteration ||
+      !w.running.load(std::memory_order_acquire)) {
+    return;     // Resumed while we were looking, the backtrace may be torn
+  }
+
+  portENTER_CRITICAL(&stallMux);
+  samples[sampleCount % STALL_RING_SIZE] = sample;
+  sampleCount++;
+  portEXIT_CRITICAL(&stallMux);
+
+  LOG_W(STALL, "%s stuck for %u ms in %s%s", watchNames[watch], elapsedMs,
+               subsystemNames[sample.subsystem], sample.spinning ? " (spinning)" : "");
+}
+
+/**
+ * Monitor task: look for iterations running beyond STALL_SEVERE_MS
+ */
+static void monitorTaskLoop(void* parameter) {
+  uint32_t sampledIteration[STALL_WATCH_COUNT] = {};
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(powerPollInterval(STALL_MONITOR_INTERVAL_MS)));
+    for (int i = 0; i < STALL_WATCH_COUNT; i++) {
+      WatchState& w = watches[i];
+      if (!w.running.load(std::memory_order_acquire)) {
+        continue;
+      }
+      uint32_t iteration = w.iteration.load(std::memory_order_relaxed);
+      uint32_t elapsedMs = (micros() - w.startUs.load(std::memory_order_relaxed)) / 1000;
+      if (elapsedMs >= STALL_SEVERE_MS && iteration != sampledIteration[i]) {
+        sampledIteration[i] = iteration;
+        sampleStall((StallWatch)i, iteration, elapsedMs);
+      }
+    }
+  }
+}
+
+/**
+ * Start the stall monitor task
+ */
+void setupStallMonitor() {
+  if (monitorTask != nullptr) {
+    return;
+  }
+  xTaskCreatePinnedToCore(monitorTaskLoop, "stall_monitor", STALL_TASK_STACK, nullptr,
+                          STALL_TASK_PRIORITY, &monitorTask, STALL_TASK_CORE);
+}
+
+/**
+ * Write the stall histogram and the severe stall samples as text (GET /stalls)
+ *
+ * @param write Receives the report in chunks (null terminated)
+ */
+void writeStallReport(void (*write)(const char* chunk)) {
+  static uint32_t counts[STALL_SUB_COUNT][STALL_BUCKET_COUNT];
+  static uint32_t maxMs[STALL_SUB_COUNT];
+  static uint64_t totalMs[STALL_SUB_COUNT];
+  static StallSample ring[STALL_RING_SIZE];
+  portENTER_CRITICAL(&stallMux);
+  memcpy(counts, stallCounts, sizeof(counts));
+  memcpy(maxMs, stallMaxMs, sizeof(maxMs));
+  memcpy(totalMs, stallTotalMs, sizeof(totalMs));
+  memcpy(ring, samples, sizeof(ring));
+  uint32_t total = sampleCount;
+  portEXIT_CRITICAL(&stallMux);
+
+  char line[256];
+  snprintf(line, sizeof(line), "Stall budget %u ms, severe %u ms\n\nIterations:",
+           STALL_BUDGET_MS, STALL_SEVERE_MS);
+  write(line);
+  for (int i = 0; i < STALL_WATCH_COUNT; i++) {
+    snprintf(line, sizeof(line), "%s %s %u (max %u ms)", i == 0 ? "" : ",", watchNames[i],
+             watches[i].iteration.load(), watches[i].maxUs / 1000);
+    write(line);
+  }
+
+  int len = snprintf(line, sizeof(line), "\n\nStalls by subsystem\n%-13s", "subsystem");
+  for (int b = 0; b < STALL_BUCKET_COUNT; b++) {
+    len += snprintf(line + len, sizeof(line) - len, "%7s", bucketNames[b]);
+  }
+  snprintf(line + len, sizeof(line) - len, "%9s %10s\n", "max ms", "total ms");
+  write(line);
+  for (int s = 0; s < STALL_SUB_COUNT; s++) {
+    if (maxMs[s] == 0) {
+      continue;
+    }
+    len = snprintf(line, sizeof(line), "%-13s", subsystemNames[s]);
+    for (int b = 0; b < STALL_BUCKET_COUNT; b++) {
+      len += snprintf(line + len, sizeof(line) - len, "%7u", counts[s][b]);
+    }
+    snprintf(line + len, sizeof(line) - len, "%9u %10llu\n", maxMs[s], (unsigned long long)totalMs[s]);
+    write(line);
+  }
+
+  write("\nSevere stalls (newest first)\n"
+        "Decode with: xtensa-esp32s3-elf-addr2line -pfiaC -e <firmware.elf> <addresses>\n");
+  uint32_t first = total > STALL_RING_SIZE ? total - STALL_RING_SIZE : 0;
+  for (uint32_t n = total; n > first; n--) {
+    const StallSample& sample = ring[(n - 1) % STALL_RING_SIZE];
+    char duration[24];
+    if (sample.durationMs != 0) {
+      snprintf(duration, sizeof(duration), "%u ms", sample.durationMs);
+    } else {
+      snprintf(duration, sizeof(duration), "still stalled");
+    }
+    snprintf(line, sizeof(line), "#%u at %u.%03u s: %s in %s, %s%s\n", n,
+             sample.startMs / 1000, sample.startMs % 1000, watchNames[sample.watch],
+             subsystemNames[sample.subsystem], duration,
+             sample.spinning ? ", spinning (no backtrace)" : "");
+    write(line);
+    if (sample.depth == 0) {
+      continue;
+    }
+    len = snprintf(line, sizeof(line), "  Backtrace:");
+    for (uint8_t i = 0; i < sample.depth; i++) {
+      len += snprintf(line + len, sizeof(line) - len, " 0x%08x", sample.backtrace[i]);
+    }
+    snprintf(line + len, sizeof(line) - len, "\n");
+    write(line);
+  }
+}
@@ -0,0 +1,83 @@
+/**
+ * Stall.h - Loop latency watchdog and stall profiler for CeilingLamp
+ *
+ * Watched tasks (the main loop and the WiFi event handler) mark each
+ * iteration; code inside an iteration names the subsystem it belongs to:
+ *   stallIterationBegin(STALL_WATCH_LOOP);
+ *   { STALL_SCOPE(STALL_SUB_MQTT); handleMqtt(); }
+ *   stallIterationEnd(STALL_WATCH_LOOP);
+ * An iteration longer than STALL_BUDGET_MS is counted in a histogram
+ * under the subsystem that was active when the budget ran out.
+ *
+ * A monitor task checks running iterations every STALL_MONITOR_INTERVAL_MS;
+ * once one exceeds STALL_SEVERE_MS it samples the stalled task's backtrace
+ * into a ring buffer, while the task is still stuck. Histogram and samples
+ * are shown on http://<lamp>/stalls.
+ *
+ * Author: icebear74
+ */
+
+#ifndef STALL_H
+#define STALL_H
+
+#include <Arduino.h>
+
+#define STALL_RING_SIZE            16    // Severe stall samples kept
+#define STALL_BACKTRACE_DEPTH      16    // Return addresses per sample
+#define STALL_MONITOR_INTERVAL_MS  10
+#define STALL_TASK_STACK           3072
+#define STALL_TASK_PRIORITY        5     // Above the loop, below WiFi/lwIP
+#define STALL_TASK_CORE            0     // The loop runs on core 1
+
+// Stall configuration
+extern const uint32_t STALL_BUDGET_MS;
+extern const uint32_t STALL_SEVERE_MS;
+
+enum StallWatch {
+  STALL_WATCH_LOOP = 0,         // Arduino loop() (rendering)
+  STALL_WATCH_WIFI_EVENT,       // WiFiEvent() in the Arduino event task
+  STALL_WATCH_COUNT
+};
+
+enum StallSubsystem {
+  STALL_SUB_OTHER = 0,          // Outside any scope
+  STALL_SUB_ARDUINO_OTA,
+  STALL_SUB_HTTP,               // server.handleClient()
+  STALL_SUB_UPDATE_CHECK,
+  STALL_SUB_FLEET_OTA,
+  STALL_SUB_PIXEL_STREAM,
+  STALL_SUB_GROUP_SYNC,
+  STALL_SUB_MQTT,
+  STALL_SUB_RENDER,
+  STALL_SUB_LED_SHOW,
+  STALL_SUB_METRICS,
+  STALL_SUB_WIFI,
+  STALL_SUB_WPS,
+  STALL_SUB_NTP,
+  STALL_SUB_SETTINGS,           // Settings flush (flash write/erase)
+  STALL_SUB_COUNT
+};
+
+// Function declarations
+void setupStallMonitor();
+void stallIterationBegin(StallWatch watch);
+void stallIterationEnd(StallWatch watch);
+StallSubsystem stallEnter(StallSubsystem subsystem);
+void stallLeave(StallSubsystem previous);
+void writeStallReport(void (*write)(const char* chunk));
+
+// Marks the enclosing scope as belonging to a subsystem
+class StallScope {
+ public:
+  explicit StallScope(StallSubsystem subsystem) : previous(stallEnter(subsystem)) {}
+  ~StallScope() { stallLeave(previous); }
+
+ private:
+  StallSubsystem previous;
+};
+
+#define STALL_CONCAT_(a, b) a##b
+#define STALL_CONCAT(a, b) STALL_CONCAT_(a, b)
+#define STALL_SCOPE(subsystem) StallScope STALL_CONCAT(stallScope, __LINE__)(subsystem)
+
+#endif // STALL_H
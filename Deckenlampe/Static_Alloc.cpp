@@ -0,0 +1,171 @@
+/**
+ * Static_Alloc.cpp - Scratch arena and heap check implementation
+ *
+ * The heap check replaces the global operator new/delete. Allocations are
+ * only counted on the loop task once handleHeapCheck() has run (the first
+ * loop() iteration), so everything set up in setup() is excluded.
+ *
+ * C allocations (malloc, Arduino String) need linker flags: with
+ * HEAP_CHECK_WRAP_MALLOC the firmware is linked with
+ *   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * and every reference to them, in precompiled libraries too, lands in the
+ * __wrap_ functions below. free() is not wrapped, only allocations count.
+ * Code that calls heap_caps_malloc() directly and malloc calls inside ROM
+ * functions still bypass the check; their effect shows in the heap gauges
+ * on /metrics (allocated blocks, largest free block low-water mark).
+ *
+ * Author: icebear74
+ */
+
+#include "Static_Alloc.h"
+#include "Log.h"
+#include "Metrics.h"
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Heap check configuration
+const unsigned long HEAP_CHECK_REPORT_INTERVAL_MS = 10000;  // Log new loop allocations at most this often
+
+static uint8_t scratchBuffer[SCRATCH_ARENA_SIZE] __attribute__((aligned(8)));
+ScratchArena scratchArena(scratchBuffer, sizeof(scratchBuffer));
+
+static std::atomic<TaskHandle_t> checkedTask(nullptr);
+static std::atomic<uint32_t> loopAllocations(0);
+static std::atomic<uint32_t> lastSize(0);
+static std::atomic<uint32_t> lastCaller(0);
+static uint32_t reportedAllocations = 0;
+static unsigned long lastReport = 0;
+static HeapCheckStats stats;
+
+#if HEAP_CHECK_ENABLED
+
+/**
+ * Count an allocation if it is made by the loop task in steady state
+ */
+static inline void countAllocation(size_t size, void* caller) {
+  TaskHandle_t task = checkedTask.load(std::memory_order_relaxed);
+  if (task == nullptr || task != xTaskGetCurrentTaskHandle()) {
+    return;
+  }
+  loopAllocations.fetch_add(1, std::memory_order_relaxed);
+  lastSize.store(size, std::memory_order_relaxed);
+  lastCaller.store((uint32_t)(uintptr_t)caller, std::memory_order_relaxed);
+  metricsInc(METRIC_LOOP_HEAP_ALLOCATIONS);
+}
+
+#if HEAP_CHECK_WRAP_MALLOC
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* memory, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  countAllocation(count * size, __builtin_return_address(0));
+  return __real_calloc(count, size);
+}
+
+// Counted whenever it may allocate; realloc(p, 0) frees
+void* __wrap_realloc(void* memory, size_t size) {
+  if (size > 0) {
+    countAllocation(size, __builtin_return_address(0));
+  }
+  return __real_realloc(memory, size);
+}
+}
+
+// operator new counts its own caller, not itself
+#define rawMalloc __real_malloc
+
+#else
+
+#define rawMalloc malloc
+
+#endif // HEAP_CHECK_WRAP_MALLOC
+
+static void* allocate(size_t size) {
+  void* memory = rawMalloc(size ? size : 1);
+  if (memory == nullptr) {
+#if __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+  }
+  return memory;
+}
+
+void* operator new(size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return allocate(size);
+}
+
+void* operator new[](size_t size) {
+  countAllocation(size, __builtin_return_address(0));
+  return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  countAllocation(size, __builtin_return_address(0));
+  return rawMalloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  countAllocation(size, __builtin_return_address(0));
+  return rawMalloc(size ? size : 1);
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { free(memory); }
+
+#endif // HEAP_CHECK_ENABLED
+
+/**
+ * Arm the heap check and report steady-state allocations
+ * Call this function from the main loop; the first call ends the setup
+ * phase, later calls log new allocations at most every
+ * HEAP_CHECK_REPORT_INTERVAL_MS.
+ */
+void handleHeapCheck() {
+  if (checkedTask.load(std::memory_order_relaxed) == nullptr) {
+    checkedTask.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+    lastReport = millis();
+    return;
+  }
+  unsigned long now = millis();
+  if (now - lastReport < HEAP_CHECK_REPORT_INTERVAL_MS) {
+    return;
+  }
+  lastReport = now;
+  metricsSet(METRIC_SCRATCH_HIGH_WATER, scratchArena.highWater());
+
+  uint32_t count = loopAllocations.load(std::memory_order_relaxed);
+  if (count != reportedAllocations) {
+    LOG_W(MAIN, "Heap check: %u allocations in loop (latest %u bytes from 0x%08x)",
+                count - reportedAllocations, lastSize.load(std::memory_order_relaxed),
+                lastCaller.load(std::memory_order_relaxed));
+    reportedAllocations = count;
+  }
+}
+
+/**
+ * Get heap check statistics
+ *
+ * @return Steady-state loop allocations and the latest allocation site
+ */
+const HeapCheckStats& getHeapCheckStats() {
+  stats.loopAllocations = loopAllocations.load(std::memory_order_relaxed);
+  stats.lastSize = lastSize.load(std::memory_order_relaxed);
+  stats.lastCaller = lastCaller.load(std::memory_order_relaxed);
+  return stats;
+}
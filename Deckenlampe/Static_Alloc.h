@@ -0,0 +1,235 @@
+/**
+ * Static_Alloc.h - Heap-free containers and scratch arena for CeilingLamp
+ *
+ * Replacements for Arduino String and std::vector that never touch the
+ * heap, so months of operation cannot fragment it:
+ * - FixedString<N>: text of at most N - 1 characters in place; appends that
+ *   do not fit are cut off and flagged (truncated())
+ * - FixedVector<T, N>: up to N elements in place; push_back() fails when full
+ * - ScratchArena: bump allocator over a static buffer for per-request and
+ *   per-scan scratch; an ArenaScope gives everything back at scope end:
+ *     ArenaScope scope(scratchArena);
+ *     WiFiAP* aps = scratchArena.allocateArray<WiFiAP>(count);
+ *
+ * With HEAP_CHECK_ENABLED (default), every C++ allocation (operator new)
+ * made by the main loop after setup() is counted on /metrics and the
+ * latest caller is logged, so steady-state allocations can be found.
+ * Builds with HEAP_CHECK_WRAP_MALLOC count malloc/calloc/realloc as well.
+ * Allocations made with heap_caps_malloc() (WiFi driver, lwIP) are never
+ * seen: a count of zero means none were found, not that there are none.
+ *
+ * Author: icebear74
+ */
+
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include <Arduino.h>
+#include <new>
+#include <stdarg.h>
+#include "Config.h"
+
+#define SCRATCH_ARENA_SIZE 4096    // Shared scratch for the loop task
+
+// Heap check configuration
+extern const unsigned long HEAP_CHECK_REPORT_INTERVAL_MS;
+
+/**
+ * Fixed-capacity, null-terminated string
+ */
+template <size_t N>
+class FixedString {
+ public:
+  FixedString() { clear(); }
+  FixedString(const char* text) {
+    clear();
+    append(text);
+  }
+
+  void clear() {
+    len = 0;
+    buffer[0] = '\0';
+    cut = false;
+  }
+
+  FixedString& append(const char* text, size_t textLen) {
+    if (textLen > N - 1 - len) {
+      textLen = N - 1 - len;
+      cut = true;
+    }
+    memcpy(buffer + len, text, textLen);
+    len += textLen;
+    buffer[len] = '\0';
+    return *this;
+  }
+
+  FixedString& append(const char* text) { return append(text, strlen(text)); }
+
+  __attribute__((format(printf, 2, 3))) FixedString& appendf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + len, N - len, format, args);
+    va_end(args);
+    if (written < 0) {
+      buffer[len] = '\0';
+    } else if ((size_t)written >= N - len) {
+      len = N - 1;
+      cut = true;
+    } else {
+      len += written;
+    }
+    return *this;
+  }
+
+  FixedString& operator+=(const char* text) { return append(text); }
+  bool operator==(const char* text) const { return strcmp(buffer, text) == 0; }
+  bool operator!=(const char* text) const { return strcmp(buffer, text) != 0; }
+
+  const char* c_str() const { return buffer; }
+  size_t length() const { return len; }
+  bool truncated() const { return cut; }
+  static constexpr size_t capacity() { return N - 1; }
+
+ private:
+  char buffer[N];
+  size_t len;
+  bool cut;
+};
+
+/**
+ * Fixed-capacity vector (elements are stored in place)
+ */
+template <typename T, size_t N>
+class FixedVector {
+ public:
+  bool push_back(const T& item) {
+    if (count >= N) {
+      return false;
+    }
+    items[count++] = item;
+    return true;
+  }
+
+  void clear() { count = 0; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count >= N; }
+  static constexpr size_t capacity() { return N; }
+
+  T& operator[](size_t i) { return items[i]; }
+  const T& operator[](size_t i) const { return items[i]; }
+  T* begin() { return items; }
+  T* end() { return items + count; }
+  const T* begin() const { return items; }
+  const T* end() const { return items + count; }
+
+ private:
+  T items[N];
+  size_t count = 0;
+};
+
+/**
+ * Bump allocator over a fixed buffer
+ * Not thread-safe: each arena belongs to one task.
+ */
+class ScratchArena {
+ public:
+  ScratchArena(uint8_t* buffer, size_t size) : base(buffer), capacity(size), used(0), peak(0) {}
+
+  /**
+   * Allocate from the arena
+   *
+   * @return Aligned memory, nullptr if the arena is exhausted
+   */
+  void* allocate(size_t size, size_t align = alignof(max_align_t)) {
+    size_t start = (used + align - 1) & ~(align - 1);
+    if (start > capacity || size > capacity - start) {
+      return nullptr;
+    }
+    used = start + size;
+    if (used > peak) {
+      peak = used;
+    }
+    return base + start;
+  }
+
+  /**
+   * Allocate and default-construct count elements
+   * Destructors are not run; use for trivially destructible types.
+   */
+  template <typename T>
+  T* allocateArray(size_t count) {
+    if (count > capacity / sizeof(T)) {
+      return nullptr;
+    }
+    void* memory = allocate(count * sizeof(T), alignof(T));
+    if (memory == nullptr) {
+      return nullptr;
+    }
+    T* items = static_cast<T*>(memory);
+    for (size_t i = 0; i < count; i++) {
+      new (&items[i]) T();
+    }
+    return items;
+  }
+
+  size_t mark() const { return used; }
+  void release(size_t position) { used = position; }
+  size_t highWater() const { return peak; }
+  size_t size() const { return capacity; }
+
+ private:
+  uint8_t* base;
+  size_t capacity;
+  size_t used;
+  size_t peak;
+};
+
+/**
+ * Releases everything allocated from an arena within the enclosing scope
+ */
+class ArenaScope {
+ public:
+  explicit ArenaScope(ScratchArena& arena) : arena(arena), start(arena.mark()) {}
+  ~ArenaScope() { arena.release(start); }
+
+ private:
+  ScratchArena& arena;
+  size_t start;
+};
+
+typedef FixedString<16> IpString;     // "255.255.255.255"
+typedef FixedString<18> MacString;    // "AA:BB:CC:DD:EE:FF"
+
+/**
+ * Format an IPv4 address without IPAddress::toString() (heap String)
+ */
+inline IpString ipString(const IPAddress& ip) {
+  IpString text;
+  text.appendf("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return text;
+}
+
+/**
+ * Format a MAC address or BSSID
+ */
+inline MacString macString(const uint8_t* mac) {
+  MacString text;
+  text.appendf("%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return text;
+}
+
+// Scratch arena of the loop task (setup(), loop() and web handlers)
+extern ScratchArena scratchArena;
+
+struct HeapCheckStats {
+  uint32_t loopAllocations;     // operator new (and wrapped malloc) calls by the loop after setup()
+  uint32_t lastSize;            // Bytes of the latest one
+  uint32_t lastCaller;          // Return address of the latest one
+};
+
+// Function declarations
+void handleHeapCheck();
+const HeapCheckStats& getHeapCheckStats();
+
+#endif // STATIC_ALLOC_H
@@ -0,0 +1,208 @@
+/**
+ * Trace.cpp - Boot and runtime tracing implementation
+ *
+ * Events are recorded when a span ends (Chrome "complete" events with
+ * start and duration), so a writer only claims a slot with one atomic
+ * add and fills it in. Export pauses recording; a slot being filled by
+ * another task at that moment may show up incomplete.
+ *
+ * Author: icebear74
+ */
+
+#include "Trace.h"
+#include "Log.h"
+#include <algorithm>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+struct TraceEvent {
+  uint32_t startUs;     // micros() at span start
+  uint32_t durationUs;
+  uint8_t id;
+  char phase;           // 'X' = span, 'i' = instant
+  uint8_t core;
+  uint8_t reserved;
+};
+
+#if TRACE_ENABLED
+
+static const char* const traceNames[TRACE_ID_COUNT] = {
+  "setup", "serial", "settings_load", "led_init", "wifi_init", "wifi_connect", "wifi_scan",
+  "wifi_roam", "wifi_wait", "ntp_sync", "arduino_ota_setup", "web_server_setup",
+  "fleet_ota_setup", "pixel_stream_setup", "group_sync_setup", "mqtt_setup",
+  "network_ready", "first_light",
+  "led_show", "http_request", "update_check", "ota_finish", "fleet_verify",
+  "wifi_disconnect", "settings_flush",
+};
+
+static TraceEvent bootEvents[TRACE_BOOT_SIZE];
+static TraceEvent ringEvents[TRACE_RING_SIZE];
+static std::atomic<uint32_t> bootClaimed(0);    // May exceed TRACE_BOOT_SIZE
+static std::atomic<uint32_t> ringClaimed(0);    // Total runtime events
+static std::atomic<bool> booting(true);
+static std::atomic<bool> paused(false);
+
+/**
+ * Claim a slot and store one event
+ */
+static void record(TraceId id, char phase, uint32_t startUs, uint32_t durationUs) {
+  if (paused.load(std::memory_order_relaxed)) {
+    return;
+  }
+  TraceEvent* event = nullptr;
+  if (booting.load(std::memory_order_relaxed)) {
+    uint32_t slot = bootClaimed.fetch_add(1, std::memory_order_relaxed);
+    if (slot < TRACE_BOOT_SIZE) {
+      event = &bootEvents[slot];
+    }
+  }
+  if (event == nullptr) {
+    uint32_t slot = ringClaimed.fetch_add(1, std::memory_order_relaxed);
+    event = &ringEvents[slot % TRACE_RING_SIZE];
+  }
+  event->startUs = startUs;
+  event->durationUs = durationUs;
+  event->id = id;
+  event->phase = phase;
+  event->core = xPortGetCoreID();
+}
+
+/**
+ * Record a span that started at startUs and ends now
+ *
+ * @param id Trace point
+ * @param startUs micros() at the start of the span
+ */
+void traceSpan(TraceId id, uint32_t startUs) {
+  record(id, 'X', startUs, micros() - startUs);
+}
+
+/**
+ * Record a point in time
+ *
+ * @param id Trace point
+ */
+void traceInstant(TraceId id) {
+  record(id, 'i', micros(), 0);
+}
+
+/**
+ * End the boot phase and print the boot timeline
+ * Later events go into the runtime ring buffer.
+ */
+void traceBootComplete() {
+  if (!booting.exchange(false)) {
+    return;
+  }
+  uint32_t count = std::min<uint32_t>(bootClaimed.load(), TRACE_BOOT_SIZE);
+  TraceEvent events[TRACE_BOOT_SIZE];
+  memcpy(events, bootEvents, count * sizeof(TraceEvent));
+  std::sort(events, events + count, [](const TraceEvent& a, const TraceEvent& b) {
+    return a.startUs < b.startUs;
+  });
+
+  LOG_I(TRACE, "--- Boot Timeline (ms since start) ---");
+  uint32_t lightUs = 0;
+  uint32_t networkUs = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const TraceEvent& event = events[i];
+    if (event.phase == 'X') {
+      LOG_I(TRACE, "  %8.1f  %8.1f ms  %s", event.startUs / 1000.0f,
+                   event.durationUs / 1000.0f, traceNames[event.id]);
+    } else {
+      LOG_I(TRACE, "  %8.1f            %s", event.startUs / 1000.0f, traceNames[event.id]);
+    }
+    if (event.id == TRACE_FIRST_LIGHT) {
+      lightUs = event.startUs;
+    } else if (event.id == TRACE_NETWORK_READY && networkUs == 0) {
+      networkUs = event.startUs;
+    }
+  }
+  LOG_I(TRACE, "Time to light: %u ms, time to network: %u ms%s",
+               lightUs / 1000, networkUs / 1000, networkUs ? "" : " (not connected)");
+  LOG_I(TRACE, "--------------------------------------");
+}
+
+// Chunked JSON output
+struct JsonOutput {
+  void (*write)(const char* chunk);
+  char buffer[1024];
+  size_t length;
+};
+
+static void append(JsonOutput& out, const char* text) {
+  size_t len = strlen(text);
+  if (out.length + len >= sizeof(out.buffer)) {
+    out.buffer[out.length] = '\0';
+    out.write(out.buffer);
+    out.length = 0;
+  }
+  memcpy(out.buffer + out.length, text, len);
+  out.length += len;
+}
+
+static void appendEvent(JsonOutput& out, const TraceEvent& event, uint64_t startUs, const char* category) {
+  char line[192];
+  if (event.phase == 'X') {
+    snprintf(line, sizeof(line),
+             ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":1,\"tid\":%u}",
+             traceNames[event.id], category, (unsigned long long)startUs, event.durationUs, event.core);
+  } else {
+    snprintf(line, sizeof(line),
+             ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%llu,\"pid\":1,\"tid\":%u}",
+             traceNames[event.id], category, (unsigned long long)startUs, event.core);
+  }
+  append(out, line);
+}
+
+/**
+ * Export boot and runtime events as Chrome trace JSON
+ * Recording is paused while exporting.
+ *
+ * @param write Receives the JSON in chunks (null terminated)
+ */
+void writeTraceJson(void (*write)(const char* chunk)) {
+  JsonOutput out;
+  out.write = write;
+  out.length = 0;
+
+  paused.store(true);
+  append(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Deckenlampe\"}},\n"
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"core 0\"}},\n"
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"core 1\"}}");
+
+  // Boot events happen within the first 71 minutes, micros() has not wrapped
+  uint32_t bootCount = std::min<uint32_t>(bootClaimed.load(), TRACE_BOOT_SIZE);
+  for (uint32_t i = 0; i < bootCount; i++) {
+    appendEvent(out, bootEvents[i], bootEvents[i].startUs, "boot");
+  }
+
+  // Runtime events are recent: place them relative to the 64-bit clock
+  uint64_t now = esp_timer_get_time();
+  uint32_t now32 = (uint32_t)now;
+  uint32_t total = ringClaimed.load();
+  uint32_t first = total > TRACE_RING_SIZE ? total - TRACE_RING_SIZE : 0;
+  for (uint32_t i = first; i < total; i++) {
+    const TraceEvent& event = ringEvents[i % TRACE_RING_SIZE];
+    appendEvent(out, event, now - (uint32_t)(now32 - event.startUs), "runtime");
+  }
+  paused.store(false);
+
+  append(out, "\n]}\n");
+  out.buffer[out.length] = '\0';
+  write(out.buffer);
+}
+
+#else
+
+void traceSpan(TraceId id, uint32_t startUs) {}
+void traceInstant(TraceId id) {}
+void traceBootComplete() {}
+
+void writeTraceJson(void (*write)(const char* chunk)) {
+  write("{\"traceEvents\":[]}\n");
+}
+
+#endif // TRACE_ENABLED
@@ -0,0 +1,97 @@
+/**
+ * Trace.h - Boot and runtime tracing for CeilingLamp
+ *
+ * Trace points record microsecond spans into static buffers:
+ * - Until the first LED frame is shown (boot), events go into a boot
+ *   buffer that is never overwritten; the boot timeline with time-to-light
+ *   and time-to-network is printed on Serial when boot completes.
+ * - Afterwards events go into a ring buffer holding the most recent
+ *   TRACE_RING_SIZE spans.
+ * Both are exported as Chrome trace JSON on http://<lamp>/trace (open in
+ * chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Trace points are macros; with TRACE_ENABLED 0 they compile to nothing:
+ *   TRACE_SCOPE(TRACE_NTP_SYNC);          // Span until the end of the scope
+ *   TRACE_START(t0); ... TRACE_SPAN(TRACE_LED_INIT, t0);
+ *   TRACE_INSTANT(TRACE_NETWORK_READY);   // Point in time
+ * Recording is lock-free and may be called from any task.
+ *
+ * Author: icebear74
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+#define TRACE_BOOT_SIZE 64     // Boot events (kept until reboot)
+#define TRACE_RING_SIZE 512    // Runtime events (12 bytes each)
+
+enum TraceId {
+  // Boot
+  TRACE_SETUP = 0,
+  TRACE_SERIAL,
+  TRACE_SETTINGS_LOAD,
+  TRACE_LED_INIT,
+  TRACE_WIFI_INIT,
+  TRACE_WIFI_CONNECT,
+  TRACE_WIFI_SCAN,
+  TRACE_WIFI_ROAM,
+  TRACE_WIFI_WAIT,
+  TRACE_NTP_SYNC,
+  TRACE_ARDUINO_OTA_SETUP,
+  TRACE_WEB_SERVER_SETUP,
+  TRACE_FLEET_OTA_SETUP,
+  TRACE_PIXEL_STREAM_SETUP,
+  TRACE_GROUP_SYNC_SETUP,
+  TRACE_MQTT_SETUP,
+  TRACE_NETWORK_READY,
+  TRACE_FIRST_LIGHT,
+  // Runtime
+  TRACE_LED_SHOW,
+  TRACE_HTTP_REQUEST,
+  TRACE_UPDATE_CHECK,
+  TRACE_OTA_FINISH,
+  TRACE_FLEET_VERIFY,
+  TRACE_WIFI_DISCONNECT,
+  TRACE_SETTINGS_FLUSH,
+  TRACE_ID_COUNT
+};
+
+// Function declarations
+void traceSpan(TraceId id, uint32_t startUs);
+void traceInstant(TraceId id);
+void traceBootComplete();
+void writeTraceJson(void (*write)(const char* chunk));
+
+#if TRACE_ENABLED
+
+// Records a span from construction to the end of the enclosing scope
+class TraceScope {
+ public:
+  explicit TraceScope(TraceId id) : id(id), startUs(micros()) {}
+  ~TraceScope() { traceSpan(id, startUs); }
+
+ private:
+  TraceId id;
+  uint32_t startUs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(id) TraceScope TRACE_CONCAT(traceScope, __LINE__)(id)
+#define TRACE_START(var) uint32_t var = micros()
+#define TRACE_SPAN(id, var) traceSpan(id, var)
+#define TRACE_INSTANT(id) traceInstant(id)
+
+#else
+
+#define TRACE_SCOPE(id) ((void)0)
+#define TRACE_START(var) ((void)0)
+#define TRACE_SPAN(id, var) ((void)0)
+#define TRACE_INSTANT(id) ((void)0)
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_H
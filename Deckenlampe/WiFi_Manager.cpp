@@ -9,39 +9,46 @@
  */
 
 #include "WiFi_Manager.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Stall.h"
+#include "Trace.h"
 #include "Version.h"
 #include <algorithm>
 
-// WiFi connection timeout configuration
-const unsigned long WIFI_CONNECTION_TIMEOUT_MS = 20000;  // 20 seconds for connection
-const unsigned long WIFI_SCAN_TIMEOUT_MS = 10000;        // 10 seconds for scan
-
-// Delay constants
-const unsigned int INITIAL_DELAY_MS = 10;
-const unsigned int CONNECTION_CHECK_DELAY_MS = 500;
+#if NTP_ENABLED
+#include <NTPClient.h>
+#include <WiFiUdp.h>
+#endif
 
+#if WPS_ENABLED
 // Global WPS configuration
 static esp_wps_config_t config;
+#endif
 
+#if NTP_ENABLED
 // NTP Client
 static WiFiUDP ntpUdp;
 static NTPClient ntpClient(ntpUdp, DEFAULT_NTP_SERVER_PRIMARY, 0, 60 * 60 * 24 * 1000UL);
+#endif
 
 // Global time converter instance (Berlin timezone by default)
 GeneralTimeConverter timeConverter(DEFAULT_TIMEZONE);
 
+#if WPS_ENABLED
 /**
  * Initialize WPS (WiFi Protected Setup) configuration
  * Sets up device information and WPS type for pairing
  */
 void wpsInitConfig() {
-  config.wps_type = ESP_WPS_MODE;
+  config.wps_type = WPS_MODE;
   strcpy(config.factory_info.manufacturer, ESP_MANUFACTURER);
   strcpy(config.factory_info.model_number, ESP_MODEL_NUMBER);
   strcpy(config.factory_info.model_name, ESP_MODEL_NAME);
   strcpy(config.factory_info.device_name, ESP_DEVICE_NAME);
   strcpy(config.pin, "00000000");
 }
+#endif
 
 /**
  * Generate unique hostname by appending last 4 digits of WiFi MAC address
@@ -50,56 +57,65 @@ void wpsInitConfig() {
  * @param baseName Base hostname (e.g., "CeilingLamp")
  * @return Unique hostname with MAC suffix (e.g., "CeilingLamp_A1B2")
  */
-String generateUniqueHostname(const char* baseName) {
+HostnameString generateUniqueHostname(const char* baseName) {
   uint8_t mac[6];
   WiFi.macAddress(mac);
-  char macSuffix[5];
-  sprintf(macSuffix, "%02X%02X", mac[4], mac[5]);
-  return String(baseName) + "_" + String(macSuffix);
+  HostnameString hostname;
+  hostname.appendf("%s_%02X%02X", baseName, mac[4], mac[5]);
+  return hostname;
 }
 
+#if WPS_ENABLED
 /**
  * Convert WPS PIN byte array to string
  * 
  * @param a Byte array containing the 8-digit WPS PIN
  * @return String representation of the WPS PIN
  */
-String wpspin2string(uint8_t a[]) {
-  char wps_pin[9];
-  for (int i = 0; i < 8; i++) {
-    wps_pin[i] = a[i];
+WpsPinString wpspin2string(uint8_t a[]) {
+  return WpsPinString().append(reinterpret_cast<const char*>(a), 8);
+}
+#endif
+
+/**
+ * Get the SSID of the station configuration (saved, or received by WPS)
+ * Read from the driver instead of WiFi.SSID(), which returns a heap String
+ */
+static SsidString stationSsid() {
+  SsidString ssid;
+  wifi_config_t staConfig;
+  if (esp_wifi_get_config(WIFI_IF_STA, &staConfig) == ESP_OK) {
+    const char* raw = reinterpret_cast<const char*>(staConfig.sta.ssid);
+    ssid.append(raw, strnlen(raw, sizeof(staConfig.sta.ssid)));
   }
-  wps_pin[8] = '\0';
-  return (String)wps_pin;
+  return ssid;
 }
 
 /**
- * WiFi event handler
- * Handles various WiFi and WPS events including connection, disconnection,
- * and WPS pairing status
- * 
- * @param event The WiFi event type
- * @param info Additional event information
+ * Handle one WiFi or WPS event (connection, disconnection, WPS pairing status)
  */
-void WiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
+static void dispatchWiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
   switch (event) {
     case ARDUINO_EVENT_WIFI_STA_START:
-      Serial.println("Station Mode Started");
+      LOG_I(WIFI, "Station Mode Started");
       break;
 
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
-      Serial.println("Connected to: " + String(WiFi.SSID()));
-      Serial.print("Got IP: ");
-      Serial.println(WiFi.localIP());
+      TRACE_INSTANT(TRACE_NETWORK_READY);
+      LOG_I(WIFI, "Connected to: %s", stationSsid().c_str());
+      LOG_I(WIFI, "Got IP: %s", ipString(WiFi.localIP()).c_str());
       break;
 
     case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
-      Serial.println("Disconnected from station, attempting reconnection");
+      LOG_I(WIFI, "Disconnected from station, attempting reconnection");
+      metricsInc(METRIC_WIFI_RECONNECTS);
+      TRACE_INSTANT(TRACE_WIFI_DISCONNECT);
       WiFi.reconnect();
       break;
 
+#if WPS_ENABLED
     case ARDUINO_EVENT_WPS_ER_SUCCESS:
-      Serial.println("WPS Successful, stopping WPS and connecting to: " + String(WiFi.SSID()));
+      LOG_I(WIFI, "WPS Successful, stopping WPS and connecting to: %s", stationSsid().c_str());
       esp_wifi_wps_disable();
       delay(INITIAL_DELAY_MS);
       
@@ -116,38 +132,57 @@ void WiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
         }
         
         if (WiFi.status() == WL_CONNECTED) {
-          Serial.println("WPS connection established!");
-          Serial.println("WiFi credentials saved to NVS for future use");
-          syncTimeWithNTP();
+          LOG_I(WIFI, "WPS connection established!");
+          LOG_I(WIFI, "WiFi credentials saved to NVS for future use");
+          if constexpr (FEATURE_NTP) {
+            syncTimeWithNTP();
+          }
         } else {
-          Serial.println("WPS pairing succeeded but connection failed");
+          LOG_W(WIFI, "WPS pairing succeeded but connection failed");
         }
       }
       break;
 
     case ARDUINO_EVENT_WPS_ER_FAILED:
-      Serial.println("WPS Failed, retrying");
+      LOG_W(WIFI, "WPS Failed, retrying");
       esp_wifi_wps_disable();
       esp_wifi_wps_enable(&config);
       esp_wifi_wps_start(0);
       break;
 
     case ARDUINO_EVENT_WPS_ER_TIMEOUT:
-      Serial.println("WPS Timed out, retrying");
+      LOG_W(WIFI, "WPS Timed out, retrying");
       esp_wifi_wps_disable();
       esp_wifi_wps_enable(&config);
       esp_wifi_wps_start(0);
       break;
 
     case ARDUINO_EVENT_WPS_ER_PIN:
-      Serial.println("WPS_PIN = " + wpspin2string(info.wps_er_pin.pin_code));
+      LOG_I(WIFI, "WPS_PIN = %s", wpspin2string(info.wps_er_pin.pin_code).c_str());
       break;
+#endif
 
     default:
       break;
   }
 }
 
+/**
+ * WiFi event handler
+ * Runs in the Arduino event task; each event is timed by the stall monitor.
+ * 
+ * @param event The WiFi event type
+ * @param info Additional event information
+ */
+void WiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
+  stallIterationBegin(STALL_WATCH_WIFI_EVENT);
+  {
+    STALL_SCOPE(event == ARDUINO_EVENT_WPS_ER_SUCCESS ? STALL_SUB_WPS : STALL_SUB_WIFI);
+    dispatchWiFiEvent(event, info);
+  }
+  stallIterationEnd(STALL_WATCH_WIFI_EVENT);
+}
+
 /**
  * Connect to the best available AP
  * Scans for saved networks and connects to the one with the strongest signal
@@ -156,114 +191,128 @@ void WiFiEvent(WiFiEvent_t event, arduino_event_info_t info) {
  * @return true if connected successfully, false otherwise
  */
 bool connectToBestAP() {
-  Serial.println("Attempting to connect with saved credentials...");
+  LOG_I(WIFI, "Attempting to connect with saved credentials...");
   
+  TRACE_START(t0);
   WiFi.mode(WIFI_STA);
   
   // First, try to connect with saved credentials (no parameters)
-  // This will use credentials stored in NVS from previous WPS or manual config
-  WiFi.begin();
+  // This will use credentials stored in NVS from previous WPS or manual config,
+  // unless a network is set in Config.h
+  if (WIFI_SSID[0] != '\0') {
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  } else {
+    WiFi.begin();
+  }
   
-  Serial.print("Connecting");
+  LOG_I(WIFI, "Connecting...");
   int retries = 40;  // 40 * 500ms = 20 seconds
   while (WiFi.status() != WL_CONNECTED && retries > 0) {
-    Serial.print(".");
     delay(CONNECTION_CHECK_DELAY_MS);
     retries--;
   }
-  Serial.println();
+  TRACE_SPAN(TRACE_WIFI_CONNECT, t0);
   
   if (WiFi.status() == WL_CONNECTED) {
+    TRACE_INSTANT(TRACE_NETWORK_READY);
     // Successfully connected with saved credentials
-    String connectedSSID = WiFi.SSID();
-    Serial.printf("Connected to saved network: %s\n", connectedSSID.c_str());
+    SsidString connectedSSID = stationSsid();
+    LOG_I(WIFI, "Connected to saved network: %s", connectedSSID.c_str());
     
     // Now scan to see if there's a better AP with the same SSID
-    Serial.println("Scanning for potentially better access points...");
+    LOG_I(WIFI, "Scanning for potentially better access points...");
+    TRACE_START(t1);
     WiFi.scanNetworks(true);  // Async scan
     delay(3000);  // Wait for scan to complete
     int n = WiFi.scanComplete();
+    TRACE_SPAN(TRACE_WIFI_SCAN, t1);
     
     if (n > 0) {
-      Serial.printf("Found %d networks\n", n);
+      LOG_I(WIFI, "Found %d networks", n);
       
-      // Find all APs matching the connected SSID
-      std::vector<WiFiAP> matchingAPs;
+      // Find all APs matching the connected SSID (scratch for this scan only)
+      ArenaScope scope(scratchArena);
+      WiFiAP* matchingAPs = scratchArena.allocateArray<WiFiAP>(n);
+      size_t matchCount = 0;
       int32_t currentRSSI = WiFi.RSSI();
+      if (matchingAPs == nullptr) {
+        LOG_W(WIFI, "Too many networks for the scan scratch buffer");
+      }
       
-      for (int i = 0; i < n; ++i) {
-        if (WiFi.SSID(i) == connectedSSID) {
-          WiFiAP ap;
-          ap.ssid = WiFi.SSID(i);
-          ap.bssid = WiFi.BSSIDstr(i);
-          ap.rssi = WiFi.RSSI(i);
-          ap.channel = WiFi.channel(i);
-          matchingAPs.push_back(ap);
+      for (int i = 0; i < n && matchingAPs != nullptr; ++i) {
+        const wifi_ap_record_t* record = static_cast<const wifi_ap_record_t*>(WiFi.getScanInfoByIndex(i));
+        if (record != nullptr && connectedSSID == reinterpret_cast<const char*>(record->ssid)) {
+          WiFiAP& ap = matchingAPs[matchCount++];
+          strlcpy(ap.ssid, reinterpret_cast<const char*>(record->ssid), sizeof(ap.ssid));
+          memcpy(ap.bssid, record->bssid, sizeof(ap.bssid));
+          ap.rssi = record->rssi;
+          ap.channel = record->primary;
         }
       }
       
-      if (matchingAPs.size() > 1) {
+      if (matchCount > 1) {
         // Sort by signal strength
-        std::sort(matchingAPs.begin(), matchingAPs.end(), 
+        std::sort(matchingAPs, matchingAPs + matchCount, 
           [](const WiFiAP& a, const WiFiAP& b) { 
             return a.rssi > b.rssi; 
           });
         
-        Serial.printf("Found %d access points for '%s':\n", matchingAPs.size(), connectedSSID.c_str());
-        for (const auto& ap : matchingAPs) {
-          Serial.printf("  %s (%d dBm, Channel %d)%s\n", 
-                        ap.bssid.c_str(), ap.rssi, ap.channel,
-                        (ap.rssi == currentRSSI) ? " [CURRENT]" : "");
+        LOG_I(WIFI, "Found %u access points for '%s':", matchCount, connectedSSID.c_str());
+        for (size_t i = 0; i < matchCount; i++) {
+          const WiFiAP& ap = matchingAPs[i];
+          LOG_I(WIFI, "  %s (%d dBm, Channel %d)%s", 
+                      macString(ap.bssid).c_str(), ap.rssi, ap.channel,
+                      (ap.rssi == currentRSSI) ? " [CURRENT]" : "");
         }
         
         // Check if we're already on the best AP
         if (matchingAPs[0].rssi > currentRSSI + 10) {  // 10 dBm better
-          Serial.printf("Found better AP with %d dBm stronger signal, reconnecting...\n", 
-                       matchingAPs[0].rssi - currentRSSI);
-          
-          // Parse BSSID string to byte array
-          uint8_t bssid_arr[6];
-          sscanf(matchingAPs[0].bssid.c_str(), "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", 
-                 &bssid_arr[0], &bssid_arr[1], &bssid_arr[2], 
-                 &bssid_arr[3], &bssid_arr[4], &bssid_arr[5]);
+          LOG_I(WIFI, "Found better AP with %d dBm stronger signal, reconnecting...", 
+                      matchingAPs[0].rssi - currentRSSI);
           
           // Reconnect to better AP (credentials already stored, just need BSSID)
+          wifi_config_t staConfig;
+          esp_wifi_get_config(WIFI_IF_STA, &staConfig);
+          const char* rawPassword = reinterpret_cast<const char*>(staConfig.sta.password);
+          FixedString<65> password;
+          password.append(rawPassword, strnlen(rawPassword, sizeof(staConfig.sta.password)));
+          
+          TRACE_SCOPE(TRACE_WIFI_ROAM);
           WiFi.disconnect();
           delay(100);
-          WiFi.begin(connectedSSID.c_str(), WiFi.psk().c_str(), matchingAPs[0].channel, bssid_arr);
+          WiFi.begin(connectedSSID.c_str(), password.c_str(), matchingAPs[0].channel, matchingAPs[0].bssid);
           
           retries = 40;
           while (WiFi.status() != WL_CONNECTED && retries > 0) {
-            Serial.print(".");
             delay(CONNECTION_CHECK_DELAY_MS);
             retries--;
           }
-          Serial.println();
           
           if (WiFi.status() == WL_CONNECTED) {
-            Serial.printf("Reconnected to better AP: %s (%d dBm)\n", 
-                         matchingAPs[0].bssid.c_str(), matchingAPs[0].rssi);
+            LOG_I(WIFI, "Reconnected to better AP: %s (%d dBm)", 
+                        macString(matchingAPs[0].bssid).c_str(), matchingAPs[0].rssi);
           }
         } else {
-          Serial.println("Already connected to the best available AP");
+          LOG_I(WIFI, "Already connected to the best available AP");
         }
       }
       
       WiFi.scanDelete();  // Clean up scan results
     }
     
-    Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Gateway: %s\n", WiFi.gatewayIP().toString().c_str());
-    Serial.printf("DNS: %s\n", WiFi.dnsIP(0).toString().c_str());
+    LOG_I(WIFI, "IP Address: %s", ipString(WiFi.localIP()).c_str());
+    LOG_I(WIFI, "Gateway: %s", ipString(WiFi.gatewayIP()).c_str());
+    LOG_I(WIFI, "DNS: %s", ipString(WiFi.dnsIP(0)).c_str());
     return true;
     
   } else {
     // Could not connect with saved credentials
-    Serial.println("No saved credentials or connection failed");
+    LOG_W(WIFI, "No saved credentials or connection failed");
     return false;
   }
 }
 
+#if NTP_ENABLED
 /**
  * Synchronize time with NTP servers
  * Uses fallback chain: PTB -> de.pool.ntp.org -> Gateway -> Google NTP
@@ -271,52 +320,54 @@ bool connectToBestAP() {
  * @return true if time sync successful, false otherwise
  */
 bool syncTimeWithNTP() {
-  Serial.println("\n--- NTP Time Synchronization ---");
+  TRACE_SCOPE(TRACE_NTP_SYNC);
+  STALL_SCOPE(STALL_SUB_NTP);
+  LOG_I(WIFI, "--- NTP Time Synchronization ---");
   
   // Check DNS resolution for primary NTP server
   IPAddress ntpServerIP;
-  Serial.printf("Checking DNS resolution for '%s'...\n", DEFAULT_NTP_SERVER_PRIMARY);
+  LOG_I(WIFI, "Checking DNS resolution for '%s'...", DEFAULT_NTP_SERVER_PRIMARY);
   if (WiFi.hostByName(DEFAULT_NTP_SERVER_PRIMARY, ntpServerIP)) {
-    Serial.printf("  > DNS resolution SUCCESSFUL. IP: %s\n", ntpServerIP.toString().c_str());
+    LOG_I(WIFI, "  > DNS resolution SUCCESSFUL. IP: %s", ipString(ntpServerIP).c_str());
   } else {
-    Serial.println("  > DNS resolution FAILED!");
+    LOG_W(WIFI, "  > DNS resolution FAILED!");
   }
   
   ntpClient.begin();
   
   // Attempt 1: Primary NTP server (PTB Germany)
-  Serial.printf("NTP Attempt 1: %s\n", DEFAULT_NTP_SERVER_PRIMARY);
+  LOG_I(WIFI, "NTP Attempt 1: %s", DEFAULT_NTP_SERVER_PRIMARY);
   ntpClient.setPoolServerName(DEFAULT_NTP_SERVER_PRIMARY);
   if (!ntpClient.forceUpdate()) {
-    Serial.println("  > Attempt 1 failed.");
+    LOG_W(WIFI, "  > Attempt 1 failed.");
     
     // Attempt 2: Secondary NTP server (de.pool.ntp.org)
-    Serial.printf("NTP Attempt 2: %s\n", DEFAULT_NTP_SERVER_SECONDARY);
+    LOG_I(WIFI, "NTP Attempt 2: %s", DEFAULT_NTP_SERVER_SECONDARY);
     ntpClient.setPoolServerName(DEFAULT_NTP_SERVER_SECONDARY);
     if (!ntpClient.forceUpdate()) {
-      Serial.println("  > Attempt 2 failed.");
+      LOG_W(WIFI, "  > Attempt 2 failed.");
       
       // Attempt 3: Use Gateway as NTP server
-      String gatewayIpStr = WiFi.gatewayIP().toString();
-      Serial.printf("NTP Attempt 3 (Gateway): %s\n", gatewayIpStr.c_str());
+      IpString gatewayIpStr = ipString(WiFi.gatewayIP());
+      LOG_I(WIFI, "NTP Attempt 3 (Gateway): %s", gatewayIpStr.c_str());
       ntpClient.setPoolServerName(gatewayIpStr.c_str());
       if (!ntpClient.forceUpdate()) {
-        Serial.println("  > Attempt 3 failed.");
+        LOG_W(WIFI, "  > Attempt 3 failed.");
         
         // Attempt 4: Fallback to Google Public NTP IP
-        Serial.printf("NTP Attempt 4 (Fallback IP): %s\n", DEFAULT_NTP_SERVER_TERTIARY_IP);
+        LOG_I(WIFI, "NTP Attempt 4 (Fallback IP): %s", DEFAULT_NTP_SERVER_TERTIARY_IP);
         ntpClient.setPoolServerName(DEFAULT_NTP_SERVER_TERTIARY_IP);
         
         // Keep trying until success
         int retries = 5;
         while (!ntpClient.forceUpdate() && retries > 0) {
-          Serial.println("  > Attempt 4 failed. Retrying...");
+          LOG_W(WIFI, "  > Attempt 4 failed. Retrying...");
           delay(2000);
           retries--;
         }
         
         if (retries == 0) {
-          Serial.println("NTP synchronization failed after all attempts!");
+          LOG_E(WIFI, "NTP synchronization failed after all attempts!");
           return false;
         }
       }
@@ -325,10 +376,15 @@ bool syncTimeWithNTP() {
   
   // Set system time
   time_t utc_time = ntpClient.getEpochTime();
+  time_t previous = time(nullptr);
+  if (previous > 1600000000) {  // Clock was set before, report how far it drifted
+    metricsSet(METRIC_NTP_OFFSET, (int32_t)(utc_time - previous));
+  }
+  metricsInc(METRIC_NTP_SYNCS);
   timeval tv = { utc_time, 0 };
   settimeofday(&tv, nullptr);
   
-  Serial.println("Time successfully synchronized! System time is UTC.");
+  LOG_I(WIFI, "Time successfully synchronized! System time is UTC.");
   
   // Display current time in both UTC and local time
   time_t now;
@@ -336,56 +392,60 @@ bool syncTimeWithNTP() {
   
   struct tm timeinfo_utc;
   gmtime_r(&now, &timeinfo_utc);
-  Serial.printf("UTC Time: %04d-%02d-%02d %02d:%02d:%02d\n",
-                timeinfo_utc.tm_year + 1900, timeinfo_utc.tm_mon + 1, timeinfo_utc.tm_mday,
-                timeinfo_utc.tm_hour, timeinfo_utc.tm_min, timeinfo_utc.tm_sec);
+  LOG_I(WIFI, "UTC Time: %04d-%02d-%02d %02d:%02d:%02d",
+              timeinfo_utc.tm_year + 1900, timeinfo_utc.tm_mon + 1, timeinfo_utc.tm_mday,
+              timeinfo_utc.tm_hour, timeinfo_utc.tm_min, timeinfo_utc.tm_sec);
   
   // Convert to local time using GeneralTimeConverter
   time_t local_time = timeConverter.toLocal(now);
   struct tm timeinfo_local;
   gmtime_r(&local_time, &timeinfo_local);
-  Serial.printf("Local Time (Berlin): %04d-%02d-%02d %02d:%02d:%02d %s\n",
-                timeinfo_local.tm_year + 1900, timeinfo_local.tm_mon + 1, timeinfo_local.tm_mday,
-                timeinfo_local.tm_hour, timeinfo_local.tm_min, timeinfo_local.tm_sec,
-                timeConverter.isDST(now) ? "(DST)" : "(Standard)");
+  LOG_I(WIFI, "Local Time (Berlin): %04d-%02d-%02d %02d:%02d:%02d %s",
+              timeinfo_local.tm_year + 1900, timeinfo_local.tm_mon + 1, timeinfo_local.tm_mday,
+              timeinfo_local.tm_hour, timeinfo_local.tm_min, timeinfo_local.tm_sec,
+              timeConverter.isDST(now) ? "(DST)" : "(Standard)");
   
-  Serial.println("--------------------------------\n");
+  LOG_I(WIFI, "--------------------------------");
   
   return true;
 }
+#endif
 
 /**
  * Initialize WiFi connection
  * 
  * First tries to connect to saved WiFi with best AP selection.
- * If no saved credentials or connection fails, initiates WPS pairing mode.
+ * If no saved credentials or connection fails, initiates WPS pairing mode
+ * (without WPS, the driver keeps retrying the configured network).
  */
 void initWiFi() {
-  Serial.println();
-  Serial.println("WiFi Connector Initializing");
-  Serial.printf("Firmware Version: %s\n", DECKENLAMPE_VERSION);
+  LOG_I(WIFI, "WiFi Connector Initializing");
+  LOG_I(WIFI, "Firmware Version: %s", DECKENLAMPE_VERSION);
   
   // Generate unique hostname with MAC address suffix
-  String hostname = generateUniqueHostname(ESP_DEVICE_NAME);
+  HostnameString hostname = generateUniqueHostname(ESP_DEVICE_NAME);
   WiFi.setHostname(hostname.c_str());
-  Serial.println("Hostname: " + hostname);
+  LOG_I(WIFI, "Hostname: %s", hostname.c_str());
   
   // Try to connect to best AP with saved credentials
   bool connected = connectToBestAP();
   
   if (!connected) {
+    WiFi.onEvent(WiFiEvent);
+#if WPS_ENABLED
     // Connection failed or no saved credentials, start WPS
-    Serial.println();
-    Serial.println("Starting WPS pairing mode...");
-    Serial.println("Please press the WPS button on your router");
+    LOG_I(WIFI, "Starting WPS pairing mode...");
+    LOG_I(WIFI, "Please press the WPS button on your router");
 
-    WiFi.onEvent(WiFiEvent);
     WiFi.mode(WIFI_MODE_STA);
 
     wpsInitConfig();
     esp_wifi_wps_enable(&config);
     esp_wifi_wps_start(0);
-  } else {
+#else
+    LOG_W(WIFI, "Built without WPS: set WIFI_SSID in Config.h if no network is stored");
+#endif
+  } else if constexpr (FEATURE_NTP) {
     // WiFi connected, now sync time
     syncTimeWithNTP();
   }
@@ -0,0 +1,143 @@
+// Host tool: run the lamp's audio feature extraction on a WAV file
+// (see Deckenlampe/Audio_DSP.h). Compiles the firmware's Audio_DSP.cpp
+// unchanged, so levels, beats and timing match what the lamp computes.
+//
+// Build: g++ -O2 -IDeckenlampe audio-replay.cpp Deckenlampe/Audio_DSP.cpp -o audio-replay
+// Usage: ./audio-replay <file.wav> [--csv]
+//
+// The WAV file must be 16-bit PCM at 16 kHz or a multiple of it (48 kHz
+// is averaged down); stereo is mixed to mono. Without --csv a bar view
+// of the bands and the beats is printed; the summary shows the DSP cost
+// per block on this machine.
+
+#include "Audio_DSP.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static uint32_t read32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+/**
+ * Load a 16-bit PCM WAV file as mono samples at AUDIO_SAMPLE_RATE
+ */
+static bool loadWav(const char* path, std::vector<int16_t>& samples) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0) {
+    fprintf(stderr, "%s is not a WAV file\n", path);
+    return false;
+  }
+  uint16_t channels = 0;
+  uint16_t bits = 0;
+  uint32_t rate = 0;
+  size_t pos = 12;
+  while (pos + 8 <= data.size()) {
+    uint32_t size = read32(&data[pos + 4]);
+    const uint8_t* body = &data[pos + 8];
+    if (memcmp(&data[pos], "fmt ", 4) == 0 && size >= 16) {
+      channels = read16(body + 2);
+      rate = read32(body + 4);
+      bits = read16(body + 14);
+      if (read16(body) != 1 || bits != 16) {
+        fprintf(stderr, "Only 16-bit PCM is supported\n");
+        return false;
+      }
+    } else if (memcmp(&data[pos], "data", 4) == 0 && channels > 0) {
+      if (rate % AUDIO_SAMPLE_RATE != 0) {
+        fprintf(stderr, "Sample rate %u is not a multiple of %u\n", rate, AUDIO_SAMPLE_RATE);
+        return false;
+      }
+      uint32_t decimation = rate / AUDIO_SAMPLE_RATE;
+      size_t frames = (size < data.size() - pos - 8 ? size : data.size() - pos - 8) / (2 * channels);
+      for (size_t f = 0; f + decimation <= frames; f += decimation) {
+        int32_t sum = 0;
+        for (uint32_t d = 0; d < decimation; d++) {
+          for (uint16_t c = 0; c < channels; c++) {
+            sum += (int16_t)read16(body + ((f + d) * channels + c) * 2);
+          }
+        }
+        samples.push_back(sum / (int32_t)(decimation * channels));
+      }
+      return true;
+    }
+    pos += 8 + size + (size & 1);
+  }
+  fprintf(stderr, "No audio data in %s\n", path);
+  return false;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <file.wav> [--csv]\n", argv[0]);
+    return 1;
+  }
+  bool csv = argc > 2 && strcmp(argv[2], "--csv") == 0;
+  std::vector<int16_t> samples;
+  if (!loadWav(argv[1], samples)) {
+    return 1;
+  }
+
+  setupAudioDsp();
+  AudioFeatures features = {};
+  double totalUs = 0;
+  double maxUs = 0;
+  if (csv) {
+    printf("time_ms,loudness,onset,beat");
+    for (int b = 0; b < AUDIO_BANDS; b++) {
+      printf(",band%d", b);
+    }
+    printf("\n");
+  }
+
+  for (size_t offset = 0; offset + AUDIO_HOP_SIZE <= samples.size(); offset += AUDIO_HOP_SIZE) {
+    uint32_t captureUs = (uint32_t)((uint64_t)(offset + AUDIO_HOP_SIZE) * 1000000 / AUDIO_SAMPLE_RATE);
+    auto t0 = std::chrono::steady_clock::now();
+    audioDspProcess(&samples[offset], captureUs, features);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    totalUs += us;
+    maxUs = us > maxUs ? us : maxUs;
+
+    if (csv) {
+      printf("%u,%u,%u,%d", captureUs / 1000, features.loudness, features.onset, features.beat);
+      for (int b = 0; b < AUDIO_BANDS; b++) {
+        printf(",%u", features.bands[b]);
+      }
+      printf("\n");
+    } else {
+      static const char levels[] = " .:-=+*#%@";
+      char bars[AUDIO_BANDS + 1];
+      for (int b = 0; b < AUDIO_BANDS; b++) {
+        bars[b] = levels[features.bands[b] * 9 / 255];
+      }
+      bars[AUDIO_BANDS] = 0;
+      printf("%7.3f s  [%s]  loud %3u  onset %3u %s\n", captureUs / 1e6, bars, features.loudness,
+             features.onset, features.beat ? "BEAT" : "");
+    }
+  }
+
+  double seconds = (double)samples.size() / AUDIO_SAMPLE_RATE;
+  fprintf(stderr, "%u blocks, %.1f s, %u beats (%.0f BPM)\n", features.block, seconds, features.beats,
+          seconds > 0 ? features.beats * 60 / seconds : 0);
+  fprintf(stderr, "DSP cost on this host: %.1f us/block average, %.1f us max (block = %.1f ms)\n",
+          features.block ? totalUs / features.block : 0, maxUs, AUDIO_HOP_SIZE * 1000.0 / AUDIO_SAMPLE_RATE);
+  return 0;
+}
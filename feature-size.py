@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+# Build the firmware in several feature profiles (see Deckenlampe/Config.h)
+# and compare flash and RAM use, optionally also boot time on a lamp.
+#
+# Sizes of all profiles:
+#   ./feature-size.py
+# Only some profiles, another board:
+#   ./feature-size.py full headless --fqbn esp32:esp32:esp32s3
+# Boot time too (flashes every profile in turn, reads the boot timeline
+# from the serial port; needs pyserial):
+#   ./feature-size.py --port /dev/ttyACM0
+# Profile names and switches, one profile per line (read by the host build,
+# which compiles, links and boots every profile against the fakes):
+#   ./feature-size.py --list
+#
+# Each profile is built with arduino-cli into build/profile-<name>; the
+# switches are passed as -D flags, Config.h itself is not changed.
+# Deltas are relative to the first profile built.
+
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+SKETCH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "Deckenlampe")
+DEFAULT_FQBN = "esp32:esp32:XIAO_ESP32S3"
+BAUD_RATE = 115200
+BOOT_TIMEOUT = 90
+
+PROFILES = [
+    ("full", {}),
+    ("no-arduino-ota", {"ARDUINO_OTA_ENABLED": 0}),
+    ("http-ota-only", {"ARDUINO_OTA_ENABLED": 0, "WEB_OTA_ENABLED": 0}),
+    ("headless", {"ARDUINO_OTA_ENABLED": 0, "WEB_SERVER_ENABLED": 0, "NTP_ENABLED": 0, "WPS_ENABLED": 0}),
+    ("minimal", {"ARDUINO_OTA_ENABLED": 0, "WEB_SERVER_ENABLED": 0, "NTP_ENABLED": 0, "WPS_ENABLED": 0,
+                 "HTTP_UPDATE_ENABLED": 0, "TRACE_ENABLED": 0, "HEAP_CHECK_ENABLED": 0}),
+]
+
+# Boot timeline spans reported with --port (names from Trace.cpp)
+BOOT_SPANS = ["setup", "wifi_init", "ntp_sync", "arduino_ota_setup", "web_server_setup"]
+
+
+def build_path(name):
+    return os.path.join(os.path.dirname(SKETCH), "build", "profile-" + name)
+
+
+def compile_profile(name, flags, fqbn):
+    defines = " ".join("-D%s=%d" % (key, value) for key, value in sorted(flags.items()))
+    command = ["arduino-cli", "compile", "--fqbn", fqbn, "--format", "json",
+               "--build-path", build_path(name),
+               "--build-property", "compiler.cpp.extra_flags=" + defines,
+               "--build-property", "compiler.c.extra_flags=" + defines,
+               SKETCH]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    try:
+        output = json.loads(result.stdout)
+    except ValueError:
+        output = {}
+    if result.returncode != 0 or not output.get("success", True):
+        sys.stderr.write(result.stderr or output.get("compiler_err", ""))
+        print("Build of profile %s failed" % name)
+        sys.exit(1)
+
+    # Newer arduino-cli versions nest the sizes in builder_result
+    sections = output.get("builder_result", output).get("executable_sections_size") or []
+    sizes = {section["name"]: section["size"] for section in sections}
+    return sizes.get("text", 0), sizes.get("data", 0)
+
+
+def measure_boot(name, fqbn, port):
+    import serial
+
+    subprocess.run(["arduino-cli", "upload", "--fqbn", fqbn, "--port", port,
+                    "--input-dir", build_path(name), SKETCH], check=True,
+                   stdout=subprocess.DEVNULL)
+    spans = {}
+    light = None
+    deadline = time.time() + BOOT_TIMEOUT
+    connection = None
+    while time.time() < deadline and light is None:
+        if connection is None:
+            try:
+                connection = serial.Serial(port, BAUD_RATE, timeout=1)  # USB CDC re-enumerates after reset
+            except serial.SerialException:
+                time.sleep(0.2)
+                continue
+        try:
+            line = connection.readline().decode("utf-8", "replace")
+        except serial.SerialException:
+            connection = None
+            continue
+        match = re.search(r"TRACE\s+([\d.]+)\s+([\d.]+) ms\s+(\w+)\s*$", line)
+        if match and match.group(3) in BOOT_SPANS:
+            spans[match.group(3)] = float(match.group(2))
+        match = re.search(r"Time to light: (\d+) ms", line)
+        if match:
+            light = int(match.group(1))
+    if connection is not None:
+        connection.close()
+    if light is None:
+        print("  %s: no boot timeline within %d s (TRACE_ENABLED 0?)" % (name, BOOT_TIMEOUT))
+    return light, spans
+
+
+def delta(value, base):
+    return "%+d" % (value - base) if base is not None else ""
+
+
+def main():
+    names = []
+    fqbn = DEFAULT_FQBN
+    port = None
+    argv = sys.argv[1:]
+    if argv == ["--list"]:
+        for name, flags in PROFILES:
+            print(" ".join([name] + ["%s=%d" % (key, value) for key, value in sorted(flags.items())]))
+        return
+    while argv:
+        arg = argv.pop(0)
+        if arg == "--fqbn" and argv:
+            fqbn = argv.pop(0)
+        elif arg == "--port" and argv:
+            port = argv.pop(0)
+        else:
+            names.append(arg)
+    known = [name for name, _ in PROFILES]
+    if any(name not in known for name in names):
+        print("Usage: %s [profile ...] [--fqbn FQBN] [--port PORT] | --list" % sys.argv[0])
+        print("Profiles: %s" % ", ".join(known))
+        sys.exit(1)
+    profiles = [(name, flags) for name, flags in PROFILES if not names or name in names]
+
+    results = []
+    for name, flags in profiles:
+        print("Building %s ..." % name)
+        flash, ram = compile_profile(name, flags, fqbn)
+        boot = measure_boot(name, fqbn, port) if port else (None, {})
+        results.append((name, flash, ram, boot))
+    base = results[0]
+
+    print()
+    print("%-16s %10s %9s %9s %8s" % ("profile", "flash", "delta", "RAM", "delta"))
+    for name, flash, ram, _ in results:
+        print("%-16s %10d %9s %9d %8s" % (name, flash, delta(flash, base[1] if name != base[0] else None),
+                                         ram, delta(ram, base[2] if name != base[0] else None)))
+
+    if port:
+        print()
+        print("%-16s %14s %8s  %s" % ("profile", "time to light", "delta", "spans (ms)"))
+        base_light = base[3][0]
+        for name, _, _, (light, spans) in results:
+            if light is None:
+                print("%-16s %14s" % (name, "-"))
+                continue
+            print("%-16s %11d ms %8s  %s" % (
+                name, light, delta(light, base_light if name != base[0] and base_light is not None else None),
+                " ".join("%s=%.1f" % (span, spans[span]) for span in BOOT_SPANS if span in spans)))
+        print("Time to light includes the WiFi connection; compare several runs before reading small deltas.")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+# Fleet OTA host tool (protocol: see Deckenlampe/Fleet_OTA.h)
+#
+# Send a firmware image to all lamps on the network:
+#   ./fleet-ota.py send build/Deckenlampe.ino.signed.bin --iface 192.168.1.10
+# Receive a session sent by a lamp (POST /fleet-ota) without flashing:
+#   ./fleet-ota.py receive --iface 192.168.1.10
+# Test the protocol on loopback with simulated receivers and packet loss:
+#   ./fleet-ota.py simulate build/Deckenlampe.ino.bin --receivers 20 --loss 0.05
+#
+# The firmware version announced defaults to DECKENLAMPE_VERSION from
+# Deckenlampe/Version.h; lamps only accept images newer than their own.
+
+import argparse
+import hashlib
+import os
+import random
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+
+GROUP = "239.255.76.77"
+PORT = 5578
+MAGIC = 0x4F464C44
+VERSION = 1
+BLOCK_SIZE = 1024
+
+ANNOUNCE, DATA, END, NACK, DONE = 1, 2, 3, 4, 5
+
+HEADER = struct.Struct("<IBBHI")
+ANNOUNCE_BODY = struct.Struct("<IHH32s32s72s")
+SIGNATURE_MAGIC = b"DLS1"
+SIGNATURE_TRAILER_LEN = 80
+
+ANNOUNCE_INTERVAL = 0.25
+NACK_WINDOW = 0.5
+NACK_JITTER = 0.2
+IDLE_ROUNDS = 2
+MAX_ROUNDS = 20
+
+
+def header(kind, session):
+    return HEADER.pack(MAGIC, VERSION, kind, 0, session)
+
+
+def parse_header(packet):
+    if len(packet) < HEADER.size:
+        return None
+    magic, version, kind, _, session = HEADER.unpack_from(packet)
+    if magic != MAGIC or version != VERSION:
+        return None
+    return kind, session
+
+
+def firmware_version():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "Deckenlampe", "Version.h")
+    with open(path) as f:
+        match = re.search(r'#define\s+DECKENLAMPE_VERSION\s+"([^"]+)"', f.read())
+    return match.group(1) if match else "0.0.0"
+
+
+def load_image(path):
+    """Split a (signed) image into firmware and signature"""
+    with open(path, "rb") as f:
+        data = f.read()
+    trailer = data[-SIGNATURE_TRAILER_LEN:]
+    if len(data) > SIGNATURE_TRAILER_LEN and trailer[:4] == SIGNATURE_MAGIC:
+        sig_len = trailer[4] | (trailer[5] << 8)
+        return data[:-SIGNATURE_TRAILER_LEN], trailer[8:8 + sig_len]
+    return data, b""
+
+
+def multicast_socket(iface, bind_port=0):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", bind_port))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(iface))
+    return sock
+
+
+class Sender:
+    def __init__(self, image, signature, version, iface, rate_kbps, announce_s):
+        self.image = image
+        self.blocks = (len(image) + BLOCK_SIZE - 1) // BLOCK_SIZE
+        self.session = random.getrandbits(32)
+        self.interval = BLOCK_SIZE / (rate_kbps * 1024.0)
+        self.announce_s = announce_s
+        self.sock = multicast_socket(iface)
+        self.sock.settimeout(0.01)
+        self.announce_body = ANNOUNCE_BODY.pack(
+            len(image), BLOCK_SIZE, len(signature), hashlib.sha256(image).digest(),
+            version.encode()[:32], signature.ljust(72, b"\0"))
+        self.pending = set(range(self.blocks))
+        self.lock = threading.Lock()
+        self.nacks = 0
+        self.receivers = {}
+        self.sent = 0
+        self.rounds = 0
+
+    def send(self, packet):
+        self.sock.sendto(packet, (GROUP, PORT))
+
+    def announce(self, kind):
+        self.send(header(kind, self.session) + self.announce_body)
+
+    def poll(self, until):
+        """Handle NACK/DONE replies until the given time"""
+        while time.time() < until:
+            try:
+                packet, addr = self.sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            parsed = parse_header(packet)
+            if parsed is None or parsed[1] != self.session:
+                continue
+            if parsed[0] == NACK:
+                bitmap = packet[HEADER.size + 4:]
+                for block in range(min(self.blocks, len(bitmap) * 8)):
+                    if bitmap[block >> 3] & (1 << (block & 7)):
+                        self.pending.add(block)
+                self.nacks += 1
+            elif parsed[0] == DONE and addr not in self.receivers:
+                self.receivers[addr] = bool(packet[HEADER.size])
+
+    def run(self):
+        start = time.time()
+        print("Fleet OTA: session %08X, %d bytes in %d blocks" % (self.session, len(self.image), self.blocks))
+
+        end = time.time() + self.announce_s
+        while time.time() < end:
+            self.announce(ANNOUNCE)
+            self.poll(min(end, time.time() + ANNOUNCE_INTERVAL))
+
+        idle = 0
+        while self.rounds < MAX_ROUNDS:
+            self.rounds += 1
+            blocks, self.pending = sorted(self.pending), set()
+            next_send = time.time()
+            for block in blocks:
+                chunk = self.image[block * BLOCK_SIZE:(block + 1) * BLOCK_SIZE]
+                self.send(header(DATA, self.session) + struct.pack("<I", block) + chunk)
+                self.sent += 1
+                next_send += self.interval
+                delay = next_send - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+
+            while True:
+                nacks = self.nacks
+                self.announce(END)
+                self.poll(time.time() + NACK_WINDOW)
+                if self.nacks != nacks or self.pending:
+                    idle = 0
+                    break
+                idle += 1
+                if idle >= IDLE_ROUNDS:
+                    break
+            if idle >= IDLE_ROUNDS:
+                break
+
+        duration = time.time() - start
+        ok = sum(1 for v in self.receivers.values() if v)
+        print("Fleet OTA: %d rounds, %d blocks sent (%d resent), airtime %.2fx image, %d NACKs"
+              % (self.rounds, self.sent, self.sent - self.blocks, float(self.sent) / self.blocks, self.nacks))
+        print("Fleet OTA: %d receivers verified, %d failed, %.1f s"
+              % (ok, len(self.receivers) - ok, duration))
+        return ok, len(self.receivers) - ok
+
+
+class Receiver(threading.Thread):
+    """Host-side receiver: keeps the image in RAM instead of flash"""
+
+    def __init__(self, iface, loss=0.0, name="receiver"):
+        threading.Thread.__init__(self, daemon=True)
+        self.sock = multicast_socket(iface, PORT)
+        mreq = socket.inet_aton(GROUP) + socket.inet_aton(iface)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+        self.sock.settimeout(0.05)
+        self.loss = loss
+        self.name = name
+        self.session = None
+        self.done = None
+        self.received = 0
+        self.duplicates = 0
+        self.nacks_sent = 0
+        self.stop = False
+
+    def start_session(self, session, body):
+        size, block_size, _, sha, version, _ = ANNOUNCE_BODY.unpack_from(body)
+        self.session = session
+        self.size = size
+        self.sha = sha
+        self.blocks = (size + block_size - 1) // block_size
+        self.image = bytearray(size)
+        self.missing = set(range(self.blocks))
+        self.version = version.rstrip(b"\0").decode()
+
+    def bitmap(self):
+        data = bytearray((self.blocks + 7) // 8)
+        for block in self.missing:
+            data[block >> 3] |= 1 << (block & 7)
+        return bytes(data)
+
+    def run(self):
+        nack_due = None
+        sender = None
+        while not self.stop:
+            if nack_due and time.time() >= nack_due:
+                nack_due = None
+                if self.done is not None:
+                    self.sock.sendto(header(DONE, self.session) + bytes([self.done]), sender)
+                else:
+                    self.sock.sendto(header(NACK, self.session) + struct.pack("<I", len(self.missing))
+                                     + self.bitmap(), sender)
+                    self.nacks_sent += 1
+            try:
+                packet, addr = self.sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            if random.random() < self.loss:
+                continue
+            parsed = parse_header(packet)
+            if parsed is None:
+                continue
+            kind, session = parsed
+            body = packet[HEADER.size:]
+
+            if kind in (ANNOUNCE, END):
+                if self.session is None:
+                    self.start_session(session, body)
+                    sender = addr
+                if session == self.session and kind == END and nack_due is None:
+                    nack_due = time.time() + random.uniform(0, NACK_JITTER)
+            elif kind == DATA and session == self.session:
+                block = struct.unpack_from("<I", body)[0]
+                if block not in self.missing:
+                    self.duplicates += 1
+                    continue
+                chunk = body[4:]
+                self.image[block * BLOCK_SIZE:block * BLOCK_SIZE + len(chunk)] = chunk
+                self.missing.discard(block)
+                self.received += 1
+                if not self.missing:
+                    self.done = hashlib.sha256(self.image).digest() == self.sha
+                    self.sock.sendto(header(DONE, self.session) + bytes([self.done]), sender)
+
+
+def cmd_send(args):
+    image, signature = load_image(args.image)
+    sender = Sender(image, signature, args.version or firmware_version(), args.iface, args.rate, args.announce)
+    sender.run()
+
+
+def cmd_receive(args):
+    receiver = Receiver(args.iface)
+    receiver.start()
+    print("Waiting for a fleet OTA session on %s:%d ..." % (GROUP, PORT))
+    while receiver.done is None:
+        time.sleep(0.1)
+    print("Image %s (%s, %d bytes): %s, %d blocks received, %d duplicates, %d NACKs"
+          % (receiver.version, "%08X" % receiver.session, receiver.size,
+             "hash OK" if receiver.done else "HASH MISMATCH",
+             receiver.received, receiver.duplicates, receiver.nacks_sent))
+    time.sleep(NACK_WINDOW * 3)  # Answer the sender's final END rounds
+    receiver.stop = True
+
+
+def cmd_simulate(args):
+    image, signature = load_image(args.image)
+    receivers = [Receiver("127.0.0.1", args.loss, "receiver%d" % i) for i in range(args.receivers)]
+    for receiver in receivers:
+        receiver.start()
+
+    sender = Sender(image, signature, args.version or firmware_version(), "127.0.0.1", args.rate, args.announce)
+    # The sender counts DONE per address; all simulated receivers share one
+    sender.run()
+    for receiver in receivers:
+        receiver.stop = True
+
+    complete = sum(1 for r in receivers if r.done)
+    print("Simulation: %d/%d receivers complete with matching hash (loss %.0f%%)"
+          % (complete, len(receivers), args.loss * 100))
+    print("Single download: %d bytes, multicast sent %d bytes for %d receivers (%d bytes per receiver)"
+          % (len(image), sender.sent * BLOCK_SIZE, len(receivers), sender.sent * BLOCK_SIZE // max(1, len(receivers))))
+    sys.exit(0 if complete == len(receivers) else 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fleet OTA sender / receiver")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    send = sub.add_parser("send", help="multicast a firmware image to all lamps")
+    send.add_argument("image")
+    send.add_argument("--iface", default="0.0.0.0", help="local IP of the interface to send on")
+    send.add_argument("--version", help="announced firmware version (default: Version.h)")
+    send.add_argument("--rate", type=float, default=100, help="send rate in KB/s (default: 100)")
+    send.add_argument("--announce", type=float, default=5, help="announce phase in s (default: 5)")
+    send.set_defaults(func=cmd_send)
+
+    receive = sub.add_parser("receive", help="receive one session (no flashing)")
+    receive.add_argument("--iface", default="0.0.0.0", help="local IP of the interface to listen on")
+    receive.set_defaults(func=cmd_receive)
+
+    simulate = sub.add_parser("simulate", help="sender and simulated receivers on loopback")
+    simulate.add_argument("image")
+    simulate.add_argument("--receivers", type=int, default=20)
+    simulate.add_argument("--loss", type=float, default=0.05, help="packet loss per receiver (default: 0.05)")
+    simulate.add_argument("--version", help="announced firmware version (default: Version.h)")
+    simulate.add_argument("--rate", type=float, default=2000, help="send rate in KB/s (default: 2000)")
+    simulate.add_argument("--announce", type=float, default=0.5, help="announce phase in s (default: 0.5)")
+    simulate.set_defaults(func=cmd_simulate)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
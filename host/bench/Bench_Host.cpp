@@ -0,0 +1,339 @@
+/**
+ * Bench_Host.cpp - Host benchmarks of the firmware hot paths
+ *
+ * The cases of the on-device suite (Deckenlampe/Bench.cpp) on the host,
+ * plus the OTA chunk path end to end: upload chunks through gzip/delta
+ * decoding, verification and the writer task into the fake flash. Host
+ * numbers are no substitute for /bench on the lamp, but they catch
+ * algorithmic regressions on every build: bench-check.py compares them
+ * against baselines.json.
+ *
+ * Author: icebear74
+ */
+
+#include <Fake_Host.h>
+#include "Audio_DSP.h"
+#include "Config.h"
+#include "Effect_VM.h"
+#include "Effects.h"
+#include "Metrics.h"
+#include "OTA_Decode.h"
+#include "OTA_Update.h"
+#include "Sequence.h"
+#include "Settings.h"
+#include "Stall.h"
+#include "WiFi_Manager.h"
+#include <FastLED.h>
+#include <benchmark/benchmark.h>
+#include <mbedtls/sha256.h>
+#include <zlib.h>
+
+#define BENCH_LEDS        40                 // Strip length the pixel benchmarks render
+#define OTA_IMAGE_SIZE    (512 * 1024)       // Typical compressed-friendly app image
+
+static CRGB frameA[BENCH_LEDS];
+static CRGB frameB[BENCH_LEDS];
+static CRGB frameOut[BENCH_LEDS];
+static uint8_t otaChunk[1024];
+static std::vector<uint8_t> otaImage;
+static std::vector<uint8_t> otaImageGzip;
+static std::vector<uint8_t> sequenceFile;
+
+static void BM_TimeToLocal(benchmark::State& state) {
+  time_t t = 1704067200;  // 2024-01-01, steps cover both DST switches
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(timeConverter.toLocal(t));
+    t += 31537;
+  }
+}
+BENCHMARK(BM_TimeToLocal);
+
+static void BM_TimeIsDst(benchmark::State& state) {
+  time_t t = 1704067200;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(timeConverter.isDST(t));
+    t += 31537;
+  }
+}
+BENCHMARK(BM_TimeIsDst);
+
+static void renderLoop(benchmark::State& state, uint8_t type) {
+  EffectParams params = DEFAULT_EFFECT;
+  params.type = type;
+  uint32_t frame = 0;
+  for (auto _ : state) {
+    renderEffect(params, frame, frameOut, BENCH_LEDS);
+    frame += 7;
+    benchmark::DoNotOptimize(frameOut);
+  }
+}
+
+static void BM_RenderCrossfade(benchmark::State& state) {
+  renderLoop(state, EFFECT_CROSSFADE);
+}
+BENCHMARK(BM_RenderCrossfade);
+
+static void BM_RenderToggle(benchmark::State& state) {
+  renderLoop(state, EFFECT_TOGGLE);
+}
+BENCHMARK(BM_RenderToggle);
+
+// Same per-pixel blend as Frame_Interpolator, one frame per iteration
+static void BM_FrameBlend(benchmark::State& state) {
+  uint8_t frac = 0;
+  for (auto _ : state) {
+    frac += 37;
+    for (int p = 0; p < BENCH_LEDS; p++) {
+      frameOut[p] = blend(frameA[p], frameB[p], frac);
+    }
+    benchmark::DoNotOptimize(frameOut);
+  }
+}
+BENCHMARK(BM_FrameBlend);
+
+// Whole requests through the registered handlers
+static void httpLoop(benchmark::State& state, const char* uri) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    FakeHttpResponse response = server.request(HTTP_GET, uri);
+    if (response.code != 200) {
+      state.SkipWithError("request failed");
+      return;
+    }
+    bytes += response.body.size();
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+static void BM_HttpMetrics(benchmark::State& state) {
+  httpLoop(state, "/metrics");
+}
+BENCHMARK(BM_HttpMetrics);
+
+static void BM_HttpStalls(benchmark::State& state) {
+  httpLoop(state, "/stalls");
+}
+BENCHMARK(BM_HttpStalls);
+
+// Hash of one 4 KB upload chunk, as OTA_Verify does while streaming
+static void BM_OtaSha256_4k(benchmark::State& state) {
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  for (auto _ : state) {
+    for (int k = 0; k < 4; k++) {
+      mbedtls_sha256_update(&ctx, otaChunk, sizeof(otaChunk));
+    }
+  }
+  uint8_t hash[32];
+  mbedtls_sha256_finish(&ctx, hash);
+  mbedtls_sha256_free(&ctx);
+  state.SetBytesProcessed(state.iterations() * 4 * sizeof(otaChunk));
+}
+BENCHMARK(BM_OtaSha256_4k);
+
+/**
+ * One complete upload per iteration, in web server sized chunks: format
+ * detection, inflate, SHA-256, writer task, flash erase/write and the
+ * final image check
+ */
+static void otaUploadLoop(benchmark::State& state, const std::vector<uint8_t>& upload) {
+  uint32_t chunks = 0;
+  for (auto _ : state) {
+    bool ok = otaDecodeBegin();
+    for (size_t pos = 0; ok && pos < upload.size(); pos += HTTP_UPLOAD_BUFLEN) {
+      ok = otaDecodeWrite(upload.data() + pos, std::min((size_t)HTTP_UPLOAD_BUFLEN, upload.size() - pos));
+      chunks++;
+    }
+    if (!ok || !otaDecodeEnd()) {
+      state.SkipWithError("upload rejected");
+      return;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * otaImage.size());
+  state.SetItemsProcessed(chunks);   // Chunks per second
+}
+
+static void BM_OtaChunksPlain(benchmark::State& state) {
+  otaUploadLoop(state, otaImage);
+}
+BENCHMARK(BM_OtaChunksPlain)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_OtaChunksGzip(benchmark::State& state) {
+  otaUploadLoop(state, otaImageGzip);
+}
+BENCHMARK(BM_OtaChunksGzip)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Sequential frame decoding of the stored sequence (delta records from flash)
+static void BM_SequenceDecode(benchmark::State& state) {
+  uint32_t frame = 0;
+  for (auto _ : state) {
+    decodeSequenceFrame(frame++, frameOut, BENCH_LEDS);
+    benchmark::DoNotOptimize(frameOut);
+  }
+}
+BENCHMARK(BM_SequenceDecode);
+
+// Reads 4 KB of the memory-mapped sequence file per iteration
+static void BM_SequenceRead4k(benchmark::State& state) {
+  size_t size;
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(sequenceData(&size));
+  size_t count = size / 4;
+  size_t offset = 0;
+  uint32_t acc = 0;
+  for (auto _ : state) {
+    for (size_t w = 0; w < 1024; w++) {
+      acc += words[offset];
+      offset = offset + 1 < count ? offset + 1 : 0;
+    }
+    benchmark::DoNotOptimize(acc);
+  }
+}
+BENCHMARK(BM_SequenceRead4k);
+
+// Moving rainbow, a typical uploaded effect (make-effect.py syntax in comments)
+static const uint32_t vmRainbow[] = {
+  VM_I(VM_OP_LDI,  8, 0, 16384),   // li   r8, 0.25          ; turns per second
+  VM_R(VM_OP_MUL,  9, 4, 8),       // mul  r9, sec, r8
+  VM_R(VM_OP_ADD,  9, 9, 3),       // add  r9, r9, pos
+  VM_R(VM_OP_SIN, 10, 9, 0),       // sin  r10, r9
+  VM_R(VM_OP_COS, 11, 9, 0),       // cos  r11, r9
+  VM_I(VM_OP_ADDI, 9, 9, 21845),   // addi r9, r9, 0.3333
+  VM_R(VM_OP_SIN, 12, 9, 0),       // sin  r12, r9
+  VM_I(VM_OP_LUI, 13, 0, 1),       // lui  r13, 1
+  VM_R(VM_OP_ADD, 10, 10, 13),     // add  r10, r10, r13
+  VM_I(VM_OP_SHR,  5, 10, 1),      // shr  red, r10, 1
+  VM_R(VM_OP_ADD, 11, 11, 13),     // add  r11, r11, r13
+  VM_I(VM_OP_SHR,  6, 11, 1),      // shr  green, r11, 1
+  VM_R(VM_OP_ADD, 12, 12, 13),     // add  r12, r12, r13
+  VM_I(VM_OP_SHR,  7, 12, 1),      // shr  blue, r12, 1
+  VM_R(VM_OP_TRI, 14, 9, 0),       // tri  r14, r9
+  VM_R(VM_OP_MUL,  7, 7, 14),      // mul  blue, blue, r14
+  VM_R(VM_OP_HALT, 0, 0, 0),       // halt
+};
+static VmProgram vmProgram;
+
+// Endless loop: every frame runs into VM_FRAME_STEP_BUDGET
+static const uint32_t vmSpin[] = {
+  VM_I(VM_OP_JMP, 0, 0, 0),        // loop: jmp loop
+};
+static VmProgram vmSpinProgram;
+
+// One frame of the rainbow program over the benchmark strip; fps against
+// the 100 FPS render rate
+static void BM_VmFrame(benchmark::State& state) {
+  uint32_t elapsedMs = 0;
+  uint32_t steps = 0;
+  for (auto _ : state) {
+    vmRunFrame(vmProgram, elapsedMs, frameOut, BENCH_LEDS, &steps);
+    elapsedMs += 10;
+    benchmark::DoNotOptimize(frameOut);
+  }
+  state.counters["steps"] = steps;
+  state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_VmFrame);
+
+// Worst case: a frame that uses the whole step budget
+static void BM_VmFrameBudget(benchmark::State& state) {
+  uint32_t steps = 0;
+  for (auto _ : state) {
+    vmRunFrame(vmSpinProgram, 0, frameOut, BENCH_LEDS, &steps);
+    benchmark::DoNotOptimize(frameOut);
+  }
+  state.counters["steps"] = steps;
+  state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_VmFrameBudget);
+
+// Feature extraction of one block of a synthetic signal (bass + tone)
+static int16_t audioBlock[AUDIO_HOP_SIZE];
+static AudioFeatures audioFeatures;
+
+static void BM_AudioDsp(benchmark::State& state) {
+  uint32_t captureUs = 0;
+  for (auto _ : state) {
+    audioDspProcess(audioBlock, captureUs, audioFeatures);
+    captureUs += 16000;
+  }
+  benchmark::DoNotOptimize(audioFeatures);
+}
+BENCHMARK(BM_AudioDsp);
+
+// ---------------------------------------------------------------------------
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data) {
+  z_stream stream = {};
+  deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+  std::vector<uint8_t> out(deflateBound(&stream, data.size()));
+  stream.next_in = const_cast<uint8_t*>(data.data());
+  stream.avail_in = data.size();
+  stream.next_out = out.data();
+  stream.avail_out = out.size();
+  deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+static bool loadFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Bring up the modules the benchmarks use (no network services)
+ */
+static bool setupFirmware() {
+  setupSettings();
+  setupSequence();
+  setupStallMonitor();
+  setupWebServer();
+  setupAudioDsp();
+
+  for (int p = 0; p < BENCH_LEDS; p++) {
+    frameA[p] = CRGB(p * 5, 255 - p * 5, 128);
+    frameB[p] = CRGB(255 - p * 3, p * 3, 64);
+  }
+  for (size_t i = 0; i < sizeof(otaChunk); i++) {
+    otaChunk[i] = i * 131;
+  }
+  for (int i = 0; i < AUDIO_HOP_SIZE; i++) {
+    audioBlock[i] = sin16(i * 256) / 4 + sin16(i * 4096) / 8;
+  }
+  const char* error;
+  if (!vmVerify(vmProgram, vmRainbow, sizeof(vmRainbow) / sizeof(vmRainbow[0]), &error) ||
+      !vmVerify(vmSpinProgram, vmSpin, sizeof(vmSpin) / sizeof(vmSpin[0]), &error)) {
+    fprintf(stderr, "Effect program rejected: %s\n", error);
+    return false;
+  }
+
+  otaImage = fakeAppImage(OTA_IMAGE_SIZE, 1);
+  otaImageGzip = gzip(otaImage);
+
+  if (!loadFile(TEST_SEQUENCE_PATH, sequenceFile) || !sequenceUploadBegin() ||
+      !sequenceUploadWrite(sequenceFile.data(), sequenceFile.size()) || !sequenceUploadEnd()) {
+    fprintf(stderr, "Cannot store %s\n", TEST_SEQUENCE_PATH);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv) || !setupFirmware()) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Runs the host benchmarks and compares them against stored baselines
+# (host counterpart of http://<lamp>/bench, see Deckenlampe/Bench.h).
+#
+# Usage: bench-check.py <deckenlampe_bench> <baselines.json> [--record] [--tolerance PERCENT]
+#
+# Every benchmark runs REPEATS times and the median run counts. A result
+# slower than its baseline by more than the tolerance is a regression: the
+# script exits with 1, so ctest / CI fail. The default tolerance is wider
+# than BENCH_TOLERANCE_PERCENT on the lamp (20%): shared build machines
+# vary by 20-30% between runs, the host check is meant to catch
+# algorithmic slowdowns. --record stores the results as the new
+# baselines; record on the machine that runs the check.
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+REPEATS = 10
+MIN_TIME = 0.1          # Seconds per repetition
+DEFAULT_TOLERANCE = 50
+
+UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def run_benchmarks(binary):
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as out:
+        path = out.name
+    try:
+        subprocess.run([binary, "--benchmark_repetitions=%d" % REPEATS, "--benchmark_min_time=%s" % MIN_TIME,
+                        "--benchmark_out=%s" % path, "--benchmark_out_format=json"],
+                       check=True, stdout=subprocess.DEVNULL)
+        with open(path) as f:
+            report = json.load(f)
+    finally:
+        os.unlink(path)
+
+    runs = {}
+    for bench in report["benchmarks"]:
+        if bench.get("run_type") != "iteration" or bench.get("error_occurred"):
+            continue
+        ns = bench["real_time"] * UNIT_NS[bench.get("time_unit", "ns")]
+        runs.setdefault(bench["run_name"], []).append(ns)
+    return {name: sorted(times)[len(times) // 2] for name, times in runs.items()}
+
+
+def main():
+    args = []
+    record = False
+    tolerance = DEFAULT_TOLERANCE
+    argv = sys.argv[1:]
+    while argv:
+        arg = argv.pop(0)
+        if arg == "--record":
+            record = True
+        elif arg == "--tolerance" and argv:
+            tolerance = int(argv.pop(0))
+        else:
+            args.append(arg)
+    if len(args) != 2:
+        print("Usage: %s <deckenlampe_bench> <baselines.json> [--record] [--tolerance PERCENT]" % sys.argv[0])
+        sys.exit(2)
+    binary, baseline_path = args
+
+    results = run_benchmarks(binary)
+    baselines = {}
+    if os.path.exists(baseline_path):
+        with open(baseline_path) as f:
+            baselines = json.load(f).get("benchmarks", {})
+
+    print("%-28s %12s %12s %8s" % ("benchmark", "ns/op", "baseline", "change"))
+    regressions = 0
+    for name, ns in sorted(results.items()):
+        base = baselines.get(name)
+        if base is None or record:
+            print("%-28s %12.1f %12s %8s" % (name, ns, "-", "-"))
+            continue
+        change = (ns - base) * 100.0 / base
+        marker = ""
+        if ns * 100 > base * (100 + tolerance):
+            regressions += 1
+            marker = "  REGRESSION"
+        print("%-28s %12.1f %12.1f %+7.1f%%%s" % (name, ns, base, change, marker))
+    missing = sorted(set(baselines) - set(results))
+    for name in missing:
+        print("%-28s %12s   (failed or removed)" % (name, "-"))
+
+    if record:
+        with open(baseline_path, "w") as f:
+            json.dump({"comment": "ns per operation, median of %d runs; record with bench-check.py --record"
+                                  % REPEATS,
+                       "benchmarks": {name: round(ns, 1) for name, ns in sorted(results.items())}},
+                      f, indent=2)
+            f.write("\n")
+        print("\nResult: baselines recorded in %s" % baseline_path)
+    elif regressions or missing:
+        print("\nResult: REGRESSION (%d, tolerance %d%%)" % (regressions + len(missing), tolerance))
+        sys.exit(1)
+    else:
+        print("\nResult: OK (tolerance %d%%)" % tolerance)
+
+
+if __name__ == "__main__":
+    main()
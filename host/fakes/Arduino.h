@@ -0,0 +1,281 @@
+/**
+ * Arduino.h - Host fake of the Arduino-ESP32 core
+ *
+ * Just enough of the Arduino API for the firmware modules to compile and
+ * run natively (tests, benchmarks): time, Serial, String, IPAddress and
+ * the ESP object. Time comes from the host clock, or from a manual clock
+ * that tests advance explicitly (see Fake_Host.h).
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+
+// XIAO ESP32S3 pin names
+#define D0 1
+#define D1 2
+#define D2 3
+#define D3 4
+#define D8 7
+#define D9 8
+#define D10 9
+#define LED_BUILTIN 21
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define IRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+
+template <class T, class L, class H>
+static inline T constrain(T x, L low, H high) {
+  return x < (T)low ? (T)low : (x > (T)high ? (T)high : x);
+}
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// GPIO (no-ops)
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Random numbers
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// BSD string functions of newlib (glibc has them from 2.38)
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+extern "C" size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+// The wall clock is the host clock plus a per-process offset: setting it
+// (NTP code under test) or skewing it (fakeWallClockSkewUs) moves only
+// this process
+int fakeSettimeofday(const struct timeval* tv, const struct timezone* tz);
+int fakeGettimeofday(struct timeval* tv, void* tz);
+#define settimeofday fakeSettimeofday
+#define gettimeofday fakeGettimeofday
+
+/**
+ * Arduino String on top of std::string (the firmware avoids it on hot paths)
+ */
+class String {
+public:
+  String() {}
+  String(const char* s) : str(s ? s : "") {}
+  String(const std::string& s) : str(s) {}
+  String(char c) : str(1, c) {}
+  String(int v) : str(std::to_string(v)) {}
+  String(unsigned int v) : str(std::to_string(v)) {}
+  String(long v) : str(std::to_string(v)) {}
+  String(unsigned long v) : str(std::to_string(v)) {}
+  String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+  String(double v, unsigned int decimals = 2) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    str = buf;
+  }
+
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.size(); }
+  bool isEmpty() const { return str.empty(); }
+  bool reserve(unsigned int size) { str.reserve(size); return true; }
+  int toInt() const { return atoi(str.c_str()); }
+  float toFloat() const { return atof(str.c_str()); }
+  char charAt(unsigned int index) const { return index < str.size() ? str[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t pos = str.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  int indexOf(const char* s, unsigned int from = 0) const {
+    size_t pos = str.find(s, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < str.size() ? String(str.substr(from, to - from)) : String();
+  }
+  bool startsWith(const String& prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+  bool endsWith(const String& suffix) const {
+    return str.size() >= suffix.str.size() &&
+           str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+  }
+  bool equals(const String& other) const { return str == other.str; }
+  void trim() {
+    size_t start = str.find_first_not_of(" \t\r\n");
+    size_t end = str.find_last_not_of(" \t\r\n");
+    str = start == std::string::npos ? std::string() : str.substr(start, end - start + 1);
+  }
+  void toLowerCase() { for (char& c : str) c = tolower((unsigned char)c); }
+  void toUpperCase() { for (char& c : str) c = toupper((unsigned char)c); }
+
+  String& operator+=(const String& other) { str += other.str; return *this; }
+  String& operator+=(const char* s) { str += s; return *this; }
+  String& operator+=(char c) { str += c; return *this; }
+  String& concat(const String& other) { str += other.str; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a.str + b.str); }
+  friend String operator+(const String& a, const char* b) { return String(a.str + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.str); }
+  bool operator==(const String& other) const { return str == other.str; }
+  bool operator==(const char* s) const { return str == s; }
+  bool operator!=(const String& other) const { return str != other.str; }
+  bool operator!=(const char* s) const { return str != s; }
+  bool operator<(const String& other) const { return str < other.str; }
+
+private:
+  std::string str;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+  size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+  size_t write(const char* s, size_t size) { return write(reinterpret_cast<const uint8_t*>(s), size); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+  size_t println() { return write("\r\n"); }
+  template <class T>
+  size_t println(const T& v) { return print(v) + println(); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) {
+      return 0;
+    }
+    return write(reinterpret_cast<const uint8_t*>(buf), std::min((size_t)len, sizeof(buf) - 1));
+  }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  void setTimeout(unsigned long timeout) { timeoutMs = timeout; }
+  size_t readBytes(uint8_t* buffer, size_t length);
+  size_t readBytes(char* buffer, size_t length) { return readBytes(reinterpret_cast<uint8_t*>(buffer), length); }
+
+protected:
+  unsigned long timeoutMs = 1000;
+};
+
+/**
+ * Serial port: output is collected for tests (and echoed with
+ * fakeSerialEcho), input is empty
+ */
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) {}
+  void end() {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int availableForWrite() { return 4096; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress {
+public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d;
+  }
+  IPAddress(uint32_t networkOrder) : address(networkOrder) {}
+
+  bool fromString(const char* s);
+  String toString() const;
+  operator uint32_t() const { return address; }
+  uint8_t operator[](int index) const { return bytes[index]; }
+  uint8_t& operator[](int index) { return bytes[index]; }
+  bool operator==(const IPAddress& other) const { return address == other.address; }
+  bool operator!=(const IPAddress& other) const { return address != other.address; }
+
+private:
+  union {
+    uint8_t bytes[4];
+    uint32_t address;   // Network byte order, as in lwIP
+  };
+};
+
+/**
+ * ESP object (heap figures come from the host allocator counters)
+ */
+class EspClass {
+public:
+  void restart();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getHeapSize();
+  uint64_t getEfuseMac();
+  uint32_t getCpuFreqMHz();
+  uint32_t getSketchSize();
+  uint32_t getFreeSketchSpace();
+};
+
+extern EspClass ESP;
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+extern "C" uint32_t esp_random(void);
+extern "C" int64_t esp_timer_get_time(void);
+
+#endif // FAKE_ARDUINO_H
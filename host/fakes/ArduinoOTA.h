@@ -0,0 +1,46 @@
+/**
+ * ArduinoOTA.h - Host fake of the ArduinoOTA library (never receives an update)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ARDUINOOTA_H
+#define FAKE_ARDUINOOTA_H
+
+#include <Arduino.h>
+#include <Update.h>
+#include <functional>
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+#define U_FLASH 0
+
+class ArduinoOTAClass {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  ArduinoOTAClass& setPort(uint16_t port) { return *this; }
+  ArduinoOTAClass& setHostname(const char* hostname) { return *this; }
+  ArduinoOTAClass& setPassword(const char* password) { return *this; }
+  ArduinoOTAClass& setMdnsEnabled(bool enabled) { return *this; }
+  ArduinoOTAClass& setRebootOnSuccess(bool reboot) { return *this; }
+  ArduinoOTAClass& onStart(THandlerFunction fn) { return *this; }
+  ArduinoOTAClass& onEnd(THandlerFunction fn) { return *this; }
+  ArduinoOTAClass& onError(THandlerFunction_Error fn) { return *this; }
+  ArduinoOTAClass& onProgress(THandlerFunction_Progress fn) { return *this; }
+  void begin() {}
+  void handle() {}
+  int getCommand() { return U_FLASH; }
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif // FAKE_ARDUINOOTA_H
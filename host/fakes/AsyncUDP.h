@@ -0,0 +1,76 @@
+/**
+ * AsyncUDP.h - Host fake of the AsyncUDP library
+ *
+ * A host UDP socket with a receive thread per listener, so packet
+ * callbacks run concurrently with the loop like on the lamp (AsyncUDP
+ * task). Multicast listeners join the group on the interface of
+ * WiFi.localIP() and loop their own traffic back, which lets several
+ * lamps on 127.0.0.x talk to each other.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ASYNCUDP_H
+#define FAKE_ASYNCUDP_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+class AsyncUDPPacket {
+public:
+  AsyncUDPPacket(uint8_t* data, size_t length, IPAddress remoteIp, uint16_t remotePort, IPAddress localIp,
+                 uint16_t localPort, bool multicast)
+      : payload(data), payloadLength(length), remote(remoteIp), remotePortNumber(remotePort), local(localIp),
+        localPortNumber(localPort), multicast(multicast) {}
+
+  uint8_t* data() { return payload; }
+  size_t length() { return payloadLength; }
+  IPAddress remoteIP() { return remote; }
+  uint16_t remotePort() { return remotePortNumber; }
+  IPAddress localIP() { return local; }
+  uint16_t localPort() { return localPortNumber; }
+  bool isMulticast() { return multicast; }
+  bool isBroadcast() { return false; }
+
+private:
+  uint8_t* payload;
+  size_t payloadLength;
+  IPAddress remote;
+  uint16_t remotePortNumber;
+  IPAddress local;
+  uint16_t localPortNumber;
+  bool multicast;
+};
+
+typedef std::function<void(AsyncUDPPacket& packet)> AuPacketHandlerFunction;
+
+class AsyncUDP {
+public:
+  AsyncUDP() {}
+  ~AsyncUDP() { close(); }
+  AsyncUDP(const AsyncUDP&) = delete;
+  AsyncUDP& operator=(const AsyncUDP&) = delete;
+
+  bool listen(uint16_t port) { return listen(IPAddress(), port); }
+  bool listen(const IPAddress& address, uint16_t port);
+  bool listenMulticast(const IPAddress& group, uint16_t port, uint8_t ttl = 1);
+  void onPacket(AuPacketHandlerFunction callback) { handler = callback; }
+  size_t writeTo(const uint8_t* data, size_t len, const IPAddress& address, uint16_t port);
+  void close();
+  bool connected() { return socketFd >= 0; }
+
+private:
+  bool openSocket(uint16_t port, bool multicastGroup, const IPAddress& group, uint8_t ttl);
+  void receiveLoop();
+
+  int socketFd = -1;
+  uint16_t localPort = 0;
+  bool multicast = false;
+  AuPacketHandlerFunction handler;
+  std::atomic<bool> running{false};
+  std::thread receiver;
+};
+
+#endif // FAKE_ASYNCUDP_H
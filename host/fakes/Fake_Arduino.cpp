@@ -0,0 +1,413 @@
+/**
+ * Fake_Arduino.cpp - Host fake of the Arduino core, FastLED output and the
+ * small ESP-IDF system APIs (restart, random, CRC, heap, power management)
+ *
+ * Author: icebear74
+ */
+
+#include "Fake_Host.h"
+#include <FastLED.h>
+#include <esp_heap_caps.h>
+#include <esp_pm.h>
+#include <esp_rom_crc.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <zlib.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+CFastLED FastLED;
+
+// ---------------------------------------------------------------------------
+// Clock
+// ---------------------------------------------------------------------------
+
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+static std::atomic<bool> clockManual(false);
+static std::atomic<uint64_t> manualUs(0);
+static std::atomic<int64_t> realOffsetUs(0);   // Time skipped in manual mode
+
+static uint64_t realUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clockStart).count() +
+         realOffsetUs.load();
+}
+
+static uint64_t nowUs() {
+  return clockManual.load() ? manualUs.load() : realUs();
+}
+
+// Switching back to the host clock continues from the manual time, so
+// time never runs backwards
+void fakeClockManual(bool manual) {
+  if (manual && !clockManual.load()) {
+    manualUs.store(realUs());
+  } else if (!manual && clockManual.load()) {
+    realOffsetUs.fetch_add((int64_t)(manualUs.load() - realUs()));
+  }
+  clockManual.store(manual);
+}
+
+void fakeClockAdvanceUs(uint64_t us) {
+  manualUs.fetch_add(us);
+}
+
+void fakeClockAdvanceMs(uint32_t ms) {
+  fakeClockAdvanceUs((uint64_t)ms * 1000);
+}
+
+static std::mutex readHookMutex;
+static std::function<void()> readHook;
+static std::atomic<bool> readHookArmed(false);
+
+void fakeClockOnNextRead(std::function<void()> hook) {
+  std::lock_guard<std::mutex> lock(readHookMutex);
+  readHook = hook;
+  readHookArmed.store(hook != nullptr);
+}
+
+unsigned long millis() {
+  uint64_t us = nowUs();
+  if (readHookArmed.exchange(false)) {
+    std::function<void()> hook;
+    {
+      std::lock_guard<std::mutex> lock(readHookMutex);
+      hook.swap(readHook);
+    }
+    hook();
+  }
+  return (unsigned long)(uint32_t)(us / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(uint32_t)nowUs();
+}
+
+int64_t esp_timer_get_time(void) {
+  return (int64_t)nowUs();
+}
+
+void delay(unsigned long ms) {
+  if (clockManual.load()) {
+    fakeClockAdvanceMs(ms);
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (clockManual.load()) {
+    fakeClockAdvanceUs(us);
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+static std::atomic<int64_t> wallOffsetUs(0);
+
+static int64_t hostWallUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int fakeSettimeofday(const struct timeval* tv, const struct timezone* tz) {
+  if (tv != nullptr) {
+    wallOffsetUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - hostWallUs();
+  }
+  return 0;
+}
+
+int fakeGettimeofday(struct timeval* tv, void* tz) {
+  int64_t us = hostWallUs() + wallOffsetUs.load();
+  tv->tv_sec = us / 1000000;
+  tv->tv_usec = us % 1000000;
+  return 0;
+}
+
+void fakeWallClockSkewUs(int64_t skewUs) {
+  wallOffsetUs = skewUs;
+}
+
+// ---------------------------------------------------------------------------
+// GPIO, random numbers, strings
+// ---------------------------------------------------------------------------
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return LOW; }
+
+static std::mutex randomMutex;
+static std::mt19937 randomEngine(std::random_device{}());
+
+uint32_t esp_random(void) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return randomEngine();
+}
+
+long random(long howBig) {
+  return howBig <= 0 ? 0 : (long)(esp_random() % (uint32_t)howBig);
+}
+
+long random(long howSmall, long howBig) {
+  return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  randomEngine.seed(seed);
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+extern "C" size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+bool IPAddress::fromString(const char* s) {
+  unsigned a, b, c, d;
+  char tail;
+  if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+    return false;
+  }
+  bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d;
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+  return String(buf);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+  size_t count = 0;
+  unsigned long start = millis();
+  while (count < length && millis() - start < timeoutMs) {
+    int c = read();
+    if (c < 0) {
+      yield();
+      continue;
+    }
+    buffer[count++] = (uint8_t)c;
+  }
+  return count;
+}
+
+// ---------------------------------------------------------------------------
+// Serial
+// ---------------------------------------------------------------------------
+
+#define SERIAL_CAPTURE_LIMIT (1024 * 1024)
+
+static std::mutex serialMutex;
+static std::string serialOutput;
+static bool serialEcho = getenv("DECKENLAMPE_HOST_SERIAL") != nullptr;
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  std::lock_guard<std::mutex> lock(serialMutex);
+  if (serialOutput.size() + size > SERIAL_CAPTURE_LIMIT) {
+    serialOutput.erase(0, serialOutput.size() / 2);
+  }
+  serialOutput.append(reinterpret_cast<const char*>(buffer), size);
+  if (serialEcho) {
+    fwrite(buffer, 1, size, stdout);
+    fflush(stdout);
+  }
+  return size;
+}
+
+std::string fakeSerialOutput() {
+  std::lock_guard<std::mutex> lock(serialMutex);
+  return serialOutput;
+}
+
+void fakeSerialClear() {
+  std::lock_guard<std::mutex> lock(serialMutex);
+  serialOutput.clear();
+}
+
+void fakeSerialEcho(bool echo) {
+  serialEcho = echo;
+}
+
+// ---------------------------------------------------------------------------
+// System
+// ---------------------------------------------------------------------------
+
+static std::atomic<bool> restartRequested(false);
+static esp_reset_reason_t resetReason = ESP_RST_POWERON;
+static std::vector<shutdown_handler_t> shutdownHandlers;
+
+void esp_restart(void) {
+  restartRequested.store(true);
+}
+
+void EspClass::restart() {
+  esp_restart();
+}
+
+bool fakeRestartRequested() {
+  return restartRequested.load();
+}
+
+void fakeClearRestart() {
+  restartRequested.store(false);
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+  return resetReason;
+}
+
+void fakeSetResetReason(esp_reset_reason_t reason) {
+  resetReason = reason;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+  shutdownHandlers.push_back(handler);
+  return ESP_OK;
+}
+
+void fakeRunShutdownHandlers() {
+  for (shutdown_handler_t handler : shutdownHandlers) {
+    handler();
+  }
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    case ESP_ERR_IMAGE_INVALID: return "ESP_ERR_IMAGE_INVALID";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+// Heap figures of an ESP32-S3 with the firmware running (for /metrics)
+#define FAKE_HEAP_SIZE 320000
+#define FAKE_HEAP_FREE 200000
+
+uint32_t EspClass::getFreeHeap() { return FAKE_HEAP_FREE; }
+uint32_t EspClass::getMinFreeHeap() { return FAKE_HEAP_FREE; }
+uint32_t EspClass::getMaxAllocHeap() { return FAKE_HEAP_FREE / 2; }
+uint32_t EspClass::getHeapSize() { return FAKE_HEAP_SIZE; }
+uint32_t EspClass::getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+uint32_t EspClass::getSketchSize() { return 1200000; }
+uint32_t EspClass::getFreeSketchSpace() { return 0x330000; }
+
+static uint32_t cpuFrequencyMhz = 240;
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  cpuFrequencyMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuFrequencyMhz;
+}
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps) {
+  memset(info, 0, sizeof(*info));
+  info->total_free_bytes = FAKE_HEAP_FREE;
+  info->total_allocated_bytes = FAKE_HEAP_SIZE - FAKE_HEAP_FREE;
+  info->largest_free_block = FAKE_HEAP_FREE / 2;
+  info->minimum_free_bytes = FAKE_HEAP_FREE;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  return malloc(size);
+}
+
+void heap_caps_free(void* ptr) {
+  free(ptr);
+}
+
+// Power management: accepted, has no effect on the host
+struct esp_pm_lock {
+  int count;
+};
+
+esp_err_t esp_pm_configure(const void* config) {
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name, esp_pm_lock_handle_t* outHandle) {
+  *outHandle = new esp_pm_lock{ 0 };
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+  handle->count++;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+  if (handle->count == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  handle->count--;
+  return ESP_OK;
+}
+
+// ROM CRC routines (little endian variants, inverted in and out)
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len) {
+  return crc32(crc, buf, len);
+}
+
+uint16_t esp_rom_crc16_le(uint16_t crc, uint8_t const* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+// ---------------------------------------------------------------------------
+// LED output
+// ---------------------------------------------------------------------------
+
+static std::mutex showMutex;
+static uint32_t showCount = 0;
+static std::vector<uint8_t> shownFrame;
+
+void CFastLED::show() {
+  std::lock_guard<std::mutex> lock(showMutex);
+  showCount++;
+  if (leds != nullptr) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(leds);
+    shownFrame.assign(data, data + ledCount * sizeof(CRGB));
+  }
+}
+
+uint32_t fakeShowCount() {
+  std::lock_guard<std::mutex> lock(showMutex);
+  return showCount;
+}
+
+std::vector<uint8_t> fakeShownFrame() {
+  std::lock_guard<std::mutex> lock(showMutex);
+  return shownFrame;
+}
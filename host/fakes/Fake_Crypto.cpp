@@ -0,0 +1,165 @@
+/**
+ * Fake_Crypto.cpp - Host fake of mbedTLS SHA-256 / public key verify and of
+ * the ROM tinfl inflater (OpenSSL and zlib underneath)
+ *
+ * Author: icebear74
+ */
+
+// The low-level SHA256_* calls are deprecated in OpenSSL 3 but map 1:1 onto
+// the mbedTLS streaming API
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+#include <rom/miniz.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include <string.h>
+#include <zlib.h>
+
+static_assert(sizeof(SHA256_CTX) <= sizeof(mbedtls_sha256_context), "SHA256_CTX does not fit");
+static_assert(sizeof(z_stream) <= sizeof(((tinfl_decompressor*)nullptr)->stream), "z_stream does not fit");
+
+// ---------------------------------------------------------------------------
+// SHA-256
+// ---------------------------------------------------------------------------
+
+static SHA256_CTX* sha(mbedtls_sha256_context* ctx) {
+  return reinterpret_cast<SHA256_CTX*>(ctx->state);
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+  if (ctx != nullptr) {
+    memset(ctx, 0, sizeof(*ctx));
+  }
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+  return (is224 ? SHA224_Init(sha(ctx)) : SHA256_Init(sha(ctx))) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+  return SHA256_Update(sha(ctx), input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output) {
+  return SHA256_Final(output, sha(ctx)) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224) {
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  int ret = mbedtls_sha256_starts(&ctx, is224);
+  if (ret == 0) {
+    ret = mbedtls_sha256_update(&ctx, input, ilen);
+  }
+  if (ret == 0) {
+    ret = mbedtls_sha256_finish(&ctx, output);
+  }
+  mbedtls_sha256_free(&ctx);
+  return ret;
+}
+
+// ---------------------------------------------------------------------------
+// Public keys
+// ---------------------------------------------------------------------------
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+  ctx->key = nullptr;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+  if (ctx != nullptr && ctx->key != nullptr) {
+    EVP_PKEY_free(static_cast<EVP_PKEY*>(ctx->key));
+    ctx->key = nullptr;
+  }
+}
+
+// Like mbedTLS, a PEM key length includes the terminating NUL
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen) {
+  if (keylen == 0 || key[keylen - 1] != '\0') {
+    return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+  }
+  BIO* bio = BIO_new_mem_buf(key, (int)(keylen - 1));
+  EVP_PKEY* pkey = bio != nullptr ? PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr) : nullptr;
+  BIO_free(bio);
+  if (pkey == nullptr) {
+    return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+  }
+  mbedtls_pk_free(ctx);
+  ctx->key = pkey;
+  return 0;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLen,
+                      const unsigned char* sig, size_t sigLen) {
+  if (ctx->key == nullptr || md != MBEDTLS_MD_SHA256 || hashLen != 32) {
+    return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+  }
+  EVP_PKEY_CTX* verify = EVP_PKEY_CTX_new(static_cast<EVP_PKEY*>(ctx->key), nullptr);
+  bool ok = verify != nullptr && EVP_PKEY_verify_init(verify) == 1 &&
+            EVP_PKEY_CTX_set_signature_md(verify, EVP_sha256()) == 1 &&
+            EVP_PKEY_verify(verify, sig, sigLen, hash, hashLen) == 1;
+  EVP_PKEY_CTX_free(verify);
+  return ok ? 0 : MBEDTLS_ERR_RSA_VERIFY_FAILED;
+}
+
+// ---------------------------------------------------------------------------
+// tinfl (raw deflate, streaming)
+// ---------------------------------------------------------------------------
+
+static voidpf arenaAlloc(voidpf opaque, uInt items, uInt size) {
+  tinfl_decompressor* r = static_cast<tinfl_decompressor*>(opaque);
+  size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+  if (bytes > sizeof(r->arena) - r->arenaUsed) {
+    return Z_NULL;
+  }
+  void* ptr = r->arena + r->arenaUsed;
+  r->arenaUsed += bytes;
+  return ptr;
+}
+
+static void arenaFree(voidpf opaque, voidpf address) {}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* inBuf, size_t* inBufSize,
+                              mz_uint8* outBufStart, mz_uint8* outBufNext, size_t* outBufSize,
+                              const mz_uint32 flags) {
+  z_stream* stream = reinterpret_cast<z_stream*>(r->stream);
+  if (r->m_state == 0) {
+    memset(stream, 0, sizeof(*stream));
+    r->arenaUsed = 0;
+    stream->zalloc = arenaAlloc;
+    stream->zfree = arenaFree;
+    stream->opaque = r;
+    if (inflateInit2(stream, (flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15) != Z_OK) {
+      *inBufSize = 0;
+      *outBufSize = 0;
+      return TINFL_STATUS_FAILED;
+    }
+    r->m_state = 1;
+  }
+
+  stream->next_in = const_cast<mz_uint8*>(inBuf);
+  stream->avail_in = (uInt)*inBufSize;
+  stream->next_out = outBufNext;
+  stream->avail_out = (uInt)*outBufSize;
+  int ret = inflate(stream, Z_NO_FLUSH);
+  *inBufSize -= stream->avail_in;
+  *outBufSize -= stream->avail_out;
+
+  if (ret == Z_STREAM_END) {
+    return TINFL_STATUS_DONE;
+  }
+  if (ret != Z_OK && ret != Z_BUF_ERROR) {
+    return TINFL_STATUS_FAILED;
+  }
+  if (stream->avail_out == 0) {
+    return TINFL_STATUS_HAS_MORE_OUTPUT;
+  }
+  return (flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
@@ -0,0 +1,524 @@
+/**
+ * Fake_Flash.cpp - Host fake of the flash partitions, the OTA API, the app
+ * image check and the Update class
+ *
+ * Author: icebear74
+ */
+
+#include "Fake_Host.h"
+#include <Update.h>
+#include <esp_image_format.h>
+#include <esp_ota_ops.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef FAKE_PARTITIONS_CSV
+#error "FAKE_PARTITIONS_CSV must name Deckenlampe/partitions.csv"
+#endif
+
+#define FAKE_FLASH_SIZE (8 * 1024 * 1024)
+
+UpdateClass Update;
+
+static std::recursive_mutex flashMutex;
+static std::vector<uint8_t> flash;
+static std::vector<esp_partition_t> partitions;
+static uint32_t eraseCount = 0;
+static uint32_t eraseDelayUs = 0;
+static const esp_partition_t* bootPartition = nullptr;
+
+/**
+ * Parse a number of the partition table (decimal, 0x hex, K/M suffix)
+ */
+static uint32_t parseSize(const std::string& text) {
+  char* end = nullptr;
+  unsigned long value = strtoul(text.c_str(), &end, 0);
+  if (end != nullptr && (*end == 'K' || *end == 'k')) {
+    value *= 1024;
+  } else if (end != nullptr && (*end == 'M' || *end == 'm')) {
+    value *= 1024 * 1024;
+  }
+  return (uint32_t)value;
+}
+
+static int parseSubtype(const std::string& text) {
+  static const struct { const char* name; int value; } names[] = {
+    { "factory", ESP_PARTITION_SUBTYPE_APP_FACTORY }, { "ota_0", ESP_PARTITION_SUBTYPE_APP_OTA_0 },
+    { "ota_1", ESP_PARTITION_SUBTYPE_APP_OTA_1 }, { "ota", ESP_PARTITION_SUBTYPE_DATA_OTA },
+    { "nvs", ESP_PARTITION_SUBTYPE_DATA_NVS }, { "coredump", ESP_PARTITION_SUBTYPE_DATA_COREDUMP },
+    { "spiffs", ESP_PARTITION_SUBTYPE_DATA_SPIFFS },
+  };
+  for (const auto& name : names) {
+    if (text == name.name) {
+      return name.value;
+    }
+  }
+  return (int)parseSize(text);
+}
+
+static std::string trimmed(const std::string& text) {
+  size_t start = text.find_first_not_of(" \t\r");
+  size_t end = text.find_last_not_of(" \t\r");
+  return start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+}
+
+/**
+ * Load the partition table and erase the whole flash (first use)
+ */
+static void loadFlash() {
+  if (!flash.empty()) {
+    return;
+  }
+  flash.assign(FAKE_FLASH_SIZE, 0xFF);
+  FILE* file = fopen(FAKE_PARTITIONS_CSV, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot open %s\n", FAKE_PARTITIONS_CSV);
+    abort();
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    std::string text = trimmed(line);
+    if (text.empty() || text[0] == '#') {
+      continue;
+    }
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+      size_t comma = text.find(',', pos);
+      fields.push_back(trimmed(text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos)));
+      if (comma == std::string::npos) {
+        break;
+      }
+      pos = comma + 1;
+    }
+    if (fields.size() < 5) {
+      continue;
+    }
+    esp_partition_t partition = {};
+    strlcpy(partition.label, fields[0].c_str(), sizeof(partition.label));
+    partition.type = fields[1] == "app" ? ESP_PARTITION_TYPE_APP : ESP_PARTITION_TYPE_DATA;
+    partition.subtype = (esp_partition_subtype_t)parseSubtype(fields[2]);
+    partition.address = parseSize(fields[3]);
+    partition.size = parseSize(fields[4]);
+    partition.erase_size = SPI_FLASH_SEC_SIZE;
+    partitions.push_back(partition);
+  }
+  fclose(file);
+}
+
+static const esp_partition_t* findPartition(esp_partition_type_t type, int subtype, const char* label) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  loadFlash();
+  for (const esp_partition_t& partition : partitions) {
+    if ((type == ESP_PARTITION_TYPE_ANY || partition.type == type) &&
+        (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype) &&
+        (label == nullptr || strcmp(partition.label, label) == 0)) {
+      return &partition;
+    }
+  }
+  return nullptr;
+}
+
+void fakeFlashReset() {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  loadFlash();
+  std::fill(flash.begin(), flash.end(), 0xFF);
+  eraseCount = 0;
+  eraseDelayUs = 0;
+  bootPartition = nullptr;
+}
+
+uint8_t* fakeFlashData(const esp_partition_t* partition) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  loadFlash();
+  return flash.data() + partition->address;
+}
+
+uint32_t fakeFlashEraseCount() {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  return eraseCount;
+}
+
+void fakeFlashEraseDelayUs(uint32_t us) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  eraseDelayUs = us;
+}
+
+const esp_partition_t* fakeBootPartition() {
+  return bootPartition;
+}
+
+// ---------------------------------------------------------------------------
+// Partitions
+// ---------------------------------------------------------------------------
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+  return findPartition(type, subtype, label);
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t srcOffset, void* dst, size_t size) {
+  if (partition == nullptr || srcOffset > partition->size || size > partition->size - srcOffset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  memcpy(dst, flash.data() + partition->address + srcOffset, size);
+  return ESP_OK;
+}
+
+// NOR flash: programming can only clear bits
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dstOffset, const void* src, size_t size) {
+  if (partition == nullptr || dstOffset > partition->size || size > partition->size - dstOffset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  uint8_t* out = flash.data() + partition->address + dstOffset;
+  const uint8_t* in = static_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < size; i++) {
+    out[i] &= in[i];
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (partition == nullptr || offset > partition->size || size > partition->size - offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (eraseDelayUs > 0) {
+    // Flash is busy meanwhile, like the SPI flash driver
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)eraseDelayUs * (size / SPI_FLASH_SEC_SIZE)));
+  }
+  memset(flash.data() + partition->address + offset, 0xFF, size);
+  eraseCount += size / SPI_FLASH_SEC_SIZE;
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void** outPtr,
+                             esp_partition_mmap_handle_t* outHandle) {
+  if (partition == nullptr || offset > partition->size || size > partition->size - offset) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  *outPtr = flash.data() + partition->address + offset;
+  *outHandle = 1;
+  return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {}
+
+// ---------------------------------------------------------------------------
+// App images
+// ---------------------------------------------------------------------------
+
+/**
+ * Walk the segments of an app image like the bootloader does
+ *
+ * @return Image length including checksum and appended hash, 0 if invalid
+ */
+static uint32_t imageLength(const uint8_t* image, uint32_t maxLen) {
+  esp_image_header_t header;
+  if (maxLen < sizeof(header)) {
+    return 0;
+  }
+  memcpy(&header, image, sizeof(header));
+  if (header.magic != ESP_IMAGE_HEADER_MAGIC || header.segment_count == 0 ||
+      header.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+    return 0;
+  }
+  uint32_t pos = sizeof(header);
+  uint8_t checksum = 0xEF;
+  for (int s = 0; s < header.segment_count; s++) {
+    if (pos + 8 > maxLen) {
+      return 0;
+    }
+    uint32_t dataLen;
+    memcpy(&dataLen, image + pos + 4, 4);
+    pos += 8;
+    if (dataLen > maxLen - pos) {
+      return 0;
+    }
+    for (uint32_t i = 0; i < dataLen; i++) {
+      checksum ^= image[pos + i];
+    }
+    pos += dataLen;
+  }
+  pos = (pos + 16) & ~15u;   // Padding and the checksum byte end 16-byte aligned
+  if (pos > maxLen || image[pos - 1] != checksum) {
+    return 0;
+  }
+  if (header.hash_appended) {
+    pos += 32;
+  }
+  return pos <= maxLen ? pos : 0;
+}
+
+std::vector<uint8_t> fakeAppImage(size_t len, uint32_t seed) {
+  len &= ~(size_t)15;
+  std::vector<uint8_t> image(len, 0);
+  esp_image_header_t header = {};
+  header.magic = ESP_IMAGE_HEADER_MAGIC;
+  header.segment_count = 1;
+  header.chip_id = CONFIG_IDF_FIRMWARE_CHIP_ID;
+  memcpy(image.data(), &header, sizeof(header));
+
+  uint32_t dataLen = len - sizeof(header) - 8 - 16;
+  uint32_t loadAddress = 0x3C000020;
+  memcpy(image.data() + sizeof(header), &loadAddress, 4);
+  memcpy(image.data() + sizeof(header) + 4, &dataLen, 4);
+  uint8_t checksum = 0xEF;
+  uint32_t state = seed * 2654435761u + 1;
+  for (uint32_t i = 0; i < dataLen; i++) {
+    // Compressible but not trivial, like machine code
+    state = state * 1103515245u + 12345u;
+    uint8_t byte = (i % 64 < 40) ? (uint8_t)(i / 64) : (uint8_t)(state >> 24);
+    image[sizeof(header) + 8 + i] = byte;
+    checksum ^= byte;
+  }
+  image[len - 1] = checksum;
+  return image;
+}
+
+void fakeFlashInstallRunningImage(const uint8_t* image, size_t len) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  esp_partition_erase_range(running, 0, (len + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1));
+  esp_partition_write(running, 0, image, len);
+}
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t* part, esp_image_metadata_t* data) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  loadFlash();
+  if (part->offset > flash.size() || part->size > flash.size() - part->offset) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t len = imageLength(flash.data() + part->offset, part->size);
+  if (len == 0) {
+    return ESP_ERR_IMAGE_INVALID;
+  }
+  data->start_addr = part->offset;
+  memcpy(&data->image, flash.data() + part->offset, sizeof(data->image));
+  data->image_len = len;
+  return ESP_OK;
+}
+
+// ---------------------------------------------------------------------------
+// OTA
+// ---------------------------------------------------------------------------
+
+struct FakeOtaSession {
+  const esp_partition_t* partition = nullptr;
+  bool sequentialErase = false;
+  uint32_t erasedEnd = 0;
+  uint32_t written = 0;
+};
+
+static FakeOtaSession otaSession;
+static esp_ota_handle_t otaHandle = 0;
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+  return findPartition(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, nullptr);
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+  return bootPartition != nullptr ? bootPartition : esp_ota_get_running_partition();
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* startFrom) {
+  return findPartition(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, nullptr);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t imageSize, esp_ota_handle_t* outHandle) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (partition == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (partition == esp_ota_get_running_partition()) {
+    return ESP_ERR_OTA_PARTITION_CONFLICT;
+  }
+  otaSession = FakeOtaSession();
+  otaSession.partition = partition;
+  if (imageSize == OTA_WITH_SEQUENTIAL_WRITES) {
+    otaSession.sequentialErase = true;
+  } else {
+    size_t eraseSize = imageSize == OTA_SIZE_UNKNOWN ? partition->size : imageSize;
+    if (eraseSize > partition->size) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = esp_partition_erase_range(partition, 0,
+                                              (eraseSize + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1));
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  *outHandle = ++otaHandle;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (handle != otaHandle || otaSession.partition == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (otaSession.written == 0 && size > 0 && static_cast<const uint8_t*>(data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  if (otaSession.sequentialErase) {
+    while (otaSession.erasedEnd < otaSession.written + size) {
+      esp_err_t err = esp_partition_erase_range(otaSession.partition, otaSession.erasedEnd, SPI_FLASH_SEC_SIZE);
+      if (err != ESP_OK) {
+        return err;
+      }
+      otaSession.erasedEnd += SPI_FLASH_SEC_SIZE;
+    }
+  }
+  esp_err_t err = esp_partition_write(otaSession.partition, otaSession.written, data, size);
+  if (err == ESP_OK) {
+    otaSession.written += size;
+  }
+  return err;
+}
+
+// Does not erase: the caller must have erased the range (like the real one)
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void* data, size_t size, uint32_t offset) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (handle != otaHandle || otaSession.partition == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (offset == 0 && size > 0 && static_cast<const uint8_t*>(data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  esp_err_t err = esp_partition_write(otaSession.partition, offset, data, size);
+  if (err == ESP_OK && offset + size > otaSession.written) {
+    otaSession.written = offset + size;
+  }
+  return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (handle != otaHandle || otaSession.partition == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  esp_partition_pos_t pos = { otaSession.partition->address, otaSession.partition->size };
+  esp_image_metadata_t metadata;
+  otaSession.partition = nullptr;
+  return esp_image_verify(ESP_IMAGE_VERIFY, &pos, &metadata) == ESP_OK ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  if (handle != otaHandle) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  otaSession.partition = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  std::lock_guard<std::recursive_mutex> lock(flashMutex);
+  esp_partition_pos_t pos = { partition->address, partition->size };
+  esp_image_metadata_t metadata;
+  if (esp_image_verify(ESP_IMAGE_VERIFY, &pos, &metadata) != ESP_OK) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  bootPartition = partition;
+  return ESP_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Update (Arduino wrapper around the OTA API)
+// ---------------------------------------------------------------------------
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char* label) {
+  error = UPDATE_ERROR_OK;
+  progressBytes = 0;
+  imageSize = size;
+  if (esp_ota_begin(esp_ota_get_next_update_partition(nullptr), size, &handle) != ESP_OK) {
+    error = UPDATE_ERROR_SPACE;
+    return false;
+  }
+  running = true;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+  if (!running || hasError()) {
+    return 0;
+  }
+  if (esp_ota_write(handle, data, len) != ESP_OK) {
+    error = progressBytes == 0 ? UPDATE_ERROR_MAGIC_BYTE : UPDATE_ERROR_WRITE;
+    return 0;
+  }
+  progressBytes += len;
+  if (progressCallback) {
+    progressCallback(progressBytes, imageSize);
+  }
+  return len;
+}
+
+size_t UpdateClass::writeStream(Stream& data) {
+  uint8_t buffer[1024];
+  size_t total = 0;
+  int c;
+  size_t n = 0;
+  while ((c = data.read()) >= 0) {
+    buffer[n++] = (uint8_t)c;
+    if (n == sizeof(buffer)) {
+      total += write(buffer, n);
+      n = 0;
+    }
+  }
+  if (n > 0) {
+    total += write(buffer, n);
+  }
+  return total;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (!running || hasError()) {
+    return false;
+  }
+  running = false;
+  if (!evenIfRemaining && imageSize != UPDATE_SIZE_UNKNOWN && progressBytes != imageSize) {
+    error = UPDATE_ERROR_SIZE;
+    esp_ota_abort(handle);
+    return false;
+  }
+  if (esp_ota_end(handle) != ESP_OK ||
+      esp_ota_set_boot_partition(esp_ota_get_next_update_partition(nullptr)) != ESP_OK) {
+    error = UPDATE_ERROR_ACTIVATE;
+    return false;
+  }
+  return true;
+}
+
+void UpdateClass::abort() {
+  if (running) {
+    esp_ota_abort(handle);
+  }
+  running = false;
+  error = UPDATE_ERROR_ABORT;
+}
+
+const char* UpdateClass::errorString() {
+  switch (error) {
+    case UPDATE_ERROR_OK: return "No Error";
+    case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+    case UPDATE_ERROR_SIZE: return "Bad Size Given";
+    case UPDATE_ERROR_SPACE: return "Not Enough Space";
+    case UPDATE_ERROR_MAGIC_BYTE: return "Wrong Magic Byte";
+    case UPDATE_ERROR_ABORT: return "Update Aborted";
+    case UPDATE_ERROR_ACTIVATE: return "Could Not Activate The Firmware";
+    default: return "UNKNOWN";
+  }
+}
+
+void UpdateClass::printError(Print& out) {
+  out.println(errorString());
+}
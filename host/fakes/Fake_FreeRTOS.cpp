@@ -0,0 +1,229 @@
+/**
+ * Fake_FreeRTOS.cpp - Host fake of the FreeRTOS tasks, queues and semaphores
+ *
+ * Author: icebear74
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct FakeTask {
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notifyValue = 0;
+};
+
+struct FakeQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+static thread_local FakeTask* currentTask = nullptr;
+
+// Waits with portMAX_DELAY block forever, others for the given ticks (ms)
+template <class Predicate>
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks,
+                    Predicate ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+// ---------------------------------------------------------------------------
+// Tasks
+// ---------------------------------------------------------------------------
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                       UBaseType_t priority, TaskHandle_t* createdTask) {
+  FakeTask* task = new FakeTask();
+  if (createdTask != nullptr) {
+    *createdTask = task;
+  }
+  std::thread([function, parameter, task]() {
+    currentTask = task;
+    function(parameter);
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* createdTask,
+                                   BaseType_t coreId) {
+  return xTaskCreate(function, name, stackDepth, parameter, priority, createdTask);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == currentTask) {
+    // A task ends by returning on the host; park the thread until exit
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void vTaskDelayUntil(TickType_t* previousWake, TickType_t increment) {
+  *previousWake += increment;
+  TickType_t now = xTaskGetTickCount();
+  if ((int32_t)(*previousWake - now) > 0) {
+    vTaskDelay(*previousWake - now);
+  }
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (currentTask == nullptr) {
+    // Threads not created by xTaskCreate (main, test threads); not on the
+    // heap, the heap check asks for the task from inside malloc
+    static thread_local FakeTask ownTask;
+    currentTask = &ownTask;
+  }
+  return currentTask;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t coreId) {
+  return coreId == xPortGetCoreID() ? xTaskGetCurrentTaskHandle() : nullptr;
+}
+
+BaseType_t xPortGetCoreID() {
+  return 1;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return 1024;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifyValue++;
+  }
+  task->notified.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  FakeTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  waitFor(task->notified, lock, ticksToWait, [task]() { return task->notifyValue > 0; });
+  uint32_t value = task->notifyValue;
+  if (value > 0) {
+    task->notifyValue = clearOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+// Queues
+// ---------------------------------------------------------------------------
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  FakeQueue* queue = new FakeQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return queue->items.size() < queue->length; })) {
+    return pdFALSE;
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higherPriorityTaskWoken) {
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return !queue->items.empty(); })) {
+    return pdFALSE;
+  }
+  if (queue->itemSize > 0) {
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+  }
+  queue->items.pop_front();
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->items.clear();
+  }
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+// ---------------------------------------------------------------------------
+// Semaphores: queues of zero-size items (a mutex starts out given)
+// ---------------------------------------------------------------------------
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  SemaphoreHandle_t semaphore = xQueueCreate(maxCount, 0);
+  for (UBaseType_t i = 0; i < initialCount; i++) {
+    xQueueSend(semaphore, nullptr, 0);
+  }
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  return xQueueReceive(semaphore, nullptr, ticksToWait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  return xQueueSend(semaphore, nullptr, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higherPriorityTaskWoken) {
+  return xSemaphoreGive(semaphore);
+}
@@ -0,0 +1,85 @@
+/**
+ * Fake_Host.h - Test controls of the host fakes
+ *
+ * The firmware sees the normal Arduino/ESP-IDF API; tests and benchmarks
+ * use these functions to drive time, the network identity, flash and the
+ * microphone, and to read what the firmware put out.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_HOST_H
+#define FAKE_HOST_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <esp_partition.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Clock: the host clock by default. In manual mode time only moves with
+// fakeClockAdvance*() and delay(); vTaskDelay() still sleeps for real so
+// background tasks cannot spin.
+void fakeClockManual(bool manual);
+void fakeClockAdvanceUs(uint64_t us);
+void fakeClockAdvanceMs(uint32_t ms);
+// Run a hook once inside the next millis() call, after it read the time:
+// lets a test put another task's work between a read and its use
+void fakeClockOnNextRead(std::function<void()> hook);
+
+// Wall clock (gettimeofday) of this process relative to the host clock,
+// e.g. to give simulated lamps different NTP errors
+void fakeWallClockSkewUs(int64_t skewUs);
+
+// Serial output (everything the firmware logged since the last clear)
+std::string fakeSerialOutput();
+void fakeSerialClear();
+void fakeSerialEcho(bool echo);
+
+// Network identity; set before the firmware's setup functions run
+void fakeWiFiSetStatus(wl_status_t status);
+void fakeWiFiSetLocalIP(IPAddress ip);
+void fakeWiFiSetMac(const uint8_t mac[6]);
+void fakeWiFiEvent(WiFiEvent_t event);
+
+// TCP send buffer: limit the bytes each WiFiClient::write() accepts (the
+// function gets the requested size), e.g. to simulate a full lwIP buffer
+// that drains between two writes; nullptr removes the limit
+void fakeWiFiClientWriteLimit(std::function<size_t(size_t size)> limit);
+
+// HTTP client: GET() answers with the queued replies in order (none left:
+// connection refused); every request is recorded
+void fakeHttpQueueReply(const FakeHttpReply& reply);
+std::vector<FakeHttpRequest> fakeHttpRequests();
+
+// DNS: while held, dns_gethostbyname() leaves lookups pending; releasing
+// answers the pending one through its callback (from the calling thread)
+void fakeDnsHold(bool hold);
+
+// System
+bool fakeRestartRequested();
+void fakeClearRestart();
+void fakeSetResetReason(esp_reset_reason_t reason);
+void fakeRunShutdownHandlers();
+
+// Flash (partitions from Deckenlampe/partitions.csv, app0 is running)
+void fakeFlashReset();
+uint8_t* fakeFlashData(const esp_partition_t* partition);
+uint32_t fakeFlashEraseCount();
+void fakeFlashEraseDelayUs(uint32_t us);   // Real time per erased sector (ESP32: ~30 ms)
+void fakeFlashInstallRunningImage(const uint8_t* image, size_t len);
+std::vector<uint8_t> fakeAppImage(size_t len, uint32_t seed);
+const esp_partition_t* fakeBootPartition();
+
+// LEDs: number of FastLED.show() calls and the last frame shown
+uint32_t fakeShowCount();
+std::vector<uint8_t> fakeShownFrame();
+
+// Microphone: queue one DMA block (AUDIO_HOP_SIZE 32-bit slots)
+bool fakeI2sPush(const int32_t* samples, size_t count);
+size_t fakeI2sQueued();
+void fakeI2sHold(bool hold);   // Reads wait while held, as if the audio task were busy
+
+#endif // FAKE_HOST_H
@@ -0,0 +1,129 @@
+/**
+ * Fake_I2s.cpp - Host fake of the I2S RX driver fed by fakeI2sPush()
+ *
+ * Author: icebear74
+ */
+
+#include "Fake_Host.h"
+#include <driver/i2s_std.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+struct FakeI2sChannel {
+  std::mutex mutex;
+  std::condition_variable pushed;
+  size_t depth = 0;
+  std::deque<std::vector<int32_t>> blocks;
+  i2s_event_callbacks_t callbacks = {};
+  void* userContext = nullptr;
+  bool enabled = false;
+};
+
+static std::atomic<bool> readsHeld(false);
+
+static std::mutex channelMutex;
+static FakeI2sChannel* channel = nullptr;
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* config, i2s_chan_handle_t* txHandle, i2s_chan_handle_t* rxHandle) {
+  std::lock_guard<std::mutex> lock(channelMutex);
+  if (channel != nullptr || rxHandle == nullptr) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  channel = new FakeI2sChannel();
+  channel->depth = config->dma_desc_num;
+  *rxHandle = channel;
+  return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle) {
+  std::lock_guard<std::mutex> lock(channelMutex);
+  if (handle != channel) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  delete channel;
+  channel = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* config) {
+  return handle != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks,
+                                              void* userContext) {
+  std::lock_guard<std::mutex> lock(handle->mutex);
+  handle->callbacks = *callbacks;
+  handle->userContext = userContext;
+  return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+  std::lock_guard<std::mutex> lock(handle->mutex);
+  handle->enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void* dest, size_t size, size_t* bytesRead,
+                           uint32_t timeoutMs) {
+  std::unique_lock<std::mutex> lock(handle->mutex);
+  auto ready = [handle]() { return !readsHeld.load() && !handle->blocks.empty(); };
+  if (timeoutMs == portMAX_DELAY) {
+    handle->pushed.wait(lock, ready);
+  } else if (!handle->pushed.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+    *bytesRead = 0;
+    return ESP_ERR_TIMEOUT;
+  }
+  std::vector<int32_t>& block = handle->blocks.front();
+  size_t bytes = std::min(size, block.size() * sizeof(int32_t));
+  memcpy(dest, block.data(), bytes);
+  handle->blocks.pop_front();
+  *bytesRead = bytes;
+  return ESP_OK;
+}
+
+// Called like the DMA interrupt: on_recv for every block, on_recv_q_ovf as
+// well when the oldest queued block had to be dropped
+bool fakeI2sPush(const int32_t* samples, size_t count) {
+  std::unique_lock<std::mutex> lock(channelMutex);
+  if (channel == nullptr || !channel->enabled) {
+    return false;
+  }
+  FakeI2sChannel* handle = channel;
+  std::unique_lock<std::mutex> channelLock(handle->mutex);
+  bool overflow = handle->blocks.size() >= handle->depth;
+  if (overflow) {
+    handle->blocks.pop_front();
+  }
+  handle->blocks.emplace_back(samples, samples + count);
+  i2s_event_data_t event = { handle->blocks.back().data(), count * sizeof(int32_t) };
+  if (handle->callbacks.on_recv != nullptr) {
+    handle->callbacks.on_recv(handle, &event, handle->userContext);
+  }
+  if (overflow && handle->callbacks.on_recv_q_ovf != nullptr) {
+    handle->callbacks.on_recv_q_ovf(handle, &event, handle->userContext);
+  }
+  channelLock.unlock();
+  handle->pushed.notify_all();
+  return !overflow;
+}
+
+void fakeI2sHold(bool hold) {
+  std::lock_guard<std::mutex> lock(channelMutex);
+  readsHeld.store(hold);
+  if (channel != nullptr && !hold) {
+    std::lock_guard<std::mutex> channelLock(channel->mutex);
+    channel->pushed.notify_all();
+  }
+}
+
+size_t fakeI2sQueued() {
+  std::lock_guard<std::mutex> lock(channelMutex);
+  if (channel == nullptr) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> channelLock(channel->mutex);
+  return channel->blocks.size();
+}
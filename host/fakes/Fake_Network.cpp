@@ -0,0 +1,641 @@
+/**
+ * Fake_Network.cpp - Host fake of WiFi, lwIP DNS, WiFiClient, HTTPClient, AsyncUDP, WebServer and ArduinoOTA
+ *
+ * Author: icebear74
+ */
+
+#include "Fake_Host.h"
+#include <ArduinoOTA.h>
+#include <HTTPClient.h>
+#include <AsyncUDP.h>
+#include <WebServer.h>
+#include <esp_wps.h>
+#include <lwip/dns.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+WiFiClass WiFi;
+ArduinoOTAClass ArduinoOTA;
+
+// ---------------------------------------------------------------------------
+// WiFi station
+// ---------------------------------------------------------------------------
+
+static wl_status_t wifiStatus = WL_CONNECTED;
+static IPAddress wifiLocalIp(127, 0, 0, 1);
+static uint8_t wifiMac[6] = { 0x02, 0xDE, 0xC0, 0x00, 0x00, 0x01 };
+static char wifiHostname[33] = "CeilingLamp";
+static std::mutex wifiMutex;
+static std::vector<WiFiEventFuncCb> wifiHandlers;
+
+void fakeWiFiSetStatus(wl_status_t status) {
+  wifiStatus = status;
+}
+
+void fakeWiFiSetLocalIP(IPAddress ip) {
+  wifiLocalIp = ip;
+}
+
+void fakeWiFiSetMac(const uint8_t mac[6]) {
+  memcpy(wifiMac, mac, sizeof(wifiMac));
+}
+
+void fakeWiFiEvent(WiFiEvent_t event) {
+  std::vector<WiFiEventFuncCb> handlers;
+  {
+    std::lock_guard<std::mutex> lock(wifiMutex);
+    handlers = wifiHandlers;
+  }
+  arduino_event_info_t info = {};
+  for (WiFiEventFuncCb handler : handlers) {
+    handler(event, info);
+  }
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) { return true; }
+wl_status_t WiFiClass::begin() { return wifiStatus; }
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+  return wifiStatus;
+}
+bool WiFiClass::reconnect() { return true; }
+bool WiFiClass::disconnect(bool wifiOff) { return true; }
+wl_status_t WiFiClass::status() { return wifiStatus; }
+IPAddress WiFiClass::localIP() { return wifiLocalIp; }
+IPAddress WiFiClass::gatewayIP() { return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::dnsIP(uint8_t index) { return IPAddress(127, 0, 0, 1); }
+bool WiFiClass::setSleep(bool enabled) { return true; }
+bool WiFiClass::setSleep(wifi_ps_type_t sleepType) { return true; }
+String WiFiClass::SSID() { return String("host"); }
+int32_t WiFiClass::RSSI() { return -40; }
+int16_t WiFiClass::scanNetworks(bool async) { return async ? WIFI_SCAN_RUNNING : 0; }
+int16_t WiFiClass::scanComplete() { return 0; }
+void WiFiClass::scanDelete() {}
+void* WiFiClass::getScanInfoByIndex(int index) { return nullptr; }
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, wifiMac, sizeof(wifiMac));
+  return mac;
+}
+
+String WiFiClass::macAddress() {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", wifiMac[0], wifiMac[1], wifiMac[2], wifiMac[3],
+           wifiMac[4], wifiMac[5]);
+  return String(buf);
+}
+
+uint64_t EspClass::getEfuseMac() {
+  uint64_t mac = 0;
+  for (int i = 5; i >= 0; i--) {
+    mac = (mac << 8) | wifiMac[i];
+  }
+  return mac;
+}
+
+bool WiFiClass::setHostname(const char* hostname) {
+  strlcpy(wifiHostname, hostname, sizeof(wifiHostname));
+  return true;
+}
+
+const char* WiFiClass::getHostname() {
+  return wifiHostname;
+}
+
+// Numeric addresses and localhost only, the tests never need DNS
+bool WiFiClass::hostByName(const char* host, IPAddress& result) {
+  if (strcmp(host, "localhost") == 0) {
+    result = IPAddress(127, 0, 0, 1);
+    return true;
+  }
+  return result.fromString(host);
+}
+
+void WiFiClass::onEvent(WiFiEventFuncCb callback) {
+  std::lock_guard<std::mutex> lock(wifiMutex);
+  wifiHandlers.push_back(callback);
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* config) {
+  memset(config, 0, sizeof(*config));
+  memcpy(config->sta.ssid, "host", 4);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* info) {
+  memset(info, 0, sizeof(*info));
+  memcpy(info->ssid, "host", 4);
+  info->rssi = -40;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_wps_enable(const esp_wps_config_t* config) { return ESP_OK; }
+esp_err_t esp_wifi_wps_disable(void) { return ESP_OK; }
+esp_err_t esp_wifi_wps_start(int timeoutMs) { return ESP_OK; }
+
+// ---------------------------------------------------------------------------
+// lwIP DNS
+// ---------------------------------------------------------------------------
+
+static std::mutex dnsMutex;
+static bool dnsHeld = false;
+static std::string dnsPendingName;
+static dns_found_callback dnsPendingCallback = nullptr;
+static void* dnsPendingArg = nullptr;
+
+static bool dnsLookup(const char* hostname, ip_addr_t* addr) {
+  IPAddress ip;
+  if (!WiFi.hostByName(hostname, ip)) {
+    return false;
+  }
+  addr->u_addr.ip4.addr = (uint32_t)ip;
+  addr->type = 0;
+  return true;
+}
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callbackArg) {
+  std::lock_guard<std::mutex> lock(dnsMutex);
+  if (dnsHeld) {
+    dnsPendingName = hostname;
+    dnsPendingCallback = found;
+    dnsPendingArg = callbackArg;
+    return ERR_INPROGRESS;
+  }
+  return dnsLookup(hostname, addr) ? ERR_OK : ERR_VAL;
+}
+
+void fakeDnsHold(bool hold) {
+  dns_found_callback found;
+  void* callbackArg;
+  std::string name;
+  {
+    std::lock_guard<std::mutex> lock(dnsMutex);
+    dnsHeld = hold;
+    if (hold || !dnsPendingCallback) {
+      return;
+    }
+    found = dnsPendingCallback;
+    callbackArg = dnsPendingArg;
+    name = dnsPendingName;
+    dnsPendingCallback = nullptr;
+  }
+  ip_addr_t addr;
+  found(name.c_str(), dnsLookup(name.c_str(), &addr) ? &addr : nullptr, callbackArg);
+}
+
+static sockaddr_in socketAddress(IPAddress ip, uint16_t port) {
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = (uint32_t)ip;
+  return address;
+}
+
+// ---------------------------------------------------------------------------
+// WiFiClient
+// ---------------------------------------------------------------------------
+
+WiFiClient::~WiFiClient() {
+  stop();
+}
+
+WiFiClient& WiFiClient::operator=(WiFiClient&& other) {
+  if (this != &other) {
+    stop();
+    socketFd = other.socketFd;
+    other.socketFd = -1;
+  }
+  return *this;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip, port, 3000);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, 3000);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) {
+    return 0;
+  }
+  return connect(ip, port, timeoutMs);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+  stop();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return 0;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  sockaddr_in address = socketAddress(ip, port);
+  int ret = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  if (ret < 0 && errno == EINPROGRESS) {
+    pollfd pfd = { fd, POLLOUT, 0 };
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (poll(&pfd, 1, timeoutMs) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) == 0 &&
+        error == 0) {
+      ret = 0;
+    }
+  }
+  if (ret < 0) {
+    ::close(fd);
+    return 0;
+  }
+  socketFd = fd;
+  return 1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (socketFd < 0) {
+    return 0;
+  }
+  uint8_t probe;
+  ssize_t n = recv(socketFd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    // Peer closed: still "connected" while unread data is buffered
+    return available() > 0;
+  }
+  return 1;
+}
+
+void WiFiClient::stop() {
+  if (socketFd >= 0) {
+    ::close(socketFd);
+    socketFd = -1;
+  }
+}
+
+void WiFiClient::setNoDelay(bool noDelay) {
+  if (socketFd >= 0) {
+    int flag = noDelay;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+}
+
+int WiFiClient::available() {
+  int count = 0;
+  if (socketFd < 0 || ioctl(socketFd, FIONREAD, &count) < 0) {
+    return 0;
+  }
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (socketFd < 0) {
+    return -1;
+  }
+  ssize_t n = recv(socketFd, buffer, size, MSG_DONTWAIT);
+  return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  if (socketFd < 0 || recv(socketFd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1) {
+    return -1;
+  }
+  return c;
+}
+
+static std::mutex writeLimitMutex;
+static std::function<size_t(size_t size)> writeLimit;
+
+void fakeWiFiClientWriteLimit(std::function<size_t(size_t size)> limit) {
+  std::lock_guard<std::mutex> lock(writeLimitMutex);
+  writeLimit = limit;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if (socketFd < 0) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(writeLimitMutex);
+    if (writeLimit) {
+      size = std::min(size, writeLimit(size));
+    }
+  }
+  if (size == 0) {
+    return 0;
+  }
+  ssize_t n = send(socketFd, buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+// ---------------------------------------------------------------------------
+// HTTPClient
+// ---------------------------------------------------------------------------
+
+static std::mutex httpMutex;
+static std::deque<FakeHttpReply> httpReplies;
+static std::vector<FakeHttpRequest> httpRequests;
+
+void fakeHttpQueueReply(const FakeHttpReply& reply) {
+  std::lock_guard<std::mutex> lock(httpMutex);
+  httpReplies.push_back(reply);
+}
+
+std::vector<FakeHttpRequest> fakeHttpRequests() {
+  std::lock_guard<std::mutex> lock(httpMutex);
+  return httpRequests;
+}
+
+bool HTTPClient::begin(WiFiClient& client, const char* url) {
+  end();
+  request = FakeHttpRequest();
+  request.url = url;
+  collected.clear();
+  return strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0;
+}
+
+void HTTPClient::end() {
+  bodyStream.stop();
+  answered = false;
+}
+
+int HTTPClient::GET() {
+  std::lock_guard<std::mutex> lock(httpMutex);
+  httpRequests.push_back(request);
+  if (httpReplies.empty()) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  reply = httpReplies.front();
+  httpReplies.pop_front();
+  answered = true;
+  return reply.code;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  request.headers[name.c_str()] = value.c_str();
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], size_t count) {
+  collected.assign(headerKeys, headerKeys + count);
+}
+
+String HTTPClient::header(const char* name) {
+  return hasHeader(name) ? String(reply.headers[name]) : String();
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+  // Like the real client: only headers asked for with collectHeaders()
+  return answered && std::find(collected.begin(), collected.end(), name) != collected.end() &&
+         reply.headers.count(name) > 0;
+}
+
+int HTTPClient::getSize() {
+  return answered && !reply.chunked ? (int)reply.body.size() : -1;
+}
+
+bool HTTPClient::connected() {
+  return bodyStream.connected();
+}
+
+// The body arrives through one end of a socket pair whose other end is
+// already closed, so the reader sees the end of the response
+WiFiClient* HTTPClient::getStreamPtr() {
+  if (!answered) {
+    return nullptr;
+  }
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return nullptr;
+  }
+  int size = (int)reply.body.size() + 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  ssize_t n = send(fds[0], reply.body.data(), reply.body.size(), MSG_NOSIGNAL);
+  ::close(fds[0]);
+  if (n != (ssize_t)reply.body.size()) {
+    ::close(fds[1]);
+    return nullptr;
+  }
+  bodyStream = WiFiClient(fds[1]);
+  return &bodyStream;
+}
+
+int HTTPClient::writeToStream(Stream* stream) {
+  if (!answered) {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  size_t n = stream->write(reinterpret_cast<const uint8_t*>(reply.body.data()), reply.body.size());
+  return n == reply.body.size() ? (int)n : HTTPC_ERROR_STREAM_WRITE;
+}
+
+String HTTPClient::getString() {
+  return answered ? String(reply.body) : String();
+}
+
+// ---------------------------------------------------------------------------
+// AsyncUDP
+// ---------------------------------------------------------------------------
+
+bool AsyncUDP::openSocket(uint16_t port, bool multicastGroup, const IPAddress& group, uint8_t ttl) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+  sockaddr_in address = socketAddress(IPAddress(), port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // Multicast leaves and joins on the interface of the lamp's address
+  in_addr interface;
+  interface.s_addr = (uint32_t)WiFi.localIP();
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+  unsigned char loop = 1;
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  unsigned char hops = ttl;
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+  if (multicastGroup) {
+    ip_mreq membership;
+    membership.imr_multiaddr.s_addr = (uint32_t)group;
+    membership.imr_interface = interface;
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+      ::close(fd);
+      return false;
+    }
+  }
+
+  socklen_t addressLen = sizeof(address);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&address), &addressLen);
+  socketFd = fd;
+  localPort = ntohs(address.sin_port);
+  multicast = multicastGroup;
+  return true;
+}
+
+bool AsyncUDP::listen(const IPAddress& address, uint16_t port) {
+  close();
+  if (!openSocket(port, false, IPAddress(), 1)) {
+    return false;
+  }
+  running = true;
+  receiver = std::thread(&AsyncUDP::receiveLoop, this);
+  return true;
+}
+
+bool AsyncUDP::listenMulticast(const IPAddress& group, uint16_t port, uint8_t ttl) {
+  close();
+  if (!openSocket(port, true, group, ttl)) {
+    return false;
+  }
+  running = true;
+  receiver = std::thread(&AsyncUDP::receiveLoop, this);
+  return true;
+}
+
+void AsyncUDP::receiveLoop() {
+  static const size_t maxDatagram = 1500;
+  uint8_t buffer[maxDatagram];
+  while (running.load()) {
+    pollfd pfd = { socketFd, POLLIN, 0 };
+    if (poll(&pfd, 1, 20) != 1) {
+      continue;
+    }
+    sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = recvfrom(socketFd, buffer, sizeof(buffer), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&from),
+                         &fromLen);
+    if (n < 0 || !handler) {
+      continue;
+    }
+    AsyncUDPPacket packet(buffer, (size_t)n, IPAddress((uint32_t)from.sin_addr.s_addr), ntohs(from.sin_port),
+                          WiFi.localIP(), localPort, multicast);
+    handler(packet);
+  }
+}
+
+size_t AsyncUDP::writeTo(const uint8_t* data, size_t len, const IPAddress& address, uint16_t port) {
+  if (socketFd < 0 && !openSocket(0, false, IPAddress(), 1)) {
+    return 0;
+  }
+  sockaddr_in to = socketAddress(address, port);
+  ssize_t n = sendto(socketFd, data, len, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+  return n < 0 ? 0 : (size_t)n;
+}
+
+void AsyncUDP::close() {
+  running = false;
+  if (receiver.joinable()) {
+    receiver.join();
+  }
+  if (socketFd >= 0) {
+    ::close(socketFd);
+    socketFd = -1;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// WebServer
+// ---------------------------------------------------------------------------
+
+void WebServer::on(const char* uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler) {
+  routes.push_back({ uri, method, handler, uploadHandler });
+}
+
+String WebServer::arg(const char* name) {
+  auto it = args.find(name);
+  return it == args.end() ? String() : String(it->second);
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  response.code = code;
+  response.contentType = contentType ? contentType : "";
+  response.body.append(content.c_str(), content.length());
+  response.handled = true;
+}
+
+void WebServer::sendContent(const char* content, size_t size) {
+  response.body.append(content, size);
+}
+
+FakeHttpResponse WebServer::request(HTTPMethod method, const char* uri, const uint8_t* upload, size_t uploadLen,
+                                    size_t chunkSize) {
+  response = FakeHttpResponse();
+  contentLength = CONTENT_LENGTH_NOT_SET;
+  args.clear();
+  currentMethod = method;
+
+  std::string path(uri);
+  size_t query = path.find('?');
+  if (query != std::string::npos) {
+    std::string rest = path.substr(query + 1);
+    path.resize(query);
+    while (!rest.empty()) {
+      size_t amp = rest.find('&');
+      std::string pair = rest.substr(0, amp);
+      size_t eq = pair.find('=');
+      args[pair.substr(0, eq)] = eq == std::string::npos ? "" : pair.substr(eq + 1);
+      rest = amp == std::string::npos ? "" : rest.substr(amp + 1);
+    }
+  }
+  currentUri = path;
+
+  for (Route& route : routes) {
+    if (route.uri != path || (route.method != HTTP_ANY && route.method != method)) {
+      continue;
+    }
+    if (route.uploadHandler) {
+      currentUpload.filename = "upload.bin";
+      currentUpload.name = "update";
+      currentUpload.type = "application/octet-stream";
+      currentUpload.totalSize = 0;
+      currentUpload.currentSize = 0;
+      currentUpload.status = UPLOAD_FILE_START;
+      route.uploadHandler();
+
+      if (chunkSize == 0 || chunkSize > HTTP_UPLOAD_BUFLEN) {
+        chunkSize = HTTP_UPLOAD_BUFLEN;
+      }
+      for (size_t pos = 0; pos < uploadLen; pos += chunkSize) {
+        size_t n = std::min(chunkSize, uploadLen - pos);
+        memcpy(currentUpload.buf, upload + pos, n);
+        currentUpload.currentSize = n;
+        currentUpload.totalSize += n;
+        currentUpload.status = UPLOAD_FILE_WRITE;
+        route.uploadHandler();
+      }
+      currentUpload.currentSize = 0;
+      currentUpload.status = UPLOAD_FILE_END;
+      route.uploadHandler();
+    }
+    route.handler();
+    return response;
+  }
+
+  if (notFoundHandler) {
+    notFoundHandler();
+  } else {
+    send(404, "text/plain", "Not found");
+  }
+  return response;
+}
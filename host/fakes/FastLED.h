@@ -0,0 +1,158 @@
+/**
+ * FastLED.h - Host fake of FastLED
+ *
+ * CRGB and the 8/16-bit math the firmware uses, with FastLED's integer
+ * algorithms so rendered frames match the lamp bit for bit. show() copies
+ * the LED buffer into a capture that tests read (Fake_Host.h).
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_FASTLED_H
+#define FAKE_FASTLED_H
+
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+
+static inline uint8_t scale8(uint8_t i, fract8 scale) {
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+static inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+  return (((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+static inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  unsigned int t = i + j;
+  return t > 255 ? 255 : t;
+}
+
+static inline uint8_t qsub8(uint8_t i, uint8_t j) {
+  int t = i - j;
+  return t < 0 ? 0 : t;
+}
+
+static inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac) {
+  if (b > a) {
+    return a + scale8(b - a, frac);
+  }
+  return a - scale8(a - b, frac);
+}
+
+static inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+  uint16_t partial = (a << 8) | b;
+  partial += (b * amountOfB);
+  partial -= (a * amountOfB);
+  return partial >> 8;
+}
+
+static inline int16_t sin16(uint16_t theta) {
+  static const uint16_t base[] = { 0, 6393, 12539, 18204, 23170, 27245, 30273, 32137 };
+  static const uint8_t slope[] = { 49, 48, 44, 38, 31, 23, 14, 4 };
+  uint16_t offset = (theta & 0x3FFF) >> 3;
+  if (theta & 0x4000) {
+    offset = 2047 - offset;
+  }
+  uint8_t section = offset / 256;
+  uint16_t mx = slope[section] * (uint8_t)((uint8_t)offset / 2);
+  int16_t y = mx + base[section];
+  return (theta & 0x8000) ? -y : y;
+}
+
+static inline int16_t cos16(uint16_t theta) {
+  return sin16(theta + 16384);
+}
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  CRGB() {}
+  constexpr CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+  constexpr CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+
+  uint8_t& operator[](uint8_t index) { return raw[index]; }
+  const uint8_t& operator[](uint8_t index) const { return raw[index]; }
+  bool operator==(const CRGB& other) const { return r == other.r && g == other.g && b == other.b; }
+  bool operator!=(const CRGB& other) const { return !(*this == other); }
+
+  CRGB& nscale8(uint8_t scale) {
+    r = scale8(r, scale);
+    g = scale8(g, scale);
+    b = scale8(b, scale);
+    return *this;
+  }
+  CRGB& nscale8_video(uint8_t scale) {
+    r = scale8_video(r, scale);
+    g = scale8_video(g, scale);
+    b = scale8_video(b, scale);
+    return *this;
+  }
+
+  enum HTMLColorCode : uint32_t {
+    Black = 0x000000,
+    White = 0xFFFFFF,
+    Red = 0xFF0000,
+    Green = 0x008000,
+    Blue = 0x0000FF
+  };
+};
+
+static inline CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2) {
+  if (amountOfP2 == 0) {
+    return p1;
+  }
+  if (amountOfP2 == 255) {
+    return p2;
+  }
+  return CRGB(blend8(p1.r, p2.r, amountOfP2), blend8(p1.g, p2.g, amountOfP2), blend8(p1.b, p2.b, amountOfP2));
+}
+
+// RGBW conversion of the SK6812 strip (nothing to do on the host)
+struct Rgbw {};
+static inline Rgbw RgbwDefault() {
+  return Rgbw();
+}
+
+class CLEDController {
+public:
+  CLEDController& setRgbw(const Rgbw& rgbw) { return *this; }
+};
+
+enum EOrder { RGB = 0012, GRB = 0102 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER>
+class SK6812 {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER>
+class WS2812B {};
+
+class CFastLED {
+public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController& addLeds(CRGB* data, int numLeds) {
+    leds = data;
+    ledCount = numLeds;
+    return controller;
+  }
+  void show();
+  void setBrightness(uint8_t scale) { brightness = scale; }
+  uint8_t getBrightness() const { return brightness; }
+
+  CRGB* leds = nullptr;
+  int ledCount = 0;
+
+private:
+  CLEDController controller;
+  uint8_t brightness = 255;
+};
+
+extern CFastLED FastLED;
+
+#endif // FAKE_FASTLED_H
@@ -0,0 +1,73 @@
+/**
+ * HTTPClient.h - Host fake of the Arduino-ESP32 HTTPClient
+ *
+ * No network: GET() answers with the next reply queued by
+ * fakeHttpQueueReply() and records the request (URL and the headers
+ * added). With nothing queued it fails with a connection error, so the
+ * HTTP update path runs its retry and backoff logic. The body is served
+ * through writeToStream()/getString() and, for downloads, a socket pair
+ * behind getStreamPtr().
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_HTTPCLIENT_H
+#define FAKE_HTTPCLIENT_H
+
+#include <WiFi.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_NOT_FOUND 404
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_STRICT_FOLLOW_REDIRECTS 1
+
+// Scripted response for the next GET()
+struct FakeHttpReply {
+  int code = HTTP_CODE_OK;
+  std::string body;
+  std::map<std::string, std::string> headers;
+  bool chunked = false;     // No Content-Length: getSize() is -1
+};
+
+// Request as GET() sent it
+struct FakeHttpRequest {
+  std::string url;
+  std::map<std::string, std::string> headers;
+};
+
+class HTTPClient {
+public:
+  bool begin(WiFiClient& client, const String& url) { return begin(client, url.c_str()); }
+  bool begin(WiFiClient& client, const char* url);
+  void end();
+  int GET();
+  void addHeader(const String& name, const String& value);
+  void collectHeaders(const char* headerKeys[], size_t count);
+  String header(const char* name);
+  bool hasHeader(const char* name);
+  int getSize();
+  bool connected();
+  WiFiClient* getStreamPtr();
+  int writeToStream(Stream* stream);
+  String getString();
+  void setTimeout(uint16_t timeout) {}
+  void setConnectTimeout(int32_t timeout) {}
+  void setReuse(bool reuse) {}
+  void setFollowRedirects(int follow) {}
+  static String errorToString(int error) { return String("connection refused"); }
+
+private:
+  FakeHttpRequest request;
+  std::vector<std::string> collected;
+  FakeHttpReply reply;
+  bool answered = false;
+  WiFiClient bodyStream;
+};
+
+#endif // FAKE_HTTPCLIENT_H
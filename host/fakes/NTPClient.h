@@ -0,0 +1,26 @@
+/**
+ * NTPClient.h - Host fake of the NTPClient library (time comes from the host)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_NTPCLIENT_H
+#define FAKE_NTPCLIENT_H
+
+#include <WiFiUdp.h>
+
+class NTPClient {
+public:
+  NTPClient(WiFiUDP& udp, const char* poolServerName = "pool.ntp.org", long timeOffset = 0,
+            unsigned long updateInterval = 60000) {}
+  void begin() {}
+  void begin(unsigned int port) {}
+  bool update() { return true; }
+  bool forceUpdate() { return true; }
+  bool isTimeSet() const { return true; }
+  void setPoolServerName(const char* poolServerName) {}
+  void setUpdateInterval(unsigned long updateInterval) {}
+  unsigned long getEpochTime() const { return (unsigned long)time(nullptr); }
+};
+
+#endif // FAKE_NTPCLIENT_H
@@ -0,0 +1,59 @@
+/**
+ * Update.h - Host fake of the Arduino-ESP32 Update class
+ *
+ * Writes through the fake esp_ota_* API into the next OTA partition.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_UPDATE_H
+#define FAKE_UPDATE_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+#define UPDATE_ERROR_OK    0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SIZE  4
+#define UPDATE_ERROR_SPACE 5
+#define UPDATE_ERROR_MAGIC_BYTE 10
+#define UPDATE_ERROR_ABORT 8
+#define UPDATE_ERROR_ACTIVATE 11
+
+class UpdateClass {
+public:
+  typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
+
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW,
+             const char* label = NULL);
+  size_t write(uint8_t* data, size_t len);
+  size_t writeStream(Stream& data);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  void printError(Print& out);
+  const char* errorString();
+  bool hasError() { return error != UPDATE_ERROR_OK; }
+  uint8_t getError() { return error; }
+  bool isRunning() { return running; }
+  bool isFinished() { return running && progressBytes == imageSize; }
+  size_t size() { return imageSize; }
+  size_t progress() { return progressBytes; }
+  size_t remaining() { return imageSize - progressBytes; }
+  UpdateClass& onProgress(THandlerFunction_Progress callback) { progressCallback = callback; return *this; }
+
+private:
+  uint32_t handle = 0;
+  bool running = false;
+  uint8_t error = UPDATE_ERROR_OK;
+  size_t imageSize = 0;
+  size_t progressBytes = 0;
+  THandlerFunction_Progress progressCallback;
+};
+
+extern UpdateClass Update;
+
+#endif // FAKE_UPDATE_H
@@ -0,0 +1,119 @@
+/**
+ * WebServer.h - Host fake of the Arduino-ESP32 WebServer
+ *
+ * No socket: tests and benchmarks drive the registered handlers with
+ * request(), which runs the upload callbacks in HTTP_UPLOAD_BUFLEN chunks
+ * (like the real multipart parser) and returns the captured response.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_WEBSERVER_H
+#define FAKE_WEBSERVER_H
+
+#include <WiFi.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+typedef enum {
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS
+} HTTPMethod;
+
+typedef enum {
+  UPLOAD_FILE_START,
+  UPLOAD_FILE_WRITE,
+  UPLOAD_FILE_END,
+  UPLOAD_FILE_ABORTED
+} HTTPUploadStatus;
+
+#define HTTP_UPLOAD_BUFLEN 1436
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+typedef struct {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+} HTTPUpload;
+
+// Response captured by WebServer::request()
+struct FakeHttpResponse {
+  int code = 0;
+  std::string contentType;
+  std::string body;
+  bool handled = false;
+};
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  WebServer(int port = 80) : port(port) {}
+
+  void begin() { started = true; }
+  void handleClient() {}
+  void on(const char* uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const char* uri, HTTPMethod method, THandlerFunction handler) { on(uri, method, handler, nullptr); }
+  void on(const char* uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler);
+  void onNotFound(THandlerFunction handler) { notFoundHandler = handler; }
+
+  HTTPUpload& upload() { return currentUpload; }
+  String uri() { return String(currentUri); }
+  HTTPMethod method() { return currentMethod; }
+  bool hasArg(const char* name) { return args.count(name) > 0; }
+  String arg(const char* name);
+
+  void setContentLength(size_t length) { contentLength = length; }
+  void sendHeader(const String& name, const String& value, bool first = false) {}
+  void send(int code, const char* contentType = nullptr, const String& content = String());
+  void send(int code, const char* contentType, const char* content) { send(code, contentType, String(content)); }
+  void sendContent(const char* content, size_t size);
+  void sendContent(const char* content) { sendContent(content, strlen(content)); }
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+
+  /**
+   * Run one request through the registered handlers
+   *
+   * @param method Request method
+   * @param uri Path, optionally with a query string (?a=1&b)
+   * @param upload Body delivered to the upload handler (if any)
+   * @param uploadLen Body length
+   * @param chunkSize Largest upload chunk (HTTP_UPLOAD_BUFLEN at most)
+   */
+  FakeHttpResponse request(HTTPMethod method, const char* uri, const uint8_t* upload = nullptr,
+                           size_t uploadLen = 0, size_t chunkSize = HTTP_UPLOAD_BUFLEN);
+  bool isStarted() const { return started; }
+
+private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction uploadHandler;
+  };
+
+  int port;
+  bool started = false;
+  std::vector<Route> routes;
+  THandlerFunction notFoundHandler;
+  HTTPUpload currentUpload = {};
+  std::string currentUri;
+  HTTPMethod currentMethod = HTTP_GET;
+  std::map<std::string, std::string> args;
+  size_t contentLength = CONTENT_LENGTH_NOT_SET;
+  FakeHttpResponse response;
+};
+
+#endif // FAKE_WEBSERVER_H
@@ -0,0 +1,126 @@
+/**
+ * WiFi.h - Host fake of the Arduino-ESP32 WiFi library
+ *
+ * The station is "connected" to the host network: localIP() is a loopback
+ * address that tests choose (several lamps in one test use 127.0.0.x),
+ * events are raised by tests with fakeWiFiEvent(). WiFiClient is a real
+ * TCP socket.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_WIFI_H
+#define FAKE_WIFI_H
+
+#include <Arduino.h>
+#include "esp_wifi.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+#define WIFI_MODE_STA WIFI_STA
+
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_START,
+  ARDUINO_EVENT_WIFI_STA_STOP,
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP,
+  ARDUINO_EVENT_WPS_ER_SUCCESS,
+  ARDUINO_EVENT_WPS_ER_FAILED,
+  ARDUINO_EVENT_WPS_ER_TIMEOUT,
+  ARDUINO_EVENT_WPS_ER_PIN
+} arduino_event_id_t;
+typedef arduino_event_id_t WiFiEvent_t;
+
+typedef union {
+  struct {
+    uint8_t pin_code[8];
+  } wps_er_pin;
+} arduino_event_info_t;
+
+typedef void (*WiFiEventFuncCb)(WiFiEvent_t event, arduino_event_info_t info);
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode);
+  wl_status_t begin();
+  wl_status_t begin(const char* ssid, const char* password, int32_t channel = 0, const uint8_t* bssid = nullptr,
+                    bool connect = true);
+  bool reconnect();
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status();
+
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress dnsIP(uint8_t index = 0);
+  uint8_t* macAddress(uint8_t* mac);
+  String macAddress();
+  bool setHostname(const char* hostname);
+  const char* getHostname();
+  bool hostByName(const char* host, IPAddress& result);
+  bool setSleep(bool enabled);
+  bool setSleep(wifi_ps_type_t sleepType);
+
+  String SSID();
+  int32_t RSSI();
+  int16_t scanNetworks(bool async = false);
+  int16_t scanComplete();
+  void scanDelete();
+  void* getScanInfoByIndex(int index);
+
+  void onEvent(WiFiEventFuncCb callback);
+};
+
+extern WiFiClass WiFi;
+
+/**
+ * TCP client on a host socket (blocking connect with timeout, the rest is
+ * non-blocking like the lwIP socket under the Arduino class)
+ */
+class WiFiClient : public Stream {
+public:
+  WiFiClient() {}
+  WiFiClient(int fd) : socketFd(fd) {}   // Takes over a connected socket
+  ~WiFiClient();
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+  WiFiClient& operator=(WiFiClient&& other);
+
+  int connect(IPAddress ip, uint16_t port);
+  int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+  int connect(const char* host, uint16_t port);
+  int connect(const char* host, uint16_t port, int32_t timeoutMs);
+  uint8_t connected();
+  void stop();
+  void setNoDelay(bool noDelay);
+  int fd() const { return socketFd; }
+
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t size);
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() { return connected(); }
+
+private:
+  int socketFd = -1;
+};
+
+#endif // FAKE_WIFI_H
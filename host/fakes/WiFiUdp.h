@@ -0,0 +1,28 @@
+/**
+ * WiFiUdp.h - Host fake of the Arduino WiFiUDP class (used by NTPClient)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_WIFIUDP_H
+#define FAKE_WIFIUDP_H
+
+#include <WiFi.h>
+
+class WiFiUDP : public Stream {
+public:
+  uint8_t begin(uint16_t port) { return 1; }
+  void stop() {}
+  int beginPacket(IPAddress ip, uint16_t port) { return 1; }
+  int beginPacket(const char* host, uint16_t port) { return 1; }
+  int endPacket() { return 1; }
+  int parsePacket() { return 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t* buffer, size_t size) { return 0; }
+  size_t write(uint8_t c) override { return 1; }
+  size_t write(const uint8_t* buffer, size_t size) override { return size; }
+  using Print::write;
+};
+
+#endif // FAKE_WIFIUDP_H
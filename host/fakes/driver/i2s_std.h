@@ -0,0 +1,109 @@
+/**
+ * i2s_std.h - Host fake of the ESP-IDF I2S standard mode driver (RX only)
+ *
+ * The driver keeps a queue of dma_desc_num blocks like the real DMA ring.
+ * Tests feed blocks with fakeI2sPush() (Fake_Host.h); each push calls
+ * on_recv, and on a full queue drops the oldest block and calls
+ * on_recv_q_ovf as well. i2s_channel_read() hands out the oldest queued block.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_DRIVER_I2S_STD_H
+#define FAKE_DRIVER_I2S_STD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+typedef struct FakeI2sChannel* i2s_chan_handle_t;
+
+typedef struct {
+  void* data;
+  size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t* event, void* userContext);
+
+typedef struct {
+  i2s_isr_callback_t on_recv;
+  i2s_isr_callback_t on_recv_q_ovf;
+  i2s_isr_callback_t on_sent;
+  i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+typedef struct {
+  int id;
+  int role;
+  uint32_t dma_desc_num;
+  uint32_t dma_frame_num;
+  bool auto_clear;
+} i2s_chan_config_t;
+
+typedef struct {
+  uint32_t sample_rate_hz;
+  int clk_src;
+  int mclk_multiple;
+} i2s_std_clk_config_t;
+
+typedef struct {
+  int data_bit_width;
+  int slot_bit_width;
+  int slot_mode;
+  int slot_mask;
+  uint32_t ws_width;
+  bool ws_pol;
+  bool bit_shift;
+} i2s_std_slot_config_t;
+
+typedef struct {
+  gpio_num_t mclk;
+  gpio_num_t bclk;
+  gpio_num_t ws;
+  gpio_num_t dout;
+  gpio_num_t din;
+  struct {
+    bool mclk_inv;
+    bool bclk_inv;
+    bool ws_inv;
+  } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+  i2s_std_clk_config_t clk_cfg;
+  i2s_std_slot_config_t slot_cfg;
+  i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+#define I2S_NUM_0 0
+#define I2S_ROLE_MASTER 0
+#define I2S_GPIO_UNUSED -1
+#define I2S_DATA_BIT_WIDTH_16BIT 16
+#define I2S_DATA_BIT_WIDTH_32BIT 32
+#define I2S_SLOT_MODE_MONO 1
+#define I2S_SLOT_MODE_STEREO 2
+#define I2S_STD_SLOT_LEFT 1
+#define I2S_STD_SLOT_RIGHT 2
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(id, role) { id, role, 6, 240, false }
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) { rate, 0, 256 }
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits, mode) { bits, 0, mode, 3, bits, false, true }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t i2s_new_channel(const i2s_chan_config_t* config, i2s_chan_handle_t* txHandle, i2s_chan_handle_t* rxHandle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* config);
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks,
+                                              void* userContext);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void* dest, size_t size, size_t* bytesRead,
+                           uint32_t timeoutMs);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_DRIVER_I2S_STD_H
@@ -0,0 +1,35 @@
+/**
+ * esp_err.h - Host fake of the ESP-IDF error codes
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_ERR_H
+#define FAKE_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+#define ESP_ERR_NO_MEM            0x101
+#define ESP_ERR_INVALID_ARG       0x102
+#define ESP_ERR_INVALID_STATE     0x103
+#define ESP_ERR_INVALID_SIZE      0x104
+#define ESP_ERR_NOT_FOUND         0x105
+#define ESP_ERR_NOT_SUPPORTED     0x106
+#define ESP_ERR_TIMEOUT           0x107
+#define ESP_ERR_OTA_BASE          0x1500
+#define ESP_ERR_OTA_PARTITION_CONFLICT      (ESP_ERR_OTA_BASE + 0x01)
+#define ESP_ERR_OTA_SELECT_INFO_INVALID     (ESP_ERR_OTA_BASE + 0x02)
+#define ESP_ERR_OTA_VALIDATE_FAILED         (ESP_ERR_OTA_BASE + 0x03)
+#define ESP_ERR_IMAGE_INVALID     0x2001
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+const char* esp_err_to_name(esp_err_t code);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_ERR_H
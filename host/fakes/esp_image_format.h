@@ -0,0 +1,59 @@
+/**
+ * esp_image_format.h - Host fake of the ESP-IDF app image format
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_IMAGE_FORMAT_H
+#define FAKE_ESP_IMAGE_FORMAT_H
+
+#include <stdint.h>
+#include "esp_partition.h"
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+#define ESP_IMAGE_MAX_SEGMENTS 16
+#define CONFIG_IDF_FIRMWARE_CHIP_ID 0x0009   // ESP32-S3
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;
+  uint8_t segment_count;
+  uint8_t spi_mode;
+  uint8_t spi_speed : 4;
+  uint8_t spi_size : 4;
+  uint32_t entry_addr;
+  uint8_t wp_pin;
+  uint8_t spi_pin_drv[3];
+  uint16_t chip_id;
+  uint8_t min_chip_rev;
+  uint16_t min_chip_rev_full;
+  uint16_t max_chip_rev_full;
+  uint8_t reserved[4];
+  uint8_t hash_appended;
+} esp_image_header_t;
+
+typedef struct {
+  uint32_t offset;
+  uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+  uint32_t start_addr;
+  esp_image_header_t image;
+  uint32_t image_len;
+} esp_image_metadata_t;
+
+typedef enum {
+  ESP_IMAGE_VERIFY,
+  ESP_IMAGE_VERIFY_SILENT,
+  ESP_IMAGE_LOAD
+} esp_image_load_mode_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t* part, esp_image_metadata_t* data);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_IMAGE_FORMAT_H
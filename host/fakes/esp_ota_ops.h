@@ -0,0 +1,37 @@
+/**
+ * esp_ota_ops.h - Host fake of the ESP-IDF OTA API
+ *
+ * Works on the fake flash (esp_partition.h): begin erases like the real
+ * implementation (all of the image size, or sector by sector with
+ * OTA_WITH_SEQUENTIAL_WRITES), end checks the image magic byte.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_OTA_OPS_H
+#define FAKE_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+typedef uint32_t esp_ota_handle_t;
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* startFrom);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t imageSize, esp_ota_handle_t* outHandle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void* data, size_t size, uint32_t offset);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_OTA_OPS_H
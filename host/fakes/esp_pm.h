@@ -0,0 +1,40 @@
+/**
+ * esp_pm.h - Host fake of the ESP-IDF power management API
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_PM_H
+#define FAKE_ESP_PM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct {
+  int max_freq_mhz;
+  int min_freq_mhz;
+  bool light_sleep_enable;
+} esp_pm_config_t;
+typedef esp_pm_config_t esp_pm_config_esp32s3_t;
+
+typedef enum {
+  ESP_PM_CPU_FREQ_MAX,
+  ESP_PM_APB_FREQ_MAX,
+  ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_pm_configure(const void* config);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name, esp_pm_lock_handle_t* outHandle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_PM_H
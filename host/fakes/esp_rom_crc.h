@@ -0,0 +1,21 @@
+/**
+ * esp_rom_crc.h - Host fake of the ESP ROM CRC routines
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_ROM_CRC_H
+#define FAKE_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len);
+uint16_t esp_rom_crc16_le(uint16_t crc, uint8_t const* buf, uint32_t len);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_ROM_CRC_H
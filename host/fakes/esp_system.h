@@ -0,0 +1,41 @@
+/**
+ * esp_system.h - Host fake of the ESP-IDF system API
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_SYSTEM_H
+#define FAKE_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO
+} esp_reset_reason_t;
+
+typedef void (*shutdown_handler_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+esp_reset_reason_t esp_reset_reason(void);
+void esp_restart(void);
+uint32_t esp_random(void);
+int64_t esp_timer_get_time(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_SYSTEM_H
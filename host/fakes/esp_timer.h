@@ -0,0 +1,12 @@
+/**
+ * esp_timer.h - Host fake of the ESP-IDF high resolution timer
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_TIMER_H
+#define FAKE_ESP_TIMER_H
+
+#include "esp_system.h"
+
+#endif // FAKE_ESP_TIMER_H
@@ -0,0 +1,38 @@
+/**
+ * esp_wifi.h - Host fake of the ESP-IDF WiFi driver API
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_WIFI_H
+#define FAKE_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP = 1 } wifi_interface_t;
+
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t ssid[33];
+  uint8_t primary;
+  int8_t rssi;
+} wifi_ap_record_t;
+
+typedef union {
+  struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+  } sta;
+} wifi_config_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* config);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* info);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_WIFI_H
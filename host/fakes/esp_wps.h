@@ -0,0 +1,42 @@
+/**
+ * esp_wps.h - Host fake of the ESP-IDF WPS API (pairing never completes)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ESP_WPS_H
+#define FAKE_ESP_WPS_H
+
+#include "esp_err.h"
+
+typedef enum wps_type {
+  WPS_TYPE_DISABLE = 0,
+  WPS_TYPE_PBC,
+  WPS_TYPE_PIN,
+  WPS_TYPE_MAX
+} wps_type_t;
+
+typedef struct {
+  char manufacturer[65];
+  char model_number[33];
+  char model_name[33];
+  char device_name[33];
+} wps_factory_information_t;
+
+typedef struct {
+  wps_type_t wps_type;
+  wps_factory_information_t factory_info;
+  char pin[9];
+} esp_wps_config_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_wifi_wps_enable(const esp_wps_config_t* config);
+esp_err_t esp_wifi_wps_disable(void);
+esp_err_t esp_wifi_wps_start(int timeoutMs);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ESP_WPS_H
@@ -0,0 +1,45 @@
+/**
+ * FreeRTOS.h - Host fake of the ESP-IDF FreeRTOS kernel
+ *
+ * Tasks are host threads, one tick is one millisecond. Critical sections
+ * (portMUX) are recursive mutexes, so concurrent code from the firmware
+ * keeps its locking semantics under the host scheduler.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_FREERTOS_H
+#define FAKE_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define pdFAIL  0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define portNUM_PROCESSORS 2
+
+struct portMUX_TYPE {
+  std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#endif // FAKE_FREERTOS_H
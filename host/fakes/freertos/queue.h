@@ -0,0 +1,25 @@
+/**
+ * queue.h - Host fake of the FreeRTOS queue API
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_FREERTOS_QUEUE_H
+#define FAKE_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+struct FakeQueue;
+typedef FakeQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higherPriorityTaskWoken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#define xQueueSendToBack xQueueSend
+
+#endif // FAKE_FREERTOS_QUEUE_H
@@ -0,0 +1,23 @@
+/**
+ * semphr.h - Host fake of the FreeRTOS semaphore API (queues without data)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_FREERTOS_SEMPHR_H
+#define FAKE_FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higherPriorityTaskWoken);
+
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif // FAKE_FREERTOS_SEMPHR_H
@@ -0,0 +1,41 @@
+/**
+ * dns.h - Host fake of the lwIP asynchronous DNS resolver
+ *
+ * Answers what WiFi.hostByName() answers (numeric addresses and
+ * localhost) at once with ERR_OK and fails every other name with ERR_VAL.
+ * fakeDnsHold() keeps lookups pending (ERR_INPROGRESS) to test callers
+ * that wait for the callback.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_LWIP_DNS_H
+#define FAKE_LWIP_DNS_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+#define ERR_OK          0
+#define ERR_INPROGRESS  -5
+#define ERR_VAL         -6
+#define ERR_ARG         -16
+
+typedef struct {
+  uint32_t addr;      // Network byte order
+} ip4_addr_t;
+
+typedef struct {
+  union {
+    ip4_addr_t ip4;
+  } u_addr;
+  uint8_t type;
+} ip_addr_t;
+
+#define ip_2_ip4(ipaddr) (&((ipaddr)->u_addr.ip4))
+#define ip4_addr_get_u32(ip4addr) ((ip4addr)->addr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callbackArg);
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callbackArg);
+
+#endif // FAKE_LWIP_DNS_H
@@ -0,0 +1,21 @@
+/**
+ * sockets.h - Host fake of the lwIP BSD socket API
+ *
+ * lwIP's socket calls carry the POSIX names on the ESP32, so the host
+ * sockets stand in for them directly.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_LWIP_SOCKETS_H
+#define FAKE_LWIP_SOCKETS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif // FAKE_LWIP_SOCKETS_H
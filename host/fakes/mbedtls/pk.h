@@ -0,0 +1,37 @@
+/**
+ * pk.h - Host fake of the mbedTLS public key API (OpenSSL underneath)
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_MBEDTLS_PK_H
+#define FAKE_MBEDTLS_PK_H
+
+#include <stddef.h>
+
+typedef enum {
+  MBEDTLS_MD_NONE = 0,
+  MBEDTLS_MD_SHA256 = 9
+} mbedtls_md_type_t;
+
+typedef struct {
+  void* key;   // EVP_PKEY
+} mbedtls_pk_context;
+
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT  -0x3D00
+#define MBEDTLS_ERR_PK_BAD_INPUT_DATA      -0x3E80
+#define MBEDTLS_ERR_RSA_VERIFY_FAILED      -0x4380
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLen,
+                      const unsigned char* sig, size_t sigLen);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_MBEDTLS_PK_H
@@ -0,0 +1,33 @@
+/**
+ * sha256.h - Host fake of the mbedTLS SHA-256 API (OpenSSL underneath)
+ *
+ * The context is plain data like the real one: init/free may be repeated
+ * and free on a finished context is harmless.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_MBEDTLS_SHA256_H
+#define FAKE_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  uint64_t state[16];   // Holds an OpenSSL SHA256_CTX
+} mbedtls_sha256_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output);
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_MBEDTLS_SHA256_H
@@ -0,0 +1,59 @@
+/**
+ * miniz.h - Host fake of the tinfl inflater in the ESP32 ROM (zlib underneath)
+ *
+ * Only the streaming mode the firmware uses: raw deflate, wrapping 32 KB
+ * output dictionary, TINFL_FLAG_HAS_MORE_INPUT. zlib keeps its own window,
+ * so output is simply written at the position the caller passes. The
+ * decompressor needs no cleanup, like the real one: zlib allocates from an
+ * arena inside the struct.
+ *
+ * Author: icebear74
+ */
+
+#ifndef FAKE_ROM_MINIZ_H
+#define FAKE_ROM_MINIZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef unsigned char mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+  TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+  TINFL_FLAG_HAS_MORE_INPUT = 2,
+  TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+  TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum {
+  TINFL_STATUS_BAD_PARAM = -3,
+  TINFL_STATUS_ADLER32_MISMATCH = -2,
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+  mz_uint32 m_state;                // 0 = (re)start the stream
+  uint64_t stream[16];              // z_stream
+  size_t arenaUsed;
+  alignas(16) uint8_t arena[48 * 1024];
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->m_state = 0; } while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* inBuf, size_t* inBufSize,
+                              mz_uint8* outBufStart, mz_uint8* outBufNext, size_t* outBufSize,
+                              const mz_uint32 flags);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_ROM_MINIZ_H
@@ -0,0 +1,12 @@
+/**
+ * Sketch.cpp - The sketch (setup/loop) compiled for the host build
+ *
+ * The Arduino builder compiles Deckenlampe.ino as C++ after adding
+ * prototypes; every function in it is defined before use, so including
+ * it is all the host build needs.
+ *
+ * Author: icebear74
+ */
+
+#include <Arduino.h>
+#include "Deckenlampe.ino"
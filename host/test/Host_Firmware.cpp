@@ -0,0 +1,49 @@
+/**
+ * Host_Firmware.cpp - Run the sketch in a host test
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <unistd.h>
+
+void startFirmware() {
+  static bool started = false;
+  if (started) {
+    return;
+  }
+  started = true;
+  fakeClockManual(true);
+  setup();
+  fakeClockManual(false);
+}
+
+void runLoop(uint32_t iterations) {
+  while (iterations-- > 0) {
+    loop();
+  }
+}
+
+bool runLoopUntil(const std::function<bool()>& done, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (std::chrono::steady_clock::now() < deadline) {
+    loop();
+    if (done()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The firmware tasks (log, OTA writer, receivers) never end, like on the
+// lamp; static destructors must not run underneath them, so the test
+// process ends with _exit()
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  int result = RUN_ALL_TESTS();
+  fflush(stdout);
+  fflush(stderr);
+  _exit(result);
+}
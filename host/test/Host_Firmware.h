@@ -0,0 +1,42 @@
+/**
+ * Host_Firmware.h - Run the sketch in a host test
+ *
+ * ctest runs every test in its own process, so the firmware is set up once
+ * per process like on the lamp. Network addresses, MACs and the broker
+ * must be configured before startFirmware().
+ *
+ * Author: icebear74
+ */
+
+#ifndef HOST_FIRMWARE_H
+#define HOST_FIRMWARE_H
+
+#include <Fake_Host.h>
+#include <functional>
+
+// The sketch (host/sketch/Sketch.cpp)
+void setup();
+void loop();
+
+/**
+ * Run setup() once (later calls do nothing)
+ * setup() waits for the WiFi scan and NTP; it runs on the manual clock so
+ * those delays take no real time.
+ */
+void startFirmware();
+
+/**
+ * Run loop() for a number of iterations
+ */
+void runLoop(uint32_t iterations);
+
+/**
+ * Run loop() until a condition holds
+ *
+ * @param done Condition, checked after every iteration
+ * @param timeoutMs Real time limit
+ * @return true if the condition held within the limit
+ */
+bool runLoopUntil(const std::function<bool()>& done, uint32_t timeoutMs = 5000);
+
+#endif // HOST_FIRMWARE_H
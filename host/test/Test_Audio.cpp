@@ -0,0 +1,88 @@
+/**
+ * Test_Audio.cpp - Microphone capture timing and DSP levels
+ *
+ * Blocks are pushed into the fake I2S driver while the audio task is held
+ * (busy), so they wait in the DMA queue like on a loaded core 0. Their
+ * capture time must come from the receive interrupt, not from the read.
+ * The DSP part checks the level of loud input, which is shifted down
+ * before the FFT.
+ *
+ * Author: icebear74
+ */
+
+#include "Audio.h"
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+static const uint32_t BLOCK_MS = AUDIO_HOP_SIZE * 1000 / AUDIO_SAMPLE_RATE;
+
+// Wait (real time) until the audio task has published a block count
+static bool waitForBlock(uint32_t block, AudioFeatures& features) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (getAudioFeatures(features) && features.block >= block) {
+      return features.block == block;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+// Push blocks BLOCK_MS apart on the manual clock, return the time of the last
+static uint32_t pushBlocks(int count) {
+  std::vector<int32_t> block(AUDIO_HOP_SIZE, 0);
+  uint32_t lastUs = 0;
+  for (int i = 0; i < count; i++) {
+    fakeClockAdvanceMs(BLOCK_MS);
+    lastUs = micros();
+    fakeI2sPush(block.data(), block.size());
+  }
+  return lastUs;
+}
+
+TEST(Audio, CaptureTimeFromReceiveInterrupt) {
+  fakeClockManual(true);
+  setupAudio();
+  ASSERT_TRUE(getAudioStats().running);
+  AudioFeatures features;
+
+  // Three blocks queue up, the task reads them 40 ms after the last one
+  fakeI2sHold(true);
+  uint32_t lastUs = pushBlocks(3);
+  fakeClockAdvanceMs(40);
+  fakeI2sHold(false);
+  ASSERT_TRUE(waitForBlock(3, features));
+  EXPECT_EQ(features.captureUs, lastUs);
+
+  // The queue overflows: the driver drops the two oldest blocks
+  fakeI2sHold(true);
+  lastUs = pushBlocks(AUDIO_DMA_BUFFERS + 2);
+  EXPECT_EQ(fakeI2sQueued(), (size_t)AUDIO_DMA_BUFFERS);
+  fakeClockAdvanceMs(40);
+  fakeI2sHold(false);
+  ASSERT_TRUE(waitForBlock(3 + AUDIO_DMA_BUFFERS, features));
+  EXPECT_EQ(features.captureUs, lastUs);
+}
+
+TEST(Audio, LoudInputKeepsItsLevel) {
+  setupAudioDsp();
+  AudioFeatures features = {};
+  int16_t samples[AUDIO_HOP_SIZE];
+  uint32_t n = 0;
+  // Full-scale tone in band 4 (bin 40, 1250 Hz), then the same 6 dB lower
+  for (int block = 0; block < 26; block++) {
+    double amplitude = block < 20 ? 32767 : 16384;
+    for (int i = 0; i < AUDIO_HOP_SIZE; i++, n++) {
+      samples[i] = (int16_t)lround(amplitude * sin(2 * M_PI * 40 * n / AUDIO_FFT_SIZE));
+    }
+    audioDspProcess(samples, block * BLOCK_MS * 1000, features);
+    if (block == 19) {
+      EXPECT_EQ(features.bands[4], 255);
+    }
+  }
+  // The band peak holds: 6 dB below it in a 40 dB range
+  EXPECT_NEAR(features.bands[4], 255 * 34 / 40, 4);
+}
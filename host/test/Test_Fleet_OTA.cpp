@@ -0,0 +1,297 @@
+/**
+ * Test_Fleet_OTA.cpp - Fleet OTA receiver against a sender in the test
+ *
+ * The test multicasts a newer (signed) image to the receiver on loopback
+ * and answers its NACKs like fleet-ota.py. Erasing a flash sector takes
+ * real time, so a receiver that erases in the main loop shows up as a
+ * long handleFleetOta() call. The OTA partition starts out full of an
+ * old image: blocks written before their sector is erased corrupt it.
+ * Web uploads (OTA_Writer) write the same partition, so a fleet session
+ * and a writer session must never overlap.
+ *
+ * Author: icebear74
+ */
+
+#include "Fleet_OTA.h"
+#include "OTA_Writer.h"
+#include <AsyncUDP.h>
+#include <Fake_Host.h>
+#include <esp_ota_ops.h>
+#include <gtest/gtest.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+static const size_t IMAGE_SIZE = 200 * 1024;
+static const uint32_t ERASE_DELAY_US = 2000;  // 200 KB: ~100 ms of erasing
+
+static uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class TestSender {
+public:
+  explicit TestSender(const std::vector<uint8_t>& firmware) : image(firmware) {
+    announce.header.magic = FLEET_OTA_MAGIC;
+    announce.header.version = FLEET_OTA_VERSION;
+    announce.header.session = 0x5E55107A;
+    announce.imageSize = image.size();
+    announce.blockSize = FLEET_OTA_BLOCK_SIZE;
+    strlcpy(announce.firmwareVersion, "99.0.0", sizeof(announce.firmwareVersion));
+    SHA256(image.data(), image.size(), announce.sha256);
+    udp.onPacket([this](AsyncUDPPacket& packet) { receive(packet); });
+    udp.listen(0);
+  }
+
+  FleetOtaAnnounce announce = {};
+  uint32_t nacks = 0;
+  int done = -1;  // DONE result, -1 = none yet
+
+  uint32_t blockCount() const { return (image.size() + FLEET_OTA_BLOCK_SIZE - 1) / FLEET_OTA_BLOCK_SIZE; }
+
+  void sendAnnounce(uint8_t type) {
+    FleetOtaAnnounce packet = announce;
+    packet.header.type = type;
+    udp.writeTo(reinterpret_cast<const uint8_t*>(&packet), sizeof(packet), FLEET_OTA_MULTICAST_IP, FLEET_OTA_PORT);
+  }
+
+  void sendBlock(uint32_t block) {
+    uint32_t offset = block * FLEET_OTA_BLOCK_SIZE;
+    size_t len = std::min((size_t)FLEET_OTA_BLOCK_SIZE, image.size() - offset);
+    std::vector<uint8_t> packet(sizeof(FleetOtaData) + len);
+    FleetOtaData* data = reinterpret_cast<FleetOtaData*>(packet.data());
+    data->header = announce.header;
+    data->header.type = FLEET_OTA_DATA;
+    data->block = block;
+    memcpy(packet.data() + sizeof(FleetOtaData), image.data() + offset, len);
+    udp.writeTo(packet.data(), packet.size(), FLEET_OTA_MULTICAST_IP, FLEET_OTA_PORT);
+  }
+
+  // Blocks of the next round (all at first, then the union of the NACKs)
+  std::vector<uint32_t> takeMissing(bool all) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> blocks;
+    for (uint32_t block = 0; block < blockCount(); block++) {
+      if (all || (block / 8 < missing.size() && (missing[block / 8] & (1 << (block % 8))))) {
+        blocks.push_back(block);
+      }
+    }
+    missing.clear();
+    return blocks;
+  }
+
+private:
+  std::vector<uint8_t> image;
+  AsyncUDP udp;
+  std::mutex mutex;
+  std::vector<uint8_t> missing;
+
+  void receive(AsyncUDPPacket& packet) {
+    const FleetOtaHeader* header = reinterpret_cast<const FleetOtaHeader*>(packet.data());
+    if (packet.length() < sizeof(FleetOtaHeader) || header->session != announce.header.session) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (header->type == FLEET_OTA_NACK && packet.length() >= sizeof(FleetOtaNack)) {
+      nacks++;
+      missing.resize(std::max(missing.size(), packet.length() - sizeof(FleetOtaNack)));
+      for (size_t i = sizeof(FleetOtaNack); i < packet.length(); i++) {
+        missing[i - sizeof(FleetOtaNack)] |= packet.data()[i];
+      }
+    } else if (header->type == FLEET_OTA_DONE && packet.length() >= sizeof(FleetOtaDone)) {
+      done = reinterpret_cast<const FleetOtaDone*>(packet.data())->ok;
+    }
+  }
+};
+
+// Run the receiver for a while (real time), return the longest handleFleetOta() call
+static uint64_t runReceiver(uint32_t ms) {
+  uint64_t longest = 0;
+  uint64_t end = nowUs() + ms * 1000ULL;
+  while (nowUs() < end) {
+    uint64_t start = nowUs();
+    handleFleetOta();
+    longest = std::max(longest, nowUs() - start);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return longest;
+}
+
+// ECDSA P-256 key pair; the public key goes into OTA_PUBLIC_KEY_PEM
+static std::string makeKey(EVP_PKEY** key) {
+  *key = EVP_EC_gen("P-256");
+  BIO* bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_PUBKEY(bio, *key);
+  char* pem = nullptr;
+  long len = BIO_get_mem_data(bio, &pem);
+  std::string text(pem, len);
+  BIO_free(bio);
+  return text;
+}
+
+static void sign(EVP_PKEY* key, FleetOtaAnnounce& announce) {
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(key, nullptr);
+  size_t sigLen = OTA_SIGNATURE_MAX_LEN;
+  ASSERT_EQ(EVP_PKEY_sign_init(ctx), 1);
+  ASSERT_EQ(EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()), 1);
+  ASSERT_EQ(EVP_PKEY_sign(ctx, announce.signature, &sigLen, announce.sha256, sizeof(announce.sha256)), 1);
+  announce.sigLen = sigLen;
+  EVP_PKEY_CTX_free(ctx);
+}
+
+static void startReceiver() {
+  fakeFlashReset();
+  fakeWiFiSetLocalIP(IPAddress(127, 0, 0, 1));
+  // Old image in the OTA partition: nothing may be written before it is erased
+  const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+  memset(fakeFlashData(target), 0x00, target->size);
+  setupFleetOta();
+}
+
+// Send the blocks in rounds until the receiver reports DONE; returns the
+// longest handleFleetOta() call. The first round goes out right away, most
+// blocks arrive before their sector is erased.
+static uint64_t runSession(TestSender& sender) {
+  uint64_t longest = 0;
+  for (int round = 0; round < FLEET_OTA_MAX_ROUNDS && sender.done < 0; round++) {
+    for (uint32_t block : sender.takeMissing(round == 0)) {
+      sender.sendBlock(block);
+      if (block % 16 == 15) {
+        longest = std::max(longest, runReceiver(1));
+      }
+    }
+    sender.sendAnnounce(FLEET_OTA_END);
+    longest = std::max(longest, runReceiver(FLEET_OTA_NACK_JITTER_MS + 150));
+  }
+  return longest;
+}
+
+TEST(FleetOta, SignedImageErasedInBackground) {
+  EVP_PKEY* key = nullptr;
+  std::string pem = makeKey(&key);
+  OTA_PUBLIC_KEY_PEM = pem.c_str();
+  startReceiver();
+  std::vector<uint8_t> image = fakeAppImage(IMAGE_SIZE, 7);
+  TestSender sender(image);
+  sign(key, sender.announce);
+  fakeFlashEraseDelayUs(ERASE_DELAY_US);
+
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  uint64_t longest = runReceiver(50);
+  ASSERT_EQ(getFleetOtaState(), FLEET_OTA_RECEIVING);
+  longest = std::max(longest, runSession(sender));
+
+  EXPECT_EQ(sender.done, 1);
+  EXPECT_GT(sender.nacks, 0u);
+  EXPECT_GT(getFleetOtaStats().blocksBeforeErase, 0u);
+  EXPECT_EQ(getFleetOtaStats().blocksReceived, sender.blockCount());
+  // The erase (~100 ms) never ran inside the loop
+  EXPECT_LT(longest, IMAGE_SIZE / SPI_FLASH_SEC_SIZE * ERASE_DELAY_US / 4);
+
+  const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+  EXPECT_EQ(fakeBootPartition(), target);
+  EXPECT_EQ(memcmp(fakeFlashData(target), image.data(), image.size()), 0);
+  EXPECT_EQ(memcmp(fakeFlashData(target) + image.size(), OTA_SIGNATURE_MAGIC, 4), 0);
+  EVP_PKEY_free(key);
+}
+
+TEST(FleetOta, UnsignedSessionIgnoredWithoutKey) {
+  OTA_PUBLIC_KEY_PEM = "";
+  startReceiver();
+  TestSender sender(fakeAppImage(IMAGE_SIZE, 7));
+
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(100);
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(100);
+  EXPECT_EQ(getFleetOtaState(), FLEET_OTA_IDLE);
+  EXPECT_EQ(fakeFlashEraseCount(), 0u);
+}
+
+TEST(FleetOta, UnsignedImageIgnoredWithKey) {
+  EVP_PKEY* key = nullptr;
+  std::string pem = makeKey(&key);
+  OTA_PUBLIC_KEY_PEM = pem.c_str();
+  startReceiver();
+  TestSender sender(fakeAppImage(IMAGE_SIZE, 7));
+
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(100);
+  EXPECT_EQ(getFleetOtaState(), FLEET_OTA_IDLE);
+  EXPECT_EQ(fakeFlashEraseCount(), 0u);
+  EVP_PKEY_free(key);
+}
+
+TEST(FleetOta, AnnounceIgnoredDuringWriterSession) {
+  EVP_PKEY* key = nullptr;
+  std::string pem = makeKey(&key);
+  OTA_PUBLIC_KEY_PEM = pem.c_str();
+  startReceiver();
+  std::vector<uint8_t> upload = fakeAppImage(IMAGE_SIZE, 3);
+  ASSERT_TRUE(otaWriterBegin());
+  ASSERT_TRUE(otaWriterWrite(upload.data(), IMAGE_SIZE / 2));
+
+  TestSender sender(fakeAppImage(IMAGE_SIZE, 7));
+  sign(key, sender.announce);
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(100);
+  EXPECT_EQ(getFleetOtaState(), FLEET_OTA_IDLE);
+
+  ASSERT_TRUE(otaWriterWrite(upload.data() + IMAGE_SIZE / 2, IMAGE_SIZE - IMAGE_SIZE / 2));
+  ASSERT_TRUE(otaWriterEnd());
+  const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+  EXPECT_EQ(fakeBootPartition(), target);
+  EXPECT_EQ(memcmp(fakeFlashData(target), upload.data(), upload.size()), 0);
+
+  // The uploaded image waits for the reboot: no session may overwrite it
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(100);
+  EXPECT_EQ(getFleetOtaState(), FLEET_OTA_IDLE);
+  EXPECT_EQ(otaPartitionOwner(), OTA_OWNER_WRITER);
+  EVP_PKEY_free(key);
+}
+
+TEST(FleetOta, WriterRefusedDuringFleetSession) {
+  EVP_PKEY* key = nullptr;
+  std::string pem = makeKey(&key);
+  OTA_PUBLIC_KEY_PEM = pem.c_str();
+  startReceiver();
+  std::vector<uint8_t> image = fakeAppImage(IMAGE_SIZE, 7);
+  TestSender sender(image);
+  sign(key, sender.announce);
+
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(50);
+  ASSERT_EQ(getFleetOtaState(), FLEET_OTA_RECEIVING);
+  EXPECT_FALSE(otaWriterBegin());
+  EXPECT_FALSE(otaWriterRunning());
+  EXPECT_EQ(otaPartitionOwner(), OTA_OWNER_FLEET);
+
+  runSession(sender);
+  EXPECT_EQ(sender.done, 1);
+  const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+  EXPECT_EQ(fakeBootPartition(), target);
+  EXPECT_EQ(memcmp(fakeFlashData(target), image.data(), image.size()), 0);
+  EVP_PKEY_free(key);
+}
+
+TEST(FleetOta, AbortedWriterReleasesPartition) {
+  EVP_PKEY* key = nullptr;
+  std::string pem = makeKey(&key);
+  OTA_PUBLIC_KEY_PEM = pem.c_str();
+  startReceiver();
+  ASSERT_TRUE(otaWriterBegin());
+  otaWriterAbort();
+  EXPECT_EQ(otaPartitionOwner(), OTA_OWNER_NONE);
+
+  TestSender sender(fakeAppImage(IMAGE_SIZE, 7));
+  sign(key, sender.announce);
+  sender.sendAnnounce(FLEET_OTA_ANNOUNCE);
+  runReceiver(50);
+  EXPECT_EQ(getFleetOtaState(), FLEET_OTA_RECEIVING);
+  EVP_PKEY_free(key);
+}
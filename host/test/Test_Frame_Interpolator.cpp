@@ -0,0 +1,94 @@
+/**
+ * Test_Frame_Interpolator.cpp - DDP frames through the jitter buffer
+ *
+ * Packets are decoded directly (no sockets) on the manual clock, then the
+ * playout time is moved past the last frame so the renderer holds it.
+ *
+ * Author: icebear74
+ */
+
+#include "Frame_Interpolator.h"
+#include "Pixel_Stream.h"
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+
+static const uint16_t PIXELS = 40;
+
+static void startStreamTest() {
+  fakeClockManual(true);
+  fakeClockAdvanceMs(1000);
+  setupPixelStream(PIXELS);
+}
+
+// DDP packet with push flag, filling pixels [first, first + n) with one color
+static void sendDDP(uint8_t seq, uint16_t first, uint16_t n, CRGB color) {
+  std::vector<uint8_t> packet(DDP_HEADER_LEN + n * 3);
+  uint32_t offset = first * 3;
+  packet[0] = DDP_FLAGS_VER1 | DDP_FLAGS_PUSH;
+  packet[1] = seq;
+  packet[3] = DDP_ID_DISPLAY;
+  packet[4] = offset >> 24;
+  packet[5] = offset >> 16;
+  packet[6] = offset >> 8;
+  packet[7] = offset;
+  packet[8] = (n * 3) >> 8;
+  packet[9] = n * 3;
+  for (uint16_t i = 0; i < n; i++) {
+    memcpy(&packet[DDP_HEADER_LEN + i * 3], color.raw, 3);
+  }
+  ASSERT_TRUE(decodeDDPPacket(packet.data(), packet.size()));
+}
+
+// Render once the playout time has passed every buffered frame
+static std::vector<CRGB> renderLatest() {
+  std::vector<CRGB> out(PIXELS);
+  fakeClockAdvanceMs(PLAYOUT_DELAY_MS + STREAM_RENDER_INTERVAL_MS);
+  EXPECT_TRUE(renderInterpolatedFrame(out.data()));
+  return out;
+}
+
+TEST(FrameInterpolator, PartialDdpFrameKeepsOtherPixels) {
+  startStreamTest();
+  sendDDP(1, 0, PIXELS, CRGB(10, 20, 30));
+  fakeClockAdvanceMs(20);
+  // Only the first quarter changes; the recycled slot must not show through
+  sendDDP(2, 0, PIXELS / 4, CRGB(200, 0, 0));
+  std::vector<CRGB> out = renderLatest();
+  for (uint16_t i = 0; i < PIXELS; i++) {
+    CRGB expected = i < PIXELS / 4 ? CRGB(200, 0, 0) : CRGB(10, 20, 30);
+    EXPECT_EQ(out[i], expected) << "pixel " << i;
+  }
+  EXPECT_EQ(getFrameInterpolatorStats().framesQueued, 2u);
+}
+
+TEST(FrameInterpolator, LostPacketFrameIsNotABase) {
+  startStreamTest();
+  sendDDP(1, 0, PIXELS, CRGB(10, 20, 30));
+  fakeClockAdvanceMs(20);
+  sendDDP(3, 0, PIXELS / 2, CRGB(0, 0, 99));  // Sequence 2 lost: frame dropped
+  fakeClockAdvanceMs(20);
+  sendDDP(4, PIXELS / 2, PIXELS / 2, CRGB(0, 99, 0));
+  std::vector<CRGB> out = renderLatest();
+  EXPECT_EQ(out[0], CRGB(10, 20, 30));
+  EXPECT_EQ(out[PIXELS - 1], CRGB(0, 99, 0));
+  EXPECT_EQ(getPixelStreamStats().droppedFrames, 1u);
+}
+
+TEST(FrameInterpolator, FirstFrameOfNewStreamIsShown) {
+  startStreamTest();
+  sendDDP(1, 0, PIXELS, CRGB(10, 20, 30));
+  sendDDP(2, 0, PIXELS, CRGB(40, 50, 60));
+  renderLatest();
+
+  fakeClockAdvanceMs(PIXEL_STREAM_TIMEOUT_MS + 1);
+  handlePixelStream();
+  ASSERT_FALSE(pixelStreamActive());
+
+  // A single frame makes up the whole second stream
+  sendDDP(1, 0, PIXELS, CRGB(1, 2, 3));
+  EXPECT_TRUE(pixelStreamActive());
+  std::vector<CRGB> out = renderLatest();
+  for (uint16_t i = 0; i < PIXELS; i++) {
+    EXPECT_EQ(out[i], CRGB(1, 2, 3)) << "pixel " << i;
+  }
+}
@@ -0,0 +1,153 @@
+/**
+ * Test_Group_Sync.cpp - Several lamps syncing over loopback multicast
+ *
+ * Every lamp is a forked process with its own address (127.0.0.N), MAC and
+ * wall clock error. The lamps elect a leader (whichever times out first),
+ * the leader starts an effect, and at a common moment every lamp reports
+ * its group clock and effect frame through a pipe. A lamp that joins later
+ * must follow the running leader before its own leader timeout.
+ *
+ * Author: icebear74
+ */
+
+#include "Group_Sync.h"
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+static const int LAMPS = 3;
+static const int64_t SKEW_US[LAMPS] = { 0, 30000, -400000 };  // Slewed and stepped
+static const EffectParams TEST_EFFECT = { EFFECT_CROSSFADE, 0, 2000, { 10, 20, 30 }, { 40, 50, 60 } };
+
+struct LampReport {
+  uint32_t deviceId;
+  uint8_t role;
+  uint32_t leaderId;
+  uint32_t beaconsReceived;
+  bool effectAdopted;
+  int64_t groupMinusHostMs;  // Group clock relative to the (shared) host clock
+  uint32_t frameIndex;
+};
+
+static int64_t hostMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void runLamp(int index, int64_t startAtMs, int64_t announceAtMs, int64_t reportAtMs, int fd) {
+  while (hostMs() < startAtMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  uint8_t mac[6] = { 0x02, 0xDE, 0xC0, 0x00, 0x10, (uint8_t)(index + 1) };
+  fakeWiFiSetMac(mac);
+  fakeWiFiSetLocalIP(IPAddress(127, 0, 0, 2 + index));
+  fakeWallClockSkewUs(SKEW_US[index]);
+  setupGroupSync();
+
+  bool announced = false;
+  while (hostMs() < reportAtMs) {
+    handleGroupSync();
+    if (!announced && hostMs() >= announceAtMs && getGroupSyncRole() == GROUP_ROLE_LEADER) {
+      setGroupEffect(TEST_EFFECT);
+      announced = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  LampReport report = {};
+  report.frameIndex = effectFrameIndex();
+  report.groupMinusHostMs = groupClockMs() - hostMs();
+  report.deviceId = (uint32_t)(ESP.getEfuseMac() >> 16);
+  report.role = getGroupSyncRole();
+  report.leaderId = getGroupSyncStats().leaderId;
+  report.beaconsReceived = getGroupSyncStats().beaconsReceived;
+  report.effectAdopted = effectParamsEqual(getActiveEffect(), TEST_EFFECT);
+  _exit(write(fd, &report, sizeof(report)) == sizeof(report) ? 0 : 1);
+}
+
+TEST(GroupSync, LampsOnLoopbackShareLeaderAndTimeline) {
+  // Leader timeout plus stagger, then time for the effect and the slew
+  int64_t announceAtMs = hostMs() + GROUP_SYNC_LEADER_TIMEOUT_MS + 1024 + 1000;
+  int64_t reportAtMs = announceAtMs + 1500;
+  int pipes[LAMPS][2];
+  pid_t pids[LAMPS];
+  for (int i = 0; i < LAMPS; i++) {
+    ASSERT_EQ(pipe(pipes[i]), 0);
+    pids[i] = fork();
+    ASSERT_GE(pids[i], 0);
+    if (pids[i] == 0) {
+      runLamp(i, 0, announceAtMs, reportAtMs, pipes[i][1]);
+    }
+    close(pipes[i][1]);
+  }
+
+  LampReport reports[LAMPS];
+  for (int i = 0; i < LAMPS; i++) {
+    ASSERT_EQ(read(pipes[i][0], &reports[i], sizeof(LampReport)), (ssize_t)sizeof(LampReport)) << "lamp " << i;
+    close(pipes[i][0]);
+    int status = 0;
+    waitpid(pids[i], &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << "lamp " << i;
+  }
+
+  int leader = -1;
+  for (int i = 0; i < LAMPS; i++) {
+    if (reports[i].role == GROUP_ROLE_LEADER) {
+      EXPECT_EQ(leader, -1) << "lamps " << leader << " and " << i << " both lead";
+      leader = i;
+    }
+  }
+  ASSERT_NE(leader, -1);
+
+  for (int i = 0; i < LAMPS; i++) {
+    SCOPED_TRACE(testing::Message() << "lamp " << i << ", leader " << leader);
+    EXPECT_EQ(reports[i].leaderId, reports[leader].deviceId);
+    EXPECT_TRUE(reports[i].effectAdopted);
+    // Followers run on the leader's timeline despite their own clock errors
+    EXPECT_NEAR(reports[i].groupMinusHostMs, reports[leader].groupMinusHostMs, 3);
+    EXPECT_NEAR(reports[i].frameIndex, reports[leader].frameIndex, 2);
+    if (i != leader) {
+      EXPECT_EQ(reports[i].role, GROUP_ROLE_FOLLOWER);
+      EXPECT_GT(reports[i].beaconsReceived, 0u);
+    }
+  }
+}
+
+TEST(GroupSync, JoiningLampFollowsRunningLeader) {
+  // Lamp 0 leads and plays the effect before lamp 1 starts; lamp 1 reports
+  // before its own leader timeout could have elected anyone
+  int64_t announceAtMs = hostMs() + GROUP_SYNC_LEADER_TIMEOUT_MS + 1024 + 500;
+  int64_t joinAtMs = announceAtMs + 500;
+  int64_t reportAtMs = joinAtMs + GROUP_SYNC_LEADER_TIMEOUT_MS - 1000;
+  int pipes[2][2];
+  pid_t pids[2];
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(pipe(pipes[i]), 0);
+    pids[i] = fork();
+    ASSERT_GE(pids[i], 0);
+    if (pids[i] == 0) {
+      runLamp(i, i == 0 ? 0 : joinAtMs, announceAtMs, reportAtMs, pipes[i][1]);
+    }
+    close(pipes[i][1]);
+  }
+
+  LampReport reports[2];
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(read(pipes[i][0], &reports[i], sizeof(LampReport)), (ssize_t)sizeof(LampReport)) << "lamp " << i;
+    close(pipes[i][0]);
+    int status = 0;
+    waitpid(pids[i], &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << "lamp " << i;
+  }
+
+  ASSERT_EQ(reports[0].role, GROUP_ROLE_LEADER);
+  EXPECT_EQ(reports[1].role, GROUP_ROLE_FOLLOWER);
+  EXPECT_EQ(reports[1].leaderId, reports[0].deviceId);
+  EXPECT_GT(reports[1].beaconsReceived, 0u);
+  EXPECT_TRUE(reports[1].effectAdopted);
+  EXPECT_NEAR(reports[1].groupMinusHostMs, reports[0].groupMinusHostMs, 3);
+  EXPECT_NEAR(reports[1].frameIndex, reports[0].frameIndex, 2);
+}
@@ -0,0 +1,423 @@
+/**
+ * Test_MQTT.cpp - MQTT client against a minimal in-test broker
+ *
+ * The broker speaks enough MQTT 3.1.1 (QoS 0) for one client on
+ * 127.0.0.1:MQTT_BROKER_PORT. It parses every byte the lamp sends, so a
+ * control packet written into the middle of a queued one shows up as a
+ * malformed stream.
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include "Lamp_Control.h"
+#include "MQTT_Client.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <map>
+
+struct MqttPacket {
+  uint8_t type;
+  std::string body;
+};
+
+class TestBroker {
+public:
+  TestBroker() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(MQTT_BROKER_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listening = bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+                listen(listenFd, 1) == 0;
+  }
+
+  ~TestBroker() {
+    disconnect();
+    close(listenFd);
+  }
+
+  bool listening = false;
+  bool malformed = false;
+  uint8_t connectFlags = 0;
+  bool clientClosed = false;
+  std::vector<MqttPacket> packets;        // Everything received, in order
+  std::map<std::string, std::string> retained;
+
+  // Accept the client and read what it sent; call from runLoopUntil()
+  void poll() {
+    if (clientFd < 0) {
+      pollfd pfd = { listenFd, POLLIN, 0 };
+      if (::poll(&pfd, 1, 0) == 1) {
+        clientFd = accept(listenFd, nullptr, nullptr);
+        clientClosed = false;
+      }
+      return;
+    }
+    uint8_t buffer[1024];
+    pollfd pfd = { clientFd, POLLIN, 0 };
+    while (::poll(&pfd, 1, 0) == 1) {
+      ssize_t n = recv(clientFd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        disconnect();
+        clientClosed = true;
+        return;
+      }
+      stream.append(reinterpret_cast<char*>(buffer), n);
+    }
+    parse();
+  }
+
+  void send(uint8_t type, const std::string& body) {
+    std::string packet(1, (char)type);
+    size_t remaining = body.size();
+    do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      packet += (char)(digit | (remaining > 0 ? 0x80 : 0));
+    } while (remaining > 0);
+    packet += body;
+    ::send(clientFd, packet.data(), packet.size(), MSG_NOSIGNAL);
+  }
+
+  void publish(const std::string& topic, const std::string& payload) {
+    send(0x30, mqttString(topic) + payload);
+  }
+
+  size_t count(uint8_t type) const {
+    size_t n = 0;
+    for (const MqttPacket& packet : packets) {
+      n += (packet.type & 0xF0) == type;
+    }
+    return n;
+  }
+
+  bool connected() const { return clientFd >= 0; }
+
+  static std::string mqttString(const std::string& s) {
+    return std::string(1, (char)(s.size() >> 8)) + (char)(s.size() & 0xFF) + s;
+  }
+
+private:
+  int listenFd = -1;
+  int clientFd = -1;
+  std::string stream;
+
+  void disconnect() {
+    if (clientFd >= 0) {
+      close(clientFd);
+      clientFd = -1;
+    }
+    stream.clear();
+  }
+
+  static std::string readString(const std::string& body, size_t& pos) {
+    size_t len = ((uint8_t)body[pos] << 8) | (uint8_t)body[pos + 1];
+    std::string s = body.substr(pos + 2, len);
+    pos += 2 + len;
+    return s;
+  }
+
+  void parse() {
+    while (stream.size() >= 2) {
+      size_t remaining = 0;
+      size_t multiplier = 1;
+      size_t pos = 1;
+      bool complete = false;
+      while (pos < stream.size() && pos <= 4) {
+        uint8_t digit = stream[pos++];
+        remaining += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+        if ((digit & 0x80) == 0) {
+          complete = true;
+          break;
+        }
+      }
+      if (!complete || stream.size() < pos + remaining) {
+        return;
+      }
+      MqttPacket packet = { (uint8_t)stream[0], stream.substr(pos, remaining) };
+      stream.erase(0, pos + remaining);
+      packets.push_back(packet);
+      handle(packet);
+    }
+  }
+
+  void handle(const MqttPacket& packet) {
+    size_t pos = 0;
+    switch (packet.type & 0xF0) {
+      case 0x10:  // CONNECT; a password needs a user name (3.1.2.9)
+        connectFlags = packet.body.size() > 7 ? packet.body[7] : 0;
+        if ((connectFlags & 0x40) && !(connectFlags & 0x80)) {
+          malformed = true;
+          disconnect();
+          return;
+        }
+        send(0x20, std::string("\0\0", 2));
+        break;
+      case 0x30: {  // PUBLISH (QoS 0)
+        std::string topic = readString(packet.body, pos);
+        if (topic.empty() || topic.size() > packet.body.size()) {
+          malformed = true;
+        } else if (packet.type & 0x01) {
+          retained[topic] = packet.body.substr(pos);
+        }
+        break;
+      }
+      case 0x80:  // SUBSCRIBE
+        send(0x90, packet.body.substr(0, 2) + std::string("\0\0\0", 3));
+        break;
+      case 0xC0:  // PINGREQ
+        if (!packet.body.empty()) {
+          malformed = true;
+        }
+        send(0xD0, "");
+        break;
+      default:
+        malformed = true;  // Nothing else may come from a QoS 0 client
+        break;
+    }
+  }
+};
+
+static std::string baseTopic() {
+  return std::string(MQTT_TOPIC_PREFIX "/") + WiFi.getHostname();
+}
+
+static void connectLamp(TestBroker& broker) {
+  ASSERT_TRUE(broker.listening);
+  MQTT_BROKER_HOST = "127.0.0.1";
+  startFirmware();
+  ASSERT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return mqttConnected() && broker.retained.count(baseTopic() + "/state") > 0;
+  }));
+}
+
+TEST(Mqtt, BrokerRoundTrip) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  ASSERT_GE(broker.packets.size(), 2u);
+  const std::string& connect = broker.packets[0].body;
+  EXPECT_EQ(broker.packets[0].type, 0x10);
+  EXPECT_EQ(connect.substr(0, 7), TestBroker::mqttString("MQTT") + '\x04');
+  EXPECT_NE(connect.find(TestBroker::mqttString(baseTopic() + "/availability")), std::string::npos);
+  EXPECT_EQ(broker.packets[1].type, 0x82);
+  EXPECT_NE(broker.packets[1].body.find(TestBroker::mqttString(baseTopic() + "/set")), std::string::npos);
+
+  EXPECT_EQ(broker.retained[baseTopic() + "/availability"], "online");
+  std::string discovery = std::string(MQTT_DISCOVERY_PREFIX "/light/") + WiFi.getHostname() + "/config";
+  EXPECT_NE(broker.retained[discovery].find("\"cmd_t\":\"~/set\""), std::string::npos);
+
+  // Command in, coalesced state out
+  broker.publish(baseTopic() + "/brightness/set", "42");
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.retained[baseTopic() + "/brightness"] == "42";
+  }));
+  EXPECT_EQ(getLampState().brightness, 42);
+  EXPECT_EQ(getMqttStats().received, 1u);
+  EXPECT_FALSE(broker.malformed);
+}
+
+TEST(Mqtt, PasswordOnlyWithUsername) {
+  TestBroker broker;
+  MQTT_PASSWORD = "secret";
+  connectLamp(broker);
+  EXPECT_EQ(broker.connectFlags & 0xC0, 0);
+  EXPECT_EQ(broker.packets[0].body.find("secret"), std::string::npos);
+  EXPECT_FALSE(broker.malformed);
+}
+
+TEST(Mqtt, UsernameAndPassword) {
+  TestBroker broker;
+  MQTT_USERNAME = "lamp";
+  MQTT_PASSWORD = "secret";
+  connectLamp(broker);
+  EXPECT_EQ(broker.connectFlags & 0xC0, 0xC0);
+  const std::string& connect = broker.packets[0].body;
+  EXPECT_EQ(connect.substr(connect.size() - 14), TestBroker::mqttString("lamp") + TestBroker::mqttString("secret"));
+}
+
+TEST(Mqtt, BrokerNameResolvedWithoutBlocking) {
+  TestBroker broker;
+  ASSERT_TRUE(broker.listening);
+  fakeDnsHold(true);
+  MQTT_BROKER_HOST = "localhost";
+  startFirmware();
+  runLoop(20);
+  broker.poll();
+  EXPECT_FALSE(broker.connected());
+
+  fakeDnsHold(false);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return mqttConnected();
+  }));
+  EXPECT_EQ(getMqttStats().connectFailures, 0u);
+}
+
+TEST(Mqtt, ConnectToSilentBrokerDoesNotBlockLoop) {
+  // A listener whose accept backlog is full drops further SYNs, so the
+  // lamp's connect neither completes nor fails until its timeout
+  TestBroker broker;
+  ASSERT_TRUE(broker.listening);
+  std::vector<int> fillers;
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(MQTT_BROKER_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < 4; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    fillers.push_back(fd);
+  }
+  usleep(50000);
+
+  MQTT_BROKER_HOST = "127.0.0.1";
+  startFirmware();
+  unsigned long longest = 0;
+  unsigned long start = millis();
+  while (getMqttStats().connectFailures == 0 && millis() - start < 3000) {
+    unsigned long before = millis();
+    runLoop(1);
+    longest = std::max(longest, millis() - before);
+  }
+  EXPECT_EQ(getMqttStats().connectFailures, 1u);
+  EXPECT_LT(longest, MQTT_CONNECT_TIMEOUT_MS / 4);
+  EXPECT_FALSE(mqttConnected());
+  for (int fd : fillers) {
+    close(fd);
+  }
+}
+
+TEST(Mqtt, KeepAlivePing) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  fakeClockManual(true);
+  fakeClockAdvanceMs(MQTT_KEEPALIVE_S * 500UL + 1);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.count(0xC0) == 1;
+  }));
+  // Without the PINGRESP the next idle period would end in a keep-alive timeout
+  runLoopUntil([&]() { broker.poll(); return false; }, 200);
+  fakeClockAdvanceMs(MQTT_KEEPALIVE_S * 500UL + 1);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.count(0xC0) == 2;
+  }));
+  EXPECT_TRUE(mqttConnected());
+  EXPECT_FALSE(broker.malformed);
+}
+
+TEST(Mqtt, NoPingAfterWriteInLaterMillisecond) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  // Every write lands in the next millisecond, after the loop read millis()
+  fakeClockManual(true);
+  fakeWiFiClientWriteLimit([](size_t size) -> size_t {
+    fakeClockAdvanceMs(1);
+    return size;
+  });
+  setLampBrightness(9);
+  runLoop(1);
+  fakeClockAdvanceMs(MQTT_STATE_COALESCE_MS + 1);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.retained[baseTopic() + "/brightness"] == "9";
+  }));
+  runLoopUntil([&]() { broker.poll(); return false; }, 200);
+  fakeWiFiClientWriteLimit(nullptr);
+
+  EXPECT_EQ(broker.count(0xC0), 0u);
+  EXPECT_TRUE(mqttConnected());
+  EXPECT_FALSE(broker.malformed);
+}
+
+TEST(Mqtt, NoPingInsidePartlyWrittenPacket) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  // The send buffer takes 3 bytes of the next publish, then only ever has
+  // room for a 2-byte packet (as if it drained between two writes)
+  size_t budget = 3;
+  fakeWiFiClientWriteLimit([&budget](size_t size) -> size_t {
+    if (budget > 0) {
+      size_t n = std::min(size, budget);
+      budget -= n;
+      return n;
+    }
+    return size <= 2 ? size : 0;
+  });
+  fakeClockManual(true);
+  setLampBrightness(7);
+  runLoop(1);
+  fakeClockAdvanceMs(MQTT_STATE_COALESCE_MS + 1);
+  runLoop(5);
+  ASSERT_EQ(budget, 0u);
+  fakeClockAdvanceMs(MQTT_KEEPALIVE_S * 500UL + 1);
+  runLoop(5);
+
+  fakeWiFiClientWriteLimit(nullptr);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.retained[baseTopic() + "/brightness"] == "7";
+  }));
+  EXPECT_FALSE(broker.malformed);
+  EXPECT_TRUE(mqttConnected());
+}
+
+TEST(Mqtt, StateRejectedByFullQueueIsRetried) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  // Nothing leaves the socket: one brightness publish per coalesce window
+  // until the queue is full, then one more change it has to reject
+  fakeWiFiClientWriteLimit([](size_t) -> size_t { return 0; });
+  fakeClockManual(true);
+  uint32_t dropped = getMqttStats().dropped;
+  for (uint8_t level = 1; getMqttStats().dropped == dropped; level++) {
+    ASSERT_LE(level, MQTT_QUEUE_PACKETS + 1);
+    setLampBrightness(level);
+    runLoop(1);
+    fakeClockAdvanceMs(MQTT_STATE_COALESCE_MS + 1);
+    runLoop(1);
+  }
+  std::string rejected = std::to_string(getLampState().brightness);
+
+  fakeWiFiClientWriteLimit(nullptr);
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    fakeClockAdvanceMs(1);
+    return broker.retained[baseTopic() + "/brightness"] == rejected;
+  }));
+  EXPECT_FALSE(broker.malformed);
+}
+
+TEST(Mqtt, PartialPingDropsConnection) {
+  TestBroker broker;
+  connectLamp(broker);
+
+  fakeWiFiClientWriteLimit([](size_t size) -> size_t { return 1; });
+  fakeClockManual(true);
+  fakeClockAdvanceMs(MQTT_KEEPALIVE_S * 500UL + 1);
+  runLoop(5);
+  fakeWiFiClientWriteLimit(nullptr);
+
+  EXPECT_FALSE(mqttConnected());
+  EXPECT_TRUE(runLoopUntil([&]() {
+    broker.poll();
+    return broker.clientClosed;
+  }));
+}
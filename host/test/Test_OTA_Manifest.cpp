@@ -0,0 +1,217 @@
+/**
+ * Test_OTA_Manifest.cpp - Manifest parsing and the HTTP update check
+ *
+ * The update check runs against scripted HTTPClient replies
+ * (fakeHttpQueueReply): conditional requests, 304, malformed, oversized
+ * and older manifests, and the backoff and jitter of the check schedule
+ * on the manual clock.
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include "OTA_Manifest.h"
+#include "OTA_Update.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+
+static const char* MANIFEST_URL = "http://updates.test/manifest.json";
+
+static FakeHttpReply manifestReply(const std::string& version) {
+  FakeHttpReply reply;
+  reply.body = "{ \"version\": \"" + version + "\", \"url\": \"http://updates.test/firmware.bin\" }";
+  return reply;
+}
+
+static size_t requestCount() {
+  return fakeHttpRequests().size();
+}
+
+TEST(OtaManifest, ParsesVersionAndUrl) {
+  UpdateManifest manifest;
+  ASSERT_TRUE(parseUpdateManifest("{\"version\":\"1.2.3-abc\",\"url\":\"http:\\/\\/server\\/fw.bin\"}", manifest));
+  EXPECT_STREQ(manifest.version, "1.2.3-abc");
+  EXPECT_STREQ(manifest.url, "http://server/fw.bin");
+
+  ASSERT_TRUE(parseUpdateManifest("{\n  \"version\" :  \"2.0.0\"\n}\n", manifest));
+  EXPECT_STREQ(manifest.version, "2.0.0");
+  EXPECT_STREQ(manifest.url, "");
+}
+
+TEST(OtaManifest, RejectsMalformedManifests) {
+  UpdateManifest manifest;
+  EXPECT_FALSE(parseUpdateManifest("", manifest));
+  EXPECT_FALSE(parseUpdateManifest("<html>404</html>", manifest));
+  EXPECT_FALSE(parseUpdateManifest("{\"url\":\"http://server/fw.bin\"}", manifest));
+  EXPECT_FALSE(parseUpdateManifest("{\"version\":101}", manifest));
+  EXPECT_FALSE(parseUpdateManifest("{\"version\" \"1.0.1\"}", manifest));
+  EXPECT_FALSE(parseUpdateManifest("{\"version\":\"1.0.1", manifest));
+  EXPECT_FALSE(parseUpdateManifest("{\"version\":\"1.0\\n1\"}", manifest));
+  // A broken url must not fall back to UPDATE_SERVER_URL
+  EXPECT_FALSE(parseUpdateManifest("{\"version\":\"1.0.1\",\"url\":null}", manifest));
+  EXPECT_STREQ(manifest.version, "");
+}
+
+TEST(OtaManifest, RejectsOversizedFields) {
+  UpdateManifest manifest;
+  std::string version(UPDATE_VERSION_MAX_LEN, '1');
+  EXPECT_FALSE(parseUpdateManifest(("{\"version\":\"" + version + "\"}").c_str(), manifest));
+  version.pop_back();
+  EXPECT_TRUE(parseUpdateManifest(("{\"version\":\"" + version + "\"}").c_str(), manifest));
+
+  std::string url = "http://server/" + std::string(UPDATE_URL_MAX_LEN, 'x');
+  EXPECT_FALSE(parseUpdateManifest(("{\"version\":\"1.0.1\",\"url\":\"" + url + "\"}").c_str(), manifest));
+}
+
+TEST(OtaManifest, ComparesVersionsNumerically) {
+  EXPECT_EQ(compareVersions("1.0.0", "1.0.0"), 0);
+  EXPECT_EQ(compareVersions("1.0.0-aaaaaaa", "1.0.0-bbbbbbb"), 0);   // Git hash ignored
+  EXPECT_GT(compareVersions("1.0.1", "1.0.0-d790d2c"), 0);
+  EXPECT_LT(compareVersions("0.9.9", "1.0.0"), 0);
+  EXPECT_GT(compareVersions("1.10.0", "1.9.0"), 0);                    // Not a string compare
+  EXPECT_GT(compareVersions("2", "1.99.99"), 0);
+  EXPECT_EQ(compareVersions("1.2", "1.2.0"), 0);                       // Missing parts are 0
+  EXPECT_LT(compareVersions("", "0.0.1"), 0);
+}
+
+TEST(UpdateCheck, FailsWithoutServer) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+  ASSERT_EQ(requestCount(), 1u);
+  EXPECT_EQ(fakeHttpRequests()[0].url, MANIFEST_URL);
+}
+
+TEST(UpdateCheck, RejectsMalformedAndOversizedManifests) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  FakeHttpReply garbage;
+  garbage.body = "<html>It works!</html>";
+  fakeHttpQueueReply(garbage);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+
+  // Too large by Content-Length, and chunked (size only known while reading)
+  FakeHttpReply large = manifestReply("9.0.0");
+  large.body += std::string(UPDATE_MANIFEST_MAX_LEN, ' ');
+  fakeHttpQueueReply(large);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+  large.chunked = true;
+  fakeHttpQueueReply(large);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+
+  FakeHttpReply error = manifestReply("9.0.0");
+  error.code = HTTP_CODE_NOT_FOUND;
+  fakeHttpQueueReply(error);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+
+  // None of them started a download
+  EXPECT_EQ(requestCount(), 4u);
+  EXPECT_FALSE(fakeRestartRequested());
+}
+
+TEST(UpdateCheck, OlderOrSameVersionIsNotDownloaded) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  fakeHttpQueueReply(manifestReply("0.9.9-1234567"));
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_CURRENT);
+  fakeHttpQueueReply(manifestReply("1.0.0-1234567"));
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_CURRENT);
+  EXPECT_EQ(requestCount(), 2u);
+  EXPECT_FALSE(fakeRestartRequested());
+}
+
+TEST(UpdateCheck, ConditionalRequestAndNotModified) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  FakeHttpReply current = manifestReply(DECKENLAMPE_VERSION);
+  current.headers["ETag"] = "\"m-1\"";
+  current.headers["Last-Modified"] = "Sat, 17 Oct 2026 10:00:00 GMT";
+  fakeHttpQueueReply(current);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_CURRENT);
+  EXPECT_TRUE(fakeHttpRequests()[0].headers.empty());
+
+  FakeHttpReply notModified;
+  notModified.code = HTTP_CODE_NOT_MODIFIED;
+  fakeHttpQueueReply(notModified);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_NOT_MODIFIED);
+  ASSERT_EQ(requestCount(), 2u);
+  FakeHttpRequest conditional = fakeHttpRequests()[1];
+  EXPECT_EQ(conditional.headers["If-None-Match"], "\"m-1\"");
+  EXPECT_EQ(conditional.headers["If-Modified-Since"], "Sat, 17 Oct 2026 10:00:00 GMT");
+
+  // A 304 keeps the validators
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+  EXPECT_EQ(fakeHttpRequests()[2].headers["If-None-Match"], "\"m-1\"");
+}
+
+TEST(UpdateCheck, NewerVersionDownloadsAndKeepsRetrying) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  FakeHttpReply newer = manifestReply("9.0.0-1234567");
+  newer.headers["ETag"] = "\"m-2\"";
+  fakeHttpQueueReply(newer);
+  FakeHttpReply missing;
+  missing.code = HTTP_CODE_NOT_FOUND;
+  fakeHttpQueueReply(missing);
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+  ASSERT_EQ(requestCount(), 2u);
+  EXPECT_EQ(fakeHttpRequests()[1].url, "http://updates.test/firmware.bin");
+
+  // The failed download did not store the validators: no 304 next time
+  EXPECT_EQ(checkHTTPUpdate(), UPDATE_CHECK_FAILED);
+  EXPECT_EQ(fakeHttpRequests()[2].headers.count("If-None-Match"), 0u);
+  EXPECT_FALSE(fakeRestartRequested());
+}
+
+/**
+ * Advance the manual clock in 1 s steps until handleUpdateCheck() sends a
+ * request; returns the time that took
+ */
+static unsigned long untilNextCheck() {
+  size_t before = requestCount();
+  unsigned long start = millis();
+  while (requestCount() == before) {
+    fakeClockAdvanceMs(1000);
+    handleUpdateCheck();
+    if (millis() - start > 2 * HTTP_UPDATE_CHECK_INTERVAL_MS) {
+      ADD_FAILURE() << "no update check";
+      break;
+    }
+  }
+  return millis() - start;
+}
+
+TEST(UpdateCheck, BackoffAndJitter) {
+  UPDATE_MANIFEST_URL = MANIFEST_URL;
+  fakeClockManual(true);
+  EXPECT_LE(untilNextCheck(), HTTP_UPDATE_FIRST_CHECK_MS + 1000);
+
+  // Failed checks: doubling backoff plus up to 25% jitter, capped at the interval
+  unsigned long backoff = HTTP_UPDATE_BACKOFF_MIN_MS;
+  for (int i = 0; i < 8; i++) {
+    SCOPED_TRACE(testing::Message() << "retry " << i);
+    unsigned long delay = untilNextCheck();
+    EXPECT_GE(delay, backoff);
+    EXPECT_LE(delay, backoff + backoff / 4 + 1000);
+    backoff = std::min(backoff * 2, HTTP_UPDATE_CHECK_INTERVAL_MS);
+  }
+
+  // Answered checks: the regular interval +/- HTTP_UPDATE_JITTER_PERCENT
+  unsigned long jitter = HTTP_UPDATE_CHECK_INTERVAL_MS / 100 * HTTP_UPDATE_JITTER_PERCENT;
+  FakeHttpReply notModified;
+  notModified.code = HTTP_CODE_NOT_MODIFIED;
+  std::vector<unsigned long> delays;
+  for (int i = 0; i < 5; i++) {
+    fakeHttpQueueReply(notModified);
+    delays.push_back(untilNextCheck());
+    if (i > 0) {
+      EXPECT_GE(delays.back(), HTTP_UPDATE_CHECK_INTERVAL_MS - jitter);
+      EXPECT_LE(delays.back(), HTTP_UPDATE_CHECK_INTERVAL_MS + jitter + 1000);
+    }
+  }
+  // The first delay above still followed the last failure
+  EXPECT_LE(delays[0], HTTP_UPDATE_CHECK_INTERVAL_MS + HTTP_UPDATE_CHECK_INTERVAL_MS / 4 + 1000);
+  EXPECT_NE(*std::min_element(delays.begin() + 1, delays.end()), *std::max_element(delays.begin() + 1, delays.end()));
+
+  // Success resets the backoff: the next failure retries after the minimum
+  unsigned long delay = untilNextCheck();
+  EXPECT_GE(delay, HTTP_UPDATE_CHECK_INTERVAL_MS - jitter);
+  delay = untilNextCheck();
+  EXPECT_GE(delay, HTTP_UPDATE_BACKOFF_MIN_MS);
+  EXPECT_LE(delay, HTTP_UPDATE_BACKOFF_MIN_MS * 5 / 4 + 1000);
+}
@@ -0,0 +1,186 @@
+/**
+ * Test_Pixel_Stream.cpp - DDP and E1.31 replayed over UDP to the receivers
+ *
+ * A local sender replays packet captures to 127.0.0.1, including late and
+ * lost packets, while the receivers run on their own threads like the
+ * AsyncUDP task. The strip is long enough for multi-packet DDP frames and
+ * two E1.31 universes.
+ *
+ * Author: icebear74
+ */
+
+#include "Frame_Interpolator.h"
+#include "Pixel_Stream.h"
+#include <AsyncUDP.h>
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+static const uint16_t PIXELS = 200;
+static const size_t FRAME_BYTES = PIXELS * 3;
+
+static std::vector<uint8_t> pixelData(size_t bytes, CRGB color) {
+  std::vector<uint8_t> data(bytes);
+  for (size_t i = 0; i < bytes; i++) {
+    data[i] = color.raw[i % 3];
+  }
+  return data;
+}
+
+static std::vector<uint8_t> ddpPacket(uint8_t seq, bool push, uint32_t offset, CRGB color, size_t bytes) {
+  std::vector<uint8_t> packet(DDP_HEADER_LEN);
+  packet[0] = DDP_FLAGS_VER1 | (push ? DDP_FLAGS_PUSH : 0);
+  packet[1] = seq;
+  packet[3] = DDP_ID_DISPLAY;
+  packet[4] = offset >> 24;
+  packet[5] = offset >> 16;
+  packet[6] = offset >> 8;
+  packet[7] = offset;
+  packet[8] = bytes >> 8;
+  packet[9] = bytes;
+  std::vector<uint8_t> data = pixelData(bytes, color);
+  packet.insert(packet.end(), data.begin(), data.end());
+  return packet;
+}
+
+static std::vector<uint8_t> e131Packet(uint16_t universe, uint8_t seq, CRGB color, size_t channels) {
+  static const uint8_t acnId[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+  std::vector<uint8_t> packet(E131_HEADER_LEN);
+  packet[1] = 0x10;  // Preamble size
+  memcpy(&packet[E131_OFFSET_ACN_ID], acnId, sizeof(acnId));
+  packet[E131_OFFSET_ROOT_VECTOR + 3] = 0x04;
+  packet[E131_OFFSET_FRAME_VECTOR + 3] = 0x02;
+  packet[E131_OFFSET_SEQUENCE] = seq;
+  packet[E131_OFFSET_UNIVERSE] = universe >> 8;
+  packet[E131_OFFSET_UNIVERSE + 1] = universe;
+  packet[E131_OFFSET_DMP_VECTOR] = 0x02;
+  packet[E131_OFFSET_PROP_COUNT] = (channels + 1) >> 8;
+  packet[E131_OFFSET_PROP_COUNT + 1] = channels + 1;
+  std::vector<uint8_t> data = pixelData(channels, color);
+  packet.insert(packet.end(), data.begin(), data.end());
+  return packet;
+}
+
+// Send the packets in order and wait until the receiver has seen all of them
+// (real time, the test may run on the manual clock)
+static void replay(uint16_t port, const std::vector<std::vector<uint8_t>>& packets) {
+  const PixelStreamStats& stats = getPixelStreamStats();
+  uint32_t expected = stats.packets + stats.droppedPackets + packets.size();
+  AsyncUDP sender;
+  for (const std::vector<uint8_t>& packet : packets) {
+    ASSERT_EQ(sender.writeTo(packet.data(), packet.size(), IPAddress(127, 0, 0, 1), port), packet.size());
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (stats.packets + stats.droppedPackets >= expected) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  FAIL() << "Receiver saw only " << getPixelStreamStats().packets << " valid packets";
+}
+
+// Render once the playout time has passed every buffered frame
+static std::vector<CRGB> renderLatest() {
+  std::vector<CRGB> out(PIXELS);
+  delay(PLAYOUT_DELAY_MS * 2);
+  EXPECT_TRUE(renderInterpolatedFrame(out.data()));
+  return out;
+}
+
+TEST(PixelStream, DdpReplay) {
+  setupPixelStream(PIXELS);
+  const size_t half = FRAME_BYTES / 2;
+  replay(DDP_PORT, {
+    ddpPacket(1, false, 0, CRGB(1, 1, 1), half),
+    ddpPacket(2, true, half, CRGB(2, 2, 2), half),
+    ddpPacket(1, false, 0, CRGB(9, 9, 9), half),        // Late duplicate: ignored
+    ddpPacket(3, false, 0, CRGB(3, 3, 3), half),        // Sequence 4 lost: frame dropped
+    ddpPacket(5, true, half, CRGB(5, 5, 5), half),
+    ddpPacket(6, false, 0, CRGB(6, 6, 6), half),
+    ddpPacket(7, true, half, CRGB(7, 7, 7), half),
+  });
+
+  const PixelStreamStats& stats = getPixelStreamStats();
+  EXPECT_TRUE(pixelStreamActive());
+  EXPECT_EQ(stats.packets, 6u);
+  EXPECT_EQ(stats.droppedPackets, 1u);
+  EXPECT_EQ(stats.framesCompleted, 2u);
+  EXPECT_EQ(stats.droppedFrames, 1u);
+
+  std::vector<CRGB> out = renderLatest();
+  EXPECT_EQ(out[0], CRGB(6, 6, 6));
+  EXPECT_EQ(out[PIXELS / 2 - 1], CRGB(6, 6, 6));
+  EXPECT_EQ(out[PIXELS / 2], CRGB(7, 7, 7));
+  EXPECT_EQ(out[PIXELS - 1], CRGB(7, 7, 7));
+}
+
+TEST(PixelStream, E131Replay) {
+  setupPixelStream(PIXELS);
+  const size_t second = FRAME_BYTES - E131_CHANNELS_PER_UNIVERSE;
+  replay(E131_PORT, {
+    e131Packet(1, 10, CRGB(1, 1, 1), E131_CHANNELS_PER_UNIVERSE),
+    e131Packet(2, 10, CRGB(2, 2, 2), second),
+    e131Packet(1, 9, CRGB(9, 9, 9), E131_CHANNELS_PER_UNIVERSE),   // Late: ignored
+    e131Packet(1, 11, CRGB(3, 3, 3), E131_CHANNELS_PER_UNIVERSE),  // Universe 2 lost: frame dropped
+    e131Packet(1, 12, CRGB(4, 4, 4), E131_CHANNELS_PER_UNIVERSE),
+    e131Packet(2, 12, CRGB(5, 5, 5), second),
+  });
+
+  const PixelStreamStats& stats = getPixelStreamStats();
+  EXPECT_TRUE(pixelStreamActive());
+  EXPECT_EQ(stats.packets, 5u);
+  EXPECT_EQ(stats.droppedPackets, 1u);
+  EXPECT_EQ(stats.framesCompleted, 2u);
+  EXPECT_EQ(stats.droppedFrames, 1u);
+
+  std::vector<CRGB> out = renderLatest();
+  EXPECT_EQ(out[0], CRGB(4, 4, 4));
+  EXPECT_EQ(out[E131_CHANNELS_PER_UNIVERSE / 3 - 1], CRGB(4, 4, 4));
+  EXPECT_EQ(out[E131_CHANNELS_PER_UNIVERSE / 3], CRGB(5, 5, 5));
+  EXPECT_EQ(out[PIXELS - 1], CRGB(5, 5, 5));
+}
+
+TEST(PixelStream, MalformedPacketsAreCounted) {
+  setupPixelStream(PIXELS);
+  std::vector<uint8_t> truncated = ddpPacket(1, true, 0, CRGB(1, 1, 1), FRAME_BYTES);
+  truncated.resize(DDP_HEADER_LEN + 10);
+  std::vector<uint8_t> notAcn = e131Packet(1, 1, CRGB(1, 1, 1), 30);
+  notAcn[E131_OFFSET_ACN_ID] = 'X';
+  replay(DDP_PORT, { truncated });
+  replay(E131_PORT, { notAcn });
+
+  EXPECT_EQ(getPixelStreamStats().packets, 0u);
+  EXPECT_EQ(getPixelStreamStats().droppedPackets, 2u);
+  EXPECT_FALSE(pixelStreamActive());
+}
+
+TEST(PixelStream, FallsBackAfterTimeout) {
+  fakeClockManual(true);
+  setupPixelStream(PIXELS);
+  replay(DDP_PORT, { ddpPacket(0, true, 0, CRGB(1, 2, 3), FRAME_BYTES) });
+  handlePixelStream();
+  EXPECT_TRUE(pixelStreamActive());
+
+  fakeClockAdvanceMs(PIXEL_STREAM_TIMEOUT_MS + 1);
+  handlePixelStream();
+  EXPECT_FALSE(pixelStreamActive());
+}
+
+TEST(PixelStream, PacketDuringTimeoutCheckKeepsStream) {
+  fakeClockManual(true);
+  setupPixelStream(PIXELS);
+  replay(DDP_PORT, { ddpPacket(0, true, 0, CRGB(1, 2, 3), FRAME_BYTES) });
+  handlePixelStream();
+  ASSERT_TRUE(pixelStreamActive());
+
+  // A packet lands in the next millisecond, after handlePixelStream read the clock
+  fakeClockOnNextRead([]() {
+    fakeClockAdvanceMs(1);
+    replay(DDP_PORT, { ddpPacket(1, true, 0, CRGB(4, 5, 6), FRAME_BYTES) });
+  });
+  handlePixelStream();
+  EXPECT_TRUE(pixelStreamActive());
+  EXPECT_EQ(getPixelStreamStats().packets, 2u);
+}
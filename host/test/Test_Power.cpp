@@ -0,0 +1,53 @@
+/**
+ * Test_Power.cpp - Loop idle wait in static mode
+ *
+ * UDP receivers end the wait with powerWake(); everything else (TCP)
+ * waits for the end of POWER_STATIC_TICK_MS.
+ *
+ * Author: icebear74
+ */
+
+#include "Power.h"
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+static uint32_t idleMs() {
+  auto start = std::chrono::steady_clock::now();
+  powerIdle();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void enterStaticMode() {
+  setupPower();
+  fakeClockManual(true);
+  fakeClockAdvanceMs(POWER_STATIC_AFTER_MS + 1);
+  handlePower();
+  ASSERT_EQ(getPowerMode(), POWER_STATIC);
+}
+
+TEST(Power, StaticWaitEndsAfterTick) {
+  enterStaticMode();
+  uint32_t ms = idleMs();
+  EXPECT_GE(ms, POWER_STATIC_TICK_MS - 5);
+  EXPECT_LT(ms, POWER_STATIC_TICK_MS + 30);
+}
+
+TEST(Power, UdpWakeEndsStaticWait) {
+  enterStaticMode();
+  std::thread receiver([]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    powerWake();
+  });
+  uint32_t ms = idleMs();
+  receiver.join();
+  EXPECT_LT(ms, POWER_STATIC_TICK_MS / 2);
+}
+
+TEST(Power, ActivityLeavesStaticMode) {
+  enterStaticMode();
+  powerActivity();
+  EXPECT_EQ(getPowerMode(), POWER_ACTIVE);
+  EXPECT_LT(idleMs(), 10u);
+}
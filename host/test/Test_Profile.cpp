@@ -0,0 +1,21 @@
+/**
+ * Test_Profile.cpp - A feature profile of feature-size.py boots on the host
+ *
+ * Built once per profile (host/test/CMakeLists.txt) against firmware
+ * objects compiled with that profile's switches.
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include "Config.h"
+#include <FastLED.h>
+#include <gtest/gtest.h>
+
+TEST(Profile, BootsAndLightsTheStrip) {
+  startFirmware();
+  EXPECT_TRUE(runLoopUntil([]() { return fakeShowCount() > 0; }));
+  EXPECT_EQ(fakeShownFrame().size(), NUM_LEDS * sizeof(CRGB));
+  runLoop(100);
+  EXPECT_FALSE(fakeRestartRequested());
+}
@@ -0,0 +1,135 @@
+/**
+ * Test_Sequence.cpp - Sequence player against make-sequence.py output
+ *
+ * The build encodes the frames of make-test-frames.py with make-sequence.py
+ * (TEST_FRAMES_PATH, TEST_SEQUENCE_PATH); the firmware decoder must give
+ * back every frame exactly, played forward and seeked. Damaged headers
+ * must be rejected before anything is read from the file.
+ *
+ * Author: icebear74
+ */
+
+#include "Sequence.h"
+#include <Fake_Host.h>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+static const uint16_t PIXELS = 40;
+
+static std::vector<uint8_t> loadFile(const char* path) {
+  std::vector<uint8_t> data;
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return data;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(file);
+  return data;
+}
+
+// Upload in chunks like the web handler
+static bool store(const std::vector<uint8_t>& file) {
+  if (!sequenceUploadBegin()) {
+    return false;
+  }
+  for (size_t offset = 0; offset < file.size(); offset += 1000) {
+    if (!sequenceUploadWrite(file.data() + offset, std::min((size_t)1000, file.size() - offset))) {
+      return false;
+    }
+  }
+  return sequenceUploadEnd();
+}
+
+static void expectFrame(const std::vector<uint8_t>& frames, uint32_t frame, const CRGB* leds) {
+  const uint8_t* expected = frames.data() + frame * PIXELS * 3;
+  for (uint16_t p = 0; p < PIXELS; p++) {
+    ASSERT_EQ(leds[p], CRGB(expected[p * 3], expected[p * 3 + 1], expected[p * 3 + 2]))
+        << "frame " << frame << ", pixel " << p;
+  }
+}
+
+class SequenceTest : public testing::Test {
+protected:
+  void SetUp() override {
+    fakeFlashReset();
+    setupSequence();
+  }
+};
+
+TEST_F(SequenceTest, RoundTripFromMakeSequence) {
+  std::vector<uint8_t> frames = loadFile(TEST_FRAMES_PATH);
+  ASSERT_TRUE(store(loadFile(TEST_SEQUENCE_PATH))) << sequenceError();
+  uint32_t frameCount = frames.size() / (PIXELS * 3);
+  ASSERT_EQ(getSequenceStats().frameCount, frameCount);
+  ASSERT_EQ(getSequenceStats().pixelCount, PIXELS);
+
+  // Forward: delta records applied on the previous frame
+  CRGB leds[PIXELS + 8];
+  for (uint32_t f = 0; f < frameCount; f++) {
+    ASSERT_TRUE(decodeSequenceFrame(f, leds, PIXELS + 8));
+    expectFrame(frames, f, leds);
+    for (uint16_t p = PIXELS; p < PIXELS + 8; p++) {
+      ASSERT_EQ(leds[p], CRGB(CRGB::Black));
+    }
+  }
+  uint32_t seeks = getSequenceStats().seeks;
+  EXPECT_EQ(seeks, 1u);
+
+  // Seeks: backwards, across keyframes, wrapped, on a buffer someone else wrote
+  for (uint32_t f : { 377u, 12u, 13u, 250u, 99u, frameCount + 5 }) {
+    ASSERT_TRUE(decodeSequenceFrame(f, leds, PIXELS));
+    expectFrame(frames, f % frameCount, leds);
+  }
+  leds[3] = CRGB(1, 2, 3);
+  ASSERT_TRUE(decodeSequenceFrame(5, leds, PIXELS));
+  expectFrame(frames, 5, leds);
+  EXPECT_GT(getSequenceStats().seeks, seeks);
+}
+
+// Header of a file whose sizes the test chooses; the CRC matches the body
+static std::vector<uint8_t> craftedFile(uint32_t frameCount, uint16_t keyframeInterval, uint32_t dataSize,
+                                        uint32_t fileSize, const std::vector<uint8_t>& body) {
+  SequenceHeader head = {};
+  memcpy(head.magic, SEQUENCE_MAGIC, 4);
+  head.version = SEQUENCE_VERSION;
+  head.pixelCount = PIXELS;
+  head.frameCount = frameCount;
+  head.frameIntervalMs = 20;
+  head.keyframeInterval = keyframeInterval;
+  head.indexOffset = SEQUENCE_HEADER_LEN + dataSize;
+  head.dataSize = dataSize;
+  head.fileSize = fileSize;
+  head.crc = crc32(0, body.data(), body.size());
+  std::vector<uint8_t> file(sizeof(head) + body.size());
+  memcpy(file.data(), &head, sizeof(head));
+  std::copy(body.begin(), body.end(), file.begin() + sizeof(head));
+  return file;
+}
+
+TEST_F(SequenceTest, RejectsFileSizeBelowHeader) {
+  // The index size wraps to match, so only the lower bound stops a CRC
+  // over fileSize - 32 = 4 GB
+  EXPECT_FALSE(store(craftedFile(0x3FFFFFFA, 1, 0, 8, {})));
+  EXPECT_STREQ(sequenceError(), "invalid sequence header");
+  EXPECT_FALSE(sequenceLoaded());
+}
+
+TEST_F(SequenceTest, RejectsKeyframeIndexOverflow) {
+  // 0x40000001 keyframes * 4 wraps to 4: one index entry would pass as the
+  // whole index, the player would then read 4 GB past it
+  std::vector<uint8_t> body = { 0, 0, 32, 0, 0, 0 };  // Empty record, index entry 32
+  EXPECT_FALSE(store(craftedFile(0x40000001, 1, 2, SEQUENCE_HEADER_LEN + 6, body)));
+  EXPECT_STREQ(sequenceError(), "invalid sequence header");
+  EXPECT_FALSE(sequenceLoaded());
+}
+
+TEST_F(SequenceTest, RejectsIndexEntryNearOffsetLimit) {
+  // offset + 2 must not wrap past the record area check
+  std::vector<uint8_t> body = { 0, 0, 0xFF, 0xFF, 0xFF, 0xFF };
+  EXPECT_FALSE(store(craftedFile(1, 1, 2, SEQUENCE_HEADER_LEN + 6, body)));
+  EXPECT_STREQ(sequenceError(), "invalid keyframe index");
+}
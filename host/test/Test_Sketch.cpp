@@ -0,0 +1,33 @@
+/**
+ * Test_Sketch.cpp - The whole sketch on the host: boot, render, web server
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include "Config.h"
+#include "OTA_Update.h"
+#include <FastLED.h>
+#include <gtest/gtest.h>
+
+TEST(Sketch, BootsAndLightsTheStrip) {
+  startFirmware();
+  EXPECT_TRUE(runLoopUntil([]() { return fakeShowCount() > 0; }));
+  EXPECT_EQ(fakeShownFrame().size(), NUM_LEDS * sizeof(CRGB));
+  // The log task writes to Serial asynchronously
+  EXPECT_TRUE(runLoopUntil([]() { return fakeSerialOutput().find("Services Ready") != std::string::npos; }))
+      << fakeSerialOutput();
+}
+
+TEST(Sketch, ServesMetrics) {
+  startFirmware();
+  runLoop(10);
+  FakeHttpResponse response = server.request(HTTP_GET, "/metrics");
+  EXPECT_EQ(response.code, 200);
+  EXPECT_NE(response.body.find("deckenlampe_frames_shown_total"), std::string::npos);
+}
+
+TEST(Sketch, UnknownPathIsNotFound) {
+  startFirmware();
+  EXPECT_EQ(server.request(HTTP_GET, "/no-such-page").code, 404);
+}
@@ -0,0 +1,81 @@
+/**
+ * Test_Static_Alloc.cpp - Heap check counting new and (wrapped) malloc
+ *
+ * The host build links with --wrap=malloc,--wrap=calloc,--wrap=realloc
+ * like a lamp build with HEAP_CHECK_WRAP_MALLOC. The test thread plays
+ * the loop task: its first handleHeapCheck() call ends the setup phase.
+ *
+ * Author: icebear74
+ */
+
+#include "Host_Firmware.h"
+#include "Static_Alloc.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+// Keeps the compiler from removing allocate/free pairs
+static void* volatile sink;
+
+static uint32_t loopAllocations() {
+  return getHeapCheckStats().loopAllocations;
+}
+
+TEST(StaticAlloc, CountsNewAndMallocInLoop) {
+  sink = malloc(16);  // Setup phase: not counted
+  free(sink);
+  handleHeapCheck();
+  EXPECT_EQ(loopAllocations(), 0u);
+
+  int* value = new int(1);
+  sink = value;
+  delete value;
+  EXPECT_EQ(loopAllocations(), 1u);
+  EXPECT_EQ(getHeapCheckStats().lastSize, sizeof(int));
+
+  sink = malloc(24);
+  EXPECT_EQ(loopAllocations(), 2u);
+  EXPECT_EQ(getHeapCheckStats().lastSize, 24u);
+  sink = realloc(sink, 100);
+  EXPECT_EQ(loopAllocations(), 3u);
+  EXPECT_EQ(getHeapCheckStats().lastSize, 100u);
+  free(sink);
+  EXPECT_EQ(loopAllocations(), 3u);
+
+  sink = calloc(4, 8);
+  EXPECT_EQ(loopAllocations(), 4u);
+  EXPECT_EQ(getHeapCheckStats().lastSize, 32u);
+  sink = realloc(sink, 0);  // Frees
+  EXPECT_EQ(loopAllocations(), 4u);
+}
+
+TEST(StaticAlloc, OtherTasksAreNotCounted) {
+  handleHeapCheck();
+  std::atomic<bool> go(false);
+  std::thread other([&go]() {
+    while (!go) {
+      std::this_thread::yield();
+    }
+    sink = malloc(64);
+    free(sink);
+    int* value = new int(2);
+    sink = value;
+    delete value;
+  });
+  uint32_t before = loopAllocations();
+  go = true;
+  other.join();
+  EXPECT_EQ(loopAllocations(), before);
+}
+
+// Only what the check can see on the host: no WiFi driver or lwIP below the fakes
+TEST(StaticAlloc, FirmwareLoopSteadyState) {
+  startFirmware();
+  runLoop(50);
+  uint32_t before = loopAllocations();
+  runLoop(500);
+  EXPECT_EQ(loopAllocations(), before) << "latest " << getHeapCheckStats().lastSize << " bytes";
+  sink = malloc(8);  // The check is armed on this thread
+  free(sink);
+  EXPECT_EQ(loopAllocations(), before + 1);
+}
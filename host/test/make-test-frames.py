@@ -0,0 +1,39 @@
+#!/usr/bin/env python3
+# Writes raw RGB frames for the host tests and benchmarks of light sequences
+# (input of make-sequence.py). The pattern exercises every record type of
+# the sequence format: a static part (skip), a single changing color
+# (repeat), a moving gradient (literal) and a full change every 100 frames.
+#
+# Usage: make-test-frames.py <output.rgb> [frames] [pixels]
+
+import sys
+
+
+def frame(f, pixels):
+    out = bytearray()
+    for p in range(pixels):
+        if f % 100 == 99:
+            color = (f & 255, 255 - (f & 255), p * 6 & 255)
+        elif p < pixels // 4:
+            color = (10, 20, 30)
+        elif p < pixels // 2:
+            color = (f * 3 & 255, 0, 255 - (f & 255))
+        else:
+            color = ((p * 7 + f * 3) & 255, (p * 13 + f) & 255, (f * 5) & 255)
+        out += bytes(color)
+    return out
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s <output.rgb> [frames] [pixels]" % sys.argv[0])
+        sys.exit(1)
+    frames = int(sys.argv[2]) if len(sys.argv) > 2 else 500
+    pixels = int(sys.argv[3]) if len(sys.argv) > 3 else 40
+    with open(sys.argv[1], "wb") as f:
+        for i in range(frames):
+            f.write(frame(i, pixels))
+
+
+if __name__ == "__main__":
+    main()
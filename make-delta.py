@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+# Script to create a delta OTA patch (see Deckenlampe/OTA_Decode.h)
+# The patch rebuilds <new.bin> on the lamp from the firmware it is running
+# (<old.bin>), so only changed bytes travel over WiFi.
+#
+# Usage: ./make-delta.py <old.bin> <new.bin> [output.patch] [--gzip]
+#
+# <old.bin> must be exactly the image the lamp runs. A signed old image is
+# accepted, its trailer is stripped (it is not written to flash).
+# <new.bin> may be signed (sign-firmware.sh); the trailer is carried over.
+# With --gzip the patch is gzip compressed as well (output.patch.gz).
+
+import gzip
+import hashlib
+import struct
+import sys
+
+MAGIC = b"DLDP"
+VERSION = 1
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+SIGNATURE_MAGIC = b"DLS1"
+SIGNATURE_TRAILER_LEN = 80
+
+BLOCK = 16        # Match seed length
+STEP = 4          # Source positions indexed
+MIN_MATCH = 24    # Shorter matches are cheaper as INSERT
+
+
+def strip_trailer(image):
+    if len(image) > SIGNATURE_TRAILER_LEN and image[-SIGNATURE_TRAILER_LEN:][:4] == SIGNATURE_MAGIC:
+        return image[:-SIGNATURE_TRAILER_LEN]
+    return image
+
+
+def build_index(source):
+    index = {}
+    for offset in range(0, len(source) - BLOCK + 1, STEP):
+        index.setdefault(source[offset:offset + BLOCK], offset)
+    return index
+
+
+def diff(source, target):
+    """Greedy COPY/INSERT encoding of target against source"""
+    index = build_index(source)
+    ops = []
+    literal_start = 0
+    pos = 0
+    last_copy_end = 0
+
+    while pos + BLOCK <= len(target):
+        # Prefer continuing right after the previous copy (sequential code)
+        candidates = []
+        if target[pos:pos + BLOCK] == source[last_copy_end:last_copy_end + BLOCK]:
+            candidates.append(last_copy_end)
+        seed = index.get(target[pos:pos + BLOCK])
+        if seed is not None:
+            candidates.append(seed)
+
+        best_src = best_len = 0
+        for src in candidates:
+            length = BLOCK
+            while (pos + length < len(target) and src + length < len(source)
+                   and target[pos + length] == source[src + length]):
+                length += 1
+            if length > best_len:
+                best_src, best_len = src, length
+
+        if best_len < MIN_MATCH:
+            pos += 1
+            continue
+
+        # Extend backwards into the pending literal run
+        while (pos > literal_start and best_src > 0
+               and target[pos - 1] == source[best_src - 1]):
+            pos -= 1
+            best_src -= 1
+            best_len += 1
+
+        if pos > literal_start:
+            ops.append((OP_INSERT, target[literal_start:pos]))
+        ops.append((OP_COPY, best_src, best_len))
+        pos += best_len
+        literal_start = pos
+        last_copy_end = best_src + best_len
+
+    if literal_start < len(target):
+        ops.append((OP_INSERT, target[literal_start:]))
+    return ops
+
+
+def encode(source, target, ops):
+    out = bytearray()
+    out += MAGIC
+    out += struct.pack("<B3xII", VERSION, len(source), len(target))
+    out += hashlib.sha256(source).digest()
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(op[1]))
+            out += op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply(source, patch):
+    """Reference decoder, used to check the patch before writing it"""
+    assert patch[:4] == MAGIC
+    _, source_size, target_size = struct.unpack_from("<B3xII", patch, 4)
+    assert hashlib.sha256(source[:source_size]).digest() == patch[16:48]
+    pos = 48
+    out = bytearray()
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, pos)
+            pos += 8
+            out += source[offset:offset + length]
+        else:
+            (length,) = struct.unpack_from("<I", patch, pos)
+            pos += 4
+            out += patch[pos:pos + length]
+            pos += length
+    assert len(out) == target_size
+    return bytes(out)
+
+
+def main():
+    args = [a for a in sys.argv[1:] if a != "--gzip"]
+    compress = "--gzip" in sys.argv[1:]
+    if len(args) < 2:
+        print("Usage: %s <old.bin> <new.bin> [output.patch] [--gzip]" % sys.argv[0])
+        sys.exit(1)
+
+    with open(args[0], "rb") as f:
+        source = strip_trailer(f.read())
+    with open(args[1], "rb") as f:
+        target = f.read()
+    output = args[2] if len(args) > 2 else args[1].rsplit(".bin", 1)[0] + ".patch"
+
+    ops = diff(source, target)
+    patch = encode(source, target, ops)
+    if apply(source, patch) != target:
+        print("Patch self-check failed")
+        sys.exit(1)
+
+    if compress:
+        patch = gzip.compress(patch, 9, mtime=0)
+        if not output.endswith(".gz"):
+            output += ".gz"
+
+    with open(output, "wb") as f:
+        f.write(patch)
+
+    copied = sum(op[2] for op in ops if op[0] == OP_COPY)
+    print("Delta patch written to %s" % output)
+    print("  %d -> %d bytes, patch %d bytes (%.1f%% of full image)"
+          % (len(source), len(target), len(patch), 100.0 * len(patch) / len(target)))
+    print("  %d bytes copied from running image in %d operations"
+          % (copied, len(ops)))
+
+
+if __name__ == "__main__":
+    main()
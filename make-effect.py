@@ -0,0 +1,349 @@
+#!/usr/bin/env python3
+# Assembler for lamp effect programs (see Deckenlampe/Effect_VM.h)
+# Assembles an effect, checks it like the lamp does and runs it on a
+# reference interpreter to report its cost (instructions per frame)
+# against the frame budget. The interpreter is written for exactness, not
+# speed: time per frame is measured by the firmware VM itself, natively
+# in host/bench (BM_VmFrame, BM_VmFrameBudget) and on the lamp on /bench
+# (vm_frame).
+#
+# Usage: ./make-effect.py <effect.vasm> [output.dlvm] [--leds N] [--frames N] [--show]
+#
+# --leds     Strip length to simulate (default 40)
+# --frames   Frames to simulate at 100 FPS (default 100)
+# --show     Print the simulated pixels of the first frames
+#
+# Syntax, one instruction per line, ';' starts a comment:
+#   loop:                     label (branch target)
+#   add  r9, r9, pos          register operands r0-r15 or their aliases
+#   li   r8, 0.25             load any constant (assembles to ldi or lui + ori)
+#   addi r9, r9, 0.3333       numbers with a '.' are Q16.16 fixed point
+#   aud  r8, beat             microphone feature: band0-band7, loud, onset, beat
+#                             (0 .. 1.0; always 0 in the simulation)
+# Aliases: i, n, ms, pos, sec (inputs), red, green, blue (outputs)
+#
+# Upload: curl -F "file=@effect.dlvm" http://<lamp>/effect
+
+import struct
+import sys
+import zlib
+
+MAGIC = b"DLVM"
+VERSION = 1
+MAX_INSTRUCTIONS = 128
+FRAME_STEP_BUDGET = 40000
+FRAME_INTERVAL_MS = 10
+
+# Mnemonic: (opcode, operands); operands r = register, i = immediate, l = label,
+# a = audio feature
+OPCODES = {
+    "halt": (0x00, ""),
+    "mov": (0x01, "rr"),
+    "ldi": (0x02, "ri"),
+    "lui": (0x03, "ri"),
+    "ori": (0x04, "rri"),
+    "add": (0x05, "rrr"),
+    "sub": (0x06, "rrr"),
+    "mul": (0x07, "rrr"),
+    "div": (0x08, "rrr"),
+    "addi": (0x09, "rri"),
+    "and": (0x0A, "rrr"),
+    "or": (0x0B, "rrr"),
+    "xor": (0x0C, "rrr"),
+    "shl": (0x0D, "rri"),
+    "shr": (0x0E, "rri"),
+    "min": (0x0F, "rrr"),
+    "max": (0x10, "rrr"),
+    "abs": (0x11, "rr"),
+    "frac": (0x12, "rr"),
+    "sin": (0x13, "rr"),
+    "cos": (0x14, "rr"),
+    "tri": (0x15, "rr"),
+    "jmp": (0x16, "l"),
+    "blt": (0x17, "rrl"),
+    "bge": (0x18, "rrl"),
+    "beq": (0x19, "rrl"),
+    "bne": (0x1A, "rrl"),
+    "aud": (0x1B, "ra"),
+}
+OP_COUNT = 0x1C
+AUDIO_OP = 0x1B
+BRANCHES = (0x16, 0x17, 0x18, 0x19, 0x1A)
+
+ALIASES = {"i": 0, "n": 1, "ms": 2, "pos": 3, "sec": 4, "red": 5, "green": 6, "blue": 7}
+
+# Microphone features for "aud" (see Deckenlampe/Audio.h)
+AUDIO_FEATURES = {"band%d" % b: b for b in range(8)}
+AUDIO_FEATURES.update({"loud": 8, "onset": 9, "beat": 10})
+
+# FastLED sin16_C tables (the lamp uses FastLED's sin16)
+SIN16_BASE = (0, 6393, 12539, 18204, 23170, 27245, 30273, 32137)
+SIN16_SLOPE = (49, 48, 44, 38, 31, 23, 14, 4)
+
+
+class AsmError(Exception):
+    pass
+
+
+def s32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def sin16(theta):
+    theta &= 0xFFFF
+    offset = (theta & 0x3FFF) >> 3
+    if theta & 0x4000:
+        offset = 2047 - offset
+    section = offset // 256
+    y = SIN16_SLOPE[section] * ((offset & 0xFF) // 2) + SIN16_BASE[section]
+    return -y if theta & 0x8000 else y
+
+
+def parse_register(token):
+    token = token.lower()
+    if token in ALIASES:
+        return ALIASES[token]
+    if token.startswith("r") and token[1:].isdigit() and int(token[1:]) < 16:
+        return int(token[1:])
+    raise AsmError("invalid register '%s'" % token)
+
+
+def parse_number(token):
+    try:
+        if "." in token:
+            return int(round(float(token) * 65536))
+        return int(token, 0)
+    except ValueError:
+        raise AsmError("invalid number '%s'" % token)
+
+
+def word(op, d=0, a=0, b=0):
+    return op | d << 8 | a << 12 | (b & 0xFFFF) << 16
+
+
+def assemble(source):
+    """Two passes: collect labels, then encode"""
+    lines = []
+    labels = {}
+    for number, line in enumerate(source.splitlines(), 1):
+        line = line.split(";", 1)[0].strip()
+        while ":" in line:
+            label, line = line.split(":", 1)
+            labels[label.strip()] = sum(size for _, _, _, size in lines)
+            line = line.strip()
+        if not line:
+            continue
+        parts = line.replace(",", " ").split()
+        mnemonic, args = parts[0].lower(), parts[1:]
+        size = 1
+        if mnemonic == "li":
+            if len(args) != 2:
+                raise AsmError("line %d: li needs 2 operands" % number)
+            size = 1 if -32768 <= parse_number(args[1]) <= 32767 else 2
+        lines.append((number, mnemonic, args, size))
+
+    words = []
+    for number, mnemonic, args, _ in lines:
+        try:
+            if mnemonic == "li":
+                d = parse_register(args[0])
+                value = s32(parse_number(args[1]))
+                if -32768 <= value <= 32767:
+                    words.append(word(0x02, d, 0, value))
+                else:
+                    words.append(word(0x03, d, 0, value >> 16))
+                    words.append(word(0x04, d, d, value & 0xFFFF))
+                continue
+            if mnemonic not in OPCODES:
+                raise AsmError("unknown instruction '%s'" % mnemonic)
+            op, kinds = OPCODES[mnemonic]
+            if len(args) != len(kinds):
+                raise AsmError("%s needs %d operands" % (mnemonic, len(kinds)))
+            regs = []
+            imm = 0
+            for kind, arg in zip(kinds, args):
+                if kind == "r":
+                    regs.append(parse_register(arg))
+                elif kind == "l":
+                    if arg not in labels:
+                        raise AsmError("unknown label '%s'" % arg)
+                    imm = labels[arg]
+                elif kind == "a":
+                    if arg.lower() in AUDIO_FEATURES:
+                        imm = AUDIO_FEATURES[arg.lower()]
+                    else:
+                        imm = parse_number(arg)
+                else:
+                    imm = parse_number(arg)
+                    low, high = (0, 0xFFFF) if mnemonic == "ori" else (-32768, 32767)
+                    if not low <= imm <= high:
+                        raise AsmError("immediate %d out of range (use li)" % imm)
+            regs += [0, 0, 0]
+            if kinds.count("r") == 3:
+                words.append(word(op, regs[0], regs[1], regs[2]))
+            else:
+                words.append(word(op, regs[0], regs[1], imm))
+        except AsmError as e:
+            raise AsmError("line %d: %s" % (number, e))
+    return words
+
+
+def verify(words):
+    """Same checks as vmVerify() on the lamp"""
+    if not 0 < len(words) <= MAX_INSTRUCTIONS:
+        raise AsmError("program has %d instructions (1-%d allowed)" % (len(words), MAX_INSTRUCTIONS))
+    for pc, w in enumerate(words):
+        op = w & 0xFF
+        imm = s32(w >> 16 << 16) >> 16
+        if op >= OP_COUNT:
+            raise AsmError("instruction %d: invalid opcode" % pc)
+        if op in BRANCHES and not 0 <= imm <= len(words):
+            raise AsmError("instruction %d: branch target out of range" % pc)
+        if op in (0x0D, 0x0E) and not 0 <= imm <= 31:
+            raise AsmError("instruction %d: shift amount out of range" % pc)
+        if op == AUDIO_OP and not 0 <= imm < len(AUDIO_FEATURES):
+            raise AsmError("instruction %d: audio feature out of range" % pc)
+
+
+def run_frame(words, elapsed_ms, leds):
+    """Reference interpreter, returns (pixels, steps) like vmRunFrame()"""
+    code = [(w & 0xFF, (w >> 8) & 15, (w >> 12) & 15, (w >> 16) & 15, s32(w >> 16 << 16) >> 16) for w in words]
+    reg = [0] * 16
+    reg[1] = leds
+    reg[2] = s32(elapsed_ms)
+    reg[4] = s32(elapsed_ms * 65536 // 1000)
+    budget = FRAME_STEP_BUDGET
+    pixels = []
+    for pixel in range(leds):
+        reg[0] = pixel
+        reg[3] = (pixel << 16) // leds
+        pc = 0
+        while pc < len(code) and budget > 0:
+            op, d, ra, rb, imm = code[pc]
+            pc += 1
+            budget -= 1
+            a, b = reg[ra], reg[rb]
+            if op == 0x00:
+                pc = len(code)
+            elif op == 0x01:
+                reg[d] = a
+            elif op == 0x02:
+                reg[d] = imm
+            elif op == 0x03:
+                reg[d] = s32(imm << 16)
+            elif op == 0x04:
+                reg[d] = s32(a | (imm & 0xFFFF))
+            elif op == 0x05:
+                reg[d] = s32(a + b)
+            elif op == 0x06:
+                reg[d] = s32(a - b)
+            elif op == 0x07:
+                reg[d] = s32((a * b) >> 16)
+            elif op == 0x08:
+                if b == 0:
+                    reg[d] = 0
+                else:
+                    q = abs(a << 16) // abs(b)
+                    reg[d] = s32(q if (a < 0) == (b < 0) else -q)
+            elif op == 0x09:
+                reg[d] = s32(a + imm)
+            elif op == 0x0A:
+                reg[d] = a & b
+            elif op == 0x0B:
+                reg[d] = a | b
+            elif op == 0x0C:
+                reg[d] = a ^ b
+            elif op == 0x0D:
+                reg[d] = s32(a << imm)
+            elif op == 0x0E:
+                reg[d] = a >> imm
+            elif op == 0x0F:
+                reg[d] = min(a, b)
+            elif op == 0x10:
+                reg[d] = max(a, b)
+            elif op == 0x11:
+                reg[d] = s32(abs(a))
+            elif op == 0x12:
+                reg[d] = a & 0xFFFF
+            elif op == 0x13:
+                reg[d] = sin16(a) * 2
+            elif op == 0x14:
+                reg[d] = sin16(a + 16384) * 2
+            elif op == 0x15:
+                f = a & 0xFFFF
+                reg[d] = f * 2 if f < 0x8000 else (0x10000 - f) * 2
+            elif op == 0x16:
+                pc = imm
+            elif op == 0x17:
+                pc = imm if reg[d] < a else pc
+            elif op == 0x18:
+                pc = imm if reg[d] >= a else pc
+            elif op == 0x19:
+                pc = imm if reg[d] == a else pc
+            elif op == 0x1A:
+                pc = imm if reg[d] != a else pc
+            elif op == AUDIO_OP:
+                reg[d] = 0    # No microphone on the host
+        if budget == 0 and pc < len(code):
+            break
+        pixels.append(tuple(0 if v <= 0 else 255 if v >= 65535 else v >> 8 for v in reg[5:8]))
+    steps = FRAME_STEP_BUDGET - budget
+    return pixels + [(0, 0, 0)] * (leds - len(pixels)), steps
+
+
+def encode(words):
+    code = b"".join(struct.pack("<I", w) for w in words)
+    return MAGIC + struct.pack("<BBHI", VERSION, 0, len(words), zlib.crc32(code)) + code
+
+
+def main():
+    args = []
+    options = {"--leds": 40, "--frames": 100}
+    show = "--show" in sys.argv[1:]
+    argv = [a for a in sys.argv[1:] if a != "--show"]
+    while argv:
+        arg = argv.pop(0)
+        if arg in options and argv:
+            options[arg] = int(argv.pop(0))
+        else:
+            args.append(arg)
+    if len(args) < 1:
+        print("Usage: %s <effect.vasm> [output.dlvm] [--leds N] [--frames N] [--show]" % sys.argv[0])
+        sys.exit(1)
+
+    with open(args[0]) as f:
+        source = f.read()
+    output = args[1] if len(args) > 1 else args[0].rsplit(".", 1)[0] + ".dlvm"
+    try:
+        words = assemble(source)
+        verify(words)
+    except AsmError as e:
+        print("%s: %s" % (args[0], e))
+        sys.exit(1)
+
+    # Simulate on the reference interpreter
+    leds = options["--leds"]
+    max_steps = 0
+    overruns = 0
+    for frame in range(options["--frames"]):
+        pixels, steps = run_frame(words, frame * FRAME_INTERVAL_MS, leds)
+        max_steps = max(max_steps, steps)
+        overruns += steps >= FRAME_STEP_BUDGET
+        if show and frame < 5:
+            print("frame %d: %s" % (frame, " ".join("%02x%02x%02x" % p for p in pixels)))
+
+    with open(output, "wb") as f:
+        f.write(encode(words))
+
+    print("Effect program written to %s" % output)
+    print("  %d instructions, %d bytes" % (len(words), len(words) * 4 + 12))
+    print("  %d LEDs: up to %d steps/frame (%.1f%% of the %d step budget)"
+          % (leds, max_steps, 100.0 * max_steps / FRAME_STEP_BUDGET, FRAME_STEP_BUDGET))
+    print("  Frame time: see /bench vm_frame on the lamp (not measured here)")
+    if overruns:
+        print("  WARNING: %d frames exceed the step budget, the lamp will unload the program" % overruns)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Script to create the update manifest checked by checkHTTPUpdate()
+# The version is taken from Deckenlampe/Version.h (run ./writeversion.sh first)
+#
+# Usage: ./make-manifest.sh <firmware url> [manifest.json]
+#
+# Test with a local HTTP server (supports If-Modified-Since):
+#   mkdir ota && cp build/Deckenlampe.ino.bin ota/firmware.bin
+#   ./make-manifest.sh http://<your-pc>:8000/firmware.bin ota/manifest.json
+#   cd ota && python3 -m http.server 8000
+# and set UPDATE_MANIFEST_URL to http://<your-pc>:8000/manifest.json
+
+set -e
+
+URL="$1"
+OUTPUT="${2:-manifest.json}"
+
+if [ -z "$URL" ]; then
+    echo "Usage: $0 <firmware url> [manifest.json]"
+    exit 1
+fi
+
+VERSION=$(sed -n -E 's/#define[[:space:]]+DECKENLAMPE_VERSION[[:space:]]+"([^"]+)".*/\1/p' Deckenlampe/Version.h)
+
+if [ -z "$VERSION" ]; then
+    echo "DECKENLAMPE_VERSION not found in Deckenlampe/Version.h"
+    exit 1
+fi
+
+cat > "$OUTPUT" <<MANIFEST
+{
+  "version": "${VERSION}",
+  "url": "${URL}"
+}
+MANIFEST
+
+echo "Manifest for version ${VERSION} written to ${OUTPUT}"
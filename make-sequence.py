@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# Script to create a light sequence for the lamp (see Deckenlampe/Sequence.h)
+# The sequence is played from flash as effect "sequence".
+#
+# Usage: ./make-sequence.py <input> [output.dlsq] [--pixels N] [--interval MS] [--keyframe K]
+#
+# <input> is either
+#   - raw RGB frames (.rgb): 3 bytes per pixel, frames back to back, needs --pixels
+#   - JSON: {"pixels": 40, "interval_ms": 20, "frames": [["#ff0000", ...], ...]}
+#     (colors as "#rrggbb" or [r, g, b])
+# --interval   Milliseconds per frame (default 20, JSON "interval_ms")
+# --keyframe   Frames between keyframes, the seek granularity (default 50)
+#
+# Upload: curl -F "file=@show.dlsq" http://<lamp>/sequence
+
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = b"DLSQ"
+VERSION = 1
+HEADER_LEN = 32
+OP_SKIP = 0x00
+OP_REPEAT = 0x40
+OP_LITERAL = 0x80
+OP_MASK = 0xC0
+MAX_RUN = 64
+
+DEFAULT_INTERVAL_MS = 20
+DEFAULT_KEYFRAME = 50
+
+
+def parse_color(value):
+    if isinstance(value, str):
+        value = value.lstrip("#")
+        return bytes.fromhex(value)
+    return bytes(value)
+
+
+def read_input(path, pixels, interval):
+    with open(path, "rb") as f:
+        data = f.read()
+    if path.endswith(".json"):
+        show = json.loads(data)
+        pixels = pixels or show.get("pixels")
+        interval = interval or show.get("interval_ms")
+        frames = [b"".join(parse_color(c) for c in frame) for frame in show["frames"]]
+        if pixels is None:
+            pixels = len(frames[0]) // 3
+    else:
+        if not pixels:
+            print("Raw RGB input needs --pixels")
+            sys.exit(1)
+        size = pixels * 3
+        frames = [data[i:i + size] for i in range(0, len(data) - size + 1, size)]
+    for n, frame in enumerate(frames):
+        if len(frame) != pixels * 3:
+            print("Frame %d has %d pixels, expected %d" % (n, len(frame) // 3, pixels))
+            sys.exit(1)
+    return frames, pixels, interval or DEFAULT_INTERVAL_MS
+
+
+def encode_frame(frame, previous, pixels):
+    """Ops for one frame, SKIP only against a previous frame (delta)"""
+    out = bytearray()
+    pixel = lambda buf, i: buf[i * 3:i * 3 + 3]
+    i = 0
+    while i < pixels:
+        run = 1
+        if previous is not None and pixel(frame, i) == pixel(previous, i):
+            while i + run < pixels and run < MAX_RUN and pixel(frame, i + run) == pixel(previous, i + run):
+                run += 1
+            out.append(OP_SKIP | (run - 1))
+        elif i + 1 < pixels and pixel(frame, i + 1) == pixel(frame, i):
+            while i + run < pixels and run < MAX_RUN and pixel(frame, i + run) == pixel(frame, i):
+                run += 1
+            out.append(OP_REPEAT | (run - 1))
+            out += pixel(frame, i)
+        else:
+            # Literal until a repeat or unchanged pixel starts
+            while i + run < pixels and run < MAX_RUN:
+                j = i + run
+                if previous is not None and pixel(frame, j) == pixel(previous, j):
+                    break
+                if j + 1 < pixels and pixel(frame, j + 1) == pixel(frame, j):
+                    break
+                run += 1
+            out.append(OP_LITERAL | (run - 1))
+            out += frame[i * 3:(i + run) * 3]
+        i += run
+    if len(out) > 0xFFFF:
+        print("Frame too large (%d bytes), too many pixels" % len(out))
+        sys.exit(1)
+    return bytes(out)
+
+
+def encode(frames, pixels, interval, keyframe):
+    data = bytearray()
+    index = []
+    previous = None
+    for n, frame in enumerate(frames):
+        key = n % keyframe == 0
+        if key:
+            index.append(HEADER_LEN + len(data))
+        ops = encode_frame(frame, None if key else previous, pixels)
+        data += struct.pack("<H", len(ops)) + ops
+        previous = frame
+    body = bytes(data) + b"".join(struct.pack("<I", offset) for offset in index)
+    index_offset = HEADER_LEN + len(data)
+    file_size = HEADER_LEN + len(body)
+    header = MAGIC + struct.pack("<BBHIHHIIII", VERSION, 0, pixels, len(frames), interval, keyframe,
+                                 index_offset, len(data), file_size, zlib.crc32(body))
+    return header + body
+
+
+def decode(sequence):
+    """Reference decoder, used to check the sequence before writing it"""
+    assert sequence[:4] == MAGIC
+    (version, _, pixels, frame_count, _, keyframe, index_offset, data_size,
+     file_size, crc) = struct.unpack_from("<BBHIHHIIII", sequence, 4)
+    assert version == VERSION and file_size == len(sequence)
+    assert index_offset == HEADER_LEN + data_size
+    assert zlib.crc32(sequence[HEADER_LEN:]) == crc
+    frames = []
+    leds = bytearray(pixels * 3)
+    pos = HEADER_LEN
+    for n in range(frame_count):
+        if n % keyframe == 0:
+            (offset,) = struct.unpack_from("<I", sequence, index_offset + (n // keyframe) * 4)
+            assert offset == pos
+        (length,) = struct.unpack_from("<H", sequence, pos)
+        pos += 2
+        end = pos + length
+        i = 0
+        while pos < end:
+            op = sequence[pos]
+            run = (op & ~OP_MASK) + 1
+            pos += 1
+            if op & OP_MASK == OP_SKIP:
+                assert n % keyframe != 0
+            elif op & OP_MASK == OP_REPEAT:
+                leds[i * 3:(i + run) * 3] = sequence[pos:pos + 3] * run
+                pos += 3
+            elif op & OP_MASK == OP_LITERAL:
+                leds[i * 3:(i + run) * 3] = sequence[pos:pos + run * 3]
+                pos += run * 3
+            else:
+                raise AssertionError("invalid op 0x%02X" % op)
+            i += run
+        assert i == pixels and pos == end
+        frames.append(bytes(leds))
+    return frames
+
+
+def main():
+    args = []
+    options = {"--pixels": None, "--interval": None, "--keyframe": DEFAULT_KEYFRAME}
+    argv = sys.argv[1:]
+    while argv:
+        arg = argv.pop(0)
+        if arg in options and argv:
+            options[arg] = int(argv.pop(0))
+        else:
+            args.append(arg)
+    if len(args) < 1 or options["--keyframe"] < 1:
+        print("Usage: %s <input> [output.dlsq] [--pixels N] [--interval MS] [--keyframe K]" % sys.argv[0])
+        sys.exit(1)
+
+    frames, pixels, interval = read_input(args[0], options["--pixels"], options["--interval"])
+    if not frames:
+        print("No frames in %s" % args[0])
+        sys.exit(1)
+    output = args[1] if len(args) > 1 else args[0].rsplit(".", 1)[0] + ".dlsq"
+
+    sequence = encode(frames, pixels, interval, options["--keyframe"])
+    if decode(sequence) != frames:
+        print("Sequence self-check failed")
+        sys.exit(1)
+
+    with open(output, "wb") as f:
+        f.write(sequence)
+
+    raw = len(frames) * pixels * 3
+    print("Sequence written to %s" % output)
+    print("  %d frames of %d pixels, %d ms/frame (%.1f s)"
+          % (len(frames), pixels, interval, len(frames) * interval / 1000.0))
+    print("  %d bytes (%.1f%% of %d bytes raw), keyframe every %d frames"
+          % (len(sequence), 100.0 * len(sequence) / raw, raw, options["--keyframe"]))
+
+
+if __name__ == "__main__":
+    main()
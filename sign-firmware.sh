@@ -0,0 +1,43 @@
+#!/bin/bash
+# Script to sign a firmware image for web OTA upload
+# Appends the signature trailer checked by OTA_Verify.cpp:
+#   "DLS1" | signature length (2 bytes, little endian) | 0x0000 | DER signature padded to 72 bytes
+#
+# Usage: ./sign-firmware.sh <firmware.bin> <ota_private.pem> [signed.bin]
+#
+# Create a key pair once with:
+#   openssl ecparam -name prime256v1 -genkey -noout -out ota_private.pem
+#   openssl ec -in ota_private.pem -pubout -out ota_public.pem
+# and paste ota_public.pem into OTA_PUBLIC_KEY_PEM in Deckenlampe/OTA_Verify.cpp
+
+set -e
+
+FIRMWARE="$1"
+KEY="$2"
+OUTPUT="${3:-${FIRMWARE%.bin}.signed.bin}"
+
+if [ -z "$FIRMWARE" ] || [ -z "$KEY" ]; then
+    echo "Usage: $0 <firmware.bin> <ota_private.pem> [signed.bin]"
+    exit 1
+fi
+
+SIGNATURE=$(mktemp)
+trap 'rm -f "$SIGNATURE"' EXIT
+
+openssl dgst -sha256 -sign "$KEY" -out "$SIGNATURE" "$FIRMWARE"
+SIG_LEN=$(stat -c%s "$SIGNATURE")
+
+if [ "$SIG_LEN" -gt 72 ]; then
+    echo "Unexpected signature length ${SIG_LEN} (ECDSA P-256 key required)"
+    exit 1
+fi
+
+{
+    cat "$FIRMWARE"
+    printf 'DLS1'
+    printf "\\x$(printf %02x $((SIG_LEN & 0xFF)))\\x$(printf %02x $((SIG_LEN >> 8)))\\x00\\x00"
+    cat "$SIGNATURE"
+    head -c $((72 - SIG_LEN)) /dev/zero
+} > "$OUTPUT"
+
+echo "Signed firmware written to ${OUTPUT} (signature ${SIG_LEN} bytes)"